@@ -0,0 +1,252 @@
+#include "AdcCapture.h"
+
+#ifdef ARDUINO_ARCH_SAMD
+#include <Arduino.h>
+#include <wiring_private.h>
+
+// DMA channel used for the ADC - nothing else in the firmware uses the DMAC
+#define CAPTURE_DMA_CHANNEL 0
+
+// The DMAC fetches channel descriptors from SRAM - they must be 128-bit aligned
+static DmacDescriptor dmaDescriptors[1] __attribute__((aligned(16)));
+static DmacDescriptor dmaWriteback[1] __attribute__((aligned(16)));
+static DmacDescriptor dmaSecondDescriptor __attribute__((aligned(16)));
+
+static AdcCapture* activeCapture = nullptr;
+
+static void syncAdc() {
+  while (ADC->STATUS.bit.SYNCBUSY);
+}
+
+static void syncTc3() {
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+}
+
+static void setupDescriptor(DmacDescriptor* descriptor, int16_t* buffer, DmacDescriptor* next) {
+  descriptor->BTCTRL.reg = DMAC_BTCTRL_VALID |
+                           DMAC_BTCTRL_BLOCKACT_INT |   // Interrupt, then carry on with the next block
+                           DMAC_BTCTRL_BEATSIZE_HWORD |
+                           DMAC_BTCTRL_DSTINC;
+  descriptor->BTCNT.reg = CAPTURE_SAMPLES;
+  descriptor->SRCADDR.reg = (uint32_t)&ADC->RESULT.reg;
+  // The DMAC wants the address just past the end when the address increments
+  descriptor->DSTADDR.reg = (uint32_t)(buffer + CAPTURE_SAMPLES);
+  descriptor->DESCADDR.reg = (uint32_t)next;
+}
+
+bool AdcCapture::begin(uint8_t pin, uint32_t sampleRate) {
+  if (pin >= NUM_DIGITAL_PINS || g_APinDescription[pin].ulADCChannelNumber == No_ADC_Channel) {
+    return false;
+  }
+  // TC3 runs from the 48 MHz GCLK0 in 16-bit mode
+  uint32_t period = F_CPU / sampleRate;
+  if (sampleRate == 0 || period < 2 || period > 65536) {
+    return false;
+  }
+
+  end();
+  buffers.reset();
+  rate = F_CPU / period;  // The rate we actually get after integer division
+  activeCapture = this;
+
+  pinPeripheral(pin, PIO_ANALOG);
+  PM->APBCMASK.reg |= PM_APBCMASK_TC3 | PM_APBCMASK_EVSYS | PM_APBCMASK_ADC;
+  PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+  PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+  // ADC: one conversion per START event, keeping the core's reference and gain
+  ADC->CTRLA.bit.ENABLE = 0;
+  syncAdc();
+  ADC->INPUTCTRL.bit.MUXPOS = g_APinDescription[pin].ulADCChannelNumber;
+  ADC->INPUTCTRL.bit.MUXNEG = ADC_INPUTCTRL_MUXNEG_GND_Val;
+  syncAdc();
+  ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV64 | ADC_CTRLB_RESSEL_10BIT;
+  syncAdc();
+  ADC->SAMPCTRL.reg = 5;
+  ADC->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+  ADC->CTRLA.bit.ENABLE = 1;
+  syncAdc();
+
+  // Event system: TC3 overflow -> ADC start, no CPU involvement
+  EVSYS->USER.reg = EVSYS_USER_CHANNEL(1) | EVSYS_USER_USER(EVSYS_ID_USER_ADC_START);  // Channel n is written as n + 1
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(0) |
+                       EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_TC3_OVF) |
+                       EVSYS_CHANNEL_PATH_ASYNCHRONOUS;
+
+  // DMA: ADC result ready -> next halfword of the active buffer, two
+  // descriptors linked into a ring so capture never stops between blocks
+  setupDescriptor(&dmaDescriptors[0], buffers.bufferAt(0), &dmaSecondDescriptor);
+  setupDescriptor(&dmaSecondDescriptor, buffers.bufferAt(1), &dmaDescriptors[0]);
+
+  DMAC->CTRL.reg = 0;
+  DMAC->BASEADDR.reg = (uint32_t)dmaDescriptors;
+  DMAC->WRBADDR.reg = (uint32_t)dmaWriteback;
+  DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+  DMAC->CHID.reg = DMAC_CHID_ID(CAPTURE_DMA_CHANNEL);
+  DMAC->CHCTRLA.reg = 0;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+  while (DMAC->CHCTRLA.bit.SWRST);
+  DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) |
+                      DMAC_CHCTRLB_TRIGSRC(ADC_DMAC_ID_RESRDY) |
+                      DMAC_CHCTRLB_TRIGACT_BEAT;
+  DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+  NVIC_SetPriority(DMAC_IRQn, 1);
+  NVIC_EnableIRQ(DMAC_IRQn);
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+
+  // TC3 in match-frequency mode: overflows every `period` ticks of 48 MHz
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3;
+  while (GCLK->STATUS.bit.SYNCBUSY);
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  syncTc3();
+  while (TC3->COUNT16.CTRLA.bit.SWRST);
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV1;
+  TC3->COUNT16.CC[0].reg = period - 1;
+  syncTc3();
+  TC3->COUNT16.EVCTRL.reg = TC_EVCTRL_OVFEO;
+  TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+  syncTc3();
+
+  running = true;
+  paused = false;
+  return true;
+}
+
+void AdcCapture::end() {
+  if (!running) {
+    return;
+  }
+  TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+  syncTc3();
+  DMAC->CHID.reg = DMAC_CHID_ID(CAPTURE_DMA_CHANNEL);
+  DMAC->CHCTRLA.reg = 0;
+  NVIC_DisableIRQ(DMAC_IRQn);
+
+  // Hand the ADC back in a state analogRead() can use
+  ADC->EVCTRL.reg = 0;
+  ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV512 | ADC_CTRLB_RESSEL_10BIT;
+  syncAdc();
+  ADC->SAMPCTRL.reg = 0x3f;
+  syncAdc();
+
+  running = false;
+  activeCapture = nullptr;
+}
+
+void AdcCapture::pause() {
+  if (!running || paused) {
+    return;
+  }
+  // No more TC3 overflows, so no more ADC starts, DMA beats or interrupts
+  TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+  syncTc3();
+  paused = true;
+}
+
+void AdcCapture::resume() {
+  if (!running || !paused) {
+    return;
+  }
+  TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+  syncTc3();
+  paused = false;
+}
+
+void AdcCapture::handleBlockComplete() {
+  buffers.onBlockComplete();
+}
+
+int16_t AdcCapture::latestSample() const {
+  if (!running) {
+    return buffers.latestSample();
+  }
+  // Between beats the DMAC keeps the channel's descriptor in the write-back
+  // section, whose BTCNT counts the beats of the current block still to
+  // come. Read again if a block finished in between, so the count and the
+  // buffer it is looked up in belong together.
+  uint32_t completed;
+  int16_t sample;
+  do {
+    completed = buffers.blocksCompleted();
+    sample = buffers.latestSample(CAPTURE_SAMPLES - dmaWriteback[0].BTCNT.reg);
+  } while (completed != buffers.blocksCompleted());
+  return sample;
+}
+
+// Overrides the weak handler in the Arduino SAMD core (declared with C linkage)
+extern "C" void DMAC_Handler(void) {
+  DMAC->CHID.reg = DMAC_CHID_ID(CAPTURE_DMA_CHANNEL);
+  if (DMAC->CHINTFLAG.bit.TCMPL) {
+    DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+    if (activeCapture != nullptr) {
+      activeCapture->handleBlockComplete();
+    }
+  }
+}
+
+#else
+
+// Host stub - the producer is whoever calls feedSamples()
+bool AdcCapture::begin(uint8_t pin, uint32_t sampleRate) {
+  (void)pin;
+  if (sampleRate == 0) {
+    return false;
+  }
+  buffers.reset();
+  rate = sampleRate;
+  fillPosition = 0;
+  running = true;
+  paused = false;
+  return true;
+}
+
+void AdcCapture::end() {
+  running = false;
+}
+
+void AdcCapture::pause() {
+  paused = true;
+}
+
+void AdcCapture::resume() {
+  paused = false;
+}
+
+void AdcCapture::handleBlockComplete() {
+  buffers.onBlockComplete();
+}
+
+int16_t AdcCapture::latestSample() const {
+  return buffers.latestSample((int)fillPosition);
+}
+
+void AdcCapture::feedSamples(const int16_t* samples, size_t count) {
+  if (!running || paused) {
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    buffers.fillBuffer()[fillPosition++] = samples[i];
+    if (fillPosition == CAPTURE_SAMPLES) {
+      fillPosition = 0;
+      handleBlockComplete();
+    }
+  }
+}
+
+#endif
+
+const int16_t* AdcCapture::acquire() {
+  return buffers.acquire();
+}
+
+void AdcCapture::release() {
+  buffers.release();
+}
+
+uint32_t AdcCapture::sampleRate() const {
+  return rate;
+}
+
+const CaptureBuffers& AdcCapture::stats() const {
+  return buffers;
+}
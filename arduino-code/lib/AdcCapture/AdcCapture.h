@@ -0,0 +1,57 @@
+#ifndef ADC_CAPTURE_H
+#define ADC_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CaptureBuffers.h"
+
+// Gap-free audio capture into ping-pong buffers.
+//
+// On the Nano 33 IoT (SAMD21) TC3 overflows at the sample rate, its event
+// starts an ADC conversion through the event system, and every result is
+// moved by DMA into the active buffer. Two linked DMA descriptors alternate
+// between the buffers forever, so the CPU only sees one interrupt per block.
+//
+// On any other platform this is a host stub: samples are pushed in with
+// feedSamples() and go through exactly the same buffer handoff.
+class AdcCapture {
+public:
+  bool begin(uint8_t pin, uint32_t sampleRate);
+  void end();
+
+  // Stop and restart the sample clock without tearing anything down, for
+  // low-power idle. The block that was filling completes after resume().
+  void pause();
+  void resume();
+
+  // Finished block of CAPTURE_SAMPLES raw ADC readings, or nullptr if the
+  // next block is still filling. Call release() when done with it.
+  const int16_t* acquire();
+  void release();
+
+  // Most recent raw reading, for cheap level metering between blocks - the
+  // newest one the ADC delivered, not the end of the last finished block
+  int16_t latestSample() const;
+
+  uint32_t sampleRate() const;
+  const CaptureBuffers& stats() const;
+
+#ifndef ARDUINO_ARCH_SAMD
+  // Host stub only: behave as if the ADC had converted these samples
+  void feedSamples(const int16_t* samples, size_t count);
+#endif
+
+  // Called from the DMA interrupt handler
+  void handleBlockComplete();
+
+private:
+  CaptureBuffers buffers;
+  uint32_t rate = 0;
+  bool running = false;
+  bool paused = false;
+#ifndef ARDUINO_ARCH_SAMD
+  size_t fillPosition = 0;
+#endif
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "CaptureBuffers.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#define CAPTURE_ENTER_CRITICAL() noInterrupts()
+#define CAPTURE_EXIT_CRITICAL() interrupts()
+#else
+// Host builds drive the producer from the same thread, so no locking is needed
+#define CAPTURE_ENTER_CRITICAL()
+#define CAPTURE_EXIT_CRITICAL()
+#endif
+
+CaptureBuffers::CaptureBuffers() {
+  reset();
+}
+
+void CaptureBuffers::reset() {
+  CAPTURE_ENTER_CRITICAL();
+  fillIndex = 0;
+  readyIndex = -1;
+  heldIndex = -1;
+  lastSample = 0;
+  completedCount = 0;
+  overrunCount = 0;
+  droppedCount = 0;
+  CAPTURE_EXIT_CRITICAL();
+}
+
+int16_t* CaptureBuffers::bufferAt(uint8_t index) {
+  return buffers[index & 1];
+}
+
+int16_t* CaptureBuffers::fillBuffer() {
+  return buffers[fillIndex];
+}
+
+void CaptureBuffers::onBlockComplete() {
+  uint8_t completed = fillIndex;
+  lastSample = buffers[completed][CAPTURE_SAMPLES - 1];
+
+  // A block that was ready but never acquired is superseded by this one
+  if (readyIndex >= 0) {
+    droppedCount++;
+  }
+  readyIndex = completed;
+
+  // Move the producer to the other buffer - if the consumer is still working
+  // on it, the next block will overwrite data that is being analysed
+  fillIndex = completed ^ 1;
+  if (heldIndex == (int8_t)fillIndex) {
+    overrunCount++;
+  }
+  completedCount++;
+}
+
+const int16_t* CaptureBuffers::acquire() {
+  const int16_t* block = nullptr;
+
+  CAPTURE_ENTER_CRITICAL();
+  if (readyIndex >= 0) {
+    heldIndex = readyIndex;
+    readyIndex = -1;
+    block = buffers[heldIndex];
+  }
+  CAPTURE_EXIT_CRITICAL();
+
+  return block;
+}
+
+void CaptureBuffers::release() {
+  heldIndex = -1;
+}
+
+int16_t CaptureBuffers::latestSample() const {
+  return lastSample;
+}
+
+int16_t CaptureBuffers::latestSample(int filled) const {
+  if (filled <= 0 || filled > CAPTURE_SAMPLES) {
+    return lastSample;
+  }
+  return buffers[fillIndex][filled - 1];
+}
+
+uint32_t CaptureBuffers::blocksCompleted() const {
+  return completedCount;
+}
+
+uint32_t CaptureBuffers::overruns() const {
+  return overrunCount;
+}
+
+uint32_t CaptureBuffers::dropped() const {
+  return droppedCount;
+}
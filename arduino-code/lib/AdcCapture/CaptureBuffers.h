@@ -0,0 +1,59 @@
+#ifndef CAPTURE_BUFFERS_H
+#define CAPTURE_BUFFERS_H
+
+#include <stdint.h>
+
+// Number of samples in one capture block - must be a power of 2 for the FFT
+#ifndef CAPTURE_SAMPLES
+#define CAPTURE_SAMPLES 128
+#endif
+
+// Ping-pong buffer handoff between the capture producer (DMA interrupt on the
+// board, the host stub on Linux) and the analysis consumer in loop().
+//
+// The producer always writes into fillBuffer(). When a block is full it calls
+// onBlockComplete(), which publishes that block as "ready" and moves the
+// producer onto the other buffer. The consumer takes the ready block with
+// acquire() and hands it back with release() once the FFT is done.
+//
+// If the producer moves onto a buffer the consumer still holds, the consumer's
+// data is being overwritten underneath it - that is counted as an overrun.
+class CaptureBuffers {
+public:
+  CaptureBuffers();
+
+  // Producer side (interrupt context on the board)
+  int16_t* bufferAt(uint8_t index);  // Used to point the DMA descriptors
+  int16_t* fillBuffer();
+  void onBlockComplete();
+
+  // Consumer side (loop context)
+  const int16_t* acquire();  // Returns nullptr if no new block is ready
+  void release();
+
+  // Sample that was written last in the most recently completed block
+  int16_t latestSample() const;
+
+  // Newest sample overall: the last of the `filled` samples the producer
+  // has written into fillBuffer() so far, or latestSample() while that
+  // block is still empty. Lets a level meter read faster than blocks finish.
+  int16_t latestSample(int filled) const;
+
+  uint32_t blocksCompleted() const;
+  uint32_t overruns() const;  // Producer wrapped onto a block still held
+  uint32_t dropped() const;   // Ready block replaced before anyone took it
+
+  void reset();
+
+private:
+  int16_t buffers[2][CAPTURE_SAMPLES];
+  volatile uint8_t fillIndex;
+  volatile int8_t readyIndex;  // -1 when no block is waiting
+  volatile int8_t heldIndex;   // -1 when the consumer holds nothing
+  volatile int16_t lastSample;
+  volatile uint32_t completedCount;
+  volatile uint32_t overrunCount;
+  volatile uint32_t droppedCount;
+};
+
+#endif
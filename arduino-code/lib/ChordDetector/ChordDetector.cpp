@@ -0,0 +1,185 @@
+#include "ChordDetector.h"
+#include "NoteMapper.h"
+#include "PitchDetector.h"
+
+// Peaks must reach the strongest bin shifted down by this much
+static const int PEAK_FLOOR_SHIFT = 4;
+
+// A note must explain at least 1/MIN_SHARE of the total peak energy
+static const uint32_t MIN_SHARE = 10;
+
+struct Peak {
+  int32_t positionQ4;  // Bin index * 16, interpolated
+  uint16_t magnitude;
+  bool claimed;
+};
+
+// Offset of the true peak from bin i in 1/16 bin
+static int32_t interpolateQ4(const uint16_t* magnitude, int i) {
+  return parabolicOffsetQ8(magnitude[i - 1], magnitude[i], magnitude[i + 1]) / 16;
+}
+
+// Keep the strongest CHORD_MAX_PEAKS local maxima, strongest first
+static int findPeaks(const uint16_t* magnitude, int bins, int firstBin, Peak* peaks) {
+  if (firstBin < 1) {
+    firstBin = 1;
+  }
+
+  uint16_t strongest = 0;
+  for (int i = firstBin; i < bins; i++) {
+    if (magnitude[i] > strongest) {
+      strongest = magnitude[i];
+    }
+  }
+  uint16_t floor = strongest >> PEAK_FLOOR_SHIFT;
+  if (floor == 0) {
+    floor = 1;
+  }
+
+  int count = 0;
+  for (int i = firstBin; i < bins - 1; i++) {
+    uint16_t value = magnitude[i];
+    if (value < floor || value <= magnitude[i - 1] || value < magnitude[i + 1]) {
+      continue;
+    }
+
+    // Insertion into the sorted list, dropping the weakest when full
+    int slot = count < CHORD_MAX_PEAKS ? count++ : CHORD_MAX_PEAKS;
+    while (slot > 0 && peaks[slot - 1].magnitude < value) {
+      if (slot < CHORD_MAX_PEAKS) {
+        peaks[slot] = peaks[slot - 1];
+      }
+      slot--;
+    }
+    if (slot < CHORD_MAX_PEAKS) {
+      peaks[slot].positionQ4 = i * 16 + interpolateQ4(magnitude, i);
+      peaks[slot].magnitude = value;
+      peaks[slot].claimed = false;
+    }
+  }
+  return count;
+}
+
+// Index of the unclaimed peak within tolerance of target, or -1
+static int matchPeak(const Peak* peaks, int count, int32_t targetQ4) {
+  // Three quarters of a bin, or 3% for the upper harmonics (piano strings
+  // run slightly sharp)
+  int32_t tolerance = targetQ4 * 3 / 100;
+  if (tolerance < 12) {
+    tolerance = 12;
+  }
+
+  int best = -1;
+  int32_t bestDistance = tolerance + 1;
+  for (int p = 0; p < count; p++) {
+    if (peaks[p].claimed) {
+      continue;
+    }
+    int32_t distance = peaks[p].positionQ4 - targetQ4;
+    if (distance < 0) distance = -distance;
+    if (distance < bestDistance) {
+      bestDistance = distance;
+      best = p;
+    }
+  }
+  return best;
+}
+
+// A harmonic counts for at most HARMONIC_CAP times the candidate's own
+// peak. Without the cap a stray peak an octave below a chord scores the
+// chord's partials as its harmonics and wins as a note nobody played.
+static const uint32_t HARMONIC_CAP = 2;
+
+static uint32_t harmonicScore(const Peak* peaks, int count, int candidate) {
+  uint32_t score = peaks[candidate].magnitude;
+  uint32_t cap = HARMONIC_CAP * peaks[candidate].magnitude;
+  int32_t fundamental = peaks[candidate].positionQ4;
+  for (int h = 2; h <= CHORD_HARMONICS; h++) {
+    int p = matchPeak(peaks, count, fundamental * h);
+    if (p >= 0) {
+      score += peaks[p].magnitude < cap ? peaks[p].magnitude : cap;
+    }
+  }
+  return score;
+}
+
+int detectChord(const uint16_t* magnitude, int samples, uint32_t sampleRate, int firstBin,
+                ChordNote* notes, int maxNotes) {
+  Peak peaks[CHORD_MAX_PEAKS];
+  int peakCount = findPeaks(magnitude, samples / 2, firstBin, peaks);
+
+  uint32_t total = 0;
+  for (int p = 0; p < peakCount; p++) {
+    total += peaks[p].magnitude;
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  int noteCount = 0;
+  while (noteCount < maxNotes) {
+    int best = -1;
+    uint32_t bestScore = 0;
+    for (int p = 0; p < peakCount; p++) {
+      if (peaks[p].claimed) {
+        continue;
+      }
+      uint32_t score = harmonicScore(peaks, peakCount, p);
+      // Ties go to the lower candidate, the likelier fundamental
+      if (score > bestScore ||
+          (score == bestScore && best >= 0 && peaks[p].positionQ4 < peaks[best].positionQ4)) {
+        bestScore = score;
+        best = p;
+      }
+    }
+    if (best < 0 || bestScore * MIN_SHARE < total) {
+      break;
+    }
+
+    // Claim the fundamental and its harmonics
+    int32_t fundamental = peaks[best].positionQ4;
+    peaks[best].claimed = true;
+    for (int h = 2; h <= CHORD_HARMONICS; h++) {
+      int p = matchPeak(peaks, peakCount, fundamental * h);
+      if (p >= 0) {
+        peaks[p].claimed = true;
+      }
+    }
+
+    uint32_t frequency = ((uint32_t)fundamental * sampleRate + (uint32_t)samples * 8) / ((uint32_t)samples * 16);
+    NoteInfo note = mapFrequencyToNote((float)frequency);
+    if (!note.valid()) {
+      continue;  // Out of range - its peaks stay claimed
+    }
+
+    // Two peaks can land on one note - keep the first (stronger) one
+    bool duplicate = false;
+    for (int n = 0; n < noteCount; n++) {
+      if (notes[n].note == note.name && notes[n].octave == note.octave) {
+        duplicate = true;
+      }
+    }
+    if (duplicate) {
+      continue;
+    }
+
+    uint32_t confidence = bestScore * 100 / total;
+    ChordNote& result = notes[noteCount++];
+    result.note = note.name;
+    result.octave = note.octave;
+    result.frequency = (uint16_t)frequency;
+    result.confidence = (uint8_t)(confidence > 100 ? 100 : confidence);
+  }
+
+  // Low to high
+  for (int i = 1; i < noteCount; i++) {
+    ChordNote value = notes[i];
+    int j = i - 1;
+    while (j >= 0 && notes[j].frequency > value.frequency) {
+      notes[j + 1] = notes[j];
+      j--;
+    }
+    notes[j + 1] = value;
+  }
+  return noteCount;
+}
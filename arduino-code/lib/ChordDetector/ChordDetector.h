@@ -0,0 +1,39 @@
+#ifndef CHORD_DETECTOR_H
+#define CHORD_DETECTOR_H
+
+#include <stdint.h>
+#include "PianoReading.h"
+
+// Spectral peaks considered per frame (the strongest ones)
+#ifndef CHORD_MAX_PEAKS
+#define CHORD_MAX_PEAKS 12
+#endif
+
+// Harmonics (fundamental included) credited to a candidate note
+#ifndef CHORD_HARMONICS
+#define CHORD_HARMONICS 6
+#endif
+
+// Multi-pitch detection on a magnitude spectrum, integer only.
+//
+//  1. Peak picking: local maxima within 1/16 (-24 dB) of the strongest bin,
+//     refined to 1/16 of a bin by parabolic interpolation.
+//  2. Harmonic grouping: every unclaimed peak is a candidate fundamental and
+//     scores the magnitude of the unclaimed peaks at its harmonics, each
+//     capped at twice its own peak so a weak subharmonic can't take a
+//     chord's partials for its own. The best candidate becomes a note and
+//     claims those peaks; repeat until maxNotes or the best candidate
+//     explains less than 10% of the energy.
+//  3. Each note's confidence is its share of the total peak energy.
+//
+// Two notes only separate if their peaks are about 3 bins apart (the
+// Hamming main lobe), so the usable intervals depend on the frame length:
+// with 128 samples at 5 kHz (39 Hz bins) only wide intervals resolve; a
+// 256-sample frame gets triads from about C3 up.
+//
+// magnitude holds samples/2 bins, firstBin skips DC and rumble. Writes up
+// to maxNotes notes sorted by frequency and returns how many.
+int detectChord(const uint16_t* magnitude, int samples, uint32_t sampleRate, int firstBin,
+                ChordNote* notes, int maxNotes);
+
+#endif
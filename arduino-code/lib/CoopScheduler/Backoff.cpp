@@ -0,0 +1,34 @@
+#include "Backoff.h"
+
+Backoff::Backoff(uint32_t minDelayMs, uint32_t maxDelayMs)
+    : minDelay(minDelayMs), maxDelay(maxDelayMs), delayMs(0), failedAtMs(0), failureCount(0) {
+}
+
+bool Backoff::ready(uint32_t nowMs) const {
+  return failureCount == 0 || (uint32_t)(nowMs - failedAtMs) >= delayMs;
+}
+
+void Backoff::failed(uint32_t nowMs) {
+  if (failureCount == 0) {
+    delayMs = minDelay;
+  } else if (delayMs < maxDelay / 2) {
+    delayMs *= 2;
+  } else {
+    delayMs = maxDelay;
+  }
+  failureCount++;
+  failedAtMs = nowMs;
+}
+
+void Backoff::succeeded() {
+  failureCount = 0;
+  delayMs = 0;
+}
+
+uint32_t Backoff::currentDelay() const {
+  return delayMs;
+}
+
+uint32_t Backoff::failures() const {
+  return failureCount;
+}
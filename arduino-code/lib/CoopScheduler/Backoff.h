@@ -0,0 +1,29 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+// Exponential backoff for reconnect attempts: the wait doubles after every
+// failure, from minDelayMs up to maxDelayMs, and resets on success.
+class Backoff {
+public:
+  Backoff(uint32_t minDelayMs, uint32_t maxDelayMs);
+
+  // True when no failure is pending or the wait after the last one is over
+  bool ready(uint32_t nowMs) const;
+
+  void failed(uint32_t nowMs);
+  void succeeded();
+
+  uint32_t currentDelay() const;  // Wait applied after the last failure
+  uint32_t failures() const;      // Consecutive failures since last success
+
+private:
+  uint32_t minDelay;
+  uint32_t maxDelay;
+  uint32_t delayMs;
+  uint32_t failedAtMs;
+  uint32_t failureCount;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "Scheduler.h"
+
+// Signed difference that stays correct across millis() wrap-around
+static int32_t elapsedSince(uint32_t nowMs, uint32_t thenMs) {
+  return (int32_t)(nowMs - thenMs);
+}
+
+Scheduler::Scheduler() : count(0), missedTotal(0), missedHook(nullptr) {
+}
+
+int Scheduler::add(const char* name, TaskCallback callback, uint32_t periodMs,
+                   uint32_t deadlineMs, uint32_t dueMs) {
+  if (count >= SCHEDULER_MAX_TASKS || callback == nullptr) {
+    return -1;
+  }
+  Task& task = tasks[count];
+  task.name = name;
+  task.callback = callback;
+  task.periodMs = periodMs;
+  task.deadlineMs = deadlineMs;
+  task.dueMs = dueMs;
+  task.enabled = true;
+  task.pending = false;
+  task.runs = 0;
+  task.missedDeadlines = 0;
+  task.maxLatenessMs = 0;
+  return count++;
+}
+
+int Scheduler::addPeriodic(const char* name, TaskCallback callback, uint32_t periodMs,
+                           uint32_t deadlineMs, uint32_t nowMs) {
+  if (periodMs == 0) {
+    return -1;
+  }
+  return add(name, callback, periodMs, deadlineMs, nowMs);
+}
+
+int Scheduler::addEvent(const char* name, TaskCallback callback, uint32_t deadlineMs) {
+  return add(name, callback, 0, deadlineMs, 0);
+}
+
+void Scheduler::signal(int id, uint32_t nowMs) {
+  if (id < 0 || id >= count) {
+    return;
+  }
+  Task& task = tasks[id];
+  if (task.periodMs == 0) {
+    // Keep the earliest signal time so lateness covers the whole wait
+    if (!task.pending) {
+      task.pending = true;
+      task.dueMs = nowMs;
+    }
+  } else if (elapsedSince(task.dueMs, nowMs) > 0) {
+    task.dueMs = nowMs;
+  }
+}
+
+void Scheduler::setEnabled(int id, bool enabled, uint32_t nowMs) {
+  if (id < 0 || id >= count) {
+    return;
+  }
+  Task& task = tasks[id];
+  if (enabled && !task.enabled && task.periodMs != 0) {
+    task.dueMs = nowMs;  // Don't count the time spent disabled as lateness
+  }
+  task.enabled = enabled;
+}
+
+void Scheduler::setPeriod(int id, uint32_t periodMs) {
+  if (id < 0 || id >= count || periodMs == 0 || tasks[id].periodMs == 0) {
+    return;
+  }
+  tasks[id].periodMs = periodMs;
+}
+
+int Scheduler::runOnce(uint32_t nowMs) {
+  int ran = 0;
+  for (int i = 0; i < count; i++) {
+    Task& task = tasks[i];
+    if (!task.enabled) {
+      continue;
+    }
+    bool due = task.periodMs == 0 ? task.pending : elapsedSince(nowMs, task.dueMs) >= 0;
+    if (!due) {
+      continue;
+    }
+
+    uint32_t lateness = (uint32_t)elapsedSince(nowMs, task.dueMs);
+    if (lateness > task.maxLatenessMs) {
+      task.maxLatenessMs = lateness;
+    }
+    if (lateness > task.deadlineMs) {
+      task.missedDeadlines++;
+      missedTotal++;
+      if (missedHook != nullptr) {
+        missedHook(task, lateness);
+      }
+    }
+
+    if (task.periodMs == 0) {
+      task.pending = false;
+    } else {
+      // Fixed rate, but don't try to catch up on periods that were missed
+      task.dueMs += task.periodMs;
+      if (elapsedSince(nowMs, task.dueMs) >= 0) {
+        task.dueMs = nowMs + task.periodMs;
+      }
+    }
+
+    task.runs++;
+    task.callback(nowMs);
+    ran++;
+  }
+  return ran;
+}
+
+uint32_t Scheduler::idleTime(uint32_t nowMs) const {
+  uint32_t idle = UINT32_MAX;
+  for (int i = 0; i < count; i++) {
+    const Task& task = tasks[i];
+    if (!task.enabled) {
+      continue;
+    }
+    if (task.periodMs == 0) {
+      if (task.pending) {
+        return 0;
+      }
+      continue;
+    }
+    int32_t untilDue = elapsedSince(task.dueMs, nowMs);
+    if (untilDue <= 0) {
+      return 0;
+    }
+    if ((uint32_t)untilDue < idle) {
+      idle = (uint32_t)untilDue;
+    }
+  }
+  return idle;
+}
+
+void Scheduler::onMissedDeadline(MissedDeadlineHook hook) {
+  missedHook = hook;
+}
+
+int Scheduler::taskCount() const {
+  return count;
+}
+
+const Task& Scheduler::task(int id) const {
+  return tasks[id];
+}
+
+uint32_t Scheduler::missedDeadlines() const {
+  return missedTotal;
+}
@@ -0,0 +1,76 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Maximum number of tasks - storage is a fixed array, nothing is allocated.
+// The firmware adds 8 with every option on; the rest is headroom.
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 12
+#endif
+
+typedef void (*TaskCallback)(uint32_t nowMs);
+
+struct Task {
+  const char* name;
+  TaskCallback callback;
+  uint32_t periodMs;      // 0 for event-driven tasks
+  uint32_t deadlineMs;    // Allowed lateness before a run counts as missed
+  uint32_t dueMs;         // When the task should next start
+  bool enabled;
+  bool pending;           // Event-driven: signalled and waiting to run
+  uint32_t runs;
+  uint32_t missedDeadlines;
+  uint32_t maxLatenessMs;
+};
+
+// Cooperative, run-to-completion scheduler for loop().
+//
+// Periodic tasks run every periodMs; event-driven tasks run once after
+// signal(). Each runOnce() starts every task that is due, so callbacks must
+// return quickly - nothing here can pre-empt a task that blocks. A task that
+// starts more than deadlineMs after it was due is counted as a missed
+// deadline and reported through the missed-deadline hook.
+//
+// Time is passed in rather than read from millis(), so the scheduler runs
+// unchanged against a fake clock on the host.
+class Scheduler {
+public:
+  typedef void (*MissedDeadlineHook)(const Task& task, uint32_t latenessMs);
+
+  Scheduler();
+
+  // Returns the task id, or -1 if the table is full
+  int addPeriodic(const char* name, TaskCallback callback, uint32_t periodMs,
+                  uint32_t deadlineMs, uint32_t nowMs);
+  int addEvent(const char* name, TaskCallback callback, uint32_t deadlineMs);
+
+  // Event-driven: run at the next runOnce(). Periodic: run early.
+  void signal(int id, uint32_t nowMs);
+  void setEnabled(int id, bool enabled, uint32_t nowMs);
+  void setPeriod(int id, uint32_t periodMs);
+
+  // Run every due task once, in the order they were added.
+  // Returns the number of tasks that ran.
+  int runOnce(uint32_t nowMs);
+
+  // Milliseconds until the next periodic task is due (0 if one is due now)
+  uint32_t idleTime(uint32_t nowMs) const;
+
+  void onMissedDeadline(MissedDeadlineHook hook);
+
+  int taskCount() const;
+  const Task& task(int id) const;
+  uint32_t missedDeadlines() const;
+
+private:
+  Task tasks[SCHEDULER_MAX_TASKS];
+  int count;
+  uint32_t missedTotal;
+  MissedDeadlineHook missedHook;
+
+  int add(const char* name, TaskCallback callback, uint32_t periodMs,
+          uint32_t deadlineMs, uint32_t dueMs);
+};
+
+#endif
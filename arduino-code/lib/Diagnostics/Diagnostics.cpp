@@ -0,0 +1,125 @@
+#include "Diagnostics.h"
+#include "JsonWriter.h"
+
+// JSON field of each DiagStage
+static const char* const STAGE_NAMES[DIAG_STAGES] = {
+  "loop_us", "capture_us", "analysis_us", "publish_us", "queue_us", "flush_us",
+};
+
+Diagnostics::Diagnostics()
+    : reconnectCount(0), wakeCount(0), lastWake(0), slowestWake(0), startMs(0) {
+}
+
+void Diagnostics::countReconnect() {
+  reconnectCount++;
+}
+
+void Diagnostics::recordWake(uint32_t latencyMs) {
+  wakeCount++;
+  lastWake = latencyMs;
+  if (latencyMs > slowestWake) {
+    slowestWake = latencyMs;
+  }
+}
+
+void Diagnostics::startWindow(uint32_t nowMs) {
+  for (int i = 0; i < DIAG_STAGES; i++) {
+    histograms[i].reset();
+  }
+  startMs = nowMs;
+}
+
+const LatencyHistogram& Diagnostics::histogram(DiagStage stage) const {
+  return histograms[stage];
+}
+
+uint32_t Diagnostics::reconnects() const {
+  return reconnectCount;
+}
+
+uint32_t Diagnostics::windowStart() const {
+  return startMs;
+}
+
+uint32_t Diagnostics::wakes() const {
+  return wakeCount;
+}
+
+uint32_t Diagnostics::lastWakeMs() const {
+  return lastWake;
+}
+
+uint32_t Diagnostics::slowestWakeMs() const {
+  return slowestWake;
+}
+
+static void appendHistogram(JsonWriter& json, const char* name, const LatencyHistogram& histogram) {
+  json.append(",\"");
+  json.append(name);
+  json.append("\":{\"n\":");
+  json.appendUint(histogram.count());
+  json.append(",\"max\":");
+  json.appendUint(histogram.max());
+  json.append(",\"h\":[");
+
+  int used = LATENCY_BUCKETS;
+  while (used > 0 && histogram.bucket(used - 1) == 0) {
+    used--;
+  }
+  for (int i = 0; i < used; i++) {
+    if (i > 0) {
+      json.append(',');
+    }
+    json.appendUint(histogram.bucket(i));
+  }
+  json.append("]}");
+}
+
+// Unknown (0) is written as null
+static void appendOptional(JsonWriter& json, const char* field, uint32_t value) {
+  json.append(field);
+  if (value > 0) {
+    json.appendUint(value);
+  } else {
+    json.append("null");
+  }
+}
+
+size_t writeDiagnosticsJson(char* buffer, size_t size, const Diagnostics& diagnostics,
+                            const DiagSystem& system) {
+  if (size == 0) {
+    return 0;
+  }
+  JsonWriter json = {buffer, size, 0, false};
+  json.append("{\"uptime\":");
+  json.appendUint(system.uptimeMs);
+  json.append(",\"window\":");
+  json.appendUint(system.uptimeMs - diagnostics.windowStart());
+
+  for (int i = 0; i < DIAG_STAGES; i++) {
+    appendHistogram(json, STAGE_NAMES[i], diagnostics.histogram((DiagStage)i));
+  }
+
+  json.append(",\"reconnects\":");
+  json.appendUint(diagnostics.reconnects());
+  json.append(",\"wake_ms\":{\"n\":");
+  json.appendUint(diagnostics.wakes());
+  json.append(",\"last\":");
+  json.appendUint(diagnostics.lastWakeMs());
+  json.append(",\"max\":");
+  json.appendUint(diagnostics.slowestWakeMs());
+  json.append('}');
+  json.append(",\"missed\":");
+  json.appendUint(system.missedDeadlines);
+  json.append(",\"ring\":{\"depth\":");
+  json.appendUint(system.ringDepth);
+  json.append(",\"max\":");
+  json.appendUint(system.ringMaxDepth);
+  json.append(",\"full\":");
+  json.appendUint(system.ringFull);
+  json.append('}');
+  appendOptional(json, ",\"free_ram\":", system.freeMemory);
+  appendOptional(json, ",\"stack_max\":", system.stackHighWater);
+  json.append('}');
+  return json.finish();
+}
@@ -0,0 +1,79 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LatencyHistogram.h"
+
+// Timed stages, in the order they appear in the JSON
+enum DiagStage {
+  DIAG_LOOP,      // From the start of one loop() to the start of the next
+  DIAG_CAPTURE,   // A capture block held: acquire to release
+  DIAG_ANALYSIS,  // FFT and pitch engine (and chords) for one block
+  DIAG_PUBLISH,   // One Publisher::publish() call
+  DIAG_QUEUE,     // A message waiting in the publish ring: enqueued to written
+  DIAG_FLUSH,     // One TextDisplay::display() call
+  DIAG_STAGES
+};
+
+// What the firmware knows about the system as a whole when it reports
+struct DiagSystem {
+  uint32_t uptimeMs;
+  uint32_t missedDeadlines;  // Scheduler tasks started late, since boot
+  uint32_t freeMemory;       // Bytes between heap and stack now, 0 if unknown
+  uint32_t stackHighWater;   // Deepest stack since boot in bytes, 0 if unknown
+  uint32_t ringDepth;        // Messages waiting in the publish ring now
+  uint32_t ringMaxDepth;     // Most messages waiting at once, since boot
+  uint32_t ringFull;         // Messages the ring had no room for, since boot
+};
+
+// Worst case: every count at 10 digits, all 16 buckets written
+#define DIAG_STAGE_JSON_MAX (32 + 2 * 10 + LATENCY_BUCKETS * 11)
+#define DIAG_JSON_MAX (256 + DIAG_STAGES * DIAG_STAGE_JSON_MAX)
+
+// Always-on field instrumentation: one latency histogram per stage plus
+// link reconnects and low-power wake latency. The histograms cover one reporting window
+// and start over with startWindow(); the counters run since boot.
+class Diagnostics {
+public:
+  Diagnostics();
+
+  void record(DiagStage stage, uint32_t micros) { histograms[stage].record(micros); }
+  void countReconnect();
+
+  // Low-power idle: from the presence interrupt to the first publish after it
+  void recordWake(uint32_t latencyMs);
+
+  // Start a new window at nowMs - the histograms are cleared
+  void startWindow(uint32_t nowMs);
+
+  const LatencyHistogram& histogram(DiagStage stage) const;
+  uint32_t reconnects() const;
+  uint32_t windowStart() const;
+  uint32_t wakes() const;
+  uint32_t lastWakeMs() const;
+  uint32_t slowestWakeMs() const;
+
+private:
+  LatencyHistogram histograms[DIAG_STAGES];
+  uint32_t reconnectCount;
+  uint32_t wakeCount;
+  uint32_t lastWake;
+  uint32_t slowestWake;
+  uint32_t startMs;
+};
+
+// Write the current window as compact JSON for the diagnostics topic:
+// {"uptime":61000,"window":60000,
+//  "loop_us":{"n":52011,"max":4211,"h":[40211,9800,...]},
+//  "capture_us":{...},"analysis_us":{...},"publish_us":{...},"queue_us":{...},
+//  "flush_us":{...},"reconnects":1,"wake_ms":{"n":3,"last":212,"max":390},
+//  "missed":0,"ring":{"depth":0,"max":3,"full":0},"free_ram":17012,"stack_max":3320}
+//
+// "h" is the LatencyHistogram buckets with the trailing empty ones left
+// out: [<8 us, <16 us, <32 us, ...]. Memory figures the platform can't
+// measure are null. Returns the length, or 0 if size was too small.
+size_t writeDiagnosticsJson(char* buffer, size_t size, const Diagnostics& diagnostics,
+                            const DiagSystem& system);
+
+#endif
@@ -0,0 +1,46 @@
+#include "LatencyHistogram.h"
+
+// Edge of bucket 0 - everything shorter than this lands there
+static const uint32_t FIRST_EDGE = 8;
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+void LatencyHistogram::record(uint32_t micros) {
+  int index = 0;
+  uint32_t edge = FIRST_EDGE;
+  while (index < LATENCY_BUCKETS - 1 && micros >= edge) {
+    edge <<= 1;
+    index++;
+  }
+  buckets[index]++;
+  total++;
+  if (micros > longest) {
+    longest = micros;
+  }
+}
+
+void LatencyHistogram::reset() {
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    buckets[i] = 0;
+  }
+  total = 0;
+  longest = 0;
+}
+
+uint32_t LatencyHistogram::count() const {
+  return total;
+}
+
+uint32_t LatencyHistogram::max() const {
+  return longest;
+}
+
+uint32_t LatencyHistogram::bucket(int index) const {
+  return buckets[index];
+}
+
+uint32_t LatencyHistogram::upperBound(int index) {
+  return index < LATENCY_BUCKETS - 1 ? FIRST_EDGE << index : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Power-of-two buckets: bucket i counts durations below 2^(i + 3) us that
+// didn't fit the bucket before it, so they run 8 us, 16 us, ... 131 ms and
+// the last one takes everything longer
+#define LATENCY_BUCKETS 16
+
+// Fixed-bucket histogram of durations in microseconds.
+//
+// record() is a compare-and-shift loop over the bucket edges and a few
+// increments - no division, no floating point, nothing allocated - so it
+// can sit in the hot path on the M0+ (which has no count-leading-zeros
+// instruction to do better with).
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  void record(uint32_t micros);
+  void reset();
+
+  uint32_t count() const;
+  uint32_t max() const;
+  uint32_t bucket(int index) const;
+
+  // Exclusive upper edge of bucket index in us (0 for the open-ended last one)
+  static uint32_t upperBound(int index);
+
+private:
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t total;
+  uint32_t longest;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "FrameDiff.h"
+#include <string.h>
+
+// Every I2C transaction starts with the address byte, then a control byte
+// (0x00 commands, 0x40 data)
+static const uint32_t TRANSACTION_OVERHEAD = 2;
+static const uint32_t CHUNK_DATA = FRAME_I2C_CHUNK - 1;
+
+static uint32_t dataBytes(uint32_t count) {
+  uint32_t chunks = (count + CHUNK_DATA - 1) / CHUNK_DATA;
+  return count + chunks * TRANSACTION_OVERHEAD;
+}
+
+FrameDiff::FrameDiff() : valid(false) {
+}
+
+void FrameDiff::invalidate() {
+  valid = false;
+}
+
+int FrameDiff::update(const uint8_t* frame, PageSpan* spans) {
+  int total = 0;
+  for (int page = 0; page < PAGES; page++) {
+    const uint8_t* row = frame + page * FRAME_WIDTH;
+    uint8_t* old = shadow + page * FRAME_WIDTH;
+    PageSpan& span = spans[page];
+
+    if (!valid) {
+      span.dirty = true;
+      span.first = 0;
+      span.last = FRAME_WIDTH - 1;
+    } else {
+      // Narrow in from both ends
+      int first = 0;
+      while (first < FRAME_WIDTH && row[first] == old[first]) {
+        first++;
+      }
+      span.dirty = first < FRAME_WIDTH;
+      if (!span.dirty) {
+        continue;
+      }
+      int last = FRAME_WIDTH - 1;
+      while (row[last] == old[last]) {
+        last--;
+      }
+      span.first = (uint8_t)first;
+      span.last = (uint8_t)last;
+    }
+
+    int count = span.last - span.first + 1;
+    memcpy(old + span.first, row + span.first, count);
+    total += count;
+  }
+  valid = true;
+  return total;
+}
+
+uint32_t FrameDiff::i2cBytes(const PageSpan* spans) {
+  uint32_t total = 0;
+  for (int page = 0; page < PAGES; page++) {
+    if (spans[page].dirty) {
+      // PAGEADDR p p, COLUMNADDR first last in one command write
+      total += TRANSACTION_OVERHEAD + 6;
+      total += dataBytes(spans[page].last - spans[page].first + 1);
+    }
+  }
+  return total;
+}
+
+uint32_t FrameDiff::fullFrameI2cBytes() {
+  // PAGEADDR 0 0xFF, COLUMNADDR 0 as a list, then the last column on its own
+  return (TRANSACTION_OVERHEAD + 5) + (TRANSACTION_OVERHEAD + 1) + dataBytes(FRAME_BYTES);
+}
@@ -0,0 +1,57 @@
+#ifndef FRAME_DIFF_H
+#define FRAME_DIFF_H
+
+#include <stdint.h>
+
+#ifndef FRAME_WIDTH
+#define FRAME_WIDTH 128
+#endif
+#ifndef FRAME_HEIGHT
+#define FRAME_HEIGHT 32
+#endif
+
+// Largest I2C write the SSD1306 driver makes, control byte included
+#define FRAME_I2C_CHUNK 32
+
+// Columns [first, last] of one 8-row page that differ from the panel
+struct PageSpan {
+  bool dirty;
+  uint8_t first;
+  uint8_t last;
+};
+
+// Finds what changed between frames in SSD1306 page layout (byte x + page *
+// FRAME_WIDTH holds rows page*8 .. page*8+7 of column x, LSB on top), so a
+// refresh only has to send the changed column span of each changed page.
+//
+// A shadow copy holds what the panel is showing. update() compares the new
+// frame against it, reports one span per page and takes the changes into the
+// shadow - the caller must then actually send those spans.
+class FrameDiff {
+public:
+  static const int PAGES = FRAME_HEIGHT / 8;
+  static const int FRAME_BYTES = FRAME_WIDTH * PAGES;
+
+  FrameDiff();
+
+  // Fill spans[PAGES] with what changed and update the shadow.
+  // Returns the number of data bytes to send (0 when nothing changed).
+  int update(const uint8_t* frame, PageSpan* spans);
+
+  // Forget what the panel shows - the next update() sends everything
+  void invalidate();
+
+  // I2C bytes on the wire for these spans: per dirty page one command
+  // write (page and column window) plus the data writes, each chunk
+  // starting with a control byte
+  static uint32_t i2cBytes(const PageSpan* spans);
+
+  // The same for a full refresh as Adafruit_SSD1306::display() sends it
+  static uint32_t fullFrameI2cBytes();
+
+private:
+  uint8_t shadow[FRAME_BYTES];
+  bool valid;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "Widgets.h"
+#include <string.h>
+
+TextWidget::TextWidget(int16_t x, int16_t y, int16_t width, uint8_t textSize)
+    : x(x), y(y), width(width), textSize(textSize), drawn(false) {
+  shown[0] = '\0';
+}
+
+void TextWidget::show(TextDisplay& display, const char* text) {
+  if (drawn && strcmp(text, shown) == 0) {
+    return;
+  }
+
+  // The default font is 8 pixels tall at size 1
+  display.fillRect(x, y, width, 8 * textSize, DISPLAY_BLACK);
+  display.setTextSize(textSize);
+  display.setTextColor(DISPLAY_WHITE);
+  display.setCursor(x, y);
+  display.print(text);
+
+  // Text too long to remember is drawn every time rather than compared wrong
+  drawn = strlen(text) < TEXT_WIDGET_MAX;
+  if (drawn) {
+    strcpy(shown, text);
+  }
+}
+
+void TextWidget::invalidate() {
+  drawn = false;
+}
+
+BarWidget::BarWidget(int16_t x, int16_t y, int16_t width, int16_t height)
+    : x(x), y(y), width(width), height(height), shown(-1) {
+}
+
+void BarWidget::show(TextDisplay& display, int16_t length) {
+  if (length < 0) length = 0;
+  if (length > width) length = width;
+  if (length == shown) {
+    return;
+  }
+
+  if (shown < 0) {
+    display.fillRect(x, y, width, height, DISPLAY_BLACK);
+    shown = 0;
+  }
+  if (length > shown) {
+    display.fillRect(x + shown, y, length - shown, height, DISPLAY_WHITE);
+  } else {
+    display.fillRect(x + length, y, shown - length, height, DISPLAY_BLACK);
+  }
+  shown = length;
+}
+
+void BarWidget::invalidate() {
+  shown = -1;
+}
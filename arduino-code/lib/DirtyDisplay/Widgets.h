@@ -0,0 +1,47 @@
+#ifndef WIDGETS_H
+#define WIDGETS_H
+
+#include <stdint.h>
+#include "PianoHal.h"
+
+// Retained-mode widgets: each remembers what it last drew and only touches
+// the framebuffer when its value changes. Call invalidate() after anything
+// else wiped the screen so the next show() draws again.
+
+// Longest text a TextWidget remembers (longer text always redraws)
+#define TEXT_WIDGET_MAX 16
+
+// Text in a fixed box that is cleared before each redraw
+class TextWidget {
+public:
+  TextWidget(int16_t x, int16_t y, int16_t width, uint8_t textSize);
+
+  void show(TextDisplay& display, const char* text);
+  void invalidate();
+
+private:
+  int16_t x;
+  int16_t y;
+  int16_t width;
+  uint8_t textSize;
+  bool drawn;
+  char shown[TEXT_WIDGET_MAX];
+};
+
+// Horizontal bar that grows and shrinks with a single fillRect
+class BarWidget {
+public:
+  BarWidget(int16_t x, int16_t y, int16_t width, int16_t height);
+
+  void show(TextDisplay& display, int16_t length);
+  void invalidate();
+
+private:
+  int16_t x;
+  int16_t y;
+  int16_t width;
+  int16_t height;
+  int16_t shown;  // -1 until drawn
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "FixedSpectrum.h"
+#include <math.h>
+
+// 10-bit ADC readings are +-512 after removing the offset - shifting by 5
+// puts them at +-16384, half of Q15 full scale
+static const int INPUT_SHIFT = 5;
+
+static int16_t toQ15(double value) {
+  long scaled = lround(value * 32767.0);
+  if (scaled > 32767) scaled = 32767;
+  if (scaled < -32768) scaled = -32768;
+  return (int16_t)scaled;
+}
+
+void FixedSpectrum::begin() {
+  // Same Hamming definition as ArduinoFFT: 0.54 - 0.46 * cos(2*pi*i/(N-1))
+  for (int i = 0; i < SAMPLES; i++) {
+    double ratio = (double)i / (SAMPLES - 1);
+    window[i] = toQ15(0.54 - 0.46 * cos(2.0 * M_PI * ratio));
+  }
+  for (int k = 0; k < BINS; k++) {
+    double angle = 2.0 * M_PI * k / SAMPLES;
+    cosTable[k] = toQ15(cos(angle));
+    sinTable[k] = toQ15(sin(angle));
+  }
+}
+
+void FixedSpectrum::loadBlock(const int16_t* raw, int16_t dcOffset) {
+  for (int i = 0; i < SAMPLES; i++) {
+    int32_t centered = (int32_t)(raw[i] - dcOffset) * (1 << INPUT_SHIFT);  // Not <<: may be negative
+    real[i] = (int16_t)((centered * window[i]) >> 15);
+    imag[i] = 0;
+  }
+}
+
+int16_t* FixedSpectrum::workBuffer() {
+  return real;
+}
+
+void FixedSpectrum::compute() {
+  exponent = transform(real, imag);
+}
+
+int FixedSpectrum::transform(int16_t* re, int16_t* im) const {
+  // Bit-reversal permutation
+  for (int i = 1, j = 0; i < SAMPLES; i++) {
+    int bit = SAMPLES >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      int16_t swap = re[i];
+      re[i] = re[j];
+      re[j] = swap;
+      swap = im[i];
+      im[i] = im[j];
+      im[j] = swap;
+    }
+  }
+
+  // Radix-2 decimation-in-time butterflies with block floating point: a
+  // stage is only scaled down when its inputs are large enough to overflow,
+  // so quiet signals keep their low bits. A butterfly can grow a component by
+  // up to 2*sqrt(2), hence the 11585 (32767 / 2.83) limit.
+  int halvings = 0;
+  for (int size = 2; size <= SAMPLES; size <<= 1) {
+    int32_t largest = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+      int32_t absRe = re[i] < 0 ? -(int32_t)re[i] : re[i];
+      int32_t absIm = im[i] < 0 ? -(int32_t)im[i] : im[i];
+      if (absRe > largest) largest = absRe;
+      if (absIm > largest) largest = absIm;
+    }
+    int shift = 0;
+    while ((largest >> shift) > 11585) {
+      shift++;
+    }
+    halvings += shift;
+
+    int half = size >> 1;
+    int step = SAMPLES / size;
+    for (int start = 0; start < SAMPLES; start += size) {
+      for (int k = 0; k < half; k++) {
+        // Twiddle e^(-j*2*pi*k/size)
+        int32_t wr = cosTable[k * step];
+        int32_t wi = -sinTable[k * step];
+        int i = start + k;
+        int j = i + half;
+
+        int32_t tr = ((int32_t)re[j] * wr - (int32_t)im[j] * wi) >> 15;
+        int32_t ti = ((int32_t)re[j] * wi + (int32_t)im[j] * wr) >> 15;
+        int32_t ar = re[i];
+        int32_t ai = im[i];
+
+        re[j] = (int16_t)((ar - tr) >> shift);
+        im[j] = (int16_t)((ai - ti) >> shift);
+        re[i] = (int16_t)((ar + tr) >> shift);
+        im[i] = (int16_t)((ai + ti) >> shift);
+      }
+    }
+  }
+  return halvings;
+}
+
+void FixedSpectrum::complexToMagnitude() {
+  // Bin k only reads real[k] and imag[k], so it can overwrite real[k]
+  uint16_t* magnitude = reinterpret_cast<uint16_t*>(real);
+  for (int k = 0; k < BINS; k++) {
+    uint32_t re = real[k] < 0 ? -(int32_t)real[k] : real[k];
+    uint32_t im = imag[k] < 0 ? -(int32_t)imag[k] : imag[k];
+    uint32_t larger = re > im ? re : im;
+    uint32_t smaller = re > im ? im : re;
+    // |z| ~= 0.953 * max + 0.391 * min
+    magnitude[k] = (uint16_t)((larger * 61 + smaller * 25) >> 6);
+  }
+}
+
+HpsPeak FixedSpectrum::harmonicProductPeak(int numHarmonics, int firstBin) const {
+  // Fixed-point magnitudes are 2^(INPUT_SHIFT - exponent) times the double
+  // ones. Bins above SAMPLES/(2*h) only get h-1 factors (exactly as in the
+  // double path), so every product is brought to double-path units before
+  // comparing. For quiet frames the correction is a right shift; there the
+  // comparison is done at full-product scale and only the result is shifted.
+  const int unitShift = exponent - INPUT_SHIFT;
+  const uint16_t* magnitude = magnitudes();
+
+  HpsPeak peak = {0, 0};
+  for (int i = firstBin; i < BINS; i++) {
+    uint64_t product = magnitude[i];
+    int factors = 1;
+    for (int harmonic = 2; harmonic <= numHarmonics; harmonic++) {
+      if (i >= SAMPLES / (2 * harmonic)) {
+        break;
+      }
+      product *= magnitude[i * harmonic];
+      factors++;
+    }
+    if (unitShift >= 0) {
+      product <<= unitShift * factors;
+    } else {
+      product <<= -unitShift * (numHarmonics - factors);
+    }
+
+    if (product > peak.value) {
+      peak.value = product;
+      peak.bin = i;
+    }
+  }
+  if (unitShift < 0) {
+    peak.value >>= -unitShift * numHarmonics;
+  }
+  return peak;
+}
+
+const uint16_t* FixedSpectrum::magnitudes() const {
+  return reinterpret_cast<const uint16_t*>(real);
+}
+
+uint16_t* FixedSpectrum::magnitudes() {
+  return reinterpret_cast<uint16_t*>(real);
+}
+
+uint64_t FixedSpectrum::inputUnits(uint32_t value) const {
+  const int unitShift = exponent - INPUT_SHIFT;
+  return unitShift >= 0 ? (uint64_t)value << unitShift : value >> -unitShift;
+}
@@ -0,0 +1,82 @@
+#ifndef FIXED_SPECTRUM_H
+#define FIXED_SPECTRUM_H
+
+#include <stdint.h>
+
+// Number of samples per analysis frame - must be a power of 2
+#ifndef FIXED_SPECTRUM_SAMPLES
+#define FIXED_SPECTRUM_SAMPLES 128
+#endif
+
+// Peak of the Harmonic Product Spectrum.
+// value is expressed in the same units as the ArduinoFFT<double> path
+// (raw ADC counts through the same window), so thresholds carry over.
+struct HpsPeak {
+  uint16_t bin;
+  uint64_t value;
+};
+
+// Integer-only spectral engine for the FPU-less Cortex-M0+.
+//
+// Samples are held as Q15 in int16_t, twiddles and the Hamming window are Q15
+// tables built once in begin(), and the radix-2 FFT uses block floating point
+// (a stage is halved only when it could overflow, tracked in exponent).
+// Magnitudes use the alpha-max-plus-beta-min approximation (max error about
+// 4%) instead of a square root, and the HPS products are 64-bit integers.
+//
+// The whole pipeline works in place in one pair of SAMPLES-long int16_t
+// buffers: samples are windowed where they lie, the FFT overwrites them and
+// the magnitudes replace the real half. 512 bytes at 128 samples, plus the
+// 512 bytes of tables.
+class FixedSpectrum {
+public:
+  static const int SAMPLES = FIXED_SPECTRUM_SAMPLES;
+  static const int BINS = SAMPLES / 2;
+
+  // Build the window and twiddle tables - call once from setup()
+  void begin();
+
+  // Remove the DC offset, scale raw ADC readings up to Q15 and apply the
+  // Hamming window. Clears the imaginary part. raw may be workBuffer().
+  void loadBlock(const int16_t* raw, int16_t dcOffset);
+
+  // The SAMPLES-long buffer loadBlock() fills. A caller producing samples
+  // (the decimation cascade) can write them here and load in place instead
+  // of keeping its own copy on the stack.
+  int16_t* workBuffer();
+
+  // In-place forward FFT of the loaded block
+  void compute();
+
+  // In-place forward FFT of any SAMPLES-long Q15 pair with the same tables
+  // and block floating point. Returns the number of halvings applied, so
+  // the true result is the output times 2^return.
+  int transform(int16_t* re, int16_t* im) const;
+
+  // Fill magnitudes() with |X[k]| for k < BINS, over the real half of the
+  // transform (magnitudes() is only valid until the next loadBlock())
+  void complexToMagnitude();
+
+  // HPS over numHarmonics harmonics, searching bins from firstBin upward.
+  // The products are formed on the fly, so no HPS array is kept.
+  HpsPeak harmonicProductPeak(int numHarmonics, int firstBin) const;
+
+  const uint16_t* magnitudes() const;
+  uint16_t* magnitudes();  // For notching bins before a pitch engine reads them
+
+  // A magnitudes() value in the double path's units (raw ADC counts through
+  // the window), for comparing against the same thresholds
+  uint64_t inputUnits(uint32_t value) const;
+
+private:
+  // Work buffer: samples, then the transform, then (real) the magnitudes.
+  // Magnitudes reach 44030, so they are read back as uint16_t.
+  int16_t real[SAMPLES];
+  int16_t imag[SAMPLES];
+  int16_t window[SAMPLES];
+  int16_t cosTable[BINS];
+  int16_t sinTable[BINS];
+  int exponent = 0;  // Number of halvings applied by the last compute()
+};
+
+#endif
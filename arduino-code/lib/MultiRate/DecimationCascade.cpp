@@ -0,0 +1,96 @@
+#include "DecimationCascade.h"
+#include <string.h>
+
+// Non-zero half-band taps away from the centre, at offsets 1, 3 and 5;
+// the centre tap is 128 and the sum is 256
+static const int32_t TAP1 = 76;
+static const int32_t TAP3 = -15;
+static const int32_t TAP5 = 3;
+static const int32_t CENTRE_TAP = 128;
+static const int TAP_SHIFT = 8;
+
+void DecimationCascade::begin(uint32_t inputRate, int16_t dcOffset) {
+  rate = inputRate;
+  for (int b = 0; b < BANDS; b++) {
+    for (int i = 0; i < WINDOW; i++) {
+      windows[b][i] = dcOffset;
+    }
+    writeIndex[b] = 0;
+    received[b] = 0;
+    receivedAtMark[b] = 0;
+  }
+  for (int s = 0; s < BANDS - 1; s++) {
+    for (int i = 0; i < HALF_BAND_HISTORY; i++) {
+      stages[s].history[i] = dcOffset;
+    }
+    stages[s].position = 0;
+    stages[s].odd = false;
+  }
+}
+
+void DecimationCascade::push(const int16_t* samples, int count) {
+  for (int i = 0; i < count; i++) {
+    pushSample(0, samples[i]);
+  }
+}
+
+void DecimationCascade::pushSample(int band, int16_t sample) {
+  // Iterative rather than recursive - each band hands every second
+  // filtered sample to the next one
+  while (true) {
+    windows[band][writeIndex[band]] = sample;
+    writeIndex[band] = (writeIndex[band] + 1) % WINDOW;
+    received[band]++;
+    if (band == BANDS - 1) {
+      return;
+    }
+
+    Stage& stage = stages[band];
+    stage.history[stage.position] = sample;
+    stage.position = (stage.position + 1) & (HALF_BAND_HISTORY - 1);
+    stage.odd = !stage.odd;
+    if (stage.odd) {
+      return;
+    }
+
+    // The newest input is h[0]; the filter centre is 5 samples back
+    const int mask = HALF_BAND_HISTORY - 1;
+    int newest = (stage.position - 1) & mask;
+    const int16_t* h = stage.history;
+    int32_t acc = CENTRE_TAP * h[(newest - 5) & mask] +
+                  TAP1 * (h[(newest - 4) & mask] + h[(newest - 6) & mask]) +
+                  TAP3 * (h[(newest - 2) & mask] + h[(newest - 8) & mask]) +
+                  TAP5 * (h[newest] + h[(newest - 10) & mask]);
+    sample = (int16_t)((acc + (1 << (TAP_SHIFT - 1))) >> TAP_SHIFT);
+    band++;
+  }
+}
+
+void DecimationCascade::window(int band, int16_t* out) const {
+  // The oldest sample is the one about to be overwritten
+  int start = writeIndex[band];
+  memcpy(out, &windows[band][start], (WINDOW - start) * sizeof(int16_t));
+  memcpy(out + (WINDOW - start), &windows[band][0], start * sizeof(int16_t));
+}
+
+uint32_t DecimationCascade::sampleRate(int band) const {
+  return rate >> band;
+}
+
+bool DecimationCascade::filled(int band) const {
+  return received[band] >= (uint32_t)WINDOW;
+}
+
+void DecimationCascade::mark() {
+  for (int b = 0; b < BANDS; b++) {
+    receivedAtMark[b] = received[b];
+  }
+}
+
+int DecimationCascade::freshBands() const {
+  int bands = 0;
+  while (bands < BANDS && received[bands] - receivedAtMark[bands] >= (uint32_t)WINDOW) {
+    bands++;
+  }
+  return bands;
+}
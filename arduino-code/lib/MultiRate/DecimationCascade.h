@@ -0,0 +1,73 @@
+#ifndef DECIMATION_CASCADE_H
+#define DECIMATION_CASCADE_H
+
+#include <stdint.h>
+#include "FixedSpectrum.h"
+
+// Bands including the full-rate one; band b runs at inputRate / 2^b
+#ifndef MULTIRATE_BANDS
+#define MULTIRATE_BANDS 5
+#endif
+
+// Samples of each half-band stage's delay line (the filter is 11 taps long,
+// rounded up to a power of two for cheap wrapping)
+#define HALF_BAND_HISTORY 16
+
+// Octave-band decimator feeding one analysis window per band.
+//
+// Every captured sample goes into band 0. Each stage behind it low-pass
+// filters with an 11-tap integer half-band FIR (3, -15, 76, 128, 76, -15,
+// 3 over 256 on the odd taps: -0.1 dB to 1/8 of its input rate, -37 dB
+// from 3/8) and keeps every second output, so band b holds the last
+// FixedSpectrum::SAMPLES samples at inputRate / 2^b. The same 128-point
+// FFT then spans 2^b times as long and resolves 2^b times finer - at a
+// 10 kHz capture the fifth band reaches 4.9 Hz bins over 205 ms - while
+// RAM only grows by one window per band.
+//
+// Half the taps are zero, so a stage costs four multiplies per output and
+// the whole cascade under four per captured sample. Samples stay in raw ADC
+// units, DC included (the filters have unity DC gain), so they go through
+// FixedSpectrum::loadBlock() like a capture block.
+class DecimationCascade {
+public:
+  static const int BANDS = MULTIRATE_BANDS;
+  static const int WINDOW = FixedSpectrum::SAMPLES;
+
+  // Start over with every window and delay line at dcOffset (silence)
+  void begin(uint32_t inputRate, int16_t dcOffset);
+
+  // Feed full-rate samples in capture order
+  void push(const int16_t* samples, int count);
+
+  // Copy band's window into out, oldest sample first
+  void window(int band, int16_t* out) const;
+
+  uint32_t sampleRate(int band) const;
+
+  // Whether band has taken in a whole window since begin()
+  bool filled(int band) const;
+
+  // Note where a new sound starts (an onset). freshBands() then counts the
+  // bands, from band 0 up, whose whole window was captured after it - the
+  // longer windows still hold the previous note until they have refilled.
+  void mark();
+  int freshBands() const;
+
+private:
+  struct Stage {
+    int16_t history[HALF_BAND_HISTORY];
+    uint8_t position;  // Where the next input goes
+    bool odd;          // Next input completes a pair -> one output
+  };
+
+  void pushSample(int band, int16_t sample);
+
+  Stage stages[BANDS - 1];  // stages[b] turns band b into band b + 1
+  int16_t windows[BANDS][WINDOW];
+  uint16_t writeIndex[BANDS];
+  uint32_t received[BANDS];
+  uint32_t receivedAtMark[BANDS];
+  uint32_t rate = 0;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MULTI_RATE_PITCH_H
+#define MULTI_RATE_PITCH_H
+
+#include "DecimationCascade.h"
+#include "PitchDetector.h"
+
+// Lowest fundamental a band is trusted with, in its own bins. Below that
+// the next (longer, finer) band is asked. A bass note's upper partials are
+// often all a short window hears, so this is set well above the few bins a
+// clean tone would need (8 bins = 625 Hz for band 0 at a 10 kHz capture).
+#ifndef MULTIRATE_TRUST_BINS
+#define MULTIRATE_TRUST_BINS 8
+#endif
+
+// Highest harmonic number a finer band's answer may be below the coarser
+// one's (a bass note's fundamental is often too weak for the short window,
+// which then reports its 2nd, 3rd or 4th harmonic)
+#define MULTIRATE_MAX_SUBHARMONIC 4
+
+static_assert(DecimationCascade::WINDOW == FixedSpectrum::SAMPLES,
+              "a band's window must fill the FixedSpectrum work buffer");
+
+// For callers with no learned background: every band's spectrum is left
+// as it is. A background instead may clear (or learn from) the bins of
+// steady room tones before the engine sees them - see NoiseCalibration.
+struct NoBackground {
+  void notch(FixedSpectrum&, int, uint32_t, int) const {}
+};
+
+// Unroll band's window straight into spectrum's work buffer and transform
+// it to magnitudes there - no copy of the window on the stack. A
+// time-domain engine gets to see the samples first.
+template <class Engine, class Background>
+PitchEstimate analyzeBand(const DecimationCascade& cascade, int band, FixedSpectrum& spectrum,
+                          Engine& engine, int16_t dcOffset, int firstBin,
+                          const Background& background) {
+  int16_t* samples = spectrum.workBuffer();
+  cascade.window(band, samples);
+  engine.load(samples, dcOffset);
+  spectrum.loadBlock(samples, dcOffset);
+  spectrum.compute();
+  spectrum.complexToMagnitude();
+  background.notch(spectrum, band, cascade.sampleRate(band), firstBin);
+  return engine.estimate(spectrum, cascade.sampleRate(band), firstBin);
+}
+
+// Just band's spectrum, for callers without a pitch engine (chords)
+inline void bandSpectrum(const DecimationCascade& cascade, int band, FixedSpectrum& spectrum,
+                         int16_t dcOffset) {
+  int16_t* samples = spectrum.workBuffer();
+  cascade.window(band, samples);
+  spectrum.loadBlock(samples, dcOffset);
+  spectrum.compute();
+  spectrum.complexToMagnitude();
+}
+
+// True if fine is coarse / k for some k up to MULTIRATE_MAX_SUBHARMONIC,
+// within one of the coarse band's bins
+inline bool explainsPitch(uint32_t fineQ4, uint32_t coarseQ4, uint32_t coarseBinQ4) {
+  for (uint32_t k = 1; k <= MULTIRATE_MAX_SUBHARMONIC; k++) {
+    uint32_t expected = fineQ4 * k;
+    uint32_t distance = expected > coarseQ4 ? expected - coarseQ4 : coarseQ4 - expected;
+    if (distance <= coarseBinQ4) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct MultiRateEstimate {
+  PitchEstimate pitch;
+  int band;          // Band whose answer was taken
+  int spectrumBand;  // Band whose spectrum is left in the FixedSpectrum
+  bool settled;      // False if a finer band was wanted but not allowed yet
+};
+
+// One note decision from every band, coarse to fine. Band 0 (full rate,
+// the only one that reaches the top octaves) goes first. While the answer
+// is below what the band can resolve, the next band - twice as long, twice
+// as fine - analyzes the same sound, and its answer replaces the coarser
+// one if it is the same pitch or a sub-harmonic of it. A finer band never
+// overrules a treble note it cannot even hear.
+//
+// Only the first bands bands are used - pass cascade.freshBands() after an
+// onset so a window still holding the previous note has no say; settled
+// then tells whether the answer may still change as more bands fill.
+// strength stays band 0's, so level thresholds mean what they did at a
+// single rate. background gets every band's magnitudes before the engine.
+template <class Engine, class Background>
+MultiRateEstimate estimateMultiRate(const DecimationCascade& cascade, FixedSpectrum& spectrum,
+                                    Engine& engine, int16_t dcOffset, int firstBin, int bands,
+                                    const Background& background) {
+  MultiRateEstimate result = {
+      analyzeBand(cascade, 0, spectrum, engine, dcOffset, firstBin, background), 0, 0, true};
+  while (result.pitch.valid() && result.band + 1 < DecimationCascade::BANDS) {
+    int band = result.band;
+    uint32_t binQ4 = cascade.sampleRate(band) * 16 / DecimationCascade::WINDOW;
+    if (result.pitch.frequencyQ4 >= binQ4 * MULTIRATE_TRUST_BINS) {
+      break;
+    }
+    if (band + 1 >= bands || !cascade.filled(band + 1)) {
+      result.settled = false;
+      break;
+    }
+    PitchEstimate finer =
+        analyzeBand(cascade, band + 1, spectrum, engine, dcOffset, firstBin, background);
+    result.spectrumBand = band + 1;
+    if (!finer.valid() || !explainsPitch(finer.frequencyQ4, result.pitch.frequencyQ4, binQ4)) {
+      break;
+    }
+    result.pitch.frequencyQ4 = finer.frequencyQ4;
+    result.band = band + 1;
+  }
+  return result;
+}
+
+template <class Engine>
+MultiRateEstimate estimateMultiRate(const DecimationCascade& cascade, FixedSpectrum& spectrum,
+                                    Engine& engine, int16_t dcOffset, int firstBin, int bands) {
+  return estimateMultiRate(cascade, spectrum, engine, dcOffset, firstBin, bands, NoBackground());
+}
+
+#endif
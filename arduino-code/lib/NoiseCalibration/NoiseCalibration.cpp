@@ -0,0 +1,222 @@
+#include "NoiseCalibration.h"
+#include <string.h>
+
+NoiseCalibration::NoiseCalibration() {
+  begin(512, 0, 0, 0, 0);
+}
+
+void NoiseCalibration::begin(int16_t dcOffset, int minLevel, int maxLevel, int levelMargin,
+                             uint64_t minStrength) {
+  dcQ8 = (int32_t)dcOffset << 8;
+  levelMeanQ4 = 0;
+  levelDeviationQ4 = 0;
+  strengthMean = 0;
+  strengthDeviation = 0;
+  this->minLevel = minLevel;
+  this->maxLevel = maxLevel;
+  this->levelMargin = levelMargin;
+  this->minStrength = minStrength;
+  levelSeeded = false;
+  strengthSeeded = false;
+  for (int i = 0; i < CAL_MAX_TONES; i++) {
+    tones[i].frequencyQ4 = 0;
+    tones[i].strength = 0;
+    tones[i].score = 0;
+    memset(tones[i].levels, 0, sizeof(tones[i].levels));
+  }
+}
+
+void NoiseCalibration::learnBlock(const int16_t* block, int count) {
+  if (count <= 0) {
+    return;
+  }
+  int32_t sum = 0;
+  for (int i = 0; i < count; i++) {
+    sum += block[i];
+  }
+  int32_t meanQ8 = (sum << 8) / count;
+  dcQ8 += (meanQ8 - dcQ8) >> CAL_DC_SHIFT;
+}
+
+void NoiseCalibration::learnLevel(int level) {
+  int32_t levelQ4 = (int32_t)level << 4;
+  if (!levelSeeded) {
+    levelMeanQ4 = levelQ4;
+    levelSeeded = true;
+    return;
+  }
+  int32_t difference = levelQ4 - levelMeanQ4;
+  levelMeanQ4 += difference >> CAL_LEVEL_SHIFT;
+  int32_t deviation = difference < 0 ? -difference : difference;
+  levelDeviationQ4 += (deviation - levelDeviationQ4) >> CAL_LEVEL_SHIFT;
+}
+
+// Exponential average step on unsigned values
+static uint64_t approach(uint64_t average, uint64_t value, int shift) {
+  if (value >= average) {
+    return average + ((value - average) >> shift);
+  }
+  return average - ((average - value) >> shift);
+}
+
+void NoiseCalibration::learnPitch(const PitchEstimate& pitch) {
+  // Only pitches strong enough to become a note are candidate tones
+  bool candidate = pitch.valid() && pitch.strength > minStrength;
+  int heard = candidate ? findTone(pitch.frequencyQ4) : -1;
+
+  // A tone already being tracked is notched by frequency, so it stays out
+  // of the strength estimate - else a steady hum would also raise the bar
+  // for every other note. Unvoiced frames count as strength 0, the usual
+  // ambient case.
+  if (heard < 0) {
+    uint64_t strength = pitch.valid() ? pitch.strength : 0;
+    if (!strengthSeeded) {
+      strengthMean = strength;
+      strengthSeeded = true;
+    } else {
+      uint64_t deviation = strength > strengthMean ? strength - strengthMean : strengthMean - strength;
+      strengthMean = approach(strengthMean, strength, CAL_STRENGTH_SHIFT);
+      strengthDeviation = approach(strengthDeviation, deviation, CAL_STRENGTH_SHIFT);
+    }
+  }
+
+  if (candidate) {
+    if (heard < 0) {
+      // Take a free slot, or the one with the weakest claim
+      heard = 0;
+      for (int i = 1; i < CAL_MAX_TONES; i++) {
+        if (tones[i].score < tones[heard].score) {
+          heard = i;
+        }
+      }
+      tones[heard].frequencyQ4 = pitch.frequencyQ4;
+      tones[heard].strength = pitch.strength;
+      tones[heard].score = 0;
+      memset(tones[heard].levels, 0, sizeof(tones[heard].levels));
+    }
+    BackgroundTone& tone = tones[heard];
+    tone.frequencyQ4 = (tone.frequencyQ4 * 3 + pitch.frequencyQ4) / 4;
+    tone.strength = approach(tone.strength, pitch.strength, 2);
+    tone.score = tone.score + 2 > CAL_TONE_SCORE_MAX ? CAL_TONE_SCORE_MAX : tone.score + 2;
+  }
+  for (int i = 0; i < CAL_MAX_TONES; i++) {
+    if (i != heard && tones[i].score > 0) {
+      tones[i].score--;
+    }
+  }
+}
+
+void NoiseCalibration::learnSpectrum(const FixedSpectrum& spectrum, int band,
+                                     uint32_t sampleRate) {
+  if (band < 0 || band >= DecimationCascade::BANDS) {
+    return;
+  }
+  const uint16_t* magnitude = spectrum.magnitudes();
+  for (int i = 0; i < CAL_MAX_TONES; i++) {
+    if (tones[i].score == 0) {
+      continue;
+    }
+    for (int h = 0; h < CAL_NOTCH_HARMONICS; h++) {
+      int bin = harmonicBin(tones[i].frequencyQ4, h + 1, sampleRate);
+      if (bin + 1 >= FixedSpectrum::BINS) {
+        break;
+      }
+      // A tone between two bins shows in both
+      uint16_t larger = magnitude[bin] > magnitude[bin + 1] ? magnitude[bin] : magnitude[bin + 1];
+      uint32_t level = (uint32_t)spectrum.inputUnits(larger);
+      uint32_t& learned = tones[i].levels[band][h];
+      learned = learned == 0 ? level : (uint32_t)approach(learned, level, 2);
+    }
+  }
+}
+
+void NoiseCalibration::notch(FixedSpectrum& spectrum, int band, uint32_t sampleRate,
+                             int firstBin) const {
+  if (band < 0 || band >= DecimationCascade::BANDS) {
+    return;
+  }
+  uint16_t* magnitude = spectrum.magnitudes();
+  for (int i = 0; i < CAL_MAX_TONES; i++) {
+    if (!toneLearned(i)) {
+      continue;
+    }
+    for (int h = 0; h < CAL_NOTCH_HARMONICS; h++) {
+      int bin = harmonicBin(tones[i].frequencyQ4, h + 1, sampleRate);
+      if (bin + 1 >= FixedSpectrum::BINS) {
+        break;
+      }
+      uint64_t limit = (uint64_t)tones[i].levels[band][h] * CAL_NOTCH_MARGIN;
+      for (int k = bin; k <= bin + 1; k++) {
+        if (k >= firstBin && spectrum.inputUnits(magnitude[k]) <= limit) {
+          magnitude[k] = 0;
+        }
+      }
+    }
+  }
+}
+
+int16_t NoiseCalibration::dcOffset() const {
+  return (int16_t)((dcQ8 + 128) >> 8);
+}
+
+int NoiseCalibration::levelThreshold() const {
+  int32_t spreadQ4 = CAL_DEVIATIONS * levelDeviationQ4;
+  if (spreadQ4 < ((int32_t)levelMargin << 4)) {
+    spreadQ4 = (int32_t)levelMargin << 4;
+  }
+  int learned = (levelMeanQ4 + spreadQ4 + 8) >> 4;
+  if (learned < minLevel) {
+    return minLevel;
+  }
+  return maxLevel > minLevel && learned > maxLevel ? maxLevel : learned;
+}
+
+uint64_t NoiseCalibration::strengthThreshold() const {
+  uint64_t learned = strengthMean + CAL_STRENGTH_DEVIATIONS * strengthDeviation;
+  return learned > minStrength ? learned : minStrength;
+}
+
+bool NoiseCalibration::isBackground(const PitchEstimate& pitch) const {
+  if (!pitch.valid()) {
+    return false;
+  }
+  int index = findTone(pitch.frequencyQ4);
+  return index >= 0 && tones[index].score >= CAL_TONE_LEARNED &&
+         pitch.strength <= tones[index].strength * CAL_TONE_MARGIN;
+}
+
+int NoiseCalibration::learnedTones() const {
+  int count = 0;
+  for (int i = 0; i < CAL_MAX_TONES; i++) {
+    count += toneLearned(i);
+  }
+  return count;
+}
+
+const BackgroundTone& NoiseCalibration::tone(int index) const {
+  return tones[index];
+}
+
+bool NoiseCalibration::toneLearned(int index) const {
+  return tones[index].score >= CAL_TONE_LEARNED;
+}
+
+// The lower of the two bins around harmonic times the tone
+int NoiseCalibration::harmonicBin(uint32_t frequencyQ4, int harmonic, uint32_t sampleRate) {
+  uint64_t positionQ4 = (uint64_t)frequencyQ4 * harmonic * FixedSpectrum::SAMPLES / sampleRate;
+  return (int)(positionQ4 >> 4);
+}
+
+int NoiseCalibration::findTone(uint32_t frequencyQ4) const {
+  for (int i = 0; i < CAL_MAX_TONES; i++) {
+    if (tones[i].score == 0) {
+      continue;
+    }
+    uint32_t reference = tones[i].frequencyQ4;
+    uint32_t distance = frequencyQ4 > reference ? frequencyQ4 - reference : reference - frequencyQ4;
+    if ((uint64_t)distance * 1000 <= (uint64_t)reference * CAL_TONE_TOLERANCE) {
+      return i;
+    }
+  }
+  return -1;
+}
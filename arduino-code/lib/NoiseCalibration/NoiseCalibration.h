@@ -0,0 +1,151 @@
+#ifndef NOISE_CALIBRATION_H
+#define NOISE_CALIBRATION_H
+
+#include <stdint.h>
+#include "DecimationCascade.h"
+#include "PitchDetector.h"
+
+// Background tones remembered at once
+#ifndef CAL_MAX_TONES
+#define CAL_MAX_TONES 4
+#endif
+
+// Running estimates are exponential averages with weight 1/2^shift per
+// update: blocks for the DC bias, sense ticks for the level, ambient
+// analyses for the pitch strength
+#define CAL_DC_SHIFT 6
+#define CAL_LEVEL_SHIFT 7
+#define CAL_STRENGTH_SHIFT 4
+
+// A threshold sits this many mean deviations above the learned noise (and
+// the level threshold at least the begin() margin above it, for rooms as
+// steady as a hum)
+#define CAL_DEVIATIONS 4
+
+// The pitch strength threshold sits closer: only frames already past the
+// level threshold are analyzed, and a bass note's strength is just that of
+// the upper partials band 0 hears - at CAL_DEVIATIONS, loud broadband rooms
+// lost A2 and E3
+#define CAL_STRENGTH_DEVIATIONS 2
+
+// Two ambient pitches are the same tone within this many 1/1000ths of the
+// frequency (about 50 cents)
+#define CAL_TONE_TOLERANCE 29
+
+// A tone's score goes up by 2 in every ambient analysis that hears it and
+// down by 1 in every one that doesn't; at CAL_TONE_LEARNED it is notched.
+// So a tone must be in more than a third of the analyses to stay learned.
+#define CAL_TONE_LEARNED 16
+#define CAL_TONE_SCORE_MAX 32
+
+// A learned tone only hides a pitch up to this many times its own strength -
+// a note actually played on the hum's frequency is louder than that
+#define CAL_TONE_MARGIN 4
+
+// Harmonics of a learned tone (fundamental included) cleared from every
+// band's spectrum before the pitch engine looks, each only while its bins
+// are at most CAL_NOTCH_MARGIN times as loud as in the empty room. A note's
+// partial landing on the same bins is louder than that and survives, so
+// the hum can neither outvote a note nor lend it a false sub-harmonic.
+#define CAL_NOTCH_HARMONICS 3
+#define CAL_NOTCH_MARGIN 2
+
+// A persistent background tone: hum, a fan, a fridge
+struct BackgroundTone {
+  uint32_t frequencyQ4;  // Hz * 16, averaged over the analyses that heard it
+  uint64_t strength;     // Its usual pitch strength
+  uint8_t score;         // 0 = free slot
+  // Usual magnitude (FixedSpectrum::inputUnits) of each harmonic's bins in
+  // each band, 0 where no ambient analysis has looked
+  uint32_t levels[DecimationCascade::BANDS][CAL_NOTCH_HARMONICS];
+};
+
+// Runtime calibration of the microphone against the room.
+//
+// While nobody is at the piano the firmware feeds it what it would
+// otherwise throw away: capture blocks (for the mic's DC bias), the
+// smoothed mic level every sense tick, and now and then a pitch estimate of
+// the ambient sound. From those it keeps
+//
+//   - the DC bias, so levels and spectra are measured from the real centre
+//     rather than the nominal 512,
+//   - the level's mean and mean deviation, from which the "playing"
+//     threshold is derived (never below the configured minimum, so a quiet
+//     room behaves exactly as before),
+//   - the same for the pitch strength of ambient frames, for the "this
+//     frame has a pitch" threshold,
+//   - up to CAL_MAX_TONES tones that keep coming back, which are then
+//     notched out of the spectra (see notch()) and the pitch results.
+//
+// Integer only, a few hundred bytes, and constant work per update.
+class NoiseCalibration {
+public:
+  NoiseCalibration();
+
+  // Start over from the nominal bias and the configured minimum thresholds
+  // (also the floors the learned ones never go below); maxLevel caps the
+  // level threshold so a loud room can't make playing undetectable, and
+  // levelMargin is the least it sits above the room's mean level
+  void begin(int16_t dcOffset, int minLevel, int maxLevel, int levelMargin, uint64_t minStrength);
+
+  // An ambient capture block: its mean pulls the DC estimate
+  void learnBlock(const int16_t* block, int count);
+
+  // The smoothed mic level of one ambient sense tick
+  void learnLevel(int level);
+
+  // One ambient analysis, pitch or not
+  void learnPitch(const PitchEstimate& pitch);
+
+  // One band's magnitudes from an ambient analysis: how loud the tones
+  // being tracked are there. Pass a ToneLevelLearner to estimateMultiRate()
+  // to have it called for every band the analysis visits.
+  void learnSpectrum(const FixedSpectrum& spectrum, int band, uint32_t sampleRate);
+
+  // Clear the learned tones' harmonics from one band's magnitudes, where
+  // they are no louder than usual - pass the calibration itself to
+  // estimateMultiRate() as its background
+  void notch(FixedSpectrum& spectrum, int band, uint32_t sampleRate, int firstBin) const;
+
+  int16_t dcOffset() const;
+  int levelThreshold() const;
+  uint64_t strengthThreshold() const;
+
+  // True if pitch is one of the learned background tones at about its
+  // usual strength
+  bool isBackground(const PitchEstimate& pitch) const;
+
+  // Learned tones (score at least CAL_TONE_LEARNED) for reports
+  int learnedTones() const;
+  const BackgroundTone& tone(int index) const;
+  bool toneLearned(int index) const;
+
+private:
+  int findTone(uint32_t frequencyQ4) const;
+  static int harmonicBin(uint32_t frequencyQ4, int harmonic, uint32_t sampleRate);
+
+  int32_t dcQ8;            // DC bias * 256
+  int32_t levelMeanQ4;     // Level * 16
+  int32_t levelDeviationQ4;
+  uint64_t strengthMean;
+  uint64_t strengthDeviation;
+  int minLevel;
+  int maxLevel;
+  int levelMargin;
+  uint64_t minStrength;
+  bool levelSeeded;
+  bool strengthSeeded;
+  BackgroundTone tones[CAL_MAX_TONES];
+};
+
+// estimateMultiRate() background for ambient analyses: notches nothing,
+// learns each band's tone levels for NoiseCalibration::notch()
+struct ToneLevelLearner {
+  NoiseCalibration& calibration;
+
+  void notch(FixedSpectrum& spectrum, int band, uint32_t sampleRate, int) const {
+    calibration.learnSpectrum(spectrum, band, sampleRate);
+  }
+};
+
+#endif
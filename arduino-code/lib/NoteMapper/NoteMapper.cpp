@@ -0,0 +1,70 @@
+#include "NoteMapper.h"
+#include <math.h>
+
+// Using reference from https://muted.io/note-frequencies/
+const double NOTE_FREQUENCIES[NOTE_TABLE_SIZE] = {
+  16.35, 17.32, 18.35, 19.45, 20.60, 21.83, 23.12, 24.50, 25.96, 27.50, 29.14, 30.87, // C0 to B0
+  32.70, 34.65, 36.71, 38.89, 41.20, 43.65, 46.25, 49.00, 51.91, 55.00, 58.27, 61.74, // C1 to B1
+  65.41, 69.30, 73.42, 77.78, 82.41, 87.31, 92.50, 98.00, 103.8, 110.0, 116.5, 123.5, // C2 to B2
+  130.8, 138.6, 146.8, 155.6, 164.8, 174.6, 185.0, 196.0, 207.7, 220.0, 233.1, 246.9, // C3 to B3
+  261.6, 277.2, 293.7, 311.1, 329.6, 349.2, 370.0, 392.0, 415.3, 440.0, 466.2, 493.9, // C4 to B4
+  523.3, 554.4, 587.3, 622.3, 659.3, 698.5, 740.0, 784.0, 830.6, 880.0, 932.3, 987.8, // C5 to B5
+  1047, 1109, 1175, 1245, 1319, 1397, 1480, 1568, 1661, 1760, 1865, 1976, // C6 to B6
+  2093, 2217, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951, // C7 to B7
+  4186 // C8
+};
+
+const char* const noteNames[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+
+const NoteInfo NO_NOTE = {0, 0, 0, "---"};
+
+// MIDI number of the first table entry (C0)
+static const int MIDI_C0 = 12;
+
+// True if frequency is proportionally closer to candidate than to current.
+// Cross-multiplied form of |f - c| / c < |f - b| / b, so no division.
+static bool closerByPercent(double frequency, int candidate, int current) {
+  double c = NOTE_FREQUENCIES[candidate];
+  double b = NOTE_FREQUENCIES[current];
+  return fabs(frequency - c) * b < fabs(frequency - b) * c;
+}
+
+NoteInfo mapFrequencyToNote(float frequency) {
+  if (!(frequency > 0)) {
+    return NO_NOTE;
+  }
+
+  // Fractional MIDI note number relative to A4 = 440 Hz
+  float semitone = 69.0f + 12.0f * log2f(frequency / 440.0f);
+  int index = (int)lroundf(semitone) - MIDI_C0;
+  if (index < -2 || index > NOTE_TABLE_SIZE + 1) {
+    return NO_NOTE;
+  }
+  if (index < 0) index = 0;
+  if (index >= NOTE_TABLE_SIZE) index = NOTE_TABLE_SIZE - 1;
+
+  // The table is rounded and picks by percentage, not log distance, so the
+  // answer can differ from the rounded semitone by one near a boundary. Ties
+  // go to the lower note, as the old first-match scan did.
+  double freq = frequency;
+  int closest = index;
+  if (index > 0 && !closerByPercent(freq, closest, index - 1)) {
+    closest = index - 1;
+  }
+  if (index + 1 < NOTE_TABLE_SIZE && closerByPercent(freq, index + 1, closest)) {
+    closest = index + 1;
+  }
+
+  // Only accept the match if it's within 10% of a known frequency
+  if (fabs(freq - NOTE_FREQUENCIES[closest]) >= 0.1 * NOTE_FREQUENCIES[closest]) {
+    return NO_NOTE;
+  }
+
+  NoteInfo info;
+  info.midi = (uint8_t)(closest + MIDI_C0);
+  info.octave = (int8_t)(closest / 12);
+  info.name = noteNames[closest % 12];
+  long cents = lroundf((semitone - info.midi) * 100.0f);
+  info.cents = (int8_t)(cents > 127 ? 127 : (cents < -127 ? -127 : cents));
+  return info;
+}
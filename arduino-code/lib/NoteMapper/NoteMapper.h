@@ -0,0 +1,32 @@
+#ifndef NOTE_MAPPER_H
+#define NOTE_MAPPER_H
+
+#include <stdint.h>
+
+// Number of entries in NOTE_FREQUENCIES (C0 to C8)
+#define NOTE_TABLE_SIZE 97
+
+// Piano note frequency constants based on A4 = 440Hz standard tuning
+extern const double NOTE_FREQUENCIES[NOTE_TABLE_SIZE];
+extern const char* const noteNames[12];
+
+// Result of mapping a frequency to a note - no heap use, name points into
+// noteNames (or the "---" placeholder when there is no note)
+struct NoteInfo {
+  uint8_t midi;      // MIDI note number (C0 = 12, A4 = 69), 0 when no note
+  int8_t octave;     // Scientific pitch octave, 0 when no note
+  int8_t cents;      // Deviation from equal temperament, roughly -50..+50
+  const char* name;  // "C", "C#", ... "B", or "---"
+
+  bool valid() const { return midi != 0; }
+};
+
+extern const NoteInfo NO_NOTE;
+
+// Map a frequency to the nearest note in NOTE_FREQUENCIES, by the same
+// percentage-difference rule as the old linear scan, in constant time:
+// log2 gives the semitone directly and only its two neighbours are checked.
+// Returns NO_NOTE for frequencies outside C0..C8 or more than 10% off.
+NoteInfo mapFrequencyToNote(float frequency);
+
+#endif
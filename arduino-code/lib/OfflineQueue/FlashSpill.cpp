@@ -0,0 +1,157 @@
+#include "FlashSpill.h"
+#include <string.h>
+
+#ifdef ARDUINO_ARCH_SAMD
+#include <Arduino.h>
+
+static_assert(OFFLINE_QUEUE_FLASH_BYTES % 256 == 0, "OFFLINE_QUEUE_FLASH_BYTES must be whole 256-byte rows");
+
+// Reserved in the program flash. volatile so the compiler never assumes the
+// contents are still the zeros it was linked with.
+__attribute__((aligned(256)))
+static const volatile uint8_t spillArea[OFFLINE_QUEUE_FLASH_BYTES] = {0};
+
+static void waitNvmReady() {
+  while (!NVMCTRL->INTFLAG.bit.READY) {}
+}
+
+void FlashSpill::eraseRow(uint16_t firstPage) {
+  // The NVM cache could still hold the old contents of the row, so it's
+  // off while the row changes
+  bool cacheDisabled = NVMCTRL->CTRLB.bit.CACHEDIS;
+  NVMCTRL->CTRLB.bit.CACHEDIS = 1;
+  waitNvmReady();
+  NVMCTRL->STATUS.reg |= NVMCTRL_STATUS_MASK;  // Clear old errors
+  NVMCTRL->ADDR.reg = (uint32_t)(spillArea + (uint32_t)firstPage * PAGE_SIZE) / 2;  // 16-bit word address
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
+  waitNvmReady();
+  NVMCTRL->CTRLB.bit.CACHEDIS = cacheDisabled;
+  eraseCount++;
+}
+
+void FlashSpill::writePage(uint16_t page, const uint8_t* data, size_t length) {
+  bool cacheDisabled = NVMCTRL->CTRLB.bit.CACHEDIS;
+  NVMCTRL->CTRLB.bit.CACHEDIS = 1;
+  NVMCTRL->CTRLB.bit.MANW = 1;  // Write only on the explicit command below
+  waitNvmReady();
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_PBC;
+  waitNvmReady();
+
+  // The page buffer only takes 32-bit writes - pad the tail with erased bytes
+  volatile uint32_t* destination = (volatile uint32_t*)(spillArea + (uint32_t)page * PAGE_SIZE);
+  for (uint16_t word = 0; word < PAGE_SIZE / 4; word++) {
+    uint32_t value = 0xFFFFFFFF;
+    size_t offset = (size_t)word * 4;
+    if (offset < length) {
+      size_t count = length - offset < 4 ? length - offset : 4;
+      memcpy(&value, data + offset, count);
+    }
+    destination[word] = value;
+  }
+
+  NVMCTRL->ADDR.reg = (uint32_t)destination / 2;
+  NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_WP;
+  waitNvmReady();
+  NVMCTRL->CTRLB.bit.CACHEDIS = cacheDisabled;
+}
+
+const uint8_t* FlashSpill::pageAddress(uint16_t page) const {
+  return (const uint8_t*)spillArea + (uint32_t)page * PAGE_SIZE;
+}
+
+#else
+
+// Host stub - RAM that follows the flash rules: erase sets bytes to 0xFF and
+// writes can only clear bits
+static uint8_t spillArea[OFFLINE_QUEUE_FLASH_BYTES];
+
+void FlashSpill::eraseRow(uint16_t firstPage) {
+  memset(spillArea + (size_t)firstPage * PAGE_SIZE, 0xFF, (size_t)PAGE_SIZE * ROW_PAGES);
+  eraseCount++;
+}
+
+void FlashSpill::writePage(uint16_t page, const uint8_t* data, size_t length) {
+  uint8_t* destination = spillArea + (size_t)page * PAGE_SIZE;
+  for (size_t i = 0; i < length && i < PAGE_SIZE; i++) {
+    destination[i] &= data[i];
+  }
+}
+
+const uint8_t* FlashSpill::pageAddress(uint16_t page) const {
+  return spillArea + (size_t)page * PAGE_SIZE;
+}
+
+#endif
+
+FlashSpill::FlashSpill() : readPage(0), writePos(0), used(0), eraseCount(0) {
+}
+
+uint16_t FlashSpill::pagesFor(size_t length) {
+  return (uint16_t)((length + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+// Pages that can be written from writePos before reaching the row holding
+// the oldest unread page (that row can't be erased yet). skip is set to the
+// pages wasted at the end of the ring when needed pages don't fit there.
+uint16_t FlashSpill::freeContiguous(uint16_t& skip, uint16_t needed) const {
+  uint16_t available = PAGES;
+  if (used > 0) {
+    uint16_t readRow = readPage - readPage % ROW_PAGES;
+    available = (uint16_t)((readRow + PAGES - writePos) % PAGES);
+  }
+  skip = writePos + needed > PAGES ? (uint16_t)(PAGES - writePos) : 0;
+  return available;
+}
+
+bool FlashSpill::append(const uint8_t* data, size_t length, uint16_t& firstPage, uint16_t& pages) {
+  uint16_t needed = pagesFor(length);
+  if (needed == 0 || needed > PAGES) {
+    return false;
+  }
+
+  // Once everything is released, carry on from the next row instead of
+  // going back to the start - spreads the erases over the whole area
+  if (used == 0) {
+    writePos = (uint16_t)(((writePos + ROW_PAGES - 1) / ROW_PAGES * ROW_PAGES) % PAGES);
+    readPage = writePos;
+  }
+
+  uint16_t skip;
+  uint16_t available = freeContiguous(skip, needed);
+  if ((uint32_t)skip + needed > available) {
+    return false;
+  }
+
+  uint16_t start = (uint16_t)((writePos + skip) % PAGES);
+  for (uint16_t i = 0; i < needed; i++) {
+    uint16_t page = start + i;
+    if (page % ROW_PAGES == 0) {
+      eraseRow(page);
+    }
+    size_t offset = (size_t)i * PAGE_SIZE;
+    size_t chunk = length - offset < PAGE_SIZE ? length - offset : PAGE_SIZE;
+    writePage(page, data + offset, chunk);
+  }
+
+  firstPage = start;
+  pages = (uint16_t)(skip + needed);
+  writePos = (uint16_t)((start + needed) % PAGES);
+  used += pages;
+  return true;
+}
+
+void FlashSpill::release(uint16_t pages) {
+  if (pages > used) {
+    pages = used;
+  }
+  readPage = (uint16_t)((readPage + pages) % PAGES);
+  used -= pages;
+}
+
+uint16_t FlashSpill::usedPages() const {
+  return used;
+}
+
+uint32_t FlashSpill::rowErases() const {
+  return eraseCount;
+}
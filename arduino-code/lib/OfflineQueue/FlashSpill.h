@@ -0,0 +1,60 @@
+#ifndef FLASH_SPILL_H
+#define FLASH_SPILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the flash area reserved for spilled messages - a whole number of
+// rows (256 bytes on the SAMD21)
+#ifndef OFFLINE_QUEUE_FLASH_BYTES
+#define OFFLINE_QUEUE_FLASH_BYTES 16384
+#endif
+
+// Ring of flash pages for messages that don't fit in RAM.
+//
+// On the SAMD21 the area is a const array in the program flash, written
+// through NVMCTRL one 64-byte page at a time. A row (4 pages) is erased the
+// first time the write position enters it, so the ring only ever erases
+// rows that hold no unread data. Flash is memory mapped, so stored bytes are
+// read back in place through pageAddress().
+//
+// On any other platform this is a host stub backed by RAM that behaves the
+// same, including the erase-before-write rule.
+//
+// The ring positions live in RAM: the spill adds capacity during an outage,
+// it doesn't keep messages across a reset.
+class FlashSpill {
+public:
+  static const uint16_t PAGE_SIZE = 64;
+  static const uint16_t ROW_PAGES = 4;
+  static const uint16_t PAGES = OFFLINE_QUEUE_FLASH_BYTES / PAGE_SIZE;
+
+  FlashSpill();
+
+  // Store length bytes, starting on a fresh page. Sets firstPage and the
+  // number of pages consumed (including any skipped at the end of the ring,
+  // so release() of that count frees exactly this record). Returns false,
+  // writing nothing, if there isn't room.
+  bool append(const uint8_t* data, size_t length, uint16_t& firstPage, uint16_t& pages);
+
+  // Free the oldest `pages` pages - records are released in append order
+  void release(uint16_t pages);
+
+  const uint8_t* pageAddress(uint16_t page) const;
+  uint16_t usedPages() const;
+  uint32_t rowErases() const;  // Wear indicator
+
+  static uint16_t pagesFor(size_t length);
+
+private:
+  uint16_t freeContiguous(uint16_t& skip, uint16_t needed) const;
+  void eraseRow(uint16_t firstPage);
+  void writePage(uint16_t page, const uint8_t* data, size_t length);
+
+  uint16_t readPage;   // Oldest unreleased page
+  uint16_t writePos;   // Next page to write
+  uint16_t used;
+  uint32_t eraseCount;
+};
+
+#endif
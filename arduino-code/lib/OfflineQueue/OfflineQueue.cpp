@@ -0,0 +1,197 @@
+#include "OfflineQueue.h"
+#include <string.h>
+
+OfflineQueue::OfflineQueue()
+    : ramCount(0), ramBytes(0),
+#if OFFLINE_QUEUE_FLASH
+      flashHead(0), flashCount(0),
+#endif
+      droppedCount(0), backfilledCount(0), spilledCount(0) {
+}
+
+bool OfflineQueue::push(const char* topic, const uint8_t* payload, size_t length,
+                        uint32_t capturedMs, uint8_t priority) {
+  if (length == 0 || length > OFFLINE_QUEUE_RAM_BYTES) {
+    droppedCount++;
+    return false;
+  }
+
+  // Make room: older messages go to flash first, then the policy decides
+  while (ramCount == OFFLINE_QUEUE_RAM_ENTRIES || ramBytes + length > OFFLINE_QUEUE_RAM_BYTES) {
+    if (spillOldestRam()) {
+      continue;
+    }
+    if (!evictOne(priority)) {
+      droppedCount++;
+      return false;
+    }
+  }
+
+  RamEntry& entry = ram[ramCount++];
+  entry.capturedMs = capturedMs;
+  entry.topic = topic;
+  entry.offset = (uint16_t)ramBytes;
+  entry.length = (uint16_t)length;
+  entry.priority = priority;
+  memcpy(arena + ramBytes, payload, length);
+  ramBytes += length;
+  return true;
+}
+
+bool OfflineQueue::peek(QueuedMessage& message) const {
+#if OFFLINE_QUEUE_FLASH
+  // Flash always holds the older messages
+  if (flashCount > 0) {
+    const FlashEntry& entry = flash[flashHead];
+    message.topic = entry.topic;
+    message.payload = spill.pageAddress(entry.firstPage);
+    message.length = entry.length;
+    message.capturedMs = entry.capturedMs;
+    message.priority = entry.priority;
+    return true;
+  }
+#endif
+  if (ramCount == 0) {
+    return false;
+  }
+  const RamEntry& entry = ram[0];
+  message.topic = entry.topic;
+  message.payload = arena + entry.offset;
+  message.length = entry.length;
+  message.capturedMs = entry.capturedMs;
+  message.priority = entry.priority;
+  return true;
+}
+
+void OfflineQueue::pop() {
+#if OFFLINE_QUEUE_FLASH
+  if (flashCount > 0) {
+    removeFlash(0);
+    backfilledCount++;
+    return;
+  }
+#endif
+  if (ramCount > 0) {
+    removeRam(0);
+    backfilledCount++;
+  }
+}
+
+int OfflineQueue::size() const {
+#if OFFLINE_QUEUE_FLASH
+  return ramCount + flashCount;
+#else
+  return ramCount;
+#endif
+}
+
+bool OfflineQueue::empty() const {
+  return size() == 0;
+}
+
+uint32_t OfflineQueue::dropped() const {
+  return droppedCount;
+}
+
+uint32_t OfflineQueue::backfilled() const {
+  return backfilledCount;
+}
+
+uint32_t OfflineQueue::spilled() const {
+  return spilledCount;
+}
+
+void OfflineQueue::removeRam(int index) {
+  RamEntry removed = ram[index];
+  size_t tail = ramBytes - (removed.offset + removed.length);
+  memmove(arena + removed.offset, arena + removed.offset + removed.length, tail);
+  ramBytes -= removed.length;
+
+  for (int i = index; i < ramCount - 1; i++) {
+    ram[i] = ram[i + 1];
+    ram[i].offset -= removed.length;
+  }
+  ramCount--;
+}
+
+// Evict the oldest message of the lowest priority, if that priority is no
+// higher than maxPriority. Returns false if there is nothing to evict.
+bool OfflineQueue::evictOne(uint8_t maxPriority) {
+  for (int priority = 0; priority <= maxPriority; priority++) {
+#if OFFLINE_QUEUE_FLASH
+    // Flash entries are older than anything in RAM
+    for (int i = 0; i < flashCount; i++) {
+      if (flash[(flashHead + i) % OFFLINE_QUEUE_FLASH_ENTRIES].priority == priority) {
+        removeFlash(i);
+        droppedCount++;
+        return true;
+      }
+    }
+#endif
+    for (int i = 0; i < ramCount; i++) {
+      if (ram[i].priority == priority) {
+        removeRam(i);
+        droppedCount++;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+#if OFFLINE_QUEUE_FLASH
+
+bool OfflineQueue::spillOldestRam() {
+  if (ramCount == 0 || flashCount == OFFLINE_QUEUE_FLASH_ENTRIES) {
+    return false;
+  }
+
+  const RamEntry& oldest = ram[0];
+  uint16_t firstPage;
+  uint16_t pages;
+  if (!spill.append(arena + oldest.offset, oldest.length, firstPage, pages)) {
+    return false;
+  }
+
+  FlashEntry& entry = flash[(flashHead + flashCount) % OFFLINE_QUEUE_FLASH_ENTRIES];
+  entry.capturedMs = oldest.capturedMs;
+  entry.topic = oldest.topic;
+  entry.firstPage = firstPage;
+  entry.pages = pages;
+  entry.length = oldest.length;
+  entry.priority = oldest.priority;
+  flashCount++;
+  spilledCount++;
+
+  removeRam(0);
+  return true;
+}
+
+// The spill frees pages oldest first, so only the front entry gives its
+// pages back. One further back frees its slot at once and leaves its pages
+// to the entry before it - they go back when that one does, and the next
+// spill isn't refused for want of a slot after an eviction.
+void OfflineQueue::removeFlash(int index) {
+  if (index == 0) {
+    spill.release(flash[flashHead].pages);
+    flashHead = (flashHead + 1) % OFFLINE_QUEUE_FLASH_ENTRIES;
+    flashCount--;
+    return;
+  }
+
+  int slot = (flashHead + index) % OFFLINE_QUEUE_FLASH_ENTRIES;
+  int previous = (slot + OFFLINE_QUEUE_FLASH_ENTRIES - 1) % OFFLINE_QUEUE_FLASH_ENTRIES;
+  flash[previous].pages += flash[slot].pages;
+  for (int i = index; i < flashCount - 1; i++) {
+    flash[(flashHead + i) % OFFLINE_QUEUE_FLASH_ENTRIES] = flash[(flashHead + i + 1) % OFFLINE_QUEUE_FLASH_ENTRIES];
+  }
+  flashCount--;
+}
+
+#else
+
+bool OfflineQueue::spillOldestRam() {
+  return false;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef OFFLINE_QUEUE_H
+#define OFFLINE_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "FlashSpill.h"
+
+// RAM held for queued payloads, and the most messages held in RAM at once
+#ifndef OFFLINE_QUEUE_RAM_BYTES
+#define OFFLINE_QUEUE_RAM_BYTES 2048
+#endif
+#ifndef OFFLINE_QUEUE_RAM_ENTRIES
+#define OFFLINE_QUEUE_RAM_ENTRIES 16
+#endif
+
+// 1 = spill to the on-chip flash (FlashSpill) when RAM is full. Each spill
+// stalls the CPU for a few ms per page, so it is off by default.
+#ifndef OFFLINE_QUEUE_FLASH
+#define OFFLINE_QUEUE_FLASH 0
+#endif
+#ifndef OFFLINE_QUEUE_FLASH_ENTRIES
+#define OFFLINE_QUEUE_FLASH_ENTRIES 64
+#endif
+
+// What a message is worth keeping - higher survives longer when full
+enum MessagePriority : uint8_t {
+  PRIORITY_PRESENCE = 0,  // Idle presence / no-presence pings
+  PRIORITY_NOTES = 1      // Readings carrying notes that were played
+};
+
+// A queued message. payload stays valid until the next push() or pop().
+struct QueuedMessage {
+  const char* topic;  // Must point at storage that outlives the queue
+  const uint8_t* payload;
+  uint16_t length;
+  uint32_t capturedMs;  // millis() when the reading was taken
+  uint8_t priority;
+};
+
+// Bounded store-and-forward queue for messages that couldn't be published.
+//
+// Messages come out oldest first. When a new message doesn't fit, the oldest
+// spills to flash (with OFFLINE_QUEUE_FLASH) and otherwise the oldest message
+// of the lowest priority goes, as long as it isn't worth more than the new
+// one - if everything held is worth more, the new message is dropped
+// instead. Everything evicted or refused is counted in dropped().
+//
+// Nothing is allocated: RAM payloads are packed into one fixed arena and
+// compacted on removal.
+class OfflineQueue {
+public:
+  OfflineQueue();
+
+  // Store a copy of payload. Returns false if the message was dropped.
+  bool push(const char* topic, const uint8_t* payload, size_t length,
+            uint32_t capturedMs, uint8_t priority);
+
+  // Oldest message, false when empty
+  bool peek(QueuedMessage& message) const;
+
+  // Remove the message from peek() after it was sent - counted as backfilled
+  void pop();
+
+  int size() const;
+  bool empty() const;
+
+  uint32_t dropped() const;     // Evicted or refused
+  uint32_t backfilled() const;  // Sent late through pop()
+  uint32_t spilled() const;     // Moved to flash
+
+private:
+  struct RamEntry {
+    uint32_t capturedMs;
+    const char* topic;
+    uint16_t offset;
+    uint16_t length;
+    uint8_t priority;
+  };
+
+  void removeRam(int index);
+  bool evictOne(uint8_t maxPriority);
+  bool spillOldestRam();
+
+  uint8_t arena[OFFLINE_QUEUE_RAM_BYTES];
+  RamEntry ram[OFFLINE_QUEUE_RAM_ENTRIES];  // Oldest first
+  int ramCount;
+  size_t ramBytes;
+
+#if OFFLINE_QUEUE_FLASH
+  struct FlashEntry {
+    uint32_t capturedMs;
+    const char* topic;
+    uint16_t firstPage;
+    uint16_t pages;
+    uint16_t length;
+    uint8_t priority;
+  };
+
+  void removeFlash(int index);
+
+  FlashSpill spill;
+  FlashEntry flash[OFFLINE_QUEUE_FLASH_ENTRIES];  // Ring, oldest at flashHead
+  int flashHead;
+  int flashCount;
+#endif
+
+  uint32_t droppedCount;
+  uint32_t backfilledCount;
+  uint32_t spilledCount;
+};
+
+#endif
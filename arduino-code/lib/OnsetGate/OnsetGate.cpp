@@ -0,0 +1,73 @@
+#include "OnsetGate.h"
+
+OnsetGate::OnsetGate()
+    : valley(0), onsetMs(0), lastAnalysisMs(0), framesLeft(0), onsetPending(false),
+      onsetCount(0), analyzedCount(0), skippedCount(0) {
+}
+
+bool OnsetGate::update(int level, uint32_t nowMs) {
+  bool settling = onsetCount > 0 && nowMs - onsetMs < ONSET_REFRACTORY_MS;
+  if (settling) {
+    // Still on the attack ramp - the valley rides up to the peak
+    if (level > valley) {
+      valley = level;
+    }
+    return false;
+  }
+
+  if ((int32_t)level * 100 >= (int32_t)valley * ONSET_RISE_PERCENT &&
+      level >= valley + ONSET_MIN_RISE) {
+    trigger(nowMs);
+    valley = level;
+    return true;
+  }
+
+  if (level < valley) {
+    valley = level;
+  }
+  return false;
+}
+
+void OnsetGate::trigger(uint32_t nowMs) {
+  onsetMs = nowMs;
+  framesLeft = ONSET_FRAMES;
+  onsetPending = true;
+  onsetCount++;
+}
+
+void OnsetGate::requestAnalysis(uint8_t frames) {
+  if (frames > framesLeft) {
+    framesLeft = frames;
+  }
+}
+
+AnalysisDecision OnsetGate::decide(uint32_t nowMs) {
+  AnalysisDecision decision = ANALYSIS_SKIP;
+  if (framesLeft > 0) {
+    framesLeft--;
+    decision = onsetPending ? ANALYSIS_ONSET : ANALYSIS_REFRESH;
+    onsetPending = false;
+  } else if (nowMs - lastAnalysisMs >= ANALYSIS_REFRESH_MS) {
+    decision = ANALYSIS_REFRESH;
+  }
+
+  if (decision == ANALYSIS_SKIP) {
+    skippedCount++;
+  } else {
+    analyzedCount++;
+    lastAnalysisMs = nowMs;
+  }
+  return decision;
+}
+
+uint32_t OnsetGate::onsets() const {
+  return onsetCount;
+}
+
+uint32_t OnsetGate::analyzed() const {
+  return analyzedCount;
+}
+
+uint32_t OnsetGate::skipped() const {
+  return skippedCount;
+}
@@ -0,0 +1,87 @@
+#ifndef ONSET_GATE_H
+#define ONSET_GATE_H
+
+#include <stdint.h>
+
+// The level must rise to this percentage of the valley before it to count.
+// The smoothed level averages point samples, so it wobbles by tens of
+// percent on a steady tone - a doubling is a strike, a wobble isn't.
+#ifndef ONSET_RISE_PERCENT
+#define ONSET_RISE_PERCENT 200
+#endif
+
+// ...and by at least this much (mic level units, twice MIC_NOISE_FLOOR), so
+// noise isn't an onset
+#ifndef ONSET_MIN_RISE
+#define ONSET_MIN_RISE 50
+#endif
+
+// No new onset while the smoothed level is still climbing to its peak -
+// the mic smoothing window (10 readings, one per 10 ms sense tick) plus margin
+#ifndef ONSET_REFRACTORY_MS
+#define ONSET_REFRACTORY_MS 150
+#endif
+
+// Blocks analyzed back to back after an onset. The first one can straddle
+// the attack, the second hears the settled note.
+#ifndef ONSET_FRAMES
+#define ONSET_FRAMES 2
+#endif
+
+// While a note sustains or decays, re-check it this often
+#ifndef ANALYSIS_REFRESH_MS
+#define ANALYSIS_REFRESH_MS 250
+#endif
+
+// What to do with a capture block that is ready
+enum AnalysisDecision {
+  ANALYSIS_SKIP,     // Nothing new - keep the cached note, no FFT
+  ANALYSIS_ONSET,    // First block after an onset - a (re)struck note
+  ANALYSIS_REFRESH,  // Settling after an onset, or the periodic re-check
+};
+
+// Decides which capture blocks get the full FFT + pitch analysis.
+//
+// Onsets come from an energy rise on the smoothed mic level the firmware
+// already computes every sense tick, so detecting them costs a compare,
+// not a spectrum. The level's running minimum since the last onset (the
+// valley a decaying note leaves) is the reference: a rise to
+// ONSET_RISE_PERCENT of it, and by at least ONSET_MIN_RISE, is a new
+// strike. For ONSET_REFRACTORY_MS after an onset the valley follows the
+// level up instead, so one attack ramp is one onset.
+//
+// Blocks are analyzed for ONSET_FRAMES after an onset and then every
+// ANALYSIS_REFRESH_MS; the rest are skipped and counted.
+class OnsetGate {
+public:
+  OnsetGate();
+
+  // Feed the smoothed mic level once per sense tick. Returns true on an onset.
+  bool update(int level, uint32_t nowMs);
+
+  // Count an onset and analyze the next ONSET_FRAMES blocks
+  void trigger(uint32_t nowMs);
+
+  // Analyze the next frames blocks without calling it an onset - for when
+  // playing (re)starts and the cached note may be stale
+  void requestAnalysis(uint8_t frames = ONSET_FRAMES);
+
+  // Call once per ready block; counts the decision
+  AnalysisDecision decide(uint32_t nowMs);
+
+  uint32_t onsets() const;
+  uint32_t analyzed() const;  // Blocks that got the FFT
+  uint32_t skipped() const;   // Blocks left alone with the note cached
+
+private:
+  int valley;
+  uint32_t onsetMs;
+  uint32_t lastAnalysisMs;
+  uint8_t framesLeft;  // Back to back blocks still due after the onset
+  bool onsetPending;   // The next analyzed block is the onset one
+  uint32_t onsetCount;
+  uint32_t analyzedCount;
+  uint32_t skippedCount;
+};
+
+#endif
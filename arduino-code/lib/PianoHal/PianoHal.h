@@ -0,0 +1,113 @@
+#ifndef PIANO_HAL_H
+#define PIANO_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware abstraction for the piano firmware. The application in
+// src/main.cpp only talks to these interfaces; src/board/nano33 implements
+// them on the Nano 33 IoT and src/board/native on Linux for simulation.
+
+// Colour values for TextDisplay::setTextColor / fillRect (monochrome panel)
+#define DISPLAY_BLACK 0
+#define DISPLAY_WHITE 1
+
+// Monotonic time source
+class Clock {
+public:
+  virtual ~Clock() {}
+  virtual uint32_t millis() = 0;
+  virtual uint32_t micros() = 0;
+};
+
+// Block-based microphone capture at a fixed sample rate
+class MicSource {
+public:
+  virtual ~MicSource() {}
+  virtual bool begin(uint32_t sampleRate) = 0;
+
+  // Finished block of CAPTURE_SAMPLES raw 10-bit ADC readings, or nullptr if
+  // the next block isn't complete yet. Hand it back with releaseBlock().
+  virtual const int16_t* acquireBlock() = 0;
+  virtual void releaseBlock() = 0;
+
+  virtual int16_t latestSample() = 0;  // Newest raw reading, for level metering
+  virtual uint32_t sampleRate() = 0;
+
+  // Stop converting for low-power idle, and start again. The block that
+  // was filling comes out with a gap in it.
+  virtual void pause() {}
+  virtual void resume() {}
+};
+
+// Distance sensor (VL53L0X time of flight on the board)
+class DistanceSensor {
+public:
+  virtual ~DistanceSensor() {}
+  // Returns true and sets distanceMm only when a new measurement is ready
+  virtual bool read(int& distanceMm) = 0;
+
+  // Low-power watch: range only every periodMs and raise the wake
+  // interrupt as soon as something is closer than closerThanMm; read()
+  // reports nothing until resume(), except the range that raised it once
+  // woken(). Calling watch() again re-arms it. Returns false if the sensor
+  // can't, in which case keep polling read().
+  virtual bool watch(int closerThanMm, uint32_t periodMs) {
+    (void)closerThanMm;
+    (void)periodMs;
+    return false;
+  }
+
+  // Something came closer than the watch threshold since watch()
+  virtual bool woken() { return false; }
+
+  // Back to continuous ranging at the normal rate
+  virtual void resume() {}
+};
+
+// The subset of the Adafruit GFX text API the firmware draws with
+class TextDisplay {
+public:
+  virtual ~TextDisplay() {}
+  virtual void clearDisplay() = 0;
+  virtual void setTextSize(uint8_t size) = 0;
+  virtual void setTextColor(uint16_t color) = 0;
+  virtual void setCursor(int16_t x, int16_t y) = 0;
+  virtual void print(const char* text) = 0;
+  virtual void print(int value) = 0;
+  virtual void println(const char* text) = 0;
+  virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) = 0;
+  virtual void display() = 0;  // Push what changed since the last push to the panel
+};
+
+// Largest payload a Publisher must deliver whole. The board's publisher
+// streams it to the socket instead of going through ArduinoMqttClient's
+// 256-byte buffer; src/main.cpp checks every message it builds against it.
+#ifndef PUBLISH_MAX_PAYLOAD
+#define PUBLISH_MAX_PAYLOAD 2048
+#endif
+
+// Message transport (MQTT over WiFiNINA on the board)
+class Publisher {
+public:
+  virtual ~Publisher() {}
+  virtual bool connected() = 0;
+
+  // True only if the whole payload went out - a message that was cut short
+  // or is over PUBLISH_MAX_PAYLOAD returns false, so it can be queued
+  virtual bool publish(const char* topic, const uint8_t* payload, size_t length) = 0;
+
+  // Topic to subscribe to on every (re)connect
+  virtual void subscribe(const char* topic) { (void)topic; }
+
+  // Service incoming traffic / keepalive - called often
+  virtual void poll(uint32_t nowMs) { (void)nowMs; }
+
+  // One step of connection upkeep (reconnect etc.) - must not block for long
+  virtual void maintain(uint32_t nowMs) { (void)nowMs; }
+
+  // Radio power saving while little is sent (higher latency, link stays up)
+  virtual void setLowPower(bool enabled) { (void)enabled; }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "PianoStateMachine.h"
+
+// Which limits each state judges its inputs by
+struct StateLimits {
+  bool widenedBand;  // Presence band widened by distanceMarginMm
+  bool exitLevel;    // Playing threshold lowered to playExitPercent
+};
+
+static const StateLimits STATE_LIMITS[PIANO_STATES] = {
+  // NO_PRESENCE       PRESENCE_ONLY    PLAYING
+  {false, false},      {true, false},   {true, true},
+};
+
+// Next state for each state and input, and whether the move is an exit
+// that has to hold (presenceExitMs when the input is ABSENT, playExitMs
+// otherwise) before it is taken
+struct StateTransition {
+  PianoState next;
+  bool held;
+};
+
+static const StateTransition TRANSITIONS[PIANO_STATES][PIANO_INPUTS] = {
+  // ABSENT                        QUIET                           LOUD
+  {{STATE_NO_PRESENCE, false},     {STATE_PRESENCE_ONLY, false},   {STATE_PLAYING, false}},  // NO_PRESENCE
+  {{STATE_NO_PRESENCE, true},      {STATE_PRESENCE_ONLY, false},   {STATE_PLAYING, false}},  // PRESENCE_ONLY
+  {{STATE_NO_PRESENCE, true},      {STATE_PRESENCE_ONLY, true},    {STATE_PLAYING, false}},  // PLAYING
+};
+
+PianoStateMachine::PianoStateMachine() {
+  PianoStateConfig defaults = {75, 400, 25, 75, 500, 500, 10};
+  begin(defaults);
+}
+
+void PianoStateMachine::begin(const PianoStateConfig& config) {
+  this->config = config;
+  if (this->config.distanceWeight < 1) {
+    this->config.distanceWeight = 1;
+  }
+  distanceQ4 = 0;
+  seeded = false;
+  current = STATE_NO_PRESENCE;
+  pending = STATE_NO_PRESENCE;
+  pendingSinceMs = 0;
+  transitionCount = 0;
+  suppressedCount = 0;
+}
+
+void PianoStateMachine::addDistance(int distanceMm) {
+  int32_t readingQ4 = (int32_t)distanceMm << 4;
+  if (!seeded) {
+    distanceQ4 = readingQ4;
+    seeded = true;
+    return;
+  }
+  distanceQ4 += (readingQ4 - distanceQ4) / config.distanceWeight;
+}
+
+void PianoStateMachine::reseed() {
+  seeded = false;
+}
+
+int PianoStateMachine::distance() const {
+  return (int)((distanceQ4 + 8) >> 4);
+}
+
+PianoInput PianoStateMachine::classify(int level, int playThreshold) const {
+  const StateLimits& limits = STATE_LIMITS[current];
+  int margin = limits.widenedBand ? config.distanceMarginMm : 0;
+  int mm = distance();
+  if (mm < config.distanceMinMm - margin || mm > config.distanceMaxMm + margin) {
+    return INPUT_ABSENT;
+  }
+  int threshold = limits.exitLevel ? playThreshold * config.playExitPercent / 100 : playThreshold;
+  return level > threshold ? INPUT_LOUD : INPUT_QUIET;
+}
+
+PianoState PianoStateMachine::update(int level, int playThreshold, uint32_t nowMs) {
+  PianoInput input = classify(level, playThreshold);
+  const StateTransition& transition = TRANSITIONS[current][input];
+
+  if (transition.next == current) {
+    if (pending != current) {
+      suppressedCount++;  // An exit that didn't last
+    }
+    pending = current;
+    return current;
+  }
+
+  if (transition.held) {
+    if (pending != transition.next) {
+      pending = transition.next;
+      pendingSinceMs = nowMs;
+    }
+    uint32_t hold = input == INPUT_ABSENT ? config.presenceExitMs : config.playExitMs;
+    if (nowMs - pendingSinceMs < hold) {
+      return current;
+    }
+  }
+
+  current = transition.next;
+  pending = current;
+  transitionCount++;
+  return current;
+}
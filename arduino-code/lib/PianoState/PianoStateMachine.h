@@ -0,0 +1,85 @@
+#ifndef PIANO_STATE_MACHINE_H
+#define PIANO_STATE_MACHINE_H
+
+#include <stdint.h>
+
+// What is going on at the piano
+enum PianoState {
+  STATE_NO_PRESENCE,    // No one at piano
+  STATE_PRESENCE_ONLY,  // Someone at piano but not playing
+  STATE_PLAYING         // Someone at piano and playing
+};
+#define PIANO_STATES 3
+
+// What one sense tick's inputs say, after the current state's hysteresis
+enum PianoInput {
+  INPUT_ABSENT,  // Nobody in the presence band
+  INPUT_QUIET,   // Somebody there, level below the playing threshold
+  INPUT_LOUD     // Somebody there and playing
+};
+#define PIANO_INPUTS 3
+
+// Distance and level limits, with the margins that make leaving a state
+// harder than entering it
+struct PianoStateConfig {
+  int distanceMinMm;        // Presence band a newcomer has to be inside
+  int distanceMaxMm;
+  int distanceMarginMm;     // Someone present stays so this far outside the band
+  int playExitPercent;      // Playing stops below this percentage of the threshold
+  uint16_t presenceExitMs;  // How long the inputs must say "gone" before it counts
+  uint16_t playExitMs;      // ...and "quiet" before playing stops
+  uint8_t distanceWeight;   // Each ToF reading moves the smoothed distance 1/weight of the way
+};
+
+// Presence and playing state from the ToF distance and the smoothed mic
+// level, integer only.
+//
+// The distance is smoothed by an exponential average in 1/16 mm, so it
+// neither truncates towards zero nor drifts the way an int of a float
+// average does. Each tick, the current state's row of a small table picks
+// the limits the inputs are judged by: a state that already has presence
+// keeps it over the band widened by distanceMarginMm, one that is playing
+// keeps playing down to playExitPercent of the threshold. The resulting
+// input selects the transition, and a transition out of presence or
+// playing has to hold for its exit time first - so someone sitting right
+// at the edge of the band, or a note fading around the threshold, no
+// longer flaps the state.
+class PianoStateMachine {
+public:
+  PianoStateMachine();
+
+  void begin(const PianoStateConfig& config);
+
+  // A new ToF reading. The first one after reseed() replaces the average.
+  void addDistance(int distanceMm);
+
+  // Let the next reading replace the smoothed distance (after a wake)
+  void reseed();
+
+  // One sense tick: the smoothed mic level and the current playing
+  // threshold. Returns the (possibly new) state.
+  PianoState update(int level, int playThreshold, uint32_t nowMs);
+
+  PianoState state() const { return current; }
+  int distance() const;  // Smoothed, whole mm
+  bool present() const { return current != STATE_NO_PRESENCE; }
+  bool playing() const { return current == STATE_PLAYING; }
+
+  // Transitions taken, and ones that didn't hold long enough to be taken
+  uint32_t transitions() const { return transitionCount; }
+  uint32_t suppressed() const { return suppressedCount; }
+
+private:
+  PianoInput classify(int level, int playThreshold) const;
+
+  PianoStateConfig config;
+  int32_t distanceQ4;  // Smoothed distance * 16
+  bool seeded;
+  PianoState current;
+  PianoState pending;      // Where the inputs point, while its exit time runs
+  uint32_t pendingSinceMs;
+  uint32_t transitionCount;
+  uint32_t suppressedCount;
+};
+
+#endif
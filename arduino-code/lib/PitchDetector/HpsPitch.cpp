@@ -0,0 +1,12 @@
+#include "HpsPitch.h"
+
+PitchEstimate HpsPitch::estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate,
+                                      int firstBin) {
+  HpsPeak peak = spectrum.harmonicProductPeak(HARMONICS, firstBin);
+  PitchEstimate estimate = {0, 0};
+  if (peak.value > 0) {
+    estimate.frequencyQ4 = binToFrequencyQ4((uint32_t)peak.bin << 8, sampleRate, FixedSpectrum::SAMPLES);
+    estimate.strength = peak.value;
+  }
+  return estimate;
+}
@@ -0,0 +1,31 @@
+#ifndef HPS_PITCH_H
+#define HPS_PITCH_H
+
+#include "PitchDetector.h"
+
+// Harmonic product spectrum - the firmware's original method. The product
+// of the magnitudes at k, 2k and 3k peaks at the fundamental even when an
+// overtone is louder, but the answer is a whole bin: about 39 Hz at 5 kHz
+// and 128 samples, which is several semitones below C4.
+//
+// strength is the HPS product itself, as in the double path, so a
+// threshold on it is a bin threshold to the power of HARMONICS.
+class HpsPitch : public PitchDetector<HpsPitch> {
+public:
+  // Harmonics multiplied into the product
+  static const int HARMONICS = 3;
+
+  static const char* name() { return "hps"; }
+
+  static uint64_t scaleThreshold(uint64_t binThreshold) {
+    uint64_t threshold = 1;
+    for (int i = 0; i < HARMONICS; i++) {
+      threshold *= binThreshold;
+    }
+    return threshold;
+  }
+
+  PitchEstimate estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate, int firstBin);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "InterpolatedPitch.h"
+
+// A sub-harmonic takes over when it is at least 1/4 (-12 dB) of the peak
+static const int SUBHARMONIC_SHIFT = 2;
+
+// The local maximum within one bin of target, or -1
+static int peakNear(const uint16_t* magnitude, int target, int firstBin) {
+  int best = -1;
+  for (int i = target - 1; i <= target + 1; i++) {
+    if (i < firstBin || i < 1 || i >= FixedSpectrum::BINS - 1) {
+      continue;
+    }
+    if (magnitude[i] > magnitude[i - 1] && magnitude[i] >= magnitude[i + 1] &&
+        (best < 0 || magnitude[i] > magnitude[best])) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+PitchEstimate InterpolatedPitch::estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate,
+                                               int firstBin) {
+  const uint16_t* magnitude = spectrum.magnitudes();
+  const int bins = FixedSpectrum::BINS;
+  PitchEstimate estimate = {0, 0};
+  if (firstBin < 1) {
+    firstBin = 1;
+  }
+
+  int strongest = -1;
+  for (int i = firstBin; i < bins - 1; i++) {
+    if (strongest < 0 || magnitude[i] > magnitude[strongest]) {
+      strongest = i;
+    }
+  }
+  if (strongest < 0 || magnitude[strongest] == 0) {
+    return estimate;
+  }
+
+  // Lowest sub-harmonic that is a real peak wins
+  int fundamental = strongest;
+  for (int divisor = 3; divisor >= 2; divisor--) {
+    int candidate = peakNear(magnitude, (strongest + divisor / 2) / divisor, firstBin);
+    if (candidate >= 0 && magnitude[candidate] >= magnitude[strongest] >> SUBHARMONIC_SHIFT) {
+      fundamental = candidate;
+      break;
+    }
+  }
+
+  // Weighted average of each harmonic's interpolated position / h
+  uint64_t weightedSum = 0;
+  uint64_t weightTotal = 0;
+  for (int h = 1; h <= INTERPOLATED_PITCH_HARMONICS; h++) {
+    int bin = h == 1 ? fundamental : peakNear(magnitude, fundamental * h, firstBin);
+    if (bin < 0) {
+      continue;
+    }
+    uint32_t positionQ8 =
+        ((uint32_t)bin << 8) + parabolicOffsetQ8(magnitude[bin - 1], magnitude[bin], magnitude[bin + 1]);
+    uint32_t weight = (uint32_t)magnitude[bin] * h;
+    weightedSum += (uint64_t)positionQ8 * weight / h;
+    weightTotal += weight;
+  }
+
+  uint32_t positionQ8 = (uint32_t)((weightedSum + weightTotal / 2) / weightTotal);
+  estimate.frequencyQ4 = binToFrequencyQ4(positionQ8, sampleRate, FixedSpectrum::SAMPLES);
+  estimate.strength = spectrum.inputUnits(magnitude[strongest]);
+  return estimate;
+}
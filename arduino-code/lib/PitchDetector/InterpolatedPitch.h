@@ -0,0 +1,30 @@
+#ifndef INTERPOLATED_PITCH_H
+#define INTERPOLATED_PITCH_H
+
+#include "PitchDetector.h"
+
+// Harmonics that contribute a position estimate
+#ifndef INTERPOLATED_PITCH_HARMONICS
+#define INTERPOLATED_PITCH_HARMONICS 4
+#endif
+
+// Quadratic peak interpolation on the FFT.
+//
+//  1. Take the strongest bin, then fall back to a sub-harmonic (1/2, 1/3)
+//     when that is a peak within 12 dB of it, so a loud overtone does not
+//     read an octave or a twelfth high.
+//  2. Fit a parabola through each harmonic's peak bin and its neighbours to
+//     place it to 1/256 bin.
+//  3. Harmonic h pins the fundamental h times more finely, so the
+//     fundamental is the average of position/h over the harmonics found,
+//     weighted by magnitude * h.
+//
+// strength is the magnitude of the strongest bin.
+class InterpolatedPitch : public PitchDetector<InterpolatedPitch> {
+public:
+  static const char* name() { return "interpolated"; }
+
+  PitchEstimate estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate, int firstBin);
+};
+
+#endif
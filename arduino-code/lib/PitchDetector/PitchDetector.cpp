@@ -0,0 +1,19 @@
+#include "PitchDetector.h"
+
+int32_t parabolicOffsetQ8(int32_t left, int32_t centre, int32_t right) {
+  int32_t curvature = left - 2 * centre + right;  // < 0 at a maximum, > 0 at a minimum
+  if (curvature == 0) {
+    return 0;
+  }
+  int32_t offset = (int32_t)((int64_t)128 * (left - right) / curvature);
+  if (offset > 128) offset = 128;
+  if (offset < -128) offset = -128;
+  return offset;
+}
+
+uint32_t binToFrequencyQ4(uint32_t positionQ8, uint32_t sampleRate, int samples) {
+  // Hz * 16 = position / 256 * rate / samples * 16
+  uint64_t scaled = (uint64_t)positionQ8 * sampleRate;
+  uint32_t divisor = (uint32_t)samples * 16;
+  return (uint32_t)((scaled + divisor / 2) / divisor);
+}
@@ -0,0 +1,77 @@
+#ifndef PITCH_DETECTOR_H
+#define PITCH_DETECTOR_H
+
+#include <stdint.h>
+#include "FixedSpectrum.h"
+
+// Result of one pitch estimate
+struct PitchEstimate {
+  uint32_t frequencyQ4;  // Hz * 16, 0 when the frame has no pitch
+  uint64_t strength;     // Peak level in the double path's units (raw ADC
+                         // counts through the window), 0 when unvoiced -
+                         // one bin, or a product of bins (see below)
+
+  bool valid() const { return frequencyQ4 != 0; }
+};
+
+// Compile-time pitch detector interface (CRTP). An engine derives from
+// PitchDetector<Engine> and provides
+//
+//   PitchEstimate estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate, int firstBin);
+//   static const char* name();
+//
+// and, if it needs the time-domain samples, shadows loadBlock(). An engine
+// whose strength isn't one bin's magnitude also shadows scaleThreshold().
+//
+// Strength thresholds (MIC_MIN_THRESHOLD in src/main.cpp) are given for
+// one spectrum bin. The interpolated and YIN engines report the strongest
+// bin, so they use the threshold as it is. HPS reports the product of its
+// harmonics' bins, so for HPS it is raised to the power of their number,
+// as if every bin of the product were at the threshold. Go through
+// strengthThreshold() rather than comparing strength to a level directly. Calls are
+// resolved at compile time, so there is no vtable and an engine nobody
+// instantiates is never linked in.
+//
+// Per frame the caller does:
+//   detector.load(block, dcOffset);   // before handing the block back
+//   spectrum.compute(); spectrum.complexToMagnitude();
+//   PitchEstimate pitch = detector.estimate(spectrum, rate, firstBin);
+template <class Engine>
+class PitchDetector {
+public:
+  void load(const int16_t* raw, int16_t dcOffset) {
+    static_cast<Engine*>(this)->loadBlock(raw, dcOffset);
+  }
+
+  // firstBin skips DC and rumble, as in harmonicProductPeak()
+  PitchEstimate estimate(const FixedSpectrum& spectrum, uint32_t sampleRate, int firstBin) {
+    return static_cast<Engine*>(this)->estimatePitch(spectrum, sampleRate, firstBin);
+  }
+
+  // The strength threshold in this engine's units for binThreshold, a
+  // threshold on one bin's magnitude
+  static uint64_t strengthThreshold(uint64_t binThreshold) {
+    return Engine::scaleThreshold(binThreshold);
+  }
+
+  // Strength is one bin's magnitude
+  static uint64_t scaleThreshold(uint64_t binThreshold) {
+    return binThreshold;
+  }
+
+protected:
+  // Spectral engines work on the magnitudes alone
+  void loadBlock(const int16_t* raw, int16_t dcOffset) {
+    (void)raw;
+    (void)dcOffset;
+  }
+};
+
+// Offset of a peak from its centre sample in 1/256 of a step, from the
+// parabola through the sample and its neighbours. Clamped to half a step.
+int32_t parabolicOffsetQ8(int32_t left, int32_t centre, int32_t right);
+
+// Frequency in Hz * 16 of a spectrum position given in 1/256 bin
+uint32_t binToFrequencyQ4(uint32_t positionQ8, uint32_t sampleRate, int samples);
+
+#endif
@@ -0,0 +1,216 @@
+#include "YinPitch.h"
+
+// Same input scaling as FixedSpectrum::loadBlock(): 10-bit readings at
+// +-16384, half of Q15 full scale
+static const int INPUT_SHIFT = 5;
+
+// Shortest lag searched - 2 samples is half the sample rate
+static const int MIN_LAG = 2;
+
+// Periods shorter than this many samples are checked against the spectrum
+// for a dip found at a multiple of them (up to MAX_MULTIPLE)
+static const int SHORT_PERIOD = 8;
+static const int MAX_MULTIPLE = 4;
+
+static int log2Of(int value) {
+  int bits = 0;
+  while ((1 << bits) < value) {
+    bits++;
+  }
+  return bits;
+}
+
+void YinPitch::loadBlock(const int16_t* raw, int16_t dcOffset) {
+  for (int i = 0; i < SAMPLES; i++) {
+    samples[i] = (int16_t)(raw[i] - dcOffset);
+  }
+}
+
+// 4 conj(A[k]) B[k] from the packed transform Z = A + jB of two real
+// inputs: 2A[k] = Z[k] + conj(Z[N-k]), 2B[k] = -j(Z[k] - conj(Z[N-k]))
+static void crossSpectrum(const int16_t* re, const int16_t* im, int k, int64_t* cr, int64_t* ci) {
+  const int size = YinPitch::SAMPLES;
+  int k2 = (size - k) & (size - 1);
+  int32_t ar = (int32_t)re[k] + re[k2];
+  int32_t ai = (int32_t)im[k] - im[k2];
+  int32_t br = (int32_t)im[k] + im[k2];
+  int32_t bi = (int32_t)re[k2] - re[k];
+  *cr = (int64_t)ar * br + (int64_t)ai * bi;
+  *ci = (int64_t)ar * bi - (int64_t)ai * br;
+}
+
+// Larger of the two bins either side of frequencyQ4, 0 out of range
+static uint16_t magnitudeAt(const uint16_t* magnitude, uint32_t frequencyQ4, uint32_t sampleRate) {
+  uint32_t bin = (uint32_t)((uint64_t)frequencyQ4 * FixedSpectrum::SAMPLES / (sampleRate * 16));
+  if (bin + 1 >= (uint32_t)FixedSpectrum::BINS) {
+    return 0;
+  }
+  return magnitude[bin] > magnitude[bin + 1] ? magnitude[bin] : magnitude[bin + 1];
+}
+
+int64_t YinPitch::difference(int lag) const {
+  int64_t sum = 0;
+  for (int j = 0; j < WINDOW; j++) {
+    int32_t delta = samples[j] - samples[j + lag];
+    sum += delta * delta;
+  }
+  return sum;
+}
+
+int YinPitch::correlate(const FixedSpectrum& spectrum) {
+  // a = the first W samples (zero padded), b = all of them. With |a| = W
+  // and lags below W the circular correlation never wraps, so N points do.
+  for (int i = 0; i < SAMPLES; i++) {
+    int16_t value = (int16_t)(samples[i] << INPUT_SHIFT);
+    re[i] = i < WINDOW ? value : 0;
+    im[i] = value;
+  }
+  int forwardExponent = spectrum.transform(re, im);
+
+  // The cross spectrum conj(A) B is Hermitian, so each pair (k, N-k)
+  // gives both of its bins. First pass only finds the scale that keeps it
+  // in Q15, the second writes it over Z.
+  uint64_t largest = 0;
+  for (int k = 0; k <= SAMPLES / 2; k++) {
+    int64_t cr;
+    int64_t ci;
+    crossSpectrum(re, im, k, &cr, &ci);
+    uint64_t absR = cr < 0 ? -cr : cr;
+    uint64_t absI = ci < 0 ? -ci : ci;
+    if (absR > largest) largest = absR;
+    if (absI > largest) largest = absI;
+  }
+  int crossShift = 0;
+  while ((largest >> crossShift) > 32767) {
+    crossShift++;
+  }
+  for (int k = 0; k <= SAMPLES / 2; k++) {
+    int64_t cr;
+    int64_t ci;
+    crossSpectrum(re, im, k, &cr, &ci);
+    // Stored conjugated, ready for the inverse-by-forward-FFT below
+    int k2 = (SAMPLES - k) & (SAMPLES - 1);
+    re[k] = (int16_t)(cr >> crossShift);
+    im[k] = (int16_t)(-(ci >> crossShift));
+    re[k2] = re[k];
+    im[k2] = (int16_t)(ci >> crossShift);
+  }
+
+  // r = IFFT(C) = conj(FFT(conj(C))) / N, and r is real
+  int inverseExponent = spectrum.transform(re, im);
+
+  // Undo: the two forward exponents, the cross-spectrum shift and its
+  // factor of 4, the 1/N of the inverse and INPUT_SHIFT on both inputs
+  return inverseExponent + crossShift + 2 * forwardExponent - 2 - log2Of(SAMPLES) -
+         2 * INPUT_SHIFT;
+}
+
+PitchEstimate YinPitch::estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate,
+                                      int firstBin) {
+  PitchEstimate estimate = {0, 0};
+
+  int64_t energy0 = 0;
+  for (int j = 0; j < WINDOW; j++) {
+    energy0 += (int32_t)samples[j] * samples[j];
+  }
+  if (energy0 == 0) {
+    return estimate;
+  }
+
+  int scale = correlate(spectrum);
+
+  // Walk the lags with the running energy e(t) and the cumulative sum of
+  // d(); d'(t) = d(t) * t / sum is kept in Q16
+  int64_t energyLag = energy0;
+  uint64_t cumulative = 0;
+  int chosen = -1;
+  uint32_t chosenValue = 0;
+  int best = -1;
+  uint32_t bestValue = 0;
+  for (int lag = 1; lag < WINDOW; lag++) {
+    int32_t leaving = samples[lag - 1];
+    int32_t entering = samples[lag - 1 + WINDOW];
+    energyLag += entering * entering - leaving * leaving;
+
+    int64_t cross = scale >= 0 ? (int64_t)re[lag] << scale : (int64_t)re[lag] >> -scale;
+    int64_t d = energy0 + energyLag - 2 * cross;
+    if (d < 0) {
+      d = 0;
+    }
+    cumulative += d;
+    if (cumulative == 0 || lag < MIN_LAG) {
+      continue;
+    }
+    uint32_t value = (uint32_t)(((uint64_t)d * lag << 16) / cumulative);
+
+    if (chosen >= 0) {
+      // Follow the dip down to its bottom, then stop
+      if (value >= chosenValue) {
+        break;
+      }
+      chosen = lag;
+      chosenValue = value;
+      continue;
+    }
+    if (value * 100 < ((uint32_t)YIN_THRESHOLD_PERCENT << 16)) {
+      chosen = lag;
+      chosenValue = value;
+    }
+    if (best < 0 || value < bestValue) {
+      best = lag;
+      bestValue = value;
+    }
+  }
+
+  // Nothing under the threshold: the deepest dip, if it is periodic enough
+  if (chosen < 0) {
+    if (best < 0 || bestValue * 100 >= ((uint32_t)YIN_UNVOICED_PERCENT << 16)) {
+      return estimate;
+    }
+    chosen = best;
+  }
+
+  // Whole-sample lags are coarse - refine on the exact d() around the dip
+  int32_t offset = 0;
+  if (chosen + 1 <= SAMPLES - WINDOW) {
+    int64_t left = difference(chosen - 1);
+    int64_t centre = difference(chosen);
+    int64_t right = difference(chosen + 1);
+    // Scaled into 32 bits for the parabola, only the ratios matter
+    while (left > 0x3FFFFF || centre > 0x3FFFFF || right > 0x3FFFFF) {
+      left >>= 1;
+      centre >>= 1;
+      right >>= 1;
+    }
+    offset = parabolicOffsetQ8((int32_t)left, (int32_t)centre, (int32_t)right);
+  }
+  uint32_t lagQ8 = ((uint32_t)chosen << 8) + offset;
+  estimate.frequencyQ4 = (uint32_t)(((uint64_t)sampleRate * 4096 + lagQ8 / 2) / lagQ8);
+
+  // Level from the spectrum, as the other engines report it
+  const uint16_t* magnitude = spectrum.magnitudes();
+  uint16_t strongest = 0;
+  for (int i = firstBin < 1 ? 1 : firstBin; i < FixedSpectrum::BINS; i++) {
+    if (magnitude[i] > strongest) {
+      strongest = magnitude[i];
+    }
+  }
+  estimate.strength = spectrum.inputUnits(strongest);
+
+  // A period of a few samples falls between whole lags, so its own dip can
+  // stay above the threshold while the one at two or three periods lands
+  // on a whole lag - an octave or a twelfth low. The spectrum tells them
+  // apart: next to nothing at the estimate, a strong peak at a multiple.
+  if (magnitudeAt(magnitude, estimate.frequencyQ4, sampleRate) * 8 < strongest) {
+    for (int k = 2; k <= MAX_MULTIPLE; k++) {
+      if (chosen < k * MIN_LAG || chosen >= k * SHORT_PERIOD) {
+        continue;
+      }
+      if (magnitudeAt(magnitude, estimate.frequencyQ4 * k, sampleRate) * 2 >= strongest) {
+        estimate.frequencyQ4 *= k;
+        break;
+      }
+    }
+  }
+  return estimate;
+}
@@ -0,0 +1,56 @@
+#ifndef YIN_PITCH_H
+#define YIN_PITCH_H
+
+#include "PitchDetector.h"
+
+// Cumulative mean normalized difference below which a lag counts as the
+// period, in percent (the YIN paper's absolute threshold)
+#ifndef YIN_THRESHOLD_PERCENT
+#define YIN_THRESHOLD_PERCENT 15
+#endif
+
+// Frames whose best lag is above this are unvoiced, in percent
+#ifndef YIN_UNVOICED_PERCENT
+#define YIN_UNVOICED_PERCENT 40
+#endif
+
+// YIN (de Cheveigne & Kawahara) on the time-domain block, integer only.
+//
+// The difference function d(t) = sum over j < W of (x[j] - x[j+t])^2 with
+// W = SAMPLES/2 expands to e(0) + e(t) - 2 r(t). The energies are running
+// sums; the cross term r(t) for every lag at once is a correlation, done
+// with FixedSpectrum::transform(): both real inputs packed into one complex
+// FFT, the cross spectrum, and one inverse FFT. That is O(N log N) instead
+// of O(N^2), which pays off as FIXED_SPECTRUM_SAMPLES grows. The chosen lag
+// is then refined with the exact d() of it and its neighbours and a
+// parabola, since whole-sample lags are coarse (A4 sits between 11 and 12).
+//
+// The lag range is 2..W-1, so at 5 kHz and 128 samples it covers about
+// 80 Hz to 2.5 kHz - an octave lower than the HPS can reach.
+//
+// strength is the magnitude of the strongest spectrum bin.
+class YinPitch : public PitchDetector<YinPitch> {
+public:
+  static const int SAMPLES = FixedSpectrum::SAMPLES;
+  static const int WINDOW = SAMPLES / 2;
+
+  static const char* name() { return "yin"; }
+
+  // Keeps a copy of the block (the DMA gets it back right after)
+  void loadBlock(const int16_t* raw, int16_t dcOffset);
+
+  PitchEstimate estimatePitch(const FixedSpectrum& spectrum, uint32_t sampleRate, int firstBin);
+
+private:
+  // Exact d(lag) straight from the samples
+  int64_t difference(int lag) const;
+
+  // r(t) for t < WINDOW into re[], returns its shift to true units
+  int correlate(const FixedSpectrum& spectrum);
+
+  int16_t samples[SAMPLES];  // DC removed, raw ADC counts
+  int16_t re[SAMPLES];       // FFT work buffers
+  int16_t im[SAMPLES];
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "PracticeSession.h"
+#include "JsonWriter.h"
+
+PracticeSession::PracticeSession() {
+  begin(20000);
+}
+
+void PracticeSession::begin(uint32_t endTimeoutMs) {
+  endTimeout = endTimeoutMs;
+  open = false;
+  clear(0);
+}
+
+void PracticeSession::clear(uint32_t nowMs) {
+  wasPresent = false;
+  wasPlaying = false;
+  lastUpdateMs = nowMs;
+  start = nowMs;
+  lastPresentMs = nowMs;
+  playing = 0;
+  idle = 0;
+  away = 0;
+  absent = 0;
+  noteCount = 0;
+  for (int i = 0; i < 12; i++) {
+    pitchClasses[i] = 0;
+  }
+  for (int i = 0; i < SESSION_OCTAVES; i++) {
+    octaves[i] = 0;
+  }
+  volumes.reset();
+}
+
+SessionEvent PracticeSession::update(bool present, bool playingNow, int volume, uint32_t nowMs) {
+  if (!open) {
+    if (!present) {
+      return SESSION_NONE;
+    }
+    clear(nowMs);
+    open = true;
+    wasPresent = true;
+    wasPlaying = playingNow;
+    return SESSION_STARTED;
+  }
+
+  // The time since the last update belongs to the state it reported. An
+  // absence only counts once somebody comes back - the last one, which
+  // ends the session, isn't part of it.
+  uint32_t elapsed = nowMs - lastUpdateMs;
+  lastUpdateMs = nowMs;
+  if (!wasPresent) {
+    absent += elapsed;
+  } else if (wasPlaying) {
+    playing += elapsed;
+  } else {
+    idle += elapsed;
+  }
+  if (present) {
+    away += absent;
+    absent = 0;
+    lastPresentMs = nowMs;
+  }
+  wasPresent = present;
+  wasPlaying = present && playingNow;
+
+  if (wasPlaying) {
+    volumes.add((uint16_t)(volume < 0 ? 0 : volume > UINT16_MAX ? UINT16_MAX : volume));
+  }
+  if (!present && nowMs - lastPresentMs >= endTimeout) {
+    open = false;
+    return SESSION_ENDED;
+  }
+  return SESSION_NONE;
+}
+
+void PracticeSession::addNote(uint8_t midi) {
+  if (!open || midi < 12) {
+    return;
+  }
+  noteCount++;
+  pitchClasses[midi % 12]++;
+  int octave = midi / 12 - 1;
+  octaves[octave < SESSION_OCTAVES ? octave : SESSION_OCTAVES - 1]++;
+}
+
+uint32_t PracticeSession::notesPerMinuteX10() const {
+  if (playing == 0) {
+    return 0;
+  }
+  return (uint32_t)(((uint64_t)noteCount * 600000 + playing / 2) / playing);
+}
+
+static void appendCounts(JsonWriter& json, const char* name, const uint32_t* counts, int size) {
+  json.append(name);
+  json.append('[');
+  for (int i = 0; i < size; i++) {
+    if (i > 0) {
+      json.append(',');
+    }
+    json.appendUint(counts[i]);
+  }
+  json.append(']');
+}
+
+size_t writeSessionJson(char* buffer, size_t size, const PracticeSession& session, uint32_t uptimeMs) {
+  if (size == 0) {
+    return 0;
+  }
+  uint32_t rate = session.notesPerMinuteX10();
+  const QuantileSketch& volume = session.volume();
+
+  JsonWriter json = {buffer, size, 0, false};
+  json.append("{\"uptime\":");
+  json.appendUint(uptimeMs);
+  json.append(",\"start\":");
+  json.appendUint(session.startMs());
+  json.append(",\"end\":");
+  json.appendUint(session.endMs());
+  json.append(",\"duration_s\":");
+  json.appendUint((session.durationMs() + 500) / 1000);
+  json.append(",\"playing_s\":");
+  json.appendUint((session.playingMs() + 500) / 1000);
+  json.append(",\"idle_s\":");
+  json.appendUint((session.idleMs() + 500) / 1000);
+  json.append(",\"away_s\":");
+  json.appendUint((session.awayMs() + 500) / 1000);
+  json.append(",\"notes\":");
+  json.appendUint(session.notes());
+  json.append(",\"notes_per_min\":");
+  json.appendUint(rate / 10);
+  json.append('.');
+  json.appendUint(rate % 10);
+  appendCounts(json, ",\"pitch_classes\":", session.pitchClassCounts(), 12);
+  appendCounts(json, ",\"octaves\":", session.octaveCounts(), SESSION_OCTAVES);
+  json.append(",\"volume\":{\"n\":");
+  json.appendUint(volume.count());
+  json.append(",\"p10\":");
+  json.appendUint(volume.quantile(100));
+  json.append(",\"p50\":");
+  json.appendUint(volume.quantile(500));
+  json.append(",\"p90\":");
+  json.appendUint(volume.quantile(900));
+  json.append(",\"max\":");
+  json.appendUint(volume.max());
+  json.append("}}");
+  return json.finish();
+}
@@ -0,0 +1,96 @@
+#ifndef PRACTICE_SESSION_H
+#define PRACTICE_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "QuantileSketch.h"
+
+// Octaves counted in the histogram: 0-8 covers the piano (A0 to C8)
+#define SESSION_OCTAVES 9
+
+// Numbers in a summary: 8 times and totals, notes_per_min's two parts, the
+// histograms and 5 for the volume
+#define SESSION_JSON_NUMBERS (15 + 12 + SESSION_OCTAVES)
+
+// Worst case: the summary's text (under 200 bytes) with every number at 10
+// digits - past the 256 bytes ArduinoMqttClient buffers on its own
+#define SESSION_JSON_MAX (200 + SESSION_JSON_NUMBERS * 10)
+
+// What an update() did to the session
+enum SessionEvent {
+  SESSION_NONE,
+  SESSION_STARTED,  // Somebody arrived with no session open
+  SESSION_ENDED     // Nobody for the end timeout - summary() is final
+};
+
+// One practice session, from the first presence to the last one before
+// nobody came back for endTimeoutMs, aggregated on the device so a single
+// summary message replaces the stream of readings the server would
+// otherwise have to reduce.
+//
+// Fixed memory (about 250 bytes) and constant work per update: time is
+// split into playing, present but idle, and away (absences shorter than the
+// timeout); notes go into pitch-class and octave histograms; the volume
+// while playing goes into a QuantileSketch for its percentiles. Nothing
+// depends on the firmware, so test/test_practice_session drives it natively.
+class PracticeSession {
+public:
+  PracticeSession();
+
+  void begin(uint32_t endTimeoutMs);
+
+  // Once per sense tick (or idle tick): presence, playing and the smoothed
+  // mic level. Time between calls goes to whichever state the previous
+  // call reported.
+  SessionEvent update(bool present, bool playing, int volume, uint32_t nowMs);
+
+  // A note event heard during the session (MIDI number, C0 = 12)
+  void addNote(uint8_t midi);
+
+  bool active() const { return open; }
+
+  // The open session so far, or the last one after SESSION_ENDED. The end
+  // is the last moment somebody was there, not when the timeout ran out.
+  uint32_t startMs() const { return start; }
+  uint32_t endMs() const { return lastPresentMs; }
+  uint32_t durationMs() const { return lastPresentMs - start; }
+  uint32_t playingMs() const { return playing; }
+  uint32_t idleMs() const { return idle; }
+  uint32_t awayMs() const { return away; }
+  uint32_t notes() const { return noteCount; }
+  const uint32_t* pitchClassCounts() const { return pitchClasses; }  // 12, C first
+  const uint32_t* octaveCounts() const { return octaves; }            // SESSION_OCTAVES
+  // Notes per minute of playing, in tenths
+  uint32_t notesPerMinuteX10() const;
+  const QuantileSketch& volume() const { return volumes; }
+
+private:
+  void clear(uint32_t nowMs);
+
+  uint32_t endTimeout;
+  bool open;
+  bool wasPresent;
+  bool wasPlaying;
+  uint32_t lastUpdateMs;
+  uint32_t start;
+  uint32_t lastPresentMs;
+  uint32_t playing;
+  uint32_t idle;
+  uint32_t away;
+  uint32_t absent;  // The current absence, until somebody comes back
+  uint32_t noteCount;
+  uint32_t pitchClasses[12];
+  uint32_t octaves[SESSION_OCTAVES];
+  QuantileSketch volumes;
+};
+
+// Session summary as published on conndev/piano/session. Times are device
+// uptime in ms, with the uptime at publish so the receiver can place them:
+//   {"uptime":..,"start":..,"end":..,"duration_s":..,"playing_s":..,
+//    "idle_s":..,"away_s":..,"notes":..,"notes_per_min":12.5,
+//    "pitch_classes":[C..B],"octaves":[0..8],
+//    "volume":{"n":..,"p10":..,"p50":..,"p90":..,"max":..}}
+// Returns the length written, 0 if it didn't fit.
+size_t writeSessionJson(char* buffer, size_t size, const PracticeSession& session, uint32_t uptimeMs);
+
+#endif
@@ -0,0 +1,87 @@
+#include "QuantileSketch.h"
+
+QuantileSketch::QuantileSketch() {
+  reset();
+}
+
+void QuantileSketch::reset() {
+  for (int i = 0; i < SKETCH_BUCKETS; i++) {
+    buckets[i] = 0;
+  }
+  total = 0;
+  weight = 0;
+  smallest = 0;
+  largest = 0;
+}
+
+int QuantileSketch::bucketOf(uint16_t value) {
+  if (value < SKETCH_EXACT) {
+    return value;
+  }
+  int top = 2;
+  while (top < 15 && (value >> (top + 1))) {
+    top++;
+  }
+  int step = (value >> (top - 2)) & (SKETCH_STEPS - 1);
+  return SKETCH_EXACT + (top - 2) * SKETCH_STEPS + step;
+}
+
+uint32_t QuantileSketch::lowerEdge(int bucket) {
+  if (bucket < SKETCH_EXACT) {
+    return bucket;
+  }
+  int top = (bucket - SKETCH_EXACT) / SKETCH_STEPS + 2;
+  int step = (bucket - SKETCH_EXACT) % SKETCH_STEPS;
+  return (uint32_t)(SKETCH_STEPS + step) << (top - 2);
+}
+
+void QuantileSketch::add(uint16_t value) {
+  int bucket = bucketOf(value);
+  if (buckets[bucket] == UINT16_MAX) {
+    weight = 0;
+    for (int i = 0; i < SKETCH_BUCKETS; i++) {
+      buckets[i] >>= 1;
+      weight += buckets[i];
+    }
+  }
+  buckets[bucket]++;
+  weight++;
+  if (total == 0 || value < smallest) {
+    smallest = value;
+  }
+  if (total == 0 || value > largest) {
+    largest = value;
+  }
+  total++;
+}
+
+uint16_t QuantileSketch::quantile(int permille) const {
+  if (weight == 0) {
+    return 0;
+  }
+  if (permille < 0) {
+    permille = 0;
+  } else if (permille > 1000) {
+    permille = 1000;
+  }
+  // The sample at rank ceil(weight * permille / 1000), counting from 1
+  uint32_t rank = (uint32_t)(((uint64_t)weight * permille + 999) / 1000);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint32_t seen = 0;
+  int bucket = 0;
+  for (; bucket < SKETCH_BUCKETS - 1; bucket++) {
+    seen += buckets[bucket];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  uint32_t low = lowerEdge(bucket);
+  uint32_t high = bucket + 1 < SKETCH_BUCKETS ? lowerEdge(bucket + 1) : 65536;
+  uint32_t middle = (low + high - 1) / 2;
+  if (middle < smallest) {
+    return smallest;
+  }
+  return middle > largest ? largest : (uint16_t)middle;
+}
@@ -0,0 +1,47 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <stdint.h>
+
+// Values 0-3 have a bucket each; above that every octave [2^k, 2^(k+1)) is
+// split into four equal buckets, up to 65535
+#define SKETCH_EXACT 4
+#define SKETCH_STEPS 4
+#define SKETCH_BUCKETS (SKETCH_EXACT + 14 * SKETCH_STEPS)
+
+// Streaming quantiles of a 16-bit value in fixed memory.
+//
+// A log-linear histogram: the bucket is the value's top bit plus the two
+// bits below it, found with a few shifts, so any quantile comes back within
+// 1/8 of the true value however many samples went in. Counts are 16 bits;
+// when one would overflow, all of them are halved together, which keeps
+// the proportions (and so the quantiles) while older samples fade slightly.
+// 120 bytes of counts.
+class QuantileSketch {
+public:
+  QuantileSketch();
+
+  void reset();
+  void add(uint16_t value);
+
+  // Samples added since reset()
+  uint32_t count() const { return total; }
+  uint16_t min() const { return smallest; }
+  uint16_t max() const { return largest; }
+
+  // The value below which permille/1000 of the samples fall (the middle of
+  // its bucket, within min()..max()); 0 without samples
+  uint16_t quantile(int permille) const;
+
+private:
+  static int bucketOf(uint16_t value);
+  static uint32_t lowerEdge(int bucket);
+
+  uint16_t buckets[SKETCH_BUCKETS];
+  uint32_t total;
+  uint32_t weight;  // Sum of the buckets, after any halving
+  uint16_t smallest;
+  uint16_t largest;
+};
+
+#endif
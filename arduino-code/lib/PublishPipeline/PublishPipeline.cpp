@@ -0,0 +1,74 @@
+#include "PublishPipeline.h"
+
+PublishPipeline::PublishPipeline()
+    : publisher(nullptr), clock(nullptr), hook(nullptr), sliceUs(0), byteBudget(0),
+      fullCount(0), deepest(0), mostUsed(0),
+      sentCount(0), failedCount(0), byteCount(0), deferredCount(0), longestSlice(0) {
+}
+
+void PublishPipeline::begin(Publisher& publisher, Clock& clock, uint32_t sliceUs, size_t byteBudget) {
+  this->publisher = &publisher;
+  this->clock = &clock;
+  this->sliceUs = sliceUs;
+  this->byteBudget = byteBudget;
+}
+
+void PublishPipeline::onSend(SendHook hook) {
+  this->hook = hook;
+}
+
+bool PublishPipeline::enqueue(const char* topic, const uint8_t* payload, size_t length,
+                              uint32_t capturedMs, uint8_t priority) {
+  if (length > maxPayload()) {
+    return false;
+  }
+  if (!ring.push(topic, payload, length, capturedMs, priority, clock->micros())) {
+    fullCount++;
+    return false;
+  }
+  int waiting = ring.depth();
+  if (waiting > deepest) {
+    deepest = waiting;
+  }
+  size_t taken = ring.used();
+  if (taken > mostUsed) {
+    mostUsed = taken;
+  }
+  return true;
+}
+
+int PublishPipeline::drain() {
+  if (publisher == nullptr) {
+    return 0;
+  }
+  uint32_t start = clock->micros();
+  uint32_t now = start;
+  size_t bytes = 0;
+  int taken = 0;
+  PublishFrame frame;
+  while (ring.peek(frame)) {
+    if (taken > 0 && (now - start >= sliceUs || bytes + frame.length > byteBudget)) {
+      deferredCount++;
+      break;
+    }
+    bool ok = publisher->publish(frame.topic, frame.payload, frame.length);
+    uint32_t written = clock->micros();
+    if (ok) {
+      sentCount++;
+      byteCount += frame.length;
+    } else {
+      failedCount++;
+    }
+    if (hook != nullptr) {
+      hook(frame, ok, written - now);
+    }
+    ring.pop();
+    bytes += frame.length;
+    taken++;
+    now = clock->micros();  // The hook's own time isn't the next write's
+  }
+  if (now - start > longestSlice) {
+    longestSlice = now - start;
+  }
+  return taken;
+}
@@ -0,0 +1,77 @@
+#ifndef PUBLISH_PIPELINE_H
+#define PUBLISH_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PianoHal.h"
+#include "PublishRing.h"
+
+// Publishing decoupled from whoever produces the messages.
+//
+// Producers enqueue() serialized messages into a PublishRing and return at
+// once; drain() runs from the task that owns the link and hands them to
+// the Publisher oldest first, in time slices: it stops once sliceUs have
+// gone by or byteBudget bytes went out, and the rest waits for the next
+// call. A write that blocks (a slow SPI link to the radio, a full socket)
+// then holds up only the sender, never the sensing that produced it.
+//
+// The first message of a drain always goes, so one bigger than the budget
+// can't block the ring; a write that is already running can't be cut
+// short, so a slice overruns by at most one write. Every message taken out
+// is reported to the send hook - sent or not, with how long the write
+// took - so the caller can time it and keep what failed.
+class PublishPipeline {
+public:
+  // After each write; on failure the payload is gone once the hook returns
+  typedef void (*SendHook)(const PublishFrame& frame, bool sent, uint32_t writeUs);
+
+  PublishPipeline();
+
+  void begin(Publisher& publisher, Clock& clock, uint32_t sliceUs, size_t byteBudget);
+  void onSend(SendHook hook);
+
+  // Producer side. False if the ring has no room for it right now (counted
+  // in full()) or it is longer than maxPayload().
+  bool enqueue(const char* topic, const uint8_t* payload, size_t length,
+               uint32_t capturedMs, uint8_t priority);
+
+  // Sender side: one time slice. Returns the number of messages taken out.
+  int drain();
+
+  int depth() const { return ring.depth(); }
+  size_t used() const { return ring.used(); }
+  bool empty() const { return ring.empty(); }
+  static size_t maxPayload() { return PublishRing::maxPayload(); }
+
+  // Since begin()
+  uint32_t sent() const { return sentCount; }
+  uint32_t failed() const { return failedCount; }
+  uint32_t full() const { return fullCount; }
+  uint32_t sentBytes() const { return byteCount; }
+  int maxDepth() const { return deepest; }
+  size_t maxUsed() const { return mostUsed; }
+  uint32_t deferred() const { return deferredCount; }  // Slices that ended with messages left
+  uint32_t longestSliceUs() const { return longestSlice; }
+
+private:
+  PublishRing ring;
+  Publisher* publisher;
+  Clock* clock;
+  SendHook hook;
+  uint32_t sliceUs;
+  size_t byteBudget;
+
+  // Producer side
+  uint32_t fullCount;
+  int deepest;
+  size_t mostUsed;
+
+  // Sender side
+  uint32_t sentCount;
+  uint32_t failedCount;
+  uint32_t byteCount;
+  uint32_t deferredCount;
+  uint32_t longestSlice;
+};
+
+#endif
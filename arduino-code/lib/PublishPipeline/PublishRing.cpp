@@ -0,0 +1,113 @@
+#include "PublishRing.h"
+#include <string.h>
+
+static_assert((PUBLISH_RING_BYTES & (PUBLISH_RING_BYTES - 1)) == 0,
+              "PUBLISH_RING_BYTES must be a power of 2");
+
+// head, tail and the counts are 32-bit aligned words, so these are plain
+// loads and stores plus a barrier on the M0+ - no lock, no libatomic
+#define RING_LOAD(word) __atomic_load_n(&(word), __ATOMIC_ACQUIRE)
+#define RING_STORE(word, value) __atomic_store_n(&(word), (value), __ATOMIC_RELEASE)
+
+PublishRing::PublishRing() : head(0), tail(0), pushed(0), popped(0) {
+}
+
+// Header and payload, rounded up so the next header is aligned
+size_t PublishRing::frameSize(size_t length) {
+  size_t size = sizeof(Header) + length;
+  return (size + alignof(Header) - 1) & ~(alignof(Header) - 1);
+}
+
+size_t PublishRing::maxPayload() {
+  // A frame of half the arena fits an empty ring wherever head is: either
+  // it fits before the end or the skipped rest is smaller than the frame
+  return PUBLISH_RING_BYTES / 2 - sizeof(Header);
+}
+
+bool PublishRing::push(const char* topic, const uint8_t* payload, size_t length,
+                       uint32_t capturedMs, uint8_t priority, uint32_t nowUs) {
+  if (length >= WRAP) {
+    return false;
+  }
+  size_t size = frameSize(length);
+  uint32_t start = head;
+  uint32_t free = PUBLISH_RING_BYTES - (start - RING_LOAD(tail));
+
+  // Never split a frame across the end - skip to the front instead
+  uint32_t position = start & (PUBLISH_RING_BYTES - 1);
+  uint32_t toEnd = PUBLISH_RING_BYTES - position;
+  uint32_t skip = size > toEnd ? toEnd : 0;
+  if (skip + size > free) {
+    return false;
+  }
+  if (skip >= sizeof(Header)) {
+    // Room for a marker; anything shorter the consumer skips by itself
+    ((Header*)(arena + position))->length = WRAP;
+  }
+  if (skip > 0) {
+    position = 0;
+  }
+
+  Header* header = (Header*)(arena + position);
+  header->topic = topic;
+  header->capturedMs = capturedMs;
+  header->enqueuedUs = nowUs;
+  header->length = (uint16_t)length;
+  header->priority = priority;
+  memcpy(arena + position + sizeof(Header), payload, length);
+
+  // Counted before it becomes visible, so depth() never goes negative
+  RING_STORE(pushed, pushed + 1);
+  RING_STORE(head, start + skip + (uint32_t)size);
+  return true;
+}
+
+bool PublishRing::peek(PublishFrame& frame) const {
+  uint32_t start = tail;
+  if (start == RING_LOAD(head)) {
+    return false;
+  }
+  uint32_t position = start & (PUBLISH_RING_BYTES - 1);
+  uint32_t toEnd = PUBLISH_RING_BYTES - position;
+  if (toEnd < sizeof(Header) || ((const Header*)(arena + position))->length == WRAP) {
+    position = 0;
+  }
+
+  const Header* header = (const Header*)(arena + position);
+  frame.topic = header->topic;
+  frame.payload = arena + position + sizeof(Header);
+  frame.length = header->length;
+  frame.capturedMs = header->capturedMs;
+  frame.enqueuedUs = header->enqueuedUs;
+  frame.priority = header->priority;
+  return true;
+}
+
+void PublishRing::pop() {
+  uint32_t start = tail;
+  if (start == RING_LOAD(head)) {
+    return;
+  }
+  uint32_t position = start & (PUBLISH_RING_BYTES - 1);
+  uint32_t toEnd = PUBLISH_RING_BYTES - position;
+  if (toEnd < sizeof(Header) || ((const Header*)(arena + position))->length == WRAP) {
+    start += toEnd;
+    position = 0;
+  }
+  size_t size = frameSize(((const Header*)(arena + position))->length);
+
+  RING_STORE(tail, start + (uint32_t)size);
+  RING_STORE(popped, popped + 1);
+}
+
+// The consumer's side is read first: the producer's can only have grown
+// since, so neither difference goes negative
+int PublishRing::depth() const {
+  uint32_t out = RING_LOAD(popped);
+  return (int)(RING_LOAD(pushed) - out);
+}
+
+size_t PublishRing::used() const {
+  uint32_t released = RING_LOAD(tail);
+  return RING_LOAD(head) - released;
+}
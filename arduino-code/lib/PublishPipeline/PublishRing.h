@@ -0,0 +1,71 @@
+#ifndef PUBLISH_RING_H
+#define PUBLISH_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes held for messages waiting to be sent, headers included - a power of 2
+#ifndef PUBLISH_RING_BYTES
+#define PUBLISH_RING_BYTES 2048
+#endif
+
+// A message in the ring. payload stays valid until pop().
+struct PublishFrame {
+  const char* topic;  // Must point at storage that outlives the ring
+  const uint8_t* payload;
+  uint16_t length;
+  uint32_t capturedMs;  // millis() when the reading was taken
+  uint32_t enqueuedUs;  // micros() at push(), for the send delay
+  uint8_t priority;
+};
+
+// Lock-free single-producer/single-consumer ring of serialized messages.
+//
+// Each push() copies a header and the payload in one piece; a frame that
+// would run past the end of the arena starts over at the front instead, so
+// peek() always hands out a contiguous payload. The producer only writes
+// head and the consumer only tail, each stored with release ordering after
+// the bytes it covers and loaded with acquire ordering on the other side,
+// so no lock or critical section is needed - push() may run in an
+// interrupt, or on another thread on the host. Nothing is allocated.
+class PublishRing {
+public:
+  PublishRing();
+
+  // Producer side. Copies the message, false if it doesn't fit right now.
+  bool push(const char* topic, const uint8_t* payload, size_t length,
+            uint32_t capturedMs, uint8_t priority, uint32_t nowUs);
+
+  // Consumer side: the oldest message, false when empty; pop() drops it
+  bool peek(PublishFrame& frame) const;
+  void pop();
+
+  // Either side - a snapshot that may be one push or pop behind
+  int depth() const;    // Messages waiting
+  size_t used() const;  // Bytes taken, headers and wrap padding included
+  bool empty() const { return depth() == 0; }
+
+  // Largest payload that is sure to fit once the ring has drained
+  static size_t maxPayload();
+
+private:
+  struct Header {
+    const char* topic;
+    uint32_t capturedMs;
+    uint32_t enqueuedUs;
+    uint16_t length;  // WRAP: nothing more before the end of the arena
+    uint8_t priority;
+  };
+
+  static const uint16_t WRAP = 0xFFFF;
+
+  static size_t frameSize(size_t length);
+
+  alignas(Header) uint8_t arena[PUBLISH_RING_BYTES];
+  uint32_t head;     // Bytes ever written - producer only
+  uint32_t tail;     // Bytes ever released - consumer only
+  uint32_t pushed;   // Messages ever written - producer only
+  uint32_t popped;   // Messages ever released - consumer only
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Small append-only writer over a fixed buffer. Once something doesn't fit
+// it stops writing and remembers the overflow.
+struct JsonWriter {
+  char* buffer;
+  size_t size;
+  size_t length;
+  bool overflow;
+
+  void append(char c) {
+    if (length + 1 < size) {
+      buffer[length++] = c;
+    } else {
+      overflow = true;
+    }
+  }
+
+  void append(const char* text) {
+    while (*text) {
+      append(*text++);
+    }
+  }
+
+  void appendInt(int value) {
+    char digits[12];
+    int count = 0;
+    // Work with the negative value so INT_MIN doesn't overflow
+    int remaining = value < 0 ? value : -value;
+    do {
+      digits[count++] = (char)('0' - (remaining % 10));
+      remaining /= 10;
+    } while (remaining != 0);
+    if (value < 0) {
+      append('-');
+    }
+    while (count > 0) {
+      append(digits[--count]);
+    }
+  }
+
+  void appendUint(uint32_t value) {
+    char digits[10];
+    int count = 0;
+    do {
+      digits[count++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+      append(digits[--count]);
+    }
+  }
+
+  void appendBool(bool value) {
+    append(value ? "true" : "false");
+  }
+
+  size_t finish() {
+    buffer[length] = '\0';
+    if (overflow) {
+      buffer[0] = '\0';
+      return 0;
+    }
+    return length;
+  }
+};
+
+#endif
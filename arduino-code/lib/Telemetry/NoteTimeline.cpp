@@ -0,0 +1,52 @@
+#include "NoteTimeline.h"
+
+NoteTimeline::NoteTimeline(uint32_t intervalMs)
+    : head(0), count(0), startMs(0), interval(intervalMs), overwrittenCount(0) {
+}
+
+void NoteTimeline::push(const NoteEvent& event) {
+  if (count == NOTE_TIMELINE_CAPACITY) {
+    head = (head + 1) % NOTE_TIMELINE_CAPACITY;
+    count--;
+    overwrittenCount++;
+  }
+  events[(head + count) % NOTE_TIMELINE_CAPACITY] = event;
+  count++;
+}
+
+bool NoteTimeline::shouldFlush(uint32_t nowMs) const {
+  if (count == 0) {
+    return false;
+  }
+  return full() || (uint32_t)(nowMs - startMs) > interval;
+}
+
+void NoteTimeline::clear(uint32_t nowMs) {
+  head = 0;
+  count = 0;
+  startMs = nowMs;
+}
+
+int NoteTimeline::size() const {
+  return count;
+}
+
+bool NoteTimeline::empty() const {
+  return count == 0;
+}
+
+bool NoteTimeline::full() const {
+  return count == NOTE_TIMELINE_CAPACITY;
+}
+
+const NoteEvent& NoteTimeline::at(int index) const {
+  return events[(head + index) % NOTE_TIMELINE_CAPACITY];
+}
+
+uint32_t NoteTimeline::windowStart() const {
+  return startMs;
+}
+
+uint32_t NoteTimeline::overwritten() const {
+  return overwrittenCount;
+}
@@ -0,0 +1,56 @@
+#ifndef NOTE_TIMELINE_H
+#define NOTE_TIMELINE_H
+
+#include <stdint.h>
+
+// Maximum number of note events held between publishes
+#ifndef NOTE_TIMELINE_CAPACITY
+#define NOTE_TIMELINE_CAPACITY 16
+#endif
+
+// One detected note, stamped with the millis() it was heard at
+struct NoteEvent {
+  uint32_t timeMs;
+  const char* note;   // Points into noteNames
+  int8_t octave;
+  uint16_t frequency;
+  uint16_t volume;
+};
+
+// Fixed-capacity ring buffer of note events between two publishes.
+//
+// The batching policy lives here too: a batch is due once the publish
+// interval has passed since the window opened, or straight away when the
+// buffer is full so nothing has to be dropped. Event times are reported as
+// offsets from windowStart().
+class NoteTimeline {
+public:
+  explicit NoteTimeline(uint32_t intervalMs = 2000);
+
+  // Add an event. When full the oldest event is overwritten and counted in
+  // overwritten() - callers should flush when shouldFlush() says so first.
+  void push(const NoteEvent& event);
+
+  bool shouldFlush(uint32_t nowMs) const;
+
+  // Drop all events and open a new window at nowMs
+  void clear(uint32_t nowMs);
+
+  int size() const;
+  bool empty() const;
+  bool full() const;
+  const NoteEvent& at(int index) const;  // 0 is the oldest event
+
+  uint32_t windowStart() const;
+  uint32_t overwritten() const;
+
+private:
+  NoteEvent events[NOTE_TIMELINE_CAPACITY];
+  int head;   // Index of the oldest event
+  int count;
+  uint32_t startMs;
+  uint32_t interval;
+  uint32_t overwrittenCount;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PIANO_READING_H
+#define PIANO_READING_H
+
+#include <stdint.h>
+
+// Most notes reported for one frame in chord mode
+#ifndef CHORD_MAX_NOTES
+#define CHORD_MAX_NOTES 4
+#endif
+
+// One note of a chord from the multi-pitch detector
+struct ChordNote {
+  const char* note;    // Points into noteNames
+  int8_t octave;
+  uint16_t frequency;  // Whole Hz
+  uint8_t confidence;  // 0-100, share of the spectral peak energy it explains
+};
+
+// One telemetry reading - the fixed schema published on conndev/piano
+struct PianoReading {
+  int distance;         // Smoothed ToF distance in mm
+  int volume;           // Smoothed mic amplitude
+  bool hasFrequency;    // false -> "frequency":null
+  int frequency;        // Dominant frequency in whole Hz
+  const char* note;     // Note name, nullptr -> "note":null and "octave":null
+  int octave;
+  bool presence;
+  bool playing;
+  const ChordNote* chord;  // Chord mode: notes heard in the last frame, may be nullptr
+  uint8_t chordSize;       // 0 leaves "notes" out of the JSON
+};
+
+#endif
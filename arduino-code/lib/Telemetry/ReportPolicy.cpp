@@ -0,0 +1,68 @@
+#include "ReportPolicy.h"
+
+ReportPolicy::ReportPolicy() {
+  ReportDeadbands defaults = {25, 50, 29, 2000, 60000};
+  begin(defaults);
+}
+
+void ReportPolicy::begin(const ReportDeadbands& deadbands) {
+  this->deadbands = deadbands;
+  haveLast = false;
+  lastDistance = 0;
+  lastVolume = 0;
+  lastHasFrequency = false;
+  lastFrequency = 0;
+  lastPresence = false;
+  lastPlaying = false;
+  lastSentMs = 0;
+  for (int i = 0; i < REPORT_REASONS; i++) {
+    counts[i] = 0;
+  }
+}
+
+static bool outside(int value, int reference, int deadband) {
+  int difference = value > reference ? value - reference : reference - value;
+  return difference > deadband;
+}
+
+ReportReason ReportPolicy::due(const PianoReading& reading, bool eventsDue, uint32_t nowMs) const {
+  if (!haveLast || reading.presence != lastPresence || reading.playing != lastPlaying) {
+    return REPORT_STATE;
+  }
+  if (eventsDue) {
+    return REPORT_EVENTS;
+  }
+  uint32_t silentMs = nowMs - lastSentMs;
+  if (silentMs >= deadbands.heartbeatMs) {
+    return REPORT_HEARTBEAT;
+  }
+  // Nobody there: the distance is just the sensor's far reading settling,
+  // nothing to report until the state changes or the heartbeat
+  if (silentMs < deadbands.minGapMs || !reading.presence) {
+    return REPORT_NONE;
+  }
+
+  // While playing, every note's volume is already in the timeline's events,
+  // and the smoothed level swings from strike to decay
+  bool changed = outside(reading.distance, lastDistance, deadbands.distanceMm) ||
+                 (!reading.playing && outside(reading.volume, lastVolume, deadbands.volume)) ||
+                 reading.hasFrequency != lastHasFrequency;
+  if (!changed && reading.hasFrequency) {
+    // Relative, so a semitone counts the same in the bass and the treble
+    int32_t band = (int32_t)lastFrequency * deadbands.frequencyPermille / 1000;
+    changed = outside(reading.frequency, lastFrequency, band);
+  }
+  return changed ? REPORT_CHANGE : REPORT_NONE;
+}
+
+void ReportPolicy::sent(const PianoReading& reading, ReportReason reason, uint32_t nowMs) {
+  haveLast = true;
+  lastDistance = reading.distance;
+  lastVolume = reading.volume;
+  lastHasFrequency = reading.hasFrequency;
+  lastFrequency = reading.frequency;
+  lastPresence = reading.presence;
+  lastPlaying = reading.playing;
+  lastSentMs = nowMs;
+  counts[reason]++;
+}
@@ -0,0 +1,65 @@
+#ifndef REPORT_POLICY_H
+#define REPORT_POLICY_H
+
+#include <stdint.h>
+#include "PianoReading.h"
+
+// How far a field may move from its last published value before it is
+// news, and how often news may go out
+struct ReportDeadbands {
+  int distanceMm;         // Smoothed distance
+  int volume;             // Smoothed mic level
+  int frequencyPermille;  // Dominant frequency, 1/1000ths of the last one
+  uint32_t minGapMs;      // At most one message per gap for deadband changes
+  uint32_t heartbeatMs;   // Longest silence - a reading goes out anyway
+};
+
+// Why a reading is due
+enum ReportReason {
+  REPORT_NONE,
+  REPORT_STATE,      // presence or playing changed - sent straight away
+  REPORT_EVENTS,     // The note timeline is due (window over or buffer full)
+  REPORT_CHANGE,     // A field left its deadband
+  REPORT_HEARTBEAT,  // Nothing changed for heartbeatMs
+  REPORT_REASONS
+};
+
+// Report-by-exception for the reading on conndev/piano.
+//
+// Keeps the last reading that was published and decides, for each new
+// one, whether it is worth a message: a state change always is, pending
+// note events once the timeline wants flushing, a field outside its
+// deadband at most once per minGapMs while someone is there, and anything
+// after heartbeatMs so subscribers can tell a quiet device from a dead
+// one. The note, the chord and (while playing) the volume are not compared
+// on their own - every note played is already in the timeline's events.
+class ReportPolicy {
+public:
+  ReportPolicy();
+
+  void begin(const ReportDeadbands& deadbands);
+
+  // Whether reading should be published now. eventsDue is
+  // NoteTimeline::shouldFlush() with events waiting.
+  ReportReason due(const PianoReading& reading, bool eventsDue, uint32_t nowMs) const;
+
+  // reading was published (or queued) for reason at nowMs
+  void sent(const PianoReading& reading, ReportReason reason, uint32_t nowMs);
+
+  // Messages sent for reason so far
+  uint32_t count(ReportReason reason) const { return counts[reason]; }
+
+private:
+  ReportDeadbands deadbands;
+  bool haveLast;
+  int lastDistance;
+  int lastVolume;
+  bool lastHasFrequency;
+  int lastFrequency;
+  bool lastPresence;
+  bool lastPlaying;
+  uint32_t lastSentMs;
+  uint32_t counts[REPORT_REASONS];
+};
+
+#endif
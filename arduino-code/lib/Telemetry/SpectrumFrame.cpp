@@ -0,0 +1,205 @@
+#include "SpectrumFrame.h"
+#include <string.h>
+
+// Deadband of a delta frame, in levels, per level width
+static int deadband(int bits) {
+  return bits == 8 ? 1 : 0;
+}
+
+static int maxLevel(int bits) {
+  return bits == 8 ? 0xFF : 0x0F;
+}
+
+// Whether a delta fits the signed field of a delta frame
+static bool deltaFits(int delta, int bits) {
+  return bits == 8 ? delta >= -128 && delta <= 127 : delta >= -8 && delta <= 7;
+}
+
+// Value i of a packed run: bytes, or nibbles low first
+static void putPacked(uint8_t* out, int index, int value, int bits) {
+  if (bits == 8) {
+    out[index] = (uint8_t)value;
+  } else if (index & 1) {
+    out[index >> 1] = (uint8_t)((out[index >> 1] & 0x0F) | ((value & 0x0F) << 4));
+  } else {
+    out[index >> 1] = (uint8_t)(value & 0x0F);
+  }
+}
+
+static int getPacked(const uint8_t* in, int index, int bits) {
+  if (bits == 8) {
+    return in[index];
+  }
+  return (index & 1) ? in[index >> 1] >> 4 : in[index >> 1] & 0x0F;
+}
+
+static size_t packedSize(int count, int bits) {
+  return bits == 8 ? count : (count + 1) / 2;
+}
+
+uint8_t spectrumLevel(uint64_t magnitude, int bits) {
+  // log2 in sixteenths: the position of the top bit, then the next four
+  // bits below it as the fraction (linear between octaves, within 0.1 of
+  // an octave), rounded to the level's step. The top bit is found by
+  // halving the search, six steps whatever the magnitude.
+  uint64_t value = magnitude + 1;
+  int top = 0;
+  for (int step = 32; step > 0; step >>= 1) {
+    if (value >> (top + step)) {
+      top += step;
+    }
+  }
+  int fraction = top >= 4 ? (int)((value >> (top - 4)) & 15) : (int)((value << (4 - top)) & 15);
+  int sixteenths = top * 16 + fraction;
+  int level = bits == 8 ? (sixteenths + 1) / 2 : (sixteenths + 8) / 16;
+  return (uint8_t)(level > maxLevel(bits) ? maxLevel(bits) : level);
+}
+
+float spectrumLevelDb(uint8_t level, int bits) {
+  // 20 * log10(2) dB per octave
+  return (bits == 8 ? level / 8.0f : (float)level) * 6.0206f;
+}
+
+SpectrumEncoder::SpectrumEncoder() {
+  begin(8, 10);
+}
+
+void SpectrumEncoder::begin(int bits, int keyInterval) {
+  levelBits = bits == 4 ? 4 : 8;
+  this->keyInterval = keyInterval > 0 ? keyInterval : 1;
+  sequence = 0;
+  restart();
+}
+
+void SpectrumEncoder::restart() {
+  sinceKey = keyInterval;
+  referenceBins = 0;
+}
+
+size_t SpectrumEncoder::encode(uint8_t* buffer, size_t size, const uint8_t* levels, int bins,
+                               uint16_t binWidthQ4) {
+  if (buffer == nullptr || bins <= 0 || bins > SPECTRUM_MAX_BINS) {
+    return 0;
+  }
+  bool key = sinceKey >= keyInterval || bins != referenceBins;
+
+  // Which bins a delta frame would carry, and how long it would be. A jump
+  // the delta field can't hold (a note struck in a quiet bin) needs a key
+  // frame, so the decoder never lags behind.
+  int changed = 0;
+  uint8_t mask[SPECTRUM_MAX_BINS / 8];
+  memset(mask, 0, sizeof(mask));
+  for (int i = 0; i < bins && !key; i++) {
+    int delta = levels[i] - reference[i];
+    if (delta > deadband(levelBits) || delta < -deadband(levelBits)) {
+      mask[i >> 3] |= (uint8_t)(1 << (i & 7));
+      changed++;
+      key = !deltaFits(delta, levelBits);
+    }
+  }
+  size_t maskSize = (bins + 7) / 8;
+  size_t keyLength = SPECTRUM_HEADER_SIZE + packedSize(bins, levelBits);
+  size_t deltaLength = SPECTRUM_HEADER_SIZE + maskSize + packedSize(changed, levelBits);
+  if (!key && deltaLength >= keyLength) {
+    key = true;  // So much moved that a key frame is no longer
+  }
+  size_t length = key ? keyLength : deltaLength;
+  if (size < length) {
+    return 0;
+  }
+
+  buffer[0] = SPECTRUM_FRAME_VERSION;
+  buffer[1] = (uint8_t)((key ? SPECTRUM_FLAG_KEY : 0) | (levelBits == 4 ? SPECTRUM_FLAG_4BIT : 0));
+  buffer[2] = sequence++;
+  buffer[3] = (uint8_t)bins;
+  buffer[4] = (uint8_t)(binWidthQ4 & 0xFF);
+  buffer[5] = (uint8_t)(binWidthQ4 >> 8);
+  uint8_t* body = buffer + SPECTRUM_HEADER_SIZE;
+
+  if (key) {
+    for (int i = 0; i < bins; i++) {
+      int level = levels[i] > maxLevel(levelBits) ? maxLevel(levelBits) : levels[i];
+      putPacked(body, i, level, levelBits);
+      reference[i] = (uint8_t)level;
+    }
+    referenceBins = bins;
+    sinceKey = 1;
+    return length;
+  }
+
+  memcpy(body, mask, maskSize);
+  int slot = 0;
+  for (int i = 0; i < bins; i++) {
+    if (mask[i >> 3] & (1 << (i & 7))) {
+      int delta = levels[i] - reference[i];
+      putPacked(body + maskSize, slot++, delta, levelBits);
+      reference[i] = levels[i];
+    }
+  }
+  sinceKey++;
+  return length;
+}
+
+SpectrumDecoder::SpectrumDecoder() : synced(false) {
+  memset(&current, 0, sizeof(current));
+}
+
+bool SpectrumDecoder::decode(const uint8_t* frame, size_t length, SpectrumLevels& out) {
+  if (frame == nullptr || length < SPECTRUM_HEADER_SIZE || frame[0] != SPECTRUM_FRAME_VERSION) {
+    return false;
+  }
+  bool key = frame[1] & SPECTRUM_FLAG_KEY;
+  int bits = (frame[1] & SPECTRUM_FLAG_4BIT) ? 4 : 8;
+  uint8_t sequence = frame[2];
+  int bins = frame[3];
+  if (bins == 0 || bins > SPECTRUM_MAX_BINS) {
+    return false;
+  }
+  const uint8_t* body = frame + SPECTRUM_HEADER_SIZE;
+  size_t bodyLength = length - SPECTRUM_HEADER_SIZE;
+
+  if (key) {
+    if (bodyLength < packedSize(bins, bits)) {
+      return false;
+    }
+    for (int i = 0; i < bins; i++) {
+      current.levels[i] = (uint8_t)getPacked(body, i, bits);
+    }
+  } else {
+    // A delta only applies on top of the frame right before it
+    if (!synced || sequence != (uint8_t)(current.sequence + 1) || bins != current.bins ||
+        bits != current.bits) {
+      synced = false;
+      return false;
+    }
+    size_t maskSize = (bins + 7) / 8;
+    if (bodyLength < maskSize) {
+      return false;
+    }
+    int changed = 0;
+    for (int i = 0; i < bins; i++) {
+      changed += (body[i >> 3] >> (i & 7)) & 1;
+    }
+    if (bodyLength < maskSize + packedSize(changed, bits)) {
+      return false;
+    }
+    int slot = 0;
+    for (int i = 0; i < bins; i++) {
+      if ((body[i >> 3] >> (i & 7)) & 1) {
+        int delta = getPacked(body + maskSize, slot++, bits);
+        // Sign-extend
+        delta = bits == 8 ? (int8_t)delta : (delta & 0x08 ? delta - 16 : delta);
+        current.levels[i] = (uint8_t)(current.levels[i] + delta);
+      }
+    }
+  }
+
+  current.sequence = sequence;
+  current.key = key;
+  current.bits = bits;
+  current.bins = bins;
+  current.binWidthQ4 = (uint16_t)(frame[4] | (frame[5] << 8));
+  synced = true;
+  out = current;
+  return true;
+}
@@ -0,0 +1,103 @@
+#ifndef SPECTRUM_FRAME_H
+#define SPECTRUM_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Live magnitude spectrum, published on <topic>/spectrum in streaming mode.
+//
+// Each bin is sent as a log level: log2(magnitude + 1), in eighths (8-bit
+// levels, 0.75 dB a step) or whole octaves (4-bit levels, 6 dB a step).
+// Magnitudes are in the double path's units (raw ADC counts through the
+// window), so a level means the same at every capture rate.
+//
+// Frames are either key frames with every level, or deltas against the
+// levels the decoder already holds - only the bins that moved by more than
+// the deadband are sent. A key frame goes out every keyInterval frames, so
+// a late subscriber or a lost frame recovers within that many.
+//
+// Layout, multi-byte fields little-endian:
+//   0     version (SPECTRUM_FRAME_VERSION)
+//   1     flags   bit0 key frame, bit1 4-bit levels (else 8-bit)
+//   2     sequence number, wraps at 256
+//   3     bins (at most SPECTRUM_MAX_BINS)
+//   4..5  bin width in Hz * 16, uint16
+//   key:   the levels, bin 0 first - one byte each, or two per byte
+//          (4-bit, low nibble first)
+//   delta: a change mask, one bit per bin (bit i % 8 of byte i / 8), then
+//          a signed delta for every set bit in bin order - int8, or signed
+//          nibbles packed like the 4-bit levels
+//
+// A new version number is required for any layout change.
+#define SPECTRUM_FRAME_VERSION 1
+#define SPECTRUM_MAX_BINS 64
+#define SPECTRUM_HEADER_SIZE 6
+
+#define SPECTRUM_FLAG_KEY  0x01
+#define SPECTRUM_FLAG_4BIT 0x02
+
+// Worst case: a delta frame where every bin moved, at 8 bits
+#define SPECTRUM_FRAME_MAX (SPECTRUM_HEADER_SIZE + SPECTRUM_MAX_BINS / 8 + SPECTRUM_MAX_BINS)
+
+// Log level of a magnitude at bits (4 or 8) per bin
+uint8_t spectrumLevel(uint64_t magnitude, int bits);
+
+// A level back in dB relative to magnitude 1
+float spectrumLevelDb(uint8_t level, int bits);
+
+// Builds the frames of one stream. Keeps the levels the decoder will have,
+// so a deadband never lets the two drift apart.
+class SpectrumEncoder {
+public:
+  SpectrumEncoder();
+
+  // bits is 4 or 8. In 8-bit mode a bin within one step of what the
+  // decoder holds is left out of a delta frame.
+  void begin(int bits, int keyInterval);
+
+  // Make the next frame a key frame (after a gap in publishing)
+  void restart();
+
+  // Encode levels (from spectrumLevel() at this encoder's bits) into
+  // buffer. Returns the frame length, or 0 if it didn't fit.
+  size_t encode(uint8_t* buffer, size_t size, const uint8_t* levels, int bins,
+                uint16_t binWidthQ4);
+
+  int bits() const { return levelBits; }
+
+private:
+  uint8_t reference[SPECTRUM_MAX_BINS];
+  int levelBits;
+  int keyInterval;
+  int sinceKey;
+  int referenceBins;
+  uint8_t sequence;
+};
+
+// Levels of one decoded frame
+struct SpectrumLevels {
+  uint8_t sequence;
+  bool key;
+  int bits;
+  int bins;
+  uint16_t binWidthQ4;
+  uint8_t levels[SPECTRUM_MAX_BINS];
+};
+
+// Reference decoder: applies frames in order to its copy of the levels.
+class SpectrumDecoder {
+public:
+  SpectrumDecoder();
+
+  // Decode frame into out. Returns false for a malformed frame or an
+  // unknown version, and for a delta frame that doesn't follow the last
+  // frame decoded (a gap) - every frame until the next key frame is then
+  // refused, since its levels would be wrong.
+  bool decode(const uint8_t* frame, size_t length, SpectrumLevels& out);
+
+private:
+  SpectrumLevels current;
+  bool synced;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "TelemetryBinary.h"
+#include <string.h>
+#include "NoteMapper.h"
+
+static uint16_t clampToUint16(int value) {
+  if (value < 0) return 0;
+  if (value > 0xFFFF) return 0xFFFF;
+  return (uint16_t)value;
+}
+
+static void writeUint16(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t)(value & 0xFF);
+  out[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t readUint16(const uint8_t* in) {
+  return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static int pitchClassOf(const char* name) {
+  for (int i = 0; i < 12; i++) {
+    if (strcmp(name, noteNames[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+size_t encodeReadingBinary(uint8_t* buffer, size_t size, const PianoReading& reading) {
+  if (buffer == nullptr || size < TELEMETRY_BINARY_SIZE) {
+    return 0;
+  }
+
+  uint8_t flags = 0;
+  if (reading.presence) flags |= TELEMETRY_FLAG_PRESENCE;
+  if (reading.playing) flags |= TELEMETRY_FLAG_PLAYING;
+  if (reading.hasFrequency) flags |= TELEMETRY_FLAG_FREQUENCY;
+
+  uint8_t note = 0xFF;
+  int pitchClass = reading.note != nullptr ? pitchClassOf(reading.note) : -1;
+  if (pitchClass >= 0 && reading.octave >= 0 && reading.octave <= 0x0F) {
+    flags |= TELEMETRY_FLAG_NOTE;
+    note = (uint8_t)((pitchClass << 4) | reading.octave);
+  }
+
+  buffer[0] = TELEMETRY_BINARY_VERSION;
+  buffer[1] = flags;
+  writeUint16(buffer + 2, clampToUint16(reading.distance));
+  writeUint16(buffer + 4, clampToUint16(reading.volume));
+  writeUint16(buffer + 6, reading.hasFrequency ? clampToUint16(reading.frequency) : 0);
+  buffer[8] = note;
+  return TELEMETRY_BINARY_SIZE;
+}
+
+bool decodeReadingBinary(const uint8_t* frame, size_t length, PianoReading& reading) {
+  if (frame == nullptr || length < TELEMETRY_BINARY_SIZE || frame[0] != TELEMETRY_BINARY_VERSION) {
+    return false;
+  }
+
+  uint8_t flags = frame[1];
+  reading.presence = (flags & TELEMETRY_FLAG_PRESENCE) != 0;
+  reading.playing = (flags & TELEMETRY_FLAG_PLAYING) != 0;
+  reading.hasFrequency = (flags & TELEMETRY_FLAG_FREQUENCY) != 0;
+  reading.distance = readUint16(frame + 2);
+  reading.volume = readUint16(frame + 4);
+  reading.frequency = reading.hasFrequency ? readUint16(frame + 6) : 0;
+
+  reading.note = nullptr;
+  reading.octave = 0;
+  reading.chord = nullptr;  // Chord notes are JSON only
+  reading.chordSize = 0;
+  if (flags & TELEMETRY_FLAG_NOTE) {
+    int pitchClass = frame[8] >> 4;
+    if (pitchClass >= 12) {
+      return false;
+    }
+    reading.note = noteNames[pitchClass];
+    reading.octave = frame[8] & 0x0F;
+  }
+  return true;
+}
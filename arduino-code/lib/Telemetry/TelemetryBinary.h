@@ -0,0 +1,36 @@
+#ifndef TELEMETRY_BINARY_H
+#define TELEMETRY_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PianoReading.h"
+
+// Compact binary form of PianoReading, published on <topic>/bin.
+//
+// Fixed 9 byte layout, multi-byte fields little-endian:
+//   0     version (TELEMETRY_BINARY_VERSION)
+//   1     flags   bit0 presence, bit1 playing, bit2 frequency, bit3 note
+//   2..3  distance in mm, uint16 (clamped)
+//   4..5  volume, uint16 (clamped)
+//   6..7  frequency in Hz, uint16 (0 when bit2 is clear)
+//   8     note: pitch class (0 = C .. 11 = B) << 4 | octave (0xFF when bit3 is clear)
+//
+// A new version number is required for any layout change - decoders
+// reject versions they don't know instead of guessing.
+#define TELEMETRY_BINARY_VERSION 1
+#define TELEMETRY_BINARY_SIZE 9
+
+#define TELEMETRY_FLAG_PRESENCE  0x01
+#define TELEMETRY_FLAG_PLAYING   0x02
+#define TELEMETRY_FLAG_FREQUENCY 0x04
+#define TELEMETRY_FLAG_NOTE      0x08
+
+// Encode reading into buffer. Returns TELEMETRY_BINARY_SIZE, or 0 if the
+// buffer is too small. A note name that isn't one of noteNames is sent as no note.
+size_t encodeReadingBinary(uint8_t* buffer, size_t size, const PianoReading& reading);
+
+// Decode one frame. The decoded note points into noteNames. Returns false for
+// a short frame, an unknown version or an out-of-range note.
+bool decodeReadingBinary(const uint8_t* frame, size_t length, PianoReading& reading);
+
+#endif
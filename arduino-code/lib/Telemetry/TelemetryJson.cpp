@@ -0,0 +1,117 @@
+#include "TelemetryJson.h"
+#include "JsonWriter.h"
+
+// Everything up to, but not including, the closing brace
+static void appendReadingFields(JsonWriter& json, const PianoReading& reading) {
+  json.append("{\"distance\":");
+  json.appendInt(reading.distance);
+  json.append(",\"volume\":");
+  json.appendInt(reading.volume);
+
+  json.append(",\"frequency\":");
+  if (reading.hasFrequency) {
+    json.appendInt(reading.frequency);
+  } else {
+    json.append("null");
+  }
+
+  // Note and octave are only meaningful together
+  if (reading.note != nullptr) {
+    json.append(",\"note\":\"");
+    json.append(reading.note);
+    json.append("\",\"octave\":");
+    json.appendInt(reading.octave);
+  } else {
+    json.append(",\"note\":null,\"octave\":null");
+  }
+
+  json.append(",\"presence\":");
+  json.appendBool(reading.presence);
+  json.append(",\"playing\":");
+  json.appendBool(reading.playing);
+
+  if (reading.chord != nullptr && reading.chordSize > 0) {
+    json.append(",\"notes\":[");
+    for (int i = 0; i < reading.chordSize; i++) {
+      const ChordNote& note = reading.chord[i];
+      if (i > 0) {
+        json.append(',');
+      }
+      json.append("[\"");
+      json.append(note.note);
+      json.append("\",");
+      json.appendInt(note.octave);
+      json.append(',');
+      json.appendInt(note.frequency);
+      json.append(',');
+      json.appendInt(note.confidence);
+      json.append(']');
+    }
+    json.append(']');
+  }
+}
+
+size_t writeReadingJson(char* buffer, size_t size, const PianoReading& reading) {
+  if (buffer == nullptr || size == 0) {
+    return 0;
+  }
+
+  JsonWriter json = {buffer, size, 0, false};
+  appendReadingFields(json, reading);
+  json.append('}');
+  return json.finish();
+}
+
+size_t writeReadingJson(char* buffer, size_t size, const PianoReading& reading,
+                        const NoteTimeline& events) {
+  if (buffer == nullptr || size == 0) {
+    return 0;
+  }
+
+  JsonWriter json = {buffer, size, 0, false};
+  appendReadingFields(json, reading);
+
+  if (!events.empty()) {
+    json.append(",\"events\":[");
+    for (int i = 0; i < events.size(); i++) {
+      const NoteEvent& event = events.at(i);
+      if (i > 0) {
+        json.append(',');
+      }
+      json.append('[');
+      json.appendInt((int)(event.timeMs - events.windowStart()));
+      json.append(",\"");
+      json.append(event.note);
+      json.append("\",");
+      json.appendInt(event.octave);
+      json.append(',');
+      json.appendInt(event.frequency);
+      json.append(',');
+      json.appendInt(event.volume);
+      json.append(']');
+    }
+    json.append(']');
+  }
+
+  json.append('}');
+  return json.finish();
+}
+
+size_t writeAgedJson(char* buffer, size_t size, const char* json, size_t length, uint32_t ageMs) {
+  if (buffer == nullptr || size == 0) {
+    return 0;
+  }
+  if (length == 0 || json[length - 1] != '}') {
+    buffer[0] = '\0';
+    return 0;
+  }
+
+  JsonWriter aged = {buffer, size, 0, false};
+  for (size_t i = 0; i + 1 < length; i++) {
+    aged.append(json[i]);
+  }
+  aged.append(",\"age\":");
+  aged.appendInt(ageMs > 0x7FFFFFFF ? 0x7FFFFFFF : (int)ageMs);
+  aged.append('}');
+  return aged.finish();
+}
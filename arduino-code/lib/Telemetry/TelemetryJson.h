@@ -0,0 +1,50 @@
+#ifndef TELEMETRY_JSON_H
+#define TELEMETRY_JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PianoReading.h"
+#include "NoteTimeline.h"
+
+// Longest possible payload is 126 characters (every int at INT_MIN and a
+// three character note name) - leave some room for the terminator
+#define TELEMETRY_JSON_MAX 160
+
+// Worst case for the chord "notes" array below
+#define TELEMETRY_CHORD_NOTE_JSON_MAX 22
+#define TELEMETRY_CHORD_JSON_MAX (12 + CHORD_MAX_NOTES * TELEMETRY_CHORD_NOTE_JSON_MAX)
+
+// Write reading as the JSON object the dashboards expect, e.g.
+// {"distance":120,"volume":140,"frequency":262,"note":"C","octave":4,"presence":true,"playing":true}
+//
+// In chord mode the notes of the last frame follow as
+// "notes":[[note,octave,frequency,confidence],...], which needs
+// TELEMETRY_CHORD_JSON_MAX more room.
+//
+// Writes into the caller's buffer with no dynamic allocation and always
+// terminates it. Returns the payload length, or 0 if size was too small.
+size_t writeReadingJson(char* buffer, size_t size, const PianoReading& reading);
+
+// Worst case for one event in the "events" array below
+#define TELEMETRY_EVENT_JSON_MAX 40
+#define TELEMETRY_BATCH_JSON_MAX (TELEMETRY_JSON_MAX + TELEMETRY_CHORD_JSON_MAX + \
+                                  NOTE_TIMELINE_CAPACITY * TELEMETRY_EVENT_JSON_MAX)
+
+// Same as writeReadingJson, with the note events heard since the last
+// publish added as a compact array of [offsetMs,note,octave,frequency,volume]:
+// {"distance":120,...,"playing":true,"events":[[35,"C",4,262,140],[410,"E",4,330,152]]}
+// offsetMs is relative to events.windowStart(). With no events it writes
+// exactly the same bytes as writeReadingJson.
+size_t writeReadingJson(char* buffer, size_t size, const PianoReading& reading,
+                        const NoteTimeline& events);
+
+// Extra room writeAgedJson needs on top of the original payload
+#define TELEMETRY_AGE_JSON_MAX 18
+
+// Copy an object written by writeReadingJson and add how long ago it was
+// captured as the last field, for messages sent late from the offline queue:
+// {"distance":120,...,"playing":true,"age":93512}
+// Returns the new length, or 0 if json isn't an object or size is too small.
+size_t writeAgedJson(char* buffer, size_t size, const char* json, size_t length, uint32_t ageMs);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "PianoHal.h"
+
+// Hardware for the platform being built. Exactly one implementation is
+// compiled in: src/board/nano33 for the Nano 33 IoT, src/board/native for
+// the Linux simulator (see the build_src_filter of each env).
+
+// Bring up the display, distance sensor and network. Prints the reason and
+// returns false if something essential is missing.
+bool boardBegin();
+
+Clock& boardClock();
+MicSource& boardMic();
+DistanceSensor& boardDistanceSensor();
+TextDisplay& boardDisplay();
+Publisher& boardPublisher();
+
+// Free RAM between the heap and the stack right now, and the deepest the
+// stack has reached since boardBegin(), in bytes. 0 where the platform
+// can't tell.
+uint32_t boardFreeMemory();
+uint32_t boardStackHighWater();
+
+// Halt the CPU until the next interrupt, for at most maxMs (0 returns at
+// once). millis() keeps counting through it.
+void boardSleep(uint32_t maxMs);
+
+#endif
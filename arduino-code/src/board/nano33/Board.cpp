@@ -0,0 +1,426 @@
+// Nano 33 IoT implementation of the HAL: DMA audio capture, VL53L0X,
+// SSD1306 over I2C and MQTT over WiFiNINA
+
+#include <Arduino.h>
+#include <WiFiNINA.h>  
+#include <ArduinoMqttClient.h>
+#include <Wire.h> 
+#include <VL53L0X.h> 
+#include <Adafruit_SSD1306.h>
+#include <Adafruit_GFX.h>
+#include "arduino_secrets.h" 
+#include "AdcCapture.h"
+#include "Backoff.h"
+#include "Board.h"
+#include "FrameDiff.h"
+
+const int micPin = A0;
+const int tofInterruptPin = 2;  // VL53L0X GPIO1 (open drain, active low)
+
+const int SCREEN_WIDTH = 128;
+const int SCREEN_HEIGHT = 32;
+#define OLED_RESET -1
+#define SCREEN_ADDRESS 0x3C 
+
+char broker[] = "tigoe.net";  
+int port = 1883;
+char clientID[] = "justin-nano33iot-";
+
+class ArduinoClock : public Clock {
+public:
+  uint32_t millis() override { return ::millis(); }
+  uint32_t micros() override { return ::micros(); }
+};
+
+// Timer-triggered ADC capture, DMA fills ping-pong buffers in the background
+class DmaMicSource : public MicSource {
+public:
+  bool begin(uint32_t sampleRate) override { return capture.begin(micPin, sampleRate); }
+  const int16_t* acquireBlock() override { return capture.acquire(); }
+  void releaseBlock() override { capture.release(); }
+  int16_t latestSample() override { return capture.latestSample(); }
+  uint32_t sampleRate() override { return capture.sampleRate(); }
+  void pause() override { capture.pause(); }
+  void resume() override { capture.resume(); }
+
+private:
+  AdcCapture capture;
+};
+
+// Set by the VL53L0X GPIO1 interrupt while watching
+static volatile bool tofTriggered = false;
+
+static void onTofInterrupt() {
+  tofTriggered = true;
+}
+
+class TofDistanceSensor : public DistanceSensor {
+public:
+  bool begin() {
+    Wire.begin();
+    sensor.setTimeout(500);
+    if (!sensor.init()) {
+      return false;
+    }
+    sensor.startContinuous(RANGING_PERIOD);
+    pinMode(tofInterruptPin, INPUT_PULLUP);
+    return true;
+  }
+
+  bool read(int& distanceMm) override {
+    // Only read once a new measurement is ready, so the read never waits
+    // for the sensor's 50 ms ranging period. While watching, that's the
+    // range behind the threshold interrupt.
+    if (watching ? !tofTriggered : (sensor.readReg(VL53L0X::RESULT_INTERRUPT_STATUS) & 0x07) == 0) {
+      return false;
+    }
+    distanceMm = sensor.readRangeContinuousMillimeters();
+    return true;
+  }
+
+  // GPIO1 switches from "new sample ready" to the threshold-low interrupt:
+  // it only goes low when a range comes in under SYSTEM_THRESH_LOW
+  bool watch(int closerThanMm, uint32_t periodMs) override {
+    sensor.stopContinuous();
+    sensor.writeReg16Bit(VL53L0X::SYSTEM_THRESH_LOW, closerThanMm / 2);  // Register counts 2 mm units
+    sensor.writeReg(VL53L0X::SYSTEM_INTERRUPT_CONFIG_GPIO, GPIO_THRESHOLD_LOW);
+    sensor.writeReg(VL53L0X::SYSTEM_INTERRUPT_CLEAR, 0x01);
+    tofTriggered = false;
+    attachInterrupt(digitalPinToInterrupt(tofInterruptPin), onTofInterrupt, FALLING);
+    sensor.startContinuous(periodMs);
+    watching = true;
+    return true;
+  }
+
+  bool woken() override {
+    return tofTriggered;
+  }
+
+  void resume() override {
+    if (!watching) {
+      return;
+    }
+    detachInterrupt(digitalPinToInterrupt(tofInterruptPin));
+    sensor.stopContinuous();
+    sensor.writeReg(VL53L0X::SYSTEM_INTERRUPT_CONFIG_GPIO, GPIO_NEW_SAMPLE_READY);  // As init() left it
+    sensor.writeReg(VL53L0X::SYSTEM_INTERRUPT_CLEAR, 0x01);
+    sensor.startContinuous(RANGING_PERIOD);
+    watching = false;
+  }
+
+private:
+  static const uint32_t RANGING_PERIOD = 50;
+  static const uint8_t GPIO_THRESHOLD_LOW = 0x01;
+  static const uint8_t GPIO_NEW_SAMPLE_READY = 0x04;
+
+  VL53L0X sensor;
+  bool watching = false;
+};
+
+// Adafruit_SSD1306 that can send the changed column span of one page
+// instead of the whole 512-byte framebuffer
+class PartialSsd1306 : public Adafruit_SSD1306 {
+public:
+  using Adafruit_SSD1306::Adafruit_SSD1306;
+
+  void sendSpan(uint8_t page, uint8_t first, uint8_t last) {
+    wire->setClock(wireClk);
+    const uint8_t window[] = {SSD1306_PAGEADDR, page, page, SSD1306_COLUMNADDR, first, last};
+    ssd1306_commandList(window, sizeof(window));
+
+    // Same chunking as display(): a 0x40 data control byte per write
+    const uint8_t* data = getBuffer() + page * WIDTH + first;
+    uint16_t count = last - first + 1;
+    while (count > 0) {
+      uint16_t chunk = count < FRAME_I2C_CHUNK - 1 ? count : FRAME_I2C_CHUNK - 1;
+      wire->beginTransmission(i2caddr);
+      wire->write((uint8_t)0x40);
+      wire->write(data, chunk);
+      wire->endTransmission();
+      data += chunk;
+      count -= chunk;
+    }
+    wire->setClock(restoreClk);
+  }
+};
+
+// The I2C bus is shared with the ToF sensor, so a refresh only sends the
+// pages (and within them the columns) that changed since the last one
+class Ssd1306Display : public TextDisplay {
+public:
+  Ssd1306Display() : oled(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET) {}
+
+  bool begin() {
+    if (!oled.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
+      return false;
+    }
+    oled.clearDisplay();
+    oled.setTextSize(1);
+    oled.setTextColor(SSD1306_WHITE);
+    changes.invalidate();  // Whatever begin() left on the panel is unknown
+    return true;
+  }
+
+  void clearDisplay() override { oled.clearDisplay(); }
+  void setTextSize(uint8_t size) override { oled.setTextSize(size); }
+  void setTextColor(uint16_t color) override { oled.setTextColor(color); }
+  void setCursor(int16_t x, int16_t y) override { oled.setCursor(x, y); }
+  void print(const char* text) override { oled.print(text); }
+  void print(int value) override { oled.print(value); }
+  void println(const char* text) override { oled.println(text); }
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override {
+    oled.fillRect(x, y, w, h, color);
+  }
+  void display() override {
+    PageSpan spans[FrameDiff::PAGES];
+    if (changes.update(oled.getBuffer(), spans) == 0) {
+      return;
+    }
+    for (uint8_t page = 0; page < FrameDiff::PAGES; page++) {
+      if (spans[page].dirty) {
+        oled.sendSpan(page, spans[page].first, spans[page].last);
+      }
+    }
+  }
+
+private:
+  PartialSsd1306 oled;
+  FrameDiff changes;
+};
+
+// MQTT over WiFiNINA with a non-blocking reconnect state machine
+class MqttPublisher : public Publisher {
+public:
+  MqttPublisher() : mqttClient(wifi), reconnectBackoff(1000, 60000) {}
+
+  void begin() {
+    // WiFi.begin() normally waits for the join - with no timeout it only
+    // starts it, and maintain() polls WiFi.status() for the result
+    WiFi.setTimeout(0);
+  }
+
+  void subscribe(const char* topic) override {
+    subscribeTopic = topic;
+  }
+
+  bool connected() override {
+    return linkState == LINK_UP;
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, size_t length) override {
+    // With the size up front the payload streams straight to the socket.
+    // Without it ArduinoMqttClient buffers it in 256 bytes, silently drops
+    // the rest and still reports success.
+    if (linkState != LINK_UP || length > PUBLISH_MAX_PAYLOAD ||
+        !mqttClient.beginMessage(topic, (unsigned long)length)) {
+      return false;
+    }
+    if (mqttClient.write(payload, length) != length) {
+      // The broker is owed the rest of a packet whose size it already
+      // has - the session can't be trusted any more, so start a new one
+      Serial.println("MQTT write cut short");
+      mqttClient.stop();
+      linkState = LINK_MQTT_DOWN;
+      return false;
+    }
+    return mqttClient.endMessage() == 1;
+  }
+
+  // WiFiNINA's power save: the radio sleeps between beacons, so traffic
+  // takes longer but the connection to the broker stays up
+  void setLowPower(bool enabled) override {
+    if (enabled) {
+      WiFi.lowPowerMode();
+    } else {
+      WiFi.noLowPowerMode();
+    }
+  }
+
+  void poll(uint32_t now) override {
+    if (linkState == LINK_UP) {
+      mqttClient.poll();
+    }
+  }
+
+  // Each call does at most one step, failed attempts back off exponentially
+  // so a dead network doesn't eat the sensing loop
+  void maintain(uint32_t now) override {
+    switch (linkState) {
+      case LINK_WIFI_DOWN:
+        if (reconnectBackoff.ready(now)) {
+          Serial.println("Attempting WiFi connection...");
+          WiFi.begin(SECRET_SSID, SECRET_PASS);  // Returns at once, see begin()
+          wifiJoinStartTime = now;
+          linkState = LINK_WIFI_JOINING;
+        }
+        break;
+
+      case LINK_WIFI_JOINING:
+        if (WiFi.status() == WL_CONNECTED) {
+          Serial.println("Connected to WiFi!");
+          reconnectBackoff.succeeded();
+          linkState = LINK_MQTT_DOWN;
+        } else if (now - wifiJoinStartTime > WIFI_JOIN_TIMEOUT) {
+          reconnectBackoff.failed(now);
+          Serial.print("WiFi join timed out, next try in ");
+          Serial.print(reconnectBackoff.currentDelay());
+          Serial.println(" ms");
+          linkState = LINK_WIFI_DOWN;
+        }
+        break;
+
+      case LINK_MQTT_DOWN:
+        if (WiFi.status() != WL_CONNECTED) {
+          linkState = LINK_WIFI_DOWN;
+        } else if (reconnectBackoff.ready(now)) {
+          if (connectToBroker()) {
+            reconnectBackoff.succeeded();
+            linkState = LINK_UP;
+          } else {
+            reconnectBackoff.failed(now);
+          }
+        }
+        break;
+
+      case LINK_UP:
+        if (WiFi.status() != WL_CONNECTED) {
+          Serial.println("WiFi lost");
+          linkState = LINK_WIFI_DOWN;
+        } else if (!mqttClient.connected()) {
+          Serial.println("MQTT lost");
+          linkState = LINK_MQTT_DOWN;
+        }
+        break;
+    }
+  }
+
+private:
+  // Network link state machine - replaces the blocking connect loops
+  enum LinkState {
+    LINK_WIFI_DOWN,     // Waiting for the backoff before trying WiFi
+    LINK_WIFI_JOINING,  // WiFi.begin() issued, polling for the result
+    LINK_MQTT_DOWN,     // WiFi up, broker not connected
+    LINK_UP             // WiFi and MQTT both connected
+  };
+
+  static const unsigned long WIFI_JOIN_TIMEOUT = 15000;   // Give up on one join attempt after 15 s
+  // connect() blocks the whole loop until the broker answers - keep it
+  // inside the connection task's 1 s deadline (see CONNECTION_PERIOD in main.cpp)
+  static const unsigned long MQTT_CONNECT_TIMEOUT = 1000;
+
+  WiFiClient wifi;
+  MqttClient mqttClient;
+  LinkState linkState = LINK_WIFI_DOWN;
+  Backoff reconnectBackoff;                 // 1 s doubling up to 1 minute
+  unsigned long wifiJoinStartTime = 0;
+  const char* subscribeTopic = nullptr;
+
+  boolean connectToBroker() {
+    Serial.println("Connecting to MQTT...");
+    mqttClient.setId(clientID);
+    mqttClient.setConnectionTimeout(MQTT_CONNECT_TIMEOUT);
+    mqttClient.setUsernamePassword(SECRET_MQTT_USER, SECRET_MQTT_PASS);
+    
+    if (!mqttClient.connect(broker, port)) {
+      Serial.print("MQTT failed. Error: ");
+      Serial.println(mqttClient.connectError());
+      return false;
+    }
+
+    Serial.println("MQTT connected!");
+    if (subscribeTopic != nullptr) {
+      mqttClient.subscribe(subscribeTopic);
+    }
+    return true;
+  }
+};
+
+// Stack high-water mark: boardBegin() fills the free RAM below the stack
+// with a pattern, and the deepest the stack went is where it stops
+extern "C" char* sbrk(int incr);
+extern uint32_t __StackTop;  // From the linker script
+static const uint32_t STACK_PAINT = 0xA5A5A5A5;
+
+static uint32_t* heapEnd() {
+  return (uint32_t*)(((uintptr_t)sbrk(0) + 3) & ~(uintptr_t)3);
+}
+
+static void paintStack() {
+  // Leave the frames that are live right now (and a margin) alone
+  uint32_t* limit = (uint32_t*)__builtin_frame_address(0) - 64;
+  for (uint32_t* word = heapEnd(); word < limit; word++) {
+    *word = STACK_PAINT;
+  }
+}
+
+static ArduinoClock systemClock;
+static DmaMicSource micSource;
+static TofDistanceSensor tofSensor;
+static Ssd1306Display oledDisplay;
+static MqttPublisher mqttPublisher;
+
+bool boardBegin() {
+  paintStack();
+
+  //oled initialized
+  if (!oledDisplay.begin()) {
+    Serial.println("SSD1306 allocation failed");
+    return false;
+  }
+
+  if (!tofSensor.begin()) {
+    Serial.println("Failed to initialize ToF sensor!");
+    return false;
+  }
+
+  mqttPublisher.begin();
+  return true;
+}
+
+Clock& boardClock() {
+  return systemClock;
+}
+
+MicSource& boardMic() {
+  return micSource;
+}
+
+DistanceSensor& boardDistanceSensor() {
+  return tofSensor;
+}
+
+TextDisplay& boardDisplay() {
+  return oledDisplay;
+}
+
+Publisher& boardPublisher() {
+  return mqttPublisher;
+}
+
+uint32_t boardFreeMemory() {
+  char top;
+  return &top - (char*)sbrk(0);
+}
+
+uint32_t boardStackHighWater() {
+  // Heap that grew into the painted area starts below heapEnd(), so the
+  // first word not holding the pattern is the stack's deepest
+  const uint32_t* word = heapEnd();
+  while (word < &__StackTop && *word == STACK_PAINT) {
+    word++;
+  }
+  return (const char*)&__StackTop - (const char*)word;
+}
+
+void boardSleep(uint32_t maxMs) {
+  if (maxMs == 0) {
+    return;
+  }
+  // IDLE0: only the CPU clock stops. SysTick keeps running, so millis()
+  // stays right and its next tick (1 ms at most) wakes the core, as do the
+  // ToF, DMA and USB interrupts - maxMs needs no timer of its own.
+  PM->SLEEP.reg = PM_SLEEP_IDLE_CPU;
+  SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+  __DSB();
+  __WFI();
+}
@@ -0,0 +1,55 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Just enough of the Arduino core for src/main.cpp to build on Linux.
+// Time comes from the simulator's clock (boardClock()), not the wall clock.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <cmath>
+#include <cstdlib>
+
+using std::abs;
+
+typedef bool boolean;
+
+uint32_t millis();
+uint32_t micros();
+void delay(unsigned long ms);  // No-op, simulated time only moves in the simulator loop
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Serial port that writes to a file, or nowhere (the default)
+class SerialPort {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  explicit operator bool() const { return true; }
+
+  void setOutput(FILE* file) { out = file; }
+
+  void print(const char* text);
+  void print(char c);
+  void print(int value);
+  void print(unsigned int value);
+  void print(long value);
+  void print(unsigned long value);
+  void print(double value);  // Two decimals, like the Arduino core
+
+  template <typename T>
+  void println(T value) {
+    print(value);
+    print("\n");
+  }
+  void println() { print("\n"); }
+
+private:
+  FILE* out = nullptr;
+};
+
+extern SerialPort Serial;
+
+#endif
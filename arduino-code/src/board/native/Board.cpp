@@ -0,0 +1,462 @@
+// Native (Linux) implementation of the HAL and the Arduino core shim
+
+#include <string.h>
+#include "Arduino.h"
+#include "SimBoard.h"
+
+SerialPort Serial;
+
+static SimClock systemClock;
+static SimMicSource micSource;
+static TraceDistanceSensor traceSensor;
+static RecordingDisplay recordingDisplay;
+static RecordingPublisher recordingPublisher;
+
+uint32_t millis() {
+  return systemClock.millis();
+}
+
+uint32_t micros() {
+  return systemClock.micros();
+}
+
+void delay(unsigned long ms) {
+  (void)ms;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void SerialPort::print(const char* text) {
+  if (out != nullptr) fputs(text, out);
+}
+
+void SerialPort::print(char c) {
+  if (out != nullptr) fputc(c, out);
+}
+
+void SerialPort::print(int value) {
+  if (out != nullptr) fprintf(out, "%d", value);
+}
+
+void SerialPort::print(unsigned int value) {
+  if (out != nullptr) fprintf(out, "%u", value);
+}
+
+void SerialPort::print(long value) {
+  if (out != nullptr) fprintf(out, "%ld", value);
+}
+
+void SerialPort::print(unsigned long value) {
+  if (out != nullptr) fprintf(out, "%lu", value);
+}
+
+void SerialPort::print(double value) {
+  if (out != nullptr) fprintf(out, "%.2f", value);
+}
+
+// WAV
+
+static uint32_t readLe32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t readLe16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+WavReader::~WavReader() {
+  if (file != nullptr) fclose(file);
+}
+
+bool WavReader::open(const char* path) {
+  file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint8_t header[12];
+  if (fread(header, 1, 12, file) != 12 ||
+      memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+    fclose(file);
+    file = nullptr;
+    return false;
+  }
+
+  // Walk the chunks until "data", picking up the format on the way
+  uint16_t bitsPerSample = 0;
+  uint8_t chunk[8];
+  while (fread(chunk, 1, 8, file) == 8) {
+    uint32_t chunkSize = readLe32(chunk + 4);
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      uint8_t fmt[16];
+      if (chunkSize < 16 || fread(fmt, 1, 16, file) != 16) break;
+      uint16_t format = readLe16(fmt);
+      channels = readLe16(fmt + 2);
+      sampleRate = readLe32(fmt + 4);
+      bitsPerSample = readLe16(fmt + 14);
+      if (format != 1 || bitsPerSample != 16 || channels == 0) break;
+      fseek(file, (chunkSize - 16) + (chunkSize & 1), SEEK_CUR);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (sampleRate == 0) break;
+      frameCount = chunkSize / (2 * channels);
+      nextFrame = 0;
+      return true;
+    } else {
+      fseek(file, chunkSize + (chunkSize & 1), SEEK_CUR);
+    }
+  }
+
+  // Only 16-bit PCM is supported
+  fclose(file);
+  file = nullptr;
+  return false;
+}
+
+bool WavReader::sampleAt(uint64_t frame, int16_t& sample) {
+  if (file == nullptr || frame >= frameCount) {
+    return false;
+  }
+  if (frame == lastFrame) {
+    sample = lastValue;
+    return true;
+  }
+
+  // Skip forward to the wanted frame
+  if (frame > nextFrame) {
+    fseek(file, (long)((frame - nextFrame) * 2 * channels), SEEK_CUR);
+    nextFrame = frame;
+  }
+
+  int32_t sum = 0;
+  for (uint16_t c = 0; c < channels; c++) {
+    uint8_t bytes[2];
+    if (fread(bytes, 1, 2, file) != 2) {
+      frameCount = frame;  // Truncated file
+      return false;
+    }
+    sum += (int16_t)readLe16(bytes);
+  }
+  nextFrame = frame + 1;
+  lastFrame = frame;
+  lastValue = (int16_t)(sum / channels);
+  sample = lastValue;
+  return true;
+}
+
+// Microphone
+
+void SimMicSource::advanceTo(uint32_t nowMs) {
+  uint32_t rate = capture.sampleRate();
+  if (rate == 0) {
+    return;
+  }
+
+  // The MAX9814 output sits at mid-scale of the 10-bit ADC, full-scale WAV
+  // swings map to the ADC rails
+  uint64_t due = (uint64_t)nowMs * rate / 1000;
+  int16_t block[CAPTURE_SAMPLES];
+  size_t count = 0;
+  while (samplesFed < due) {
+    int16_t pcm = 0;
+    if (input.isOpen()) {
+      input.sampleAt(samplesFed * input.rate() / rate, pcm);
+    }
+    long value = 512 + lround(pcm * gain / 64.0f);
+    block[count++] = (int16_t)constrain(value, 0L, 1023L);
+    samplesFed++;
+
+    if (count == CAPTURE_SAMPLES) {
+      capture.feedSamples(block, count);
+      count = 0;
+    }
+  }
+  capture.feedSamples(block, count);
+}
+
+// Distance
+
+bool TraceDistanceSensor::load(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+
+  // Lines that don't parse (a header, comments) are skipped
+  char line[128];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    unsigned long timeMs;
+    int distanceMm;
+    if (sscanf(line, "%lu , %d", &timeMs, &distanceMm) == 2) {
+      trace.push_back({(uint32_t)timeMs, distanceMm});
+    }
+  }
+  fclose(file);
+  position = 0;
+  return !trace.empty();
+}
+
+int TraceDistanceSensor::distanceAt(uint32_t nowMs) {
+  if (trace.empty()) {
+    return fixedDistance;
+  }
+
+  // Step-hold: the last row at or before now (nothing measured yet = far away)
+  while (position < trace.size() && trace[position].timeMs <= nowMs) {
+    position++;
+  }
+  return position == 0 ? 8190 : trace[position - 1].distanceMm;
+}
+
+bool TraceDistanceSensor::read(int& distanceMm) {
+  if (watching) {
+    if (!triggered) {
+      return false;
+    }
+    distanceMm = wakeDistance;
+    return true;
+  }
+  uint32_t now = systemClock.millis();
+  if ((int32_t)(now - nextReadyMs) < 0) {
+    return false;
+  }
+  nextReadyMs = now + RANGING_PERIOD;
+  distanceMm = distanceAt(now);
+  return true;
+}
+
+bool TraceDistanceSensor::watch(int closerThanMm, uint32_t periodMs) {
+  watching = true;
+  triggered = false;
+  watchThreshold = closerThanMm;
+  watchPeriod = periodMs;
+  nextReadyMs = systemClock.millis() + periodMs;
+  return true;
+}
+
+bool TraceDistanceSensor::woken() {
+  uint32_t now = systemClock.millis();
+  if (watching && !triggered && (int32_t)(now - nextReadyMs) >= 0) {
+    nextReadyMs = now + watchPeriod;
+    if (distanceAt(now) < watchThreshold) {
+      wakeDistance = distanceAt(now);
+      triggered = true;
+      wakeCount++;
+    }
+  }
+  return triggered;
+}
+
+void TraceDistanceSensor::resume() {
+  watching = false;
+  nextReadyMs = systemClock.millis() + RANGING_PERIOD;
+}
+
+// Display
+
+void RecordingDisplay::clearDisplay() {
+  memset(frame, 0, sizeof(frame));
+}
+
+void RecordingDisplay::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (x < 0 || x >= FRAME_WIDTH || y < 0 || y >= FRAME_HEIGHT) {
+    return;
+  }
+  uint8_t& cell = frame[x + (y / 8) * FRAME_WIDTH];
+  uint8_t bit = 1 << (y & 7);
+  cell = color == DISPLAY_BLACK ? (cell & ~bit) : (cell | bit);
+}
+
+void RecordingDisplay::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  for (int16_t i = x; i < x + w; i++) {
+    for (int16_t j = y; j < y + h; j++) {
+      drawPixel(i, j, color);
+    }
+  }
+}
+
+void RecordingDisplay::drawChar(char c) {
+  if (c == '\n') {
+    cursorX = 0;
+    cursorY += 8 * textSize;
+    return;
+  }
+  if (cursorX + 6 * textSize > FRAME_WIDTH) {  // Wrap like Adafruit GFX
+    cursorX = 0;
+    cursorY += 8 * textSize;
+  }
+
+  // Five columns of 7 rows from a hash of the character, blank for a space.
+  // Only set pixels are drawn, as with the GFX default (no background).
+  if (c != ' ') {
+    uint32_t pattern = (uint8_t)c * 2654435761u;
+    for (int column = 0; column < 5; column++) {
+      uint8_t bits = (uint8_t)(((pattern >> (column * 5)) & 0x7F) | 0x08);
+      for (int row = 0; row < 7; row++) {
+        if (bits & (1 << row)) {
+          fillRect(cursorX + column * textSize, cursorY + row * textSize, textSize, textSize, textColor);
+        }
+      }
+    }
+  }
+  cursorX += 6 * textSize;
+}
+
+void RecordingDisplay::print(const char* text) {
+  while (*text) {
+    drawChar(*text++);
+  }
+}
+
+void RecordingDisplay::print(int value) {
+  char text[12];
+  snprintf(text, sizeof(text), "%d", value);
+  print(text);
+}
+
+void RecordingDisplay::println(const char* text) {
+  print(text);
+  drawChar('\n');
+}
+
+void RecordingDisplay::display() {
+  PageSpan spans[FrameDiff::PAGES];
+  int dataBytes = changes.update(frame, spans);
+  uint32_t wireBytes = dataBytes > 0 ? FrameDiff::i2cBytes(spans) : 0;
+
+  frameCount++;
+  if (dataBytes > 0) {
+    sentCount++;
+  }
+  byteCount += wireBytes;
+  if (wireBytes > maxBytes) {
+    maxBytes = wireBytes;
+  }
+  if (frameLog != nullptr) {
+    fprintf(frameLog, "%lu %d %lu\n", (unsigned long)systemClock.millis(), dataBytes,
+            (unsigned long)wireBytes);
+  }
+}
+
+uint64_t RecordingDisplay::fullRefreshBytes() const {
+  return (uint64_t)frameCount * FrameDiff::fullFrameI2cBytes();
+}
+
+// Publisher
+
+bool RecordingPublisher::connected() {
+  uint32_t now = systemClock.millis();
+  return now < outageStart || now >= outageEnd;
+}
+
+void RecordingPublisher::setLowPower(bool enabled) {
+  uint32_t now = systemClock.millis();
+  if (enabled && !lowPower) {
+    lowPowerSince = now;
+  } else if (!enabled && lowPower) {
+    lowPowerTotal += now - lowPowerSince;
+  }
+  lowPower = enabled;
+}
+
+uint64_t RecordingPublisher::lowPowerMs(uint32_t nowMs) const {
+  return lowPowerTotal + (lowPower ? nowMs - lowPowerSince : 0);
+}
+
+bool RecordingPublisher::publish(const char* topic, const uint8_t* payload, size_t length) {
+  if (!connected() || length > PUBLISH_MAX_PAYLOAD) {
+    return false;
+  }
+  uint32_t now = systemClock.millis();
+  log.push_back({now, topic, std::vector<uint8_t>(payload, payload + length)});
+  byteCount += length;
+
+  if (out != nullptr) {
+    bool text = true;
+    for (size_t i = 0; i < length; i++) {
+      if (payload[i] < 0x20 || payload[i] > 0x7e) {
+        text = false;
+        break;
+      }
+    }
+
+    fprintf(out, "%lu %s ", (unsigned long)now, topic);
+    if (text) {
+      fwrite(payload, 1, length, out);
+    } else {
+      for (size_t i = 0; i < length; i++) {
+        fprintf(out, "%02x", payload[i]);
+      }
+    }
+    fputc('\n', out);
+  }
+  return true;
+}
+
+bool boardBegin() {
+  return true;
+}
+
+Clock& boardClock() {
+  return systemClock;
+}
+
+MicSource& boardMic() {
+  return micSource;
+}
+
+DistanceSensor& boardDistanceSensor() {
+  return traceSensor;
+}
+
+TextDisplay& boardDisplay() {
+  return recordingDisplay;
+}
+
+Publisher& boardPublisher() {
+  return recordingPublisher;
+}
+
+// The host's memory says nothing about the board's 32 KB
+uint32_t boardFreeMemory() {
+  return 0;
+}
+
+uint32_t boardStackHighWater() {
+  return 0;
+}
+
+// The simulator runs one loop() per millisecond step, so a sleep always
+// lasts the rest of the step - only counted
+static uint32_t sleptSteps = 0;
+
+void boardSleep(uint32_t maxMs) {
+  if (maxMs > 0) {
+    sleptSteps++;
+  }
+}
+
+uint32_t simSleptMs() {
+  return sleptSteps;
+}
+
+SimClock& simClock() {
+  return systemClock;
+}
+
+SimMicSource& simMic() {
+  return micSource;
+}
+
+TraceDistanceSensor& simDistanceSensor() {
+  return traceSensor;
+}
+
+RecordingDisplay& simDisplay() {
+  return recordingDisplay;
+}
+
+RecordingPublisher& simPublisher() {
+  return recordingPublisher;
+}
@@ -0,0 +1,202 @@
+#ifndef SIM_BOARD_H
+#define SIM_BOARD_H
+
+#include <stdio.h>
+#include <vector>
+#include "AdcCapture.h"
+#include "Board.h"
+#include "FrameDiff.h"
+
+// Native implementation of the HAL. The simulator owns time: it moves the
+// clock forward, lets the mic "convert" every sample up to that moment, then
+// runs one loop(). Nothing here ever looks at the wall clock.
+
+class SimClock : public Clock {
+public:
+  uint32_t millis() override { return nowMs; }
+  uint32_t micros() override { return nowMs * 1000; }
+  void set(uint32_t ms) { nowMs = ms; }
+
+private:
+  uint32_t nowMs = 0;
+};
+
+// 16-bit PCM WAV file read front to back, any rate and channel count
+class WavReader {
+public:
+  ~WavReader();
+  bool open(const char* path);
+  bool isOpen() const { return file != nullptr; }
+
+  // Sample at frame index (channels mixed down). Indexes must not go
+  // backwards. Returns false once past the end of the file.
+  bool sampleAt(uint64_t frame, int16_t& sample);
+
+  uint32_t rate() const { return sampleRate; }
+  uint64_t frames() const { return frameCount; }
+
+private:
+  FILE* file = nullptr;
+  uint32_t sampleRate = 0;
+  uint16_t channels = 0;
+  uint64_t frameCount = 0;
+  uint64_t nextFrame = 0;  // Frame the file position is at
+  int16_t lastValue = 0;
+  uint64_t lastFrame = UINT64_MAX;
+};
+
+// Plays a WAV through the AdcCapture host stub, point-sampled at the capture
+// rate like the real ADC (so aliasing is the same as on the board). Silence
+// (mid-scale) once the file runs out or when there is no file.
+class SimMicSource : public MicSource {
+public:
+  bool begin(uint32_t sampleRate) override { return capture.begin(0, sampleRate); }
+  const int16_t* acquireBlock() override { return capture.acquire(); }
+  void releaseBlock() override { capture.release(); }
+  int16_t latestSample() override { return capture.latestSample(); }
+  uint32_t sampleRate() override { return capture.sampleRate(); }
+  void pause() override { capture.pause(); }
+  void resume() override { capture.resume(); }
+
+  WavReader& wav() { return input; }
+  void setGain(float value) { gain = value; }
+
+  // Convert every sample due up to nowMs
+  void advanceTo(uint32_t nowMs);
+
+  const CaptureBuffers& stats() const { return capture.stats(); }
+
+private:
+  AdcCapture capture;
+  WavReader input;
+  float gain = 1.0f;
+  uint64_t samplesFed = 0;
+};
+
+// Distance from a CSV trace of "time_ms,distance_mm" rows (step-hold between
+// rows), or a fixed distance without one. Like the VL53L0X in continuous
+// mode a new measurement is ready every 50 ms; while watching, one every
+// watch period, and the "interrupt" fires on the first one under the
+// threshold.
+class TraceDistanceSensor : public DistanceSensor {
+public:
+  bool load(const char* path);
+  void setFixedDistance(int mm) { fixedDistance = mm; }
+  bool read(int& distanceMm) override;
+  bool watch(int closerThanMm, uint32_t periodMs) override;
+  bool woken() override;
+  void resume() override;
+
+  uint32_t wakes() const { return wakeCount; }
+
+private:
+  int distanceAt(uint32_t nowMs);
+
+  struct Point {
+    uint32_t timeMs;
+    int distanceMm;
+  };
+  static const uint32_t RANGING_PERIOD = 50;
+
+  std::vector<Point> trace;
+  size_t position = 0;
+  int fixedDistance = 100;
+  uint32_t nextReadyMs = 0;
+  bool watching = false;
+  bool triggered = false;
+  int watchThreshold = 0;
+  uint32_t watchPeriod = 0;
+  int wakeDistance = 0;  // The range that raised the wake
+  uint32_t wakeCount = 0;
+};
+
+// 128x32 framebuffer in SSD1306 layout with the same dirty-page refresh as
+// the board, counting the I2C bytes each display() would put on the bus.
+// Text uses stand-in glyphs in the 6x8 cells of the Adafruit font: positions
+// and sizes match the panel, so do the pages and spans a change touches.
+class RecordingDisplay : public TextDisplay {
+public:
+  void clearDisplay() override;
+  void setTextSize(uint8_t size) override { textSize = size; }
+  void setTextColor(uint16_t color) override { textColor = color; }
+  void setCursor(int16_t x, int16_t y) override {
+    cursorX = x;
+    cursorY = y;
+  }
+  void print(const char* text) override;
+  void print(int value) override;
+  void println(const char* text) override;
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+  void display() override;
+
+  // One "time_ms data_bytes i2c_bytes" line per display() call
+  void setFrameLog(FILE* file) { frameLog = file; }
+
+  uint32_t frames() const { return frameCount; }          // display() calls
+  uint32_t framesSent() const { return sentCount; }       // ...that changed anything
+  uint64_t bytes() const { return byteCount; }            // I2C bytes sent
+  uint32_t maxFrameBytes() const { return maxBytes; }
+  uint64_t fullRefreshBytes() const;  // What the same frames cost as full refreshes
+
+private:
+  void drawPixel(int16_t x, int16_t y, uint16_t color);
+  void drawChar(char c);
+
+  uint8_t frame[FrameDiff::FRAME_BYTES] = {};
+  FrameDiff changes;
+  int16_t cursorX = 0;
+  int16_t cursorY = 0;
+  uint8_t textSize = 1;
+  uint16_t textColor = DISPLAY_WHITE;
+  FILE* frameLog = nullptr;
+  uint32_t frameCount = 0;
+  uint32_t sentCount = 0;
+  uint64_t byteCount = 0;
+  uint32_t maxBytes = 0;
+};
+
+// Publisher that is connected except during an optional outage window. Keeps
+// every message in memory and, if a file is set, also writes one
+// "time_ms topic payload" line per message. Payloads that aren't printable
+// text (binary frames) are written as hex.
+class RecordingPublisher : public Publisher {
+public:
+  struct Message {
+    uint32_t timeMs;
+    const char* topic;
+    std::vector<uint8_t> payload;
+  };
+
+  void setOutput(FILE* file) { out = file; }
+  void setOutage(uint32_t startMs, uint32_t endMs) {
+    outageStart = startMs;
+    outageEnd = endMs;
+  }
+
+  bool connected() override;
+  bool publish(const char* topic, const uint8_t* payload, size_t length) override;
+  void setLowPower(bool enabled) override;
+
+  const std::vector<Message>& messages() const { return log; }
+  uint64_t bytes() const { return byteCount; }
+  uint64_t lowPowerMs(uint32_t nowMs) const;  // Total time in power save up to nowMs
+
+private:
+  FILE* out = nullptr;
+  uint32_t outageStart = 0;
+  uint32_t outageEnd = 0;
+  std::vector<Message> log;
+  uint64_t byteCount = 0;
+  bool lowPower = false;
+  uint32_t lowPowerSince = 0;
+  uint64_t lowPowerTotal = 0;
+};
+
+SimClock& simClock();
+SimMicSource& simMic();
+TraceDistanceSensor& simDistanceSensor();
+RecordingDisplay& simDisplay();
+RecordingPublisher& simPublisher();
+uint32_t simSleptMs();  // 1 ms steps in which the firmware called boardSleep()
+
+#endif
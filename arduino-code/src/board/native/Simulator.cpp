@@ -0,0 +1,160 @@
+// Runs the unchanged firmware (setup()/loop() in src/main.cpp) against
+// recorded inputs, as fast as the host allows.
+//
+//   pio run -e native
+//   .pio/build/native/program --wav practice.wav --distance bench.csv --out messages.txt
+//
+//   --wav FILE        16-bit PCM audio fed to the mic (any rate, mixed to mono)
+//   --distance FILE   CSV of time_ms,distance_mm rows for the ToF sensor
+//   --distance-mm N   Fixed distance when there is no trace (default 100)
+//   --duration S      Seconds to simulate (default: length of the WAV)
+//   --gain G          Scale applied to the audio before the ADC (default 1)
+//   --outage S,E      Network down from S to E seconds into the run
+//   --out FILE        Write every published message, "-" for stdout
+//   --display-log FILE  Bytes each display refresh sent over I2C
+//   --verbose         Firmware Serial output to stderr
+//
+// Prints a summary to stderr: simulated vs wall time, what was published and
+// how long one hour of audio takes to process.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "SimBoard.h"
+
+void setup();
+void loop();
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [--wav FILE] [--distance FILE] [--distance-mm N] [--duration S]\n"
+          "          [--gain G] [--outage S,E] [--out FILE|-] [--display-log FILE]\n"
+          "          [--verbose]\n",
+          program);
+}
+
+int main(int argc, char** argv) {
+  const char* wavPath = nullptr;
+  const char* distancePath = nullptr;
+  const char* outPath = nullptr;
+  const char* displayLogPath = nullptr;
+  double durationSeconds = 0;
+  bool verbose = false;
+
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--wav") == 0 && hasValue) {
+      wavPath = argv[++i];
+    } else if (strcmp(argv[i], "--distance") == 0 && hasValue) {
+      distancePath = argv[++i];
+    } else if (strcmp(argv[i], "--distance-mm") == 0 && hasValue) {
+      simDistanceSensor().setFixedDistance(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--duration") == 0 && hasValue) {
+      durationSeconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--gain") == 0 && hasValue) {
+      simMic().setGain((float)atof(argv[++i]));
+    } else if (strcmp(argv[i], "--outage") == 0 && hasValue) {
+      double start, end;
+      if (sscanf(argv[++i], "%lf,%lf", &start, &end) != 2 || end < start) {
+        usage(argv[0]);
+        return 2;
+      }
+      simPublisher().setOutage((uint32_t)(start * 1000), (uint32_t)(end * 1000));
+    } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+      outPath = argv[++i];
+    } else if (strcmp(argv[i], "--display-log") == 0 && hasValue) {
+      displayLogPath = argv[++i];
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      verbose = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (wavPath != nullptr && !simMic().wav().open(wavPath)) {
+    fprintf(stderr, "Can't read %s (16-bit PCM WAV only)\n", wavPath);
+    return 1;
+  }
+  if (distancePath != nullptr && !simDistanceSensor().load(distancePath)) {
+    fprintf(stderr, "Can't read distance trace %s\n", distancePath);
+    return 1;
+  }
+
+  FILE* out = nullptr;
+  if (outPath != nullptr) {
+    out = strcmp(outPath, "-") == 0 ? stdout : fopen(outPath, "w");
+    if (out == nullptr) {
+      fprintf(stderr, "Can't write %s\n", outPath);
+      return 1;
+    }
+    simPublisher().setOutput(out);
+  }
+  FILE* displayLog = nullptr;
+  if (displayLogPath != nullptr) {
+    displayLog = fopen(displayLogPath, "w");
+    if (displayLog == nullptr) {
+      fprintf(stderr, "Can't write %s\n", displayLogPath);
+      return 1;
+    }
+    simDisplay().setFrameLog(displayLog);
+  }
+  if (verbose) {
+    Serial.setOutput(stderr);
+  }
+
+  if (durationSeconds <= 0) {
+    const WavReader& wav = simMic().wav();
+    if (!wav.isOpen()) {
+      usage(argv[0]);
+      fprintf(stderr, "Need --wav or --duration\n");
+      return 2;
+    }
+    durationSeconds = (double)wav.frames() / wav.rate();
+  }
+  uint32_t endMs = (uint32_t)(durationSeconds * 1000);
+
+  // 1 ms steps: every scheduler period and timeout in the firmware is a
+  // whole number of milliseconds
+  auto wallStart = std::chrono::steady_clock::now();
+  simClock().set(0);
+  setup();
+  for (uint32_t now = 0; now <= endMs; now++) {
+    simClock().set(now);
+    simMic().advanceTo(now);
+    loop();
+  }
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  if (out != nullptr && out != stdout) {
+    fclose(out);
+  }
+  if (displayLog != nullptr) {
+    fclose(displayLog);
+  }
+
+  double simulatedSeconds = endMs / 1000.0;
+  const CaptureBuffers& capture = simMic().stats();
+  fprintf(stderr, "simulated      %.1f s\n", simulatedSeconds);
+  fprintf(stderr, "wall           %.3f s\n", wallSeconds);
+  fprintf(stderr, "speedup        %.0fx real time\n", wallSeconds > 0 ? simulatedSeconds / wallSeconds : 0);
+  fprintf(stderr, "per audio hour %.2f s\n", simulatedSeconds > 0 ? wallSeconds * 3600 / simulatedSeconds : 0);
+  fprintf(stderr, "audio blocks   %lu (%lu dropped, %lu overruns)\n",
+          (unsigned long)capture.blocksCompleted(), (unsigned long)capture.dropped(),
+          (unsigned long)capture.overruns());
+  fprintf(stderr, "messages       %lu (%llu bytes)\n",
+          (unsigned long)simPublisher().messages().size(),
+          (unsigned long long)simPublisher().bytes());
+  const RecordingDisplay& display = simDisplay();
+  fprintf(stderr, "display frames %lu (%lu sent), %llu I2C bytes, max %lu per frame\n",
+          (unsigned long)display.frames(), (unsigned long)display.framesSent(),
+          (unsigned long long)display.bytes(), (unsigned long)display.maxFrameBytes());
+  fprintf(stderr, "full refreshes would be %llu I2C bytes\n",
+          (unsigned long long)display.fullRefreshBytes());
+  fprintf(stderr, "low-power idle cpu asleep %.1f s, wifi power save %.1f s, %lu wakes\n",
+          simSleptMs() / 1000.0, simPublisher().lowPowerMs(endMs) / 1000.0,
+          (unsigned long)simDistanceSensor().wakes());
+  return 0;
+}
@@ -1,44 +1,299 @@
+// Piano monitor application. All hardware access goes through the HAL in
+// Board.h, so this file builds unchanged for the board and the native
+// simulator (src/board/native).
 #include <Arduino.h>
-#include <WiFiNINA.h>  
-#include <ArduinoMqttClient.h>
-#include <Wire.h> 
-#include <VL53L0X.h> 
-#include <Adafruit_SSD1306.h>
-#include <Adafruit_GFX.h>
-#include "arduino_secrets.h" 
+#include "Board.h"
+#include "CaptureBuffers.h"
+#include "ChordDetector.h"
+#include "DecimationCascade.h"
+#include "Diagnostics.h"
+#include "FixedSpectrum.h"
+#include "MultiRatePitch.h"
+#include "NoiseCalibration.h"
+#include "NoteMapper.h"
+#include "TelemetryJson.h"
+#include "TelemetryBinary.h"
+#include "NoteTimeline.h"
+#include "OfflineQueue.h"
+#include "OnsetGate.h"
+#include "PianoStateMachine.h"
+#include "PitchDetector.h"
+#include "PracticeSession.h"
+#include "PublishPipeline.h"
+#include "ReportPolicy.h"
+#include "Scheduler.h"
+#include "SpectrumFrame.h"
+#include "Widgets.h"
+
+// Telemetry encodings: JSON on topic, compact binary frames on binaryTopic.
+// Enable both to run them side by side. Override with -D in build_flags.
+#ifndef TELEMETRY_JSON
+#define TELEMETRY_JSON 1
+#endif
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 0
+#endif
+
+// Base topic, the other topics hang off it. Give each piano of a fleet its
+// own (tools/ingest tells devices apart by it) with -D in build_flags:
+//   -D MQTT_TOPIC='"conndev/piano-2"'
+#ifndef MQTT_TOPIC
+#define MQTT_TOPIC "conndev/piano"
+#endif
+
+// Spectral engine: 1 = integer FixedSpectrum (no soft-float on the M0+),
+// 0 = the original ArduinoFFT path (now in float). Override with -D in build_flags.
+#ifndef SPECTRAL_ENGINE_FIXED
+#define SPECTRAL_ENGINE_FIXED 1
+#endif
+
+#if !SPECTRAL_ENGINE_FIXED
 #include <arduinoFFT.h>
+#include "HpsPitch.h"
+#endif
+
+// Pitch engine on the FixedSpectrum path, chosen at compile time so the
+// others are never linked in (see lib/PitchDetector and tools/pitch_check):
+//   PITCH_ENGINE_HPS           whole-bin harmonic product spectrum (the original)
+//   PITCH_ENGINE_INTERPOLATED  parabolic peak interpolation over the harmonics
+//   PITCH_ENGINE_YIN           time-domain YIN, reaches an octave lower
+#define PITCH_ENGINE_HPS 0
+#define PITCH_ENGINE_INTERPOLATED 1
+#define PITCH_ENGINE_YIN 2
+#ifndef PITCH_ENGINE
+#define PITCH_ENGINE PITCH_ENGINE_INTERPOLATED
+#endif
+
+#if PITCH_ENGINE == PITCH_ENGINE_HPS
+#include "HpsPitch.h"
+typedef HpsPitch PitchEngine;
+#elif PITCH_ENGINE == PITCH_ENGINE_INTERPOLATED
+#include "InterpolatedPitch.h"
+typedef InterpolatedPitch PitchEngine;
+#elif PITCH_ENGINE == PITCH_ENGINE_YIN
+#include "YinPitch.h"
+typedef YinPitch PitchEngine;
+#else
+#error "Unknown PITCH_ENGINE"
+#endif
+
+// Chord mode: besides the dominant note, report every note heard in the
+// frame as a "notes" array. Works on the FixedSpectrum magnitudes. A
+// 128-sample frame (39 Hz bins) can't separate most chord notes, so it is
+// only on by default with 256 or more samples, e.g.
+//   -D FIXED_SPECTRUM_SAMPLES=256 -D CAPTURE_SAMPLES=256
+// (tools/chord_check: precision/recall 1.00/0.94 at 256, 0.75/0.75 at 128)
+#ifndef CHORD_DETECTION
+#define CHORD_DETECTION (SPECTRAL_ENGINE_FIXED && FIXED_SPECTRUM_SAMPLES >= 256)
+#endif
+#if CHORD_DETECTION && !SPECTRAL_ENGINE_FIXED
+#error "CHORD_DETECTION needs SPECTRAL_ENGINE_FIXED"
+#endif
+#if CHORD_DETECTION && FIXED_SPECTRUM_SAMPLES < 256
+#warning "CHORD_DETECTION with fewer than 256 samples misses most chord notes"
+#endif
+
+// Onset gating: while playing, only analyze blocks after an onset (energy
+// rise on the smoothed mic level) and every ANALYSIS_REFRESH_MS while the
+// note sustains; the cached note stands in between. 0 = every block.
+#ifndef ONSET_GATING
+#define ONSET_GATING 1
+#endif
+
+// Multi-rate analysis: capture at 10 kHz so the top octaves have their
+// fundamental below Nyquist, and feed every block through a half-band
+// decimation cascade whose longer windows resolve the bass (see
+// lib/MultiRate and tools/key_sweep). 0 = one 128-sample window at 5 kHz.
+#ifndef MULTIRATE_ANALYSIS
+#define MULTIRATE_ANALYSIS SPECTRAL_ENGINE_FIXED
+#endif
+#if MULTIRATE_ANALYSIS && !SPECTRAL_ENGINE_FIXED
+#error "MULTIRATE_ANALYSIS needs SPECTRAL_ENGINE_FIXED"
+#endif
+
+// Adaptive calibration: while nobody is at the piano, learn the mic's DC
+// bias, the room's noise level and pitch strength, and tones that keep
+// coming back (hum, fans); derive the playing and pitch thresholds from
+// them and notch the tones out (see lib/NoiseCalibration and
+// tools/noise_check). 0 = the fixed constants and the 39 Hz hum filter.
+// Off until it has been tried in real rooms: tools/noise_check only shows
+// it keeps the notes of synthesized ones.
+#ifndef ADAPTIVE_CALIBRATION
+#define ADAPTIVE_CALIBRATION 0
+#endif
+#if ADAPTIVE_CALIBRATION && !SPECTRAL_ENGINE_FIXED
+#error "ADAPTIVE_CALIBRATION needs SPECTRAL_ENGINE_FIXED"
+#endif
+
+// Field diagnostics: latency histograms of the loop, capture, analysis,
+// publish, the publish ring's send delay and display flush, plus
+// reconnects, ring depth and memory, published on
+// diagTopic every DIAG_PERIOD_MS. 0 compiles every probe out.
+#ifndef DIAGNOSTICS
+#define DIAGNOSTICS 1
+#endif
+#ifndef DIAG_PERIOD_MS
+#define DIAG_PERIOD_MS 60000
+#endif
+
+// Low-power idle: after idleTimeout with nobody at the piano, stop the mic,
+// let the ToF wake us through its GPIO1 threshold interrupt, put WiFiNINA
+// in power save and sleep the CPU between the few tasks still running.
+// 0 = keep sensing at full rate forever.
+#ifndef LOW_POWER_IDLE
+#define LOW_POWER_IDLE 1
+#endif
+
+// Report-by-exception: publish a reading when the state changes, when note
+// events are due, when a field leaves its deadband (at most once per
+// REPORT_MIN_GAP_MS) or after REPORT_HEARTBEAT_MS of silence (see
+// lib/Telemetry/ReportPolicy.h). 0 = the fixed timers: every 2 s while
+// someone is there, every minute otherwise.
+#ifndef REPORT_BY_EXCEPTION
+#define REPORT_BY_EXCEPTION 1
+#endif
+#ifndef REPORT_DISTANCE_DEADBAND
+#define REPORT_DISTANCE_DEADBAND 25  // mm
+#endif
+#ifndef REPORT_VOLUME_DEADBAND
+#define REPORT_VOLUME_DEADBAND 50    // Mic level units, twice MIC_NOISE_FLOOR
+#endif
+#ifndef REPORT_FREQUENCY_DEADBAND
+#define REPORT_FREQUENCY_DEADBAND 29  // 1/1000ths, about half a semitone
+#endif
+#ifndef REPORT_MIN_GAP_MS
+#define REPORT_MIN_GAP_MS 2000
+#endif
+#ifndef REPORT_HEARTBEAT_MS
+#define REPORT_HEARTBEAT_MS 60000
+#endif
+
+// Practice sessions: from someone arriving until nobody came back for
+// SESSION_END_TIMEOUT_MS, aggregate time playing and idle, the notes'
+// pitch classes and octaves, notes per minute and the playing volume's
+// percentiles on the device, and publish one summary on sessionTopic at
+// the end (see lib/PracticeSession and test/test_practice_session). 0 = off.
+#ifndef PRACTICE_SESSIONS
+#define PRACTICE_SESSIONS 1
+#endif
+#ifndef SESSION_END_TIMEOUT_MS
+#define SESSION_END_TIMEOUT_MS 20000
+#endif
+
+// Live spectrum: while someone is at the piano, publish the chord band's
+// magnitudes on spectrumTopic SPECTRUM_STREAM_HZ times a second, as log
+// levels delta-coded against the previous frame (see
+// lib/Telemetry/SpectrumFrame.h and tools/spectrum_decode). 4-bit levels
+// (6 dB steps) make frames of 30-40 bytes, 8-bit ones (0.75 dB) about 60.
+// Reads the cascade's window, so it needs the multi-rate path. 0 = off.
+#ifndef SPECTRUM_STREAM
+#define SPECTRUM_STREAM 0
+#endif
+#ifndef SPECTRUM_STREAM_HZ
+#define SPECTRUM_STREAM_HZ 10
+#endif
+#ifndef SPECTRUM_STREAM_BITS
+#define SPECTRUM_STREAM_BITS 4
+#endif
+#if SPECTRUM_STREAM && !MULTIRATE_ANALYSIS
+#error "SPECTRUM_STREAM needs MULTIRATE_ANALYSIS"
+#endif
+
+// Publish pipeline: messages are serialized into a ring and written by
+// mqttTask() in slices of at most PUBLISH_SLICE_US and PUBLISH_BUDGET_BYTES,
+// so a write stuck on the radio's SPI link holds up the sender and not the
+// sensing that made the message (see lib/PublishPipeline and
+// test/test_publish_pipeline). 0 = publish inline wherever the message is made.
+#ifndef PUBLISH_PIPELINE
+#define PUBLISH_PIPELINE 1
+#endif
+#ifndef PUBLISH_SLICE_US
+#define PUBLISH_SLICE_US 4000
+#endif
+#ifndef PUBLISH_BUDGET_BYTES
+#define PUBLISH_BUDGET_BYTES 1024
+#endif
+
+// 1 = subscribe to our own topic, so every reading also comes back in
+// through poll(). Nothing reads it, so by default the broker doesn't echo.
+#ifndef MQTT_SELF_SUBSCRIBE
+#define MQTT_SELF_SUBSCRIBE 0
+#endif
+
+// Probes: two micros() reads and a histogram update, a few us on the board
+#if DIAGNOSTICS
+#define DIAG_START(var) uint32_t var = micros()
+#define DIAG_STOP(stage, var) diagnostics.record(stage, micros() - (var))
+#else
+#define DIAG_START(var)
+#define DIAG_STOP(stage, var)
+#endif
+
+// Hardware, provided by the board implementation
+MicSource& mic = boardMic();
+DistanceSensor& distanceSensor = boardDistanceSensor();
+TextDisplay& display = boardDisplay();
+Publisher& publisher = boardPublisher();
 
-const int micPin = A0;
 const int sampleSize = 10;
 const long oledTimeout = 10000;  // oled timeout
+const long idleTimeout = 30000;  // Low-power idle after this long with nobody there
 
 // Add distance threshold constants
 const int DISTANCE_MIN_THRESHOLD = 75;  // Minimum distance threshold (75mm)
 const int DISTANCE_MAX_THRESHOLD = 400; // Maximum distance threshold (400mm)
 
+// Hysteresis of the state machine: someone present stays present this far
+// outside the band above, and playing lasts down to PLAY_EXIT_PERCENT of
+// the threshold; leaving either has to last its exit time
+const int PRESENCE_MARGIN_MM = 25;
+const int PLAY_EXIT_PERCENT = 75;
+const uint16_t PRESENCE_EXIT_MS = 500;
+const uint16_t PLAY_EXIT_MS = 500;
+const uint8_t DISTANCE_SMOOTHING = 10;  // Each ToF reading counts 1/10
+
 // FFT constants
-#define SAMPLES 128             // Must be a power of 2
-#define SAMPLING_FREQUENCY 5000 // Hz, must be less than 10000 due to ADC
+#define SAMPLES CAPTURE_SAMPLES // Must be a power of 2 (set in CaptureBuffers.h)
+#if MULTIRATE_ANALYSIS
+#define SAMPLING_FREQUENCY 10000 // Hz, timer-clocked ADC + DMA keeps up easily
+#else
+#define SAMPLING_FREQUENCY 5000 // Hz
+#endif
+
+// Chords are read from the band closest to the original 5 kHz capture:
+// 19.5 Hz bins at 256 samples, fine enough for triads from C3 up
+#define CHORD_BAND 1
 
 // FFT variables
-double vReal[SAMPLES];
-double vImag[SAMPLES];
-ArduinoFFT<double> FFT = ArduinoFFT<double>(vReal, vImag, SAMPLES, SAMPLING_FREQUENCY);
-unsigned int sampling_period_us;
-unsigned long microseconds;
+#if SPECTRAL_ENGINE_FIXED
+static_assert(FIXED_SPECTRUM_SAMPLES == SAMPLES, "FIXED_SPECTRUM_SAMPLES must match CAPTURE_SAMPLES");
+FixedSpectrum spectrum;
+PitchEngine pitchEngine;
+#if MULTIRATE_ANALYSIS
+DecimationCascade cascade;
+bool blockCaptured = false;  // senseTask fed a new block into the cascade this tick
+bool notePending = false;    // An onset's note waits for the longer bands to refill
+int pendingBands = 0;        // Bands the pending note was last analyzed with
+#endif
+#else
+// One in-place work buffer pair: 10-bit samples need nothing wider than
+// float, which halves it to 1 KB and is cheaper in soft-float than double
+float vReal[SAMPLES];
+float vImag[SAMPLES];
+ArduinoFFT<float> FFT = ArduinoFFT<float>(vReal, vImag, SAMPLES, SAMPLING_FREQUENCY);
+#endif
 double dominantFrequency = 0;
 
 // Note detection
-const char* noteNames[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
-String currentNote = "";
-int currentOctave = 0;
+NoteInfo currentNote = NO_NOTE;
+ChordNote currentChord[CHORD_MAX_NOTES];  // Chord mode: notes in the last frame
+uint8_t currentChordSize = 0;
 
 int readings[sampleSize];  
 int bufferIndex = 0;
 int total = 0;
 bool isPlaying = false;
 bool personDetected = false;
-int lastSensorVal = 0;
 long lastSoundTime = 0;
 long lastPersonTime = 0;  // Last time a person was detected
 long lastTimeSent = 0;
@@ -47,30 +302,101 @@ const int noPresenceInterval = 60000;  // 1 minute interval for no presence stat
 long lastFFTTime = 0;  // Last time FFT was calculated
 long lastNoteTime = 0;  // Last time a note was detected
 const long silenceTimeout = 5000; // Reset note after 5 seconds of silence
+const long NOTE_RESTRIKE_GAP = 150; // Without onset gating: same note heard again after this gap is a new event
+
+// Which blocks get the full analysis, and how many were skipped
+OnsetGate onsetGate;
+bool havePitch = false;  // dominantFrequency/currentNote hold the last analysis' pitch
+bool pitchSettled = true;  // Multi-rate: the last pitch can't change as more bands refill
 
-const int SCREEN_WIDTH = 128;
-const int SCREEN_HEIGHT = 32;
-#define OLED_RESET -1
-#define SCREEN_ADDRESS 0x3C 
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+// Notes heard between publishes, sent as one batch with the next reading
+NoteTimeline noteTimeline(interval);
 
-VL53L0X sensor;
+char topic[] = MQTT_TOPIC;
+char binaryTopic[] = MQTT_TOPIC "/bin";
+char diagTopic[] = MQTT_TOPIC "/diag";
+#if PRACTICE_SESSIONS
+char sessionTopic[] = MQTT_TOPIC "/session";
+#endif
+#if SPECTRUM_STREAM
+char spectrumTopic[] = MQTT_TOPIC "/spectrum";
+#endif
 
-WiFiClient wifi;
-MqttClient mqttClient(wifi);
-char broker[] = "tigoe.net";  
-int port = 1883;
-char topic[] = "conndev/piano";
-String clientID = "justin-nano33iot-";
+#if DIAGNOSTICS
+Diagnostics diagnostics;
+uint32_t lastLoopStartUs = 0;
+uint32_t captureStartUs = 0;  // When the capture block being held was acquired
+bool linkWasUp = false;       // For counting reconnects
+bool linkEverUp = false;
+#endif
 
-// Replace the current DisplayState enum with this clearer PianoState
-enum PianoState {
-  STATE_NO_PRESENCE,    // No one at piano
-  STATE_PRESENCE_ONLY,  // Someone at piano but not playing
-  STATE_PLAYING         // Someone at piano and playing
-};
+#if PUBLISH_PIPELINE
+// Messages on their way out, written by mqttTask()
+PublishPipeline publishPipeline;
+#endif
+
+// Messages that couldn't be sent during a WiFi/MQTT outage, drained by
+// backfillTask() once the link is back
+OfflineQueue offlineQueue;
+
+// Presence and playing with hysteresis (lib/PianoState), and which readings
+// are worth a message (REPORT_BY_EXCEPTION)
+PianoStateMachine stateMachine;
+#if REPORT_BY_EXCEPTION
+ReportPolicy reportPolicy;
+ReportReason reportReason = REPORT_NONE;  // Why the reading being published is due
+#endif
+
+#if PRACTICE_SESSIONS
+PracticeSession practiceSession;
+#endif
 
 PianoState currentState = STATE_NO_PRESENCE;
+PianoState displayedState = STATE_NO_PRESENCE;
+int currentMicValue = 0;   // Latest smoothed mic value, shared with the display task
+bool displayAsleep = false;
+
+// Cooperative scheduler - loop() only starts tasks that are due and never
+// waits with delay(), so a network outage can't stall sensing or the display
+Scheduler scheduler;
+const uint32_t SENSE_PERIOD = 10;         // ToF, mic, state machine and audio analysis
+const uint32_t DISPLAY_TASK_PERIOD = 50;  // Display refresh checks
+const uint32_t MQTT_POLL_PERIOD = 20;     // MQTT keepalive and incoming packets
+const uint32_t CONNECTION_PERIOD = 100;   // WiFi/MQTT reconnect state machine
+// The one blocking step left is the broker connect in the board's
+// maintain(): up to MQTT_CONNECT_TIMEOUT (1 s) waiting for the broker, plus
+// the NINA module's own TCP connect when the broker host doesn't answer.
+// Audio blocks are dropped for as long as it runs; the backoff keeps it to
+// one attempt per 1-60 s, and it only happens with WiFi up and MQTT down.
+const uint32_t BACKFILL_PERIOD = 250;     // At most one queued message per run (4 per second)
+const uint32_t DIAG_PERIOD = DIAG_PERIOD_MS;  // Diagnostics report
+int displayTaskId = -1;
+int senseTaskId = -1;
+int mqttTaskId = -1;
+int connectionTaskId = -1;
+
+// Low-power idle (LOW_POWER_IDLE): the ToF ranges slowly and wakes us, the
+// link tasks slow down, and only the idle task's heartbeat remains
+const uint32_t IDLE_TASK_PERIOD = 1000;     // Heartbeat check (and polled wake without the interrupt)
+const uint32_t IDLE_LINK_PERIOD = 1000;     // MQTT poll and reconnect while idle
+const uint32_t IDLE_RANGING_PERIOD = 200;   // ToF measurement period while watching
+const uint32_t IDLE_MIN_AWAKE_MS = 1000;    // After a wake, look for presence this long before idling again
+int idleTaskId = -1;
+bool lowPowerIdle = false;
+bool distanceWatched = false;   // The sensor's interrupt wakes us (else the idle task polls)
+uint32_t wakeMs = 0;            // When the last wake happened
+bool wakePublishPending = false;  // Waiting for the first publish after a wake
+
+#if SPECTRUM_STREAM
+// Live spectrum (SPECTRUM_STREAM): one frame per run, a key frame every
+// SPECTRUM_KEY_INTERVAL so a new subscriber catches up within a second
+static_assert(SAMPLES / 2 <= SPECTRUM_MAX_BINS, "SpectrumFrame can't hold every bin");
+const uint32_t SPECTRUM_PERIOD = 1000 / SPECTRUM_STREAM_HZ;
+const int SPECTRUM_KEY_INTERVAL = SPECTRUM_STREAM_HZ;
+SpectrumEncoder spectrumEncoder;
+int spectrumTaskId = -1;
+bool spectrumStreaming = false;  // The last frame went out; else the next is a key frame
+#endif
 
 // Microphone calibration constants for MAX9814 AGC Electret Microphone
 const int MIC_DC_OFFSET = 512;  // Microphone DC offset (for a 10-bit ADC, 0-1023 range)
@@ -82,25 +408,33 @@ const float MIC_SCALE_FACTOR = 1.0;  // Scale factor for normalizing amplitude
 // Piano note frequency constraints (A440 standard tuning)
 const double LOWEST_PIANO_FREQ = 27.5;  // A0 - lowest note on a standard piano
 const double HIGHEST_PIANO_FREQ = 4186.0; // C8 - highest note on a standard piano
+#if !ADAPTIVE_CALIBRATION
 const double BACKGROUND_FREQ_THRESHOLD = 40.0; // Filter out frequencies around 39.06 Hz (D#1)
 const double BACKGROUND_FREQ_TOLERANCE = 2.0;  // Tolerance range around background frequency
+#endif
+
+// MIC_MIN_THRESHOLD is a level for one spectrum bin; the HPS strength is a
+// product of bins, so each engine scales it to its own units
+#if SPECTRAL_ENGINE_FIXED
+const uint64_t PITCH_MIN_STRENGTH = PitchEngine::strengthThreshold(MIC_MIN_THRESHOLD);
+#else
+const uint64_t PITCH_MIN_STRENGTH = HpsPitch::strengthThreshold(MIC_MIN_THRESHOLD);  // Also an HPS
+#endif
 
-// Piano note frequency constants based on A4 = 440Hz standard tuning
-// Using reference from https://muted.io/note-frequencies/
-const double NOTE_FREQUENCIES[] = {
-  16.35, 17.32, 18.35, 19.45, 20.60, 21.83, 23.12, 24.50, 25.96, 27.50, 29.14, 30.87, // C0 to B0
-  32.70, 34.65, 36.71, 38.89, 41.20, 43.65, 46.25, 49.00, 51.91, 55.00, 58.27, 61.74, // C1 to B1
-  65.41, 69.30, 73.42, 77.78, 82.41, 87.31, 92.50, 98.00, 103.8, 110.0, 116.5, 123.5, // C2 to B2
-  130.8, 138.6, 146.8, 155.6, 164.8, 174.6, 185.0, 196.0, 207.7, 220.0, 233.1, 246.9, // C3 to B3
-  261.6, 277.2, 293.7, 311.1, 329.6, 349.2, 370.0, 392.0, 415.3, 440.0, 466.2, 493.9, // C4 to B4
-  523.3, 554.4, 587.3, 622.3, 659.3, 698.5, 740.0, 784.0, 830.6, 880.0, 932.3, 987.8, // C5 to B5
-  1047, 1109, 1175, 1245, 1319, 1397, 1480, 1568, 1661, 1760, 1865, 1976, // C6 to B6
-  2093, 2217, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951, // C7 to B7
-  4186 // C8
-};
+// Current calibration - the constants above until the room has been heard
+int16_t micDcOffset = MIC_DC_OFFSET;
+int playThreshold = MIC_MIN_THRESHOLD;         // Smoothed mic level that counts as playing
+uint64_t pitchThreshold = PITCH_MIN_STRENGTH;  // Pitch strength that counts as a note
+
+#if ADAPTIVE_CALIBRATION
+NoiseCalibration calibration;
+const uint32_t CAL_SETTLE_MS = 3000;         // Let the piano stop ringing after someone leaves
+const uint32_t CAL_ANALYSIS_PERIOD = 500;    // One pitch analysis of the room this often
+uint32_t noPresenceSince = 0;                // When the current NO_PRESENCE began
+uint32_t lastCalibrationAnalysis = 0;
+#endif
 
 // Improved frequency detection parameters
-const double SAMPLING_FREQUENCY_ACTUAL = 4800; // Adjusted to account for sampling delay
 const int FFT_FREQUENCY_CORRECTION = 1;  // Correction factor for FFT frequency calculation
 
 // Update constants to include distance threshold
@@ -109,108 +443,176 @@ const int DISTANCE_THRESHOLD = 150;  // Only process audio when distance is belo
 // Add these variables near other timing variables at the top
 unsigned long lastDisplayUpdateTime = 0;  // Last time display was updated
 const long DISPLAY_UPDATE_INTERVAL = 250; // Minimum 250ms between display updates
-String lastDisplayedNote = "";   // Track the last displayed note
-int lastDisplayedOctave = 0;     // Track the last displayed octave
+uint8_t lastDisplayedMidi = 0;   // Track the last displayed note
 double lastDisplayedFrequency = 0.0; // Last displayed frequency
 
+// Screen layout - each widget redraws only when its text or length changes
+TextWidget titleText(0, 0, 128, 1);
+TextWidget lineText(0, 16, 128, 1);
+TextWidget volumeLabel(0, 12, 40, 1);
+BarWidget volumeBar(40, 12, 40, 8);
+TextWidget noteText(0, 10, 64, 2);
+TextWidget frequencyText(70, 16, 58, 1);
+int drawnScreen = -1;  // PianoState on the panel, -1 after anything else drew on it
+
 // Function prototypes - must be before they're used
-void frequencyToNote(float frequency, String &note, int &octave);
-double calculateDominantFrequency();
-void connectToNetwork();
-boolean connectToBroker();
+NoteInfo frequencyToNote(float frequency);
+double calculateDominantFrequency(const int16_t* block);
+void senseTask(uint32_t now);
+void displayTask(uint32_t now);
+void mqttTask(uint32_t now);
+void connectionTask(uint32_t now);
+void backfillTask(uint32_t now);
+#if DIAGNOSTICS
+void diagTask(uint32_t now);
+#endif
+#if SPECTRUM_STREAM
+void spectrumTask(uint32_t now);
+#endif
+void reportMissedDeadline(const Task& task, uint32_t latenessMs);
+void idleTask(uint32_t now);
+void enterIdle(uint32_t now);
+void leaveIdle(uint32_t now);
+void wakeOrRewatch(uint32_t now);
+#if ADAPTIVE_CALIBRATION
+void calibrateFromRoom(const int16_t* block, int level, uint32_t now);
+#endif
 int getSmoothedMicValue();
+const int16_t* acquireCaptureBlock();
+void releaseCaptureBlock();
+bool timedPublish(const char* messageTopic, const uint8_t* payload, size_t length);
+bool publishMessage(const char* messageTopic, const uint8_t* payload, size_t length,
+                    uint32_t capturedMs, uint8_t priority);
+#if PUBLISH_PIPELINE
+void pipelineSent(const PublishFrame& frame, bool sent, uint32_t writeUs);
+#endif
+void flushDisplay();
 void calculateAndProcessAudio(int distance, int volume);
 bool needsDisplayUpdate(PianoState state, int micValue);
 void updateDisplay(PianoState state, int micValue);
 void handleState(PianoState state, bool personDetected, bool isPlaying, int distance, int volume);
+bool reportDue(const PianoReading& reading, unsigned long periodMs);
+#if PRACTICE_SESSIONS
+void trackSession(bool personDetected, bool isPlaying, int volume);
+void publishSession();
+#endif
+void publishReading(const PianoReading& reading, const char* label);
+bool sendOrQueue(const char* messageTopic, const uint8_t* payload, size_t length,
+                 uint32_t capturedMs, uint8_t priority);
 
-// Function to convert frequency to musical note and octave using a lookup approach
-void frequencyToNote(float frequency, String &note, int &octave) {
+// Function to convert frequency to musical note and octave.
+// NoteMapper finds the note in constant time and also reports cents off pitch.
+NoteInfo frequencyToNote(float frequency) {
   // Check if this is likely background noise or out of piano range
   if (frequency <= 0 || 
       frequency < LOWEST_PIANO_FREQ || 
-      frequency > HIGHEST_PIANO_FREQ ||
-      (abs(frequency - BACKGROUND_FREQ_THRESHOLD) < BACKGROUND_FREQ_TOLERANCE)) {
-    note = "---";
-    octave = 0;
-    return;
+      frequency > HIGHEST_PIANO_FREQ) {
+    return NO_NOTE;
   }
-  
-  // Apply frequency correction - the Arduino FFT often reports frequencies as multiples
-  // This divides the frequency until it fits within the piano range
-  double correctedFreq = frequency;
-  while (correctedFreq > HIGHEST_PIANO_FREQ) {
-    correctedFreq /= 2.0;
+#if !ADAPTIVE_CALIBRATION
+  // (Learned background tones are dropped before this, with their strength)
+  if (abs(frequency - BACKGROUND_FREQ_THRESHOLD) < BACKGROUND_FREQ_TOLERANCE) {
+    return NO_NOTE;
   }
+#endif
   
-  // Find closest note by comparing with reference frequencies
-  int closestNoteIndex = -1;
-  double minDifference = 99999;
-  
-  // Search through all piano notes to find the closest match
-  for (int i = 0; i < 97; i++) {
-    double difference = abs(correctedFreq - NOTE_FREQUENCIES[i]);
-    double percentDifference = difference / NOTE_FREQUENCIES[i];
-    
-    // Find closest note by percentage difference (more accurate across octaves)
-    if (percentDifference < minDifference) {
-      minDifference = percentDifference;
-      closestNoteIndex = i;
-    }
-  }
-  
-  // If we found a close match and it's within 10% of a known frequency
-  if (closestNoteIndex >= 0 && minDifference < 0.1) {
-    // Calculate octave and note - correct indexing for piano octave notation
-    octave = closestNoteIndex / 12; // Piano octave numbering starts at 0
-    int noteIndex = closestNoteIndex % 12;
-    note = noteNames[noteIndex];
-    
-    // Debug output for verification
-    // Serial.print("Raw freq: ");
-    // Serial.print(frequency);
-    // Serial.print(" Hz, Corrected: ");
-    // Serial.print(correctedFreq);
-    // Serial.print(" Hz -> ");
-    // Serial.print(note);
-    // Serial.print(octave);
-    // Serial.print(" (");
-    // Serial.print(NOTE_FREQUENCIES[closestNoteIndex]);
-    // Serial.print(" Hz, diff: ");
-    // Serial.print(minDifference * 100);
-    // Serial.println("%)");
-  } else {
-    note = "---";
-    octave = 0;
+  NoteInfo note = mapFrequencyToNote(frequency);
+  if (!note.valid()) {
     Serial.print("No matching note for frequency: ");
-    Serial.print(frequency);
-    Serial.print(" (corrected: ");
-    Serial.print(correctedFreq);
-    Serial.println(")");
+    Serial.println(frequency);
   }
+
+  // Debug output for verification
+  // Serial.print("Raw freq: ");
+  // Serial.print(frequency);
+  // Serial.print(" Hz -> ");
+  // Serial.print(note.name);
+  // Serial.print(note.octave);
+  // Serial.print(" (");
+  // Serial.print(note.cents);
+  // Serial.println(" cents)");
+  return note;
 }
 
 // Perform FFT and find dominant frequency - updated to improve accuracy
-double calculateDominantFrequency() {
-  // Clear imaginary part
-  for (int i = 0; i < SAMPLES; i++) {
-    vImag[i] = 0;
+// Works on a block the DMA finished and hands it back (multi-rate: on the
+// cascade senseTask already fed it to, block is nullptr); returns 0 if the
+// frame has no significant pitch
+double calculateDominantFrequency(const int16_t* block) {
+#if !MULTIRATE_ANALYSIS
+  // The timer clocks the ADC, so the rate is exact - no correction needed
+  double actualSamplingFreq = mic.sampleRate();
+#endif
+
+#if SPECTRAL_ENGINE_FIXED
+#if MULTIRATE_ANALYSIS
+  // Every band's window comes out of the cascade; after an onset only the
+  // bands that have refilled since get a say. Skip the first few bins (DC
+  // and very low freq) in each.
+  (void)block;
+#if ADAPTIVE_CALIBRATION
+  // Learned tones are cleared from each band where they are no louder than usual
+  MultiRateEstimate estimate = estimateMultiRate(cascade, spectrum, pitchEngine, micDcOffset, 3,
+                                                 cascade.freshBands(), calibration);
+#else
+  MultiRateEstimate estimate = estimateMultiRate(cascade, spectrum, pitchEngine, micDcOffset, 3,
+                                                 cascade.freshBands());
+#endif
+  PitchEstimate pitch = estimate.pitch;
+  pitchSettled = estimate.settled;
+#else
+  // Integer path: window, FFT, magnitude and the pitch engine without any
+  // floating point. The DMA is already filling the other buffer while we
+  // work on this one, so the engine copies what it needs first.
+  spectrum.loadBlock(block, micDcOffset);
+  pitchEngine.load(block, micDcOffset);
+  releaseCaptureBlock();
+  spectrum.compute();
+  spectrum.complexToMagnitude();
+#if ADAPTIVE_CALIBRATION
+  calibration.notch(spectrum, 0, (uint32_t)actualSamplingFreq, 3);
+#endif
+
+  // Skip the first few bins (DC and very low freq)
+  PitchEstimate pitch = pitchEngine.estimate(spectrum, (uint32_t)actualSamplingFreq, 3);
+#endif
+#if ADAPTIVE_CALIBRATION
+  // A learned background tone at about its usual level is the room
+  if (calibration.isBackground(pitch)) {
+    pitch.frequencyQ4 = 0;
+    pitch.strength = 0;
   }
-  
-  // Sample the audio input with proper calibration
-  unsigned long startTime = micros();
-  for (int i = 0; i < SAMPLES; i++) {
-    microseconds = micros();
-    int rawValue = analogRead(micPin);
-    vReal[i] = (rawValue - MIC_DC_OFFSET) * MIC_SCALE_FACTOR;
-    while (micros() < microseconds + sampling_period_us) {
-      // Do nothing - wait
+#endif
+  uint64_t peakValue = pitch.strength;
+  double peakFreq = pitch.frequencyQ4 / 16.0;
+
+#if CHORD_DETECTION
+  // Same magnitudes, several notes - only for frames loud enough to count
+  currentChordSize = 0;
+  if (peakValue > pitchThreshold) {
+#if MULTIRATE_ANALYSIS
+    uint32_t chordRate = cascade.sampleRate(CHORD_BAND);
+    if (estimate.spectrumBand != CHORD_BAND) {
+      bandSpectrum(cascade, CHORD_BAND, spectrum, micDcOffset);
     }
+#else
+    uint32_t chordRate = (uint32_t)actualSamplingFreq;
+#endif
+    currentChordSize = detectChord(spectrum.magnitudes(), SAMPLES, chordRate, 3,
+                                   currentChord, CHORD_MAX_NOTES);
   }
-  
-  // Calculate actual sampling frequency
-  unsigned long totalTime = micros() - startTime;
-  double actualSamplingFreq = (SAMPLES * 1000000.0) / totalTime;
+#endif
+#else
+  // Copy the finished block in with proper calibration, clear imaginary part.
+  // The DMA is already filling the other buffer while we work on this one.
+  for (int i = 0; i < SAMPLES; i++) {
+    vReal[i] = (block[i] - micDcOffset) * MIC_SCALE_FACTOR;
+    vImag[i] = 0;
+  }
+  releaseCaptureBlock();
+
+  // Apply Harmonic Product Spectrum (HPS)
+  const int numHarmonics = 3;  // Use 3 harmonics
   
   // Apply Windowing to reduce spectral leakage
   FFT.windowing(FFT_WIN_TYP_HAMMING, FFT_FORWARD);
@@ -221,126 +623,274 @@ double calculateDominantFrequency() {
   // Convert from complex to magnitude
   FFT.complexToMagnitude();
   
-  // Store magnitude spectrum for HPS
-  double magnitudeSpectrum[SAMPLES/2];
-  for (int i = 0; i < SAMPLES/2; i++) {
-    magnitudeSpectrum[i] = vReal[i];
-  }
-  
-  // Apply Harmonic Product Spectrum (HPS)
-  const int numHarmonics = 3;  // Use 3 harmonics
-  
-  // Create HPS spectrum (initialized with original spectrum)
-  double hpsSpectrum[SAMPLES/2];
-  for (int i = 0; i < SAMPLES/2; i++) {
-    hpsSpectrum[i] = magnitudeSpectrum[i];
-  }
-  
-  // Multiply by downsampled versions
-  for (int harmonic = 2; harmonic <= numHarmonics; harmonic++) {
-    for (int i = 0; i < SAMPLES/(2*harmonic); i++) {
-      // Each harmonic is at exactly harmonic*frequency
-      hpsSpectrum[i] *= magnitudeSpectrum[i * harmonic];
-    }
-  }
-  
-  // Find the peak in the HPS
-  double peakValue = 0;
+  // Harmonic Product Spectrum straight off the magnitudes in vReal: each
+  // bin's product is formed as the peak search reaches it, so there is no
+  // copy of the spectrum and no HPS array. Bins above SAMPLES/(2*h) have no
+  // h-th harmonic in range and get one factor fewer.
+  float peakValue = 0;
   uint16_t peakIndex = 0;
   
   // Skip the first few bins (DC and very low freq)
   for (int i = 3; i < SAMPLES/2; i++) {
-    if (hpsSpectrum[i] > peakValue) {
-      peakValue = hpsSpectrum[i];
+    float product = vReal[i];
+    for (int harmonic = 2; harmonic <= numHarmonics && i < SAMPLES/(2*harmonic); harmonic++) {
+      // Each harmonic is at exactly harmonic*frequency
+      product *= vReal[i * harmonic];
+    }
+    if (product > peakValue) {
+      peakValue = product;
       peakIndex = i;
     }
   }
-  
+
   // Calculate frequency from peak index
   double peakFreq = peakIndex * (actualSamplingFreq / SAMPLES);
+#endif
   
   // Only return if significant
-  if (peakValue > MIC_MIN_THRESHOLD) {
+  if (peakValue > pitchThreshold) {
     return peakFreq;
   }
   
   return 0;
 }
 
-void connectToNetwork() {
-  while (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Attempting WiFi connection...");
-    WiFi.begin(SECRET_SSID, SECRET_PASS);
-    delay(2000);
+
+// Outgoing messages (one slice of them), then MQTT keepalive and incoming
+// packets
+void mqttTask(uint32_t now) {
+#if PUBLISH_PIPELINE
+  publishPipeline.drain();
+#endif
+  publisher.poll(now);
+}
+
+// One step of the board's reconnect state machine
+void connectionTask(uint32_t now) {
+  publisher.maintain(now);
+
+#if DIAGNOSTICS
+  // Every time the link comes back after the first connect
+  bool linkUp = publisher.connected();
+  if (linkUp && !linkWasUp) {
+    if (linkEverUp) {
+      diagnostics.countReconnect();
+    }
+    linkEverUp = true;
   }
-  Serial.println("Connected to WiFi!");
+  linkWasUp = linkUp;
+#endif
 }
 
-boolean connectToBroker() {
-  Serial.println("Connecting to MQTT...");
-  mqttClient.setId(clientID);
-  mqttClient.setUsernamePassword(SECRET_MQTT_USER, SECRET_MQTT_PASS);
-  
-  if (!mqttClient.connect(broker, port)) {
-    Serial.print("MQTT failed. Error: ");
-    Serial.println(mqttClient.connectError());
-    return false;
+// Send one queued message per run once the link is back, so a long outage
+// drains at a steady pace instead of starving the live readings. It is
+// written here rather than through the pipeline: the message stays queued
+// until a write succeeds, and live messages waiting in the ring go first.
+void backfillTask(uint32_t now) {
+  QueuedMessage message;
+  if (!publisher.connected() || !offlineQueue.peek(message)) {
+    return;
+  }
+#if PUBLISH_PIPELINE
+  if (!publishPipeline.empty()) {
+    return;
+  }
+#endif
+
+  // JSON says how long ago it was captured - binary frames have no room for it
+  static_assert(TELEMETRY_BATCH_JSON_MAX + TELEMETRY_AGE_JSON_MAX <= PUBLISH_MAX_PAYLOAD,
+                "a replayed reading must fit in one publish");
+  const uint8_t* payload = message.payload;
+  size_t length = message.length;
+  char aged[TELEMETRY_BATCH_JSON_MAX + TELEMETRY_AGE_JSON_MAX];
+  if (message.topic == topic) {
+    size_t agedLength = writeAgedJson(aged, sizeof(aged), (const char*)message.payload,
+                                      message.length, now - message.capturedMs);
+    if (agedLength > 0) {
+      payload = (const uint8_t*)aged;
+      length = agedLength;
+    }
+  }
+
+  if (!timedPublish(message.topic, payload, length)) {
+    return;  // Try again next run
+  }
+  offlineQueue.pop();
+
+  if (offlineQueue.empty()) {
+    Serial.print("Backfill done: ");
+    Serial.print(offlineQueue.backfilled());
+    Serial.print(" sent late, ");
+    Serial.print(offlineQueue.dropped());
+    Serial.println(" dropped so far");
   }
+}
 
-  Serial.println("MQTT connected!");
-  mqttClient.subscribe(topic);
-  return true;
+#if DIAGNOSTICS
+// Report the diagnostics window and start the next one. While the link is
+// down the window keeps growing, so the first report after an outage
+// covers all of it.
+void diagTask(uint32_t now) {
+  if (!publisher.connected()) {
+    return;
+  }
+  DiagSystem system = {now, scheduler.missedDeadlines(), boardFreeMemory(), boardStackHighWater(),
+                       0, 0, 0};
+#if PUBLISH_PIPELINE
+  system.ringDepth = publishPipeline.depth();
+  system.ringMaxDepth = publishPipeline.maxDepth();
+  system.ringFull = publishPipeline.full();
+#endif
+  char payload[DIAG_JSON_MAX];
+  static_assert(DIAG_JSON_MAX <= PUBLISH_MAX_PAYLOAD, "a full diagnostics report must fit in one publish");
+  size_t length = writeDiagnosticsJson(payload, sizeof(payload), diagnostics, system);
+  if (length > 0 && publishMessage(diagTopic, (const uint8_t*)payload, length, now, PRIORITY_PRESENCE)) {
+    diagnostics.startWindow(now);
+  }
+}
+#endif
+
+#if SPECTRUM_STREAM
+// One frame of the live spectrum from the chord band's current window.
+// Frames are stale by the time a backfill could send them, so nothing is
+// queued - without a listener or a link the stream just pauses, and starts
+// again with a key frame.
+void spectrumTask(uint32_t now) {
+  if (currentState == STATE_NO_PRESENCE || !publisher.connected()) {
+    if (spectrumStreaming) {
+      spectrumEncoder.restart();
+      spectrumStreaming = false;
+    }
+    return;
+  }
+
+  // The sense task is done with the spectrum between its runs, so the
+  // chord band can be transformed into the same buffer
+  bandSpectrum(cascade, CHORD_BAND, spectrum, micDcOffset);
+  const uint16_t* magnitudes = spectrum.magnitudes();
+  uint8_t levels[SAMPLES / 2];
+  for (int i = 0; i < SAMPLES / 2; i++) {
+    levels[i] = spectrumLevel(spectrum.inputUnits(magnitudes[i]), spectrumEncoder.bits());
+  }
+  uint16_t binWidthQ4 = (uint16_t)((cascade.sampleRate(CHORD_BAND) << 4) / SAMPLES);
+
+  uint8_t frame[SPECTRUM_FRAME_MAX];
+  size_t length = spectrumEncoder.encode(frame, sizeof(frame), levels, SAMPLES / 2, binWidthQ4);
+  spectrumStreaming = length > 0 && publishMessage(spectrumTopic, frame, length, now, PRIORITY_PRESENCE);
+  if (!spectrumStreaming) {
+    spectrumEncoder.restart();
+  }
+}
+#endif
+
+void reportMissedDeadline(const Task& task, uint32_t latenessMs) {
+  Serial.print("Task ");
+  Serial.print(task.name);
+  Serial.print(" missed its deadline by ");
+  Serial.print(latenessMs);
+  Serial.println(" ms");
+}
+
+// addPeriodic(), but a task that doesn't fit in the table stops the boot
+// with a message rather than silently never running
+int addTask(const char* name, TaskCallback callback, uint32_t periodMs, uint32_t deadlineMs,
+            uint32_t nowMs) {
+  int id = scheduler.addPeriodic(name, callback, periodMs, deadlineMs, nowMs);
+  if (id < 0) {
+    Serial.print("Task ");
+    Serial.print(name);
+    Serial.println(" not scheduled - raise SCHEDULER_MAX_TASKS");
+    while (1);
+  }
+  return id;
 }
 
 void setup() {
   Serial.begin(9600);
   if (!Serial) delay(3000);
 
-  // Calculate the sampling period
-  sampling_period_us = round(1000000 * (1.0 / SAMPLING_FREQUENCY));
+#if SPECTRAL_ENGINE_FIXED
+  spectrum.begin();
+#endif
 
-  //oled initialized
-  if (!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
-    Serial.println("SSD1306 allocation failed");
+  // Start background audio capture (timer -> ADC -> DMA on the board)
+  if (!mic.begin(SAMPLING_FREQUENCY)) {
+    Serial.println("Audio capture init failed");
     while (1);
   }
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setTextColor(SSD1306_WHITE);
-  display.setCursor(0, 0);
-  display.println("Initializing...");
-  display.display();
-
-  connectToNetwork();
-  if (!connectToBroker()) {
-    Serial.println("Retrying MQTT...");
-    delay(2000);
-    connectToBroker();
-  }
+#if MULTIRATE_ANALYSIS
+  cascade.begin(mic.sampleRate(), MIC_DC_OFFSET);
+#endif
+#if ADAPTIVE_CALIBRATION
+  calibration.begin(MIC_DC_OFFSET, MIC_MIN_THRESHOLD, MIC_MAX_AMPLITUDE, MIC_NOISE_FLOOR,
+                    PITCH_MIN_STRENGTH);
+#endif
+  PianoStateConfig stateConfig = {DISTANCE_MIN_THRESHOLD, DISTANCE_MAX_THRESHOLD, PRESENCE_MARGIN_MM,
+                                  PLAY_EXIT_PERCENT, PRESENCE_EXIT_MS, PLAY_EXIT_MS,
+                                  DISTANCE_SMOOTHING};
+  stateMachine.begin(stateConfig);
+#if PRACTICE_SESSIONS
+  practiceSession.begin(SESSION_END_TIMEOUT_MS);
+#endif
+#if REPORT_BY_EXCEPTION
+  ReportDeadbands deadbands = {REPORT_DISTANCE_DEADBAND, REPORT_VOLUME_DEADBAND,
+                               REPORT_FREQUENCY_DEADBAND, REPORT_MIN_GAP_MS, REPORT_HEARTBEAT_MS};
+  reportPolicy.begin(deadbands);
+#endif
 
-  Wire.begin();
-  sensor.setTimeout(500);
-  if (!sensor.init()) {
-    Serial.println("Failed to initialize ToF sensor!");
+  // Display, ToF sensor and network - the board prints what failed
+  if (!boardBegin()) {
     while (1);
   }
-  sensor.startContinuous(50);
+#if MQTT_SELF_SUBSCRIBE
+  publisher.subscribe(topic);
+#endif
+#if PUBLISH_PIPELINE
+  publishPipeline.begin(publisher, boardClock(), PUBLISH_SLICE_US, PUBLISH_BUDGET_BYTES);
+  publishPipeline.onSend(pipelineSent);
+#endif
 
   for (int i = 0; i < sampleSize; i++) {
     readings[i] = 0;
   }
 
   display.clearDisplay();
+  display.setTextColor(DISPLAY_WHITE);
   display.setCursor(0, 0);
   display.println("Ready!");
-  display.display();
+  flushDisplay();
+  drawnScreen = -1;
+
+  // Deadlines are how late a task may start before it is reported
+  uint32_t now = millis();
+  scheduler.onMissedDeadline(reportMissedDeadline);
+  senseTaskId = addTask("sense", senseTask, SENSE_PERIOD, 50, now);
+  displayTaskId = addTask("display", displayTask, DISPLAY_TASK_PERIOD, 100, now);
+  mqttTaskId = addTask("mqtt", mqttTask, MQTT_POLL_PERIOD, 500, now);
+  connectionTaskId = addTask("connection", connectionTask, CONNECTION_PERIOD, 1000, now);
+  addTask("backfill", backfillTask, BACKFILL_PERIOD, 1000, now);
+#if LOW_POWER_IDLE
+  idleTaskId = addTask("idle", idleTask, IDLE_TASK_PERIOD, 1000, now);
+  scheduler.setEnabled(idleTaskId, false, now);
+#endif
+#if DIAGNOSTICS
+  // First report once a whole window has gone by
+  addTask("diag", diagTask, DIAG_PERIOD, 5000, now + DIAG_PERIOD);
+  diagnostics.startWindow(now);
+  lastLoopStartUs = micros();
+#endif
+#if SPECTRUM_STREAM
+  spectrumEncoder.begin(SPECTRUM_STREAM_BITS, SPECTRUM_KEY_INTERVAL);
+  spectrumTaskId = addTask("spectrum", spectrumTask, SPECTRUM_PERIOD, 200, now);
+#endif
 }
 
 // smoothing out the mic readings here with proper calibration
 int getSmoothedMicValue() {
-  // Read with proper calibration
-  int rawMicValue = analogRead(micPin);
-  int calibratedValue = abs(rawMicValue - MIC_DC_OFFSET);
+  // Read with proper calibration - the ADC belongs to the capture DMA now,
+  // so take the newest sample it delivered instead of calling analogRead()
+  int rawMicValue = mic.latestSample();
+  int calibratedValue = abs(rawMicValue - micDcOffset);
   
   // Apply the smoothing
   total -= readings[bufferIndex]; 
@@ -351,64 +901,368 @@ int getSmoothedMicValue() {
   return total / sampleSize;
 }
 
+// Capture blocks are taken and handed back through these two, so the time a
+// block is held (while the DMA fills the other one) shows up in diagnostics
+const int16_t* acquireCaptureBlock() {
+  const int16_t* block = mic.acquireBlock();
+#if DIAGNOSTICS
+  if (block != nullptr) {
+    captureStartUs = micros();
+  }
+#endif
+  return block;
+}
+
+void releaseCaptureBlock() {
+  mic.releaseBlock();
+  DIAG_STOP(DIAG_CAPTURE, captureStartUs);
+}
+
+bool timedPublish(const char* messageTopic, const uint8_t* payload, size_t length) {
+  DIAG_START(publishStart);
+  bool sent = publisher.publish(messageTopic, payload, length);
+  DIAG_STOP(DIAG_PUBLISH, publishStart);
+  return sent;
+}
+
+// Hand a message to the link. With PUBLISH_PIPELINE it is copied into the
+// ring and mqttTask() is signalled to write it once the running task is
+// done. False if the link is down or the ring is full, so the caller can
+// keep the message or try again.
+bool publishMessage(const char* messageTopic, const uint8_t* payload, size_t length,
+                    uint32_t capturedMs, uint8_t priority) {
+  if (!publisher.connected()) {
+    return false;
+  }
+#if PUBLISH_PIPELINE
+  if (length <= PublishPipeline::maxPayload()) {
+    if (!publishPipeline.enqueue(messageTopic, payload, length, capturedMs, priority)) {
+      return false;
+    }
+    scheduler.signal(mqttTaskId, millis());
+    return true;
+  }
+  // Longer than the ring can ever hold - written here, the old way
+#else
+  (void)capturedMs;
+  (void)priority;
+#endif
+  return timedPublish(messageTopic, payload, length);
+}
+
+#if PUBLISH_PIPELINE
+// Every message mqttTask() took out of the ring, written or not
+void pipelineSent(const PublishFrame& frame, bool sent, uint32_t writeUs) {
+#if DIAGNOSTICS
+  diagnostics.record(DIAG_PUBLISH, writeUs);
+  diagnostics.record(DIAG_QUEUE, micros() - frame.enqueuedUs);
+#else
+  (void)writeUs;
+#endif
+  if (sent) {
+    return;
+  }
+  // The link went down after it was enqueued. Diagnostics and spectrum
+  // frames are worthless late (and the next spectrum frame must be a key
+  // frame); the rest waits in the offline queue like anything made during
+  // the outage.
+  if (frame.topic == diagTopic) {
+    return;
+  }
+#if SPECTRUM_STREAM
+  if (frame.topic == spectrumTopic) {
+    spectrumEncoder.restart();
+    return;
+  }
+#endif
+  if (!offlineQueue.push(frame.topic, frame.payload, frame.length, frame.capturedMs, frame.priority)) {
+    Serial.println("Offline queue full, message dropped");
+  }
+}
+#endif
+
+void flushDisplay() {
+  DIAG_START(flushStart);
+  display.display();
+  DIAG_STOP(DIAG_FLUSH, flushStart);
+}
+
 void loop() {
-  // Check network connections
-  if (WiFi.status() != WL_CONNECTED) {
-    connectToNetwork();
+#if DIAGNOSTICS
+  uint32_t loopStartUs = micros();
+  diagnostics.record(DIAG_LOOP, loopStartUs - lastLoopStartUs);
+  lastLoopStartUs = loopStartUs;
+#endif
+  uint32_t now = millis();
+#if LOW_POWER_IDLE
+  if (lowPowerIdle && distanceSensor.woken()) {
+    wakeOrRewatch(now);
+  }
+#endif
+  scheduler.runOnce(now);
+#if LOW_POWER_IDLE
+  // Nothing else to do until the next task or an interrupt
+  if (lowPowerIdle) {
+    boardSleep(scheduler.idleTime(millis()));
+  }
+#endif
+}
+
+#if LOW_POWER_IDLE
+// Nobody has been near the piano for idleTimeout: hand presence detection
+// to the ToF's threshold interrupt and turn everything else down
+void enterIdle(uint32_t now) {
+  Serial.println("Idle: low power until someone sits down");
+  mic.pause();
+  distanceWatched = distanceSensor.watch(DISTANCE_MAX_THRESHOLD, IDLE_RANGING_PERIOD);
+  publisher.setLowPower(true);
+  scheduler.setEnabled(senseTaskId, false, now);
+  scheduler.setEnabled(displayTaskId, false, now);
+  scheduler.setPeriod(mqttTaskId, IDLE_LINK_PERIOD);
+  scheduler.setPeriod(connectionTaskId, IDLE_LINK_PERIOD);
+  scheduler.setEnabled(idleTaskId, true, now);
+#if SPECTRUM_STREAM
+  scheduler.setEnabled(spectrumTaskId, false, now);
+#endif
+  wakePublishPending = false;
+  lowPowerIdle = true;
+}
+
+// Someone came into range - back to full-rate sensing straight away
+void leaveIdle(uint32_t now) {
+  lowPowerIdle = false;
+  distanceSensor.resume();
+  mic.resume();
+#if MULTIRATE_ANALYSIS
+  cascade.begin(mic.sampleRate(), micDcOffset);  // The windows hold sound from before the pause
+#endif
+  publisher.setLowPower(false);
+  scheduler.setEnabled(idleTaskId, false, now);
+  scheduler.setPeriod(mqttTaskId, MQTT_POLL_PERIOD);
+  scheduler.setPeriod(connectionTaskId, CONNECTION_PERIOD);
+  scheduler.setEnabled(displayTaskId, true, now);
+  scheduler.setEnabled(senseTaskId, true, now);
+#if SPECTRUM_STREAM
+  scheduler.setEnabled(spectrumTaskId, true, now);
+#endif
+
+  // The smoothed distance still says "far away" - let the first reading
+  // after the wake replace it instead of averaging towards it for a second
+  stateMachine.reseed();
+  wakeMs = now;
+  wakePublishPending = true;
+}
+
+// Closer than DISTANCE_MIN_THRESHOLD is something on or against the sensor,
+// not a player - waking for it would only idle again and wake again
+bool inWakeRange(int distance) {
+  return distance >= DISTANCE_MIN_THRESHOLD && distance <= DISTANCE_MAX_THRESHOLD;
+}
+
+// The watch interrupt fired: wake for a player, otherwise re-arm the watch.
+// The sensor can only interrupt on one side of a threshold, so with
+// something left too close this repeats every IDLE_RANGING_PERIOD - a few
+// register reads each time, not a full wake.
+void wakeOrRewatch(uint32_t now) {
+  int distance;
+  if (distanceSensor.read(distance) && distance < DISTANCE_MIN_THRESHOLD) {
+    distanceWatched = distanceSensor.watch(DISTANCE_MAX_THRESHOLD, IDLE_RANGING_PERIOD);
     return;
   }
-  if (!mqttClient.connected()) {
-    connectToBroker();
+  leaveIdle(now);
+}
+
+// The only sensing left while idle: the no-presence heartbeat, and the
+// wake check when the sensor has no interrupt to do it
+void idleTask(uint32_t now) {
+  int distance;
+  if (!distanceWatched && distanceSensor.read(distance) && inWakeRange(distance)) {
+    leaveIdle(now);
+    return;
   }
-  mqttClient.poll();
+  handleState(STATE_NO_PRESENCE, false, false, stateMachine.distance(), 0);
+}
+#endif
 
-  // Read and smooth sensor values
-  int sensorVal = sensor.readRangeContinuousMillimeters();
-  int sensorValSmoothed = lastSensorVal * 0.9 + sensorVal * 0.1;
-  lastSensorVal = sensorValSmoothed;
-  
-  // Detect presence - person is in valid distance range
-  bool personDetected = (sensorValSmoothed >= DISTANCE_MIN_THRESHOLD && 
-                         sensorValSmoothed <= DISTANCE_MAX_THRESHOLD);
+#if ADAPTIVE_CALIBRATION
+// One sense tick of the empty room: the level every tick, the DC bias from
+// every block, and every CAL_ANALYSIS_PERIOD what the pitch engine makes of
+// it. block may be nullptr (no new one this tick); it is not released here.
+void calibrateFromRoom(const int16_t* block, int level, uint32_t now) {
+  calibration.learnLevel(level);
+  if (block != nullptr) {
+    calibration.learnBlock(block, SAMPLES);
+    if (now - lastCalibrationAnalysis >= CAL_ANALYSIS_PERIOD) {
+      lastCalibrationAnalysis = now;
+      DIAG_START(analysisStart);
+#if MULTIRATE_ANALYSIS
+      // The whole cascade, as a played note would be analyzed - hum sits in
+      // the long bass bands
+      PitchEstimate pitch = estimateMultiRate(cascade, spectrum, pitchEngine, micDcOffset, 3,
+                                              DecimationCascade::BANDS,
+                                              ToneLevelLearner{calibration}).pitch;
+#else
+      spectrum.loadBlock(block, micDcOffset);
+      pitchEngine.load(block, micDcOffset);
+      spectrum.compute();
+      spectrum.complexToMagnitude();
+      calibration.learnSpectrum(spectrum, 0, mic.sampleRate());
+      PitchEstimate pitch = pitchEngine.estimate(spectrum, mic.sampleRate(), 3);
+#endif
+      DIAG_STOP(DIAG_ANALYSIS, analysisStart);
+      calibration.learnPitch(pitch);
+    }
+  }
+  micDcOffset = calibration.dcOffset();
+  playThreshold = calibration.levelThreshold();
+  pitchThreshold = calibration.strengthThreshold();
+}
+#endif
+
+// Presence, mic level, state machine and (when playing) audio analysis
+void senseTask(uint32_t now) {
+  // The sensor only reports when a new measurement is ready, so this never
+  // waits for the ToF's ranging period
+  int sensorVal;
+  if (distanceSensor.read(sensorVal)) {
+    stateMachine.addDistance(sensorVal);
+  }
+  int sensorValSmoothed = stateMachine.distance();
   
   // Get microphone value
   int smoothedMicValue = getSmoothedMicValue();
+  currentMicValue = smoothedMicValue;
+
+#if ADAPTIVE_CALIBRATION
+  // Nobody there (for long enough that the piano has stopped ringing):
+  // what the mic hears is the room
+  bool calibrating = currentState == STATE_NO_PRESENCE && now - noPresenceSince >= CAL_SETTLE_MS;
+#endif
+#if MULTIRATE_ANALYSIS
+  // Every block goes through the cascade, playing or not, so the long bass
+  // windows already hold the note when it is analyzed
+  const int16_t* captured = acquireCaptureBlock();
+  blockCaptured = captured != nullptr;
+  if (blockCaptured) {
+    cascade.push(captured, SAMPLES);
+  }
+#if ADAPTIVE_CALIBRATION
+  if (calibrating) {
+    calibrateFromRoom(captured, smoothedMicValue, now);
+  }
+#endif
+  if (blockCaptured) {
+    releaseCaptureBlock();
+  }
+  // A strike starts the count of bands that have refilled since
+  if (onsetGate.update(smoothedMicValue, now)) {
+    cascade.mark();
+  }
+#else
+#if ADAPTIVE_CALIBRATION
+  // Blocks are otherwise only taken while playing
+  if (calibrating) {
+    const int16_t* captured = acquireCaptureBlock();
+    calibrateFromRoom(captured, smoothedMicValue, now);
+    if (captured != nullptr) {
+      releaseCaptureBlock();
+    }
+  }
+#endif
+  onsetGate.update(smoothedMicValue, now);
+#endif
   
-  // Detect if playing - needs both presence AND volume above threshold
-  bool isPlaying = personDetected && (smoothedMicValue > MIC_MIN_THRESHOLD);
-
-  // Determine current state
-  PianoState newState;
-  if (!personDetected) {
-    newState = STATE_NO_PRESENCE;
-  } else if (!isPlaying) {
-    newState = STATE_PRESENCE_ONLY;
-  } else {
-    newState = STATE_PLAYING;
+  // Presence from the distance and playing from presence AND volume, each
+  // with its hysteresis
+  PianoState newState = stateMachine.update(smoothedMicValue, playThreshold, now);
+  bool personDetected = stateMachine.present();
+  bool isPlaying = stateMachine.playing();
+
+  // The cached note is stale once playing (re)starts. Leaving the piano
+  // reports what gating saved over the session.
+  if (newState == STATE_PLAYING && currentState != STATE_PLAYING) {
+    onsetGate.requestAnalysis();
+    havePitch = false;
+#if MULTIRATE_ANALYSIS
+    cascade.mark();
+    notePending = false;
+#endif
+  } else if (newState == STATE_NO_PRESENCE && currentState != STATE_NO_PRESENCE) {
+#if ADAPTIVE_CALIBRATION
+    noPresenceSince = now;
+#endif
+    Serial.print("Analysis: ");
+    Serial.print(onsetGate.analyzed());
+    Serial.print(" blocks analyzed, ");
+    Serial.print(onsetGate.skipped());
+    Serial.print(" skipped, ");
+    Serial.print(onsetGate.onsets());
+    Serial.println(" onsets so far");
+#if REPORT_BY_EXCEPTION
+    Serial.print("Reports: ");
+    Serial.print(reportPolicy.count(REPORT_STATE));
+    Serial.print(" state, ");
+    Serial.print(reportPolicy.count(REPORT_EVENTS));
+    Serial.print(" notes, ");
+    Serial.print(reportPolicy.count(REPORT_CHANGE));
+    Serial.print(" change, ");
+    Serial.print(reportPolicy.count(REPORT_HEARTBEAT));
+    Serial.print(" heartbeat; ");
+    Serial.print(stateMachine.suppressed());
+    Serial.println(" state flaps held back");
+#endif
   }
+#if ADAPTIVE_CALIBRATION
+  // Someone arrived: what the room taught us while they were away
+  if (currentState == STATE_NO_PRESENCE && newState != STATE_NO_PRESENCE) {
+    Serial.print("Calibration: DC ");
+    Serial.print(micDcOffset);
+    Serial.print(", playing above ");
+    Serial.print(playThreshold);
+    Serial.print(", ");
+    Serial.print(calibration.learnedTones());
+    Serial.println(" background tones");
+  }
+#endif
 
   // Handle state transition or continued state
   handleState(newState, personDetected, isPlaying, sensorValSmoothed, smoothedMicValue);
-  
+
+  // A state change should show up on the display straight away
+  if (newState != currentState) {
+    currentState = newState;
+    scheduler.signal(displayTaskId, now);
+  }
+
+#if LOW_POWER_IDLE
+  if (currentState == STATE_NO_PRESENCE && displayAsleep &&
+      now - lastPersonTime > idleTimeout &&
+      (!wakePublishPending || now - wakeMs > IDLE_MIN_AWAKE_MS)) {
+    enterIdle(now);
+  }
+#endif
+}
+
+void displayTask(uint32_t now) {
   // Update display if needed
   // If state has changed, always update the display
-  if (currentState != newState) {
-    updateDisplay(newState, smoothedMicValue);
-    currentState = newState;
+  if (displayedState != currentState) {
+    updateDisplay(currentState, currentMicValue);
+    displayedState = currentState;
   } 
   // Otherwise only update if the current state needs it
-  else if (needsDisplayUpdate(newState, smoothedMicValue)) {
-    updateDisplay(newState, smoothedMicValue);
+  else if (needsDisplayUpdate(currentState, currentMicValue)) {
+    updateDisplay(currentState, currentMicValue);
   }
   
   // Power saving: turn off display after timeout period of no presence
-  if (newState == STATE_NO_PRESENCE && 
-      millis() - lastPersonTime > oledTimeout) {
+  if (currentState == STATE_NO_PRESENCE && !displayAsleep &&
+      now - lastPersonTime > oledTimeout) {
     display.clearDisplay();
-    display.display();
+    flushDisplay();
+    drawnScreen = -1;
+    displayAsleep = true;
   }
-
-  delay(10);
 }
 
 void handleState(PianoState state, bool personDetected, bool isPlaying, 
@@ -418,53 +1272,28 @@ void handleState(PianoState state, bool personDetected, bool isPlaying,
   if (personDetected) {
     lastPersonTime = millis();
   }
+#if PRACTICE_SESSIONS
+  trackSession(personDetected, isPlaying, volume);
+#endif
   
+  // Without audio, all fields are sent - null for audio data
+  PianoReading reading = {distance, volume, false, 0, nullptr, 0, personDetected, false, nullptr, 0};
+
   // Execute state-specific logic
   switch (state) {
     case STATE_NO_PRESENCE:
-      // No presence - Use the longer interval (1 minute)
-      if ((unsigned long)(millis() - lastTimeSent) > (unsigned long)noPresenceInterval) {
+      // No presence - without news, once a minute
+      if (reportDue(reading, noPresenceInterval)) {
         lastTimeSent = millis();
-        
-        // Create JSON formatted string with all fields - null for audio data, false for presence
-        String jsonMessage = "{";
-        jsonMessage += "\"distance\":" + String(distance) + ",";
-        jsonMessage += "\"volume\":" + String(volume) + ",";
-        jsonMessage += "\"frequency\":null,";
-        jsonMessage += "\"note\":null,";
-        jsonMessage += "\"octave\":null,";
-        jsonMessage += "\"presence\":false,";
-        jsonMessage += "\"playing\":false";
-        jsonMessage += "}";
-        
-        mqttClient.beginMessage(topic);
-        mqttClient.print(jsonMessage);
-        mqttClient.endMessage();
-        Serial.println("Published no presence: " + jsonMessage);
+        publishReading(reading, "no presence");
       }
       break;
       
     case STATE_PRESENCE_ONLY:
-      // Person present but not playing
-      // Send presence data every interval
-      if ((unsigned long)(millis() - lastTimeSent) > (unsigned long)interval) {
+      // Person present but not playing - without news, every interval
+      if (reportDue(reading, interval)) {
         lastTimeSent = millis();
-        
-        // Create JSON formatted string - include all fields, null for audio data
-        String jsonMessage = "{";
-        jsonMessage += "\"distance\":" + String(distance) + ",";
-        jsonMessage += "\"volume\":" + String(volume) + ",";
-        jsonMessage += "\"frequency\":null,";
-        jsonMessage += "\"note\":null,";
-        jsonMessage += "\"octave\":null,";
-        jsonMessage += "\"presence\":true,";
-        jsonMessage += "\"playing\":false";
-        jsonMessage += "}";
-        
-        mqttClient.beginMessage(topic);
-        mqttClient.print(jsonMessage);
-        mqttClient.endMessage();
-        Serial.println("Published presence: " + jsonMessage);
+        publishReading(reading, "presence");
       }
       break;
       
@@ -476,45 +1305,206 @@ void handleState(PianoState state, bool personDetected, bool isPlaying,
 }
 
 void calculateAndProcessAudio(int distance, int volume) {
-  // Only calculate frequency if we're actively playing
-  double newFrequency = calculateDominantFrequency();
-  
-  if (newFrequency > 0) {
-    dominantFrequency = newFrequency;
-    frequencyToNote(dominantFrequency, currentNote, currentOctave);
-    lastNoteTime = millis();
-    
-    // Send MQTT message with all the data we have
-    if ((unsigned long)(millis() - lastTimeSent) > (unsigned long)interval) {
-      lastTimeSent = millis();
-      
-      // Create JSON formatted string - include all fields
-      String jsonMessage = "{";
-      jsonMessage += "\"distance\":" + String(distance) + ",";
-      jsonMessage += "\"volume\":" + String(volume) + ",";
-      
-      // Include note and frequency data - always include fields
-      jsonMessage += "\"frequency\":" + String(int(dominantFrequency)) + ",";
-      
-      // Check if we have valid note data
-      if (currentNote != "" && currentNote != "---") {
-        jsonMessage += "\"note\":\"" + currentNote + "\",";
-        jsonMessage += "\"octave\":" + String(currentOctave) + ",";
-      } else {
-        jsonMessage += "\"note\":null,";
-        jsonMessage += "\"octave\":null,";
+#if MULTIRATE_ANALYSIS
+  // Work only when senseTask put a new block into the cascade
+  if (!blockCaptured) {
+    return;
+  }
+  const int16_t* block = nullptr;
+
+  // A struck note that wanted a longer band than had refilled is looked at
+  // again each time one more band has
+  if (notePending && cascade.freshBands() > pendingBands) {
+    onsetGate.requestAnalysis(1);
+  }
+#else
+  // Work only when the DMA has finished a new block
+  const int16_t* block = acquireCaptureBlock();
+  if (block == nullptr) {
+    return;
+  }
+#endif
+
+#if ONSET_GATING
+  AnalysisDecision decision = onsetGate.decide(millis());
+#else
+  AnalysisDecision decision = ANALYSIS_REFRESH;
+#endif
+
+  if (decision == ANALYSIS_SKIP) {
+    // Same note still sounding - hand the block back without an FFT
+#if !MULTIRATE_ANALYSIS
+    releaseCaptureBlock();
+#endif
+  } else {
+    DIAG_START(analysisStart);
+    double newFrequency = calculateDominantFrequency(block);
+    DIAG_STOP(DIAG_ANALYSIS, analysisStart);
+    havePitch = newFrequency > 0;
+    if (havePitch) {
+      dominantFrequency = newFrequency;
+      uint8_t previousMidi = currentNote.midi;
+      currentNote = frequencyToNote(dominantFrequency);
+
+      // Record every new note (or the same note struck again) so the notes
+      // between publishes aren't lost
+#if ONSET_GATING
+      bool restruck = decision == ANALYSIS_ONSET;
+#else
+      bool restruck = millis() - lastNoteTime > NOTE_RESTRIKE_GAP;
+#endif
+      bool record = currentNote.valid() && (currentNote.midi != previousMidi || restruck);
+#if MULTIRATE_ANALYSIS
+      // A bass note's pitch firms up as the longer windows refill after
+      // the strike - its event waits until then, so it is recorded once
+      if (record || notePending) {
+        notePending = !pitchSettled;
+        pendingBands = cascade.freshBands();
+        record = !notePending && currentNote.valid();
       }
-      
-      jsonMessage += "\"presence\":true,";
-      jsonMessage += "\"playing\":true";
-      jsonMessage += "}";
-      
-      mqttClient.beginMessage(topic);
-      mqttClient.print(jsonMessage);
-      mqttClient.endMessage();
-      Serial.println("Published playing: " + jsonMessage);
+#endif
+      if (record) {
+#if TELEMETRY_JSON
+        // Events only go out in JSON - binary-only builds don't collect them
+        NoteEvent event = {(uint32_t)millis(), currentNote.name, currentNote.octave,
+                           (uint16_t)dominantFrequency, (uint16_t)volume};
+        noteTimeline.push(event);
+#endif
+#if PRACTICE_SESSIONS
+        practiceSession.addNote(currentNote.midi);
+#endif
+      }
+      lastNoteTime = millis();
     }
   }
+
+  // Send MQTT message with all the data we have - early if the timeline
+  // filled up. Skipped blocks report the cached note. Note/octave are null
+  // without a valid note.
+  PianoReading reading = {distance, volume, havePitch, havePitch ? int(dominantFrequency) : 0,
+                          havePitch && currentNote.valid() ? currentNote.name : nullptr,
+                          currentNote.octave, true, true,
+                          currentChord, currentChordSize};
+#if REPORT_BY_EXCEPTION
+  // Playing is news as soon as it starts, pitch or not yet
+  if (reportDue(reading, interval)) {
+#else
+  if (havePitch &&
+      ((unsigned long)(millis() - lastTimeSent) > (unsigned long)interval ||
+       noteTimeline.shouldFlush(millis()))) {
+#endif
+    lastTimeSent = millis();
+    publishReading(reading, "playing");
+  }
+}
+
+// Whether reading should go out now: when it is news (REPORT_BY_EXCEPTION),
+// or once periodMs has passed since the last publish
+bool reportDue(const PianoReading& reading, unsigned long periodMs) {
+#if REPORT_BY_EXCEPTION
+  (void)periodMs;
+  uint32_t now = millis();
+  bool eventsDue = !noteTimeline.empty() && noteTimeline.shouldFlush(now);
+  reportReason = reportPolicy.due(reading, eventsDue, now);
+  return reportReason != REPORT_NONE;
+#else
+  return (unsigned long)(millis() - lastTimeSent) > periodMs;
+#endif
+}
+
+#if PRACTICE_SESSIONS
+// Called on every state tick, idle ones included, so a session also ends
+// while the rest of the firmware sleeps
+void trackSession(bool personDetected, bool isPlaying, int volume) {
+  SessionEvent event = practiceSession.update(personDetected, isPlaying, volume, millis());
+  if (event == SESSION_STARTED) {
+    Serial.println("Session started");
+  } else if (event == SESSION_ENDED) {
+    publishSession();
+  }
+}
+
+// The one message a session leaves behind - queued like played notes when
+// the link is down
+void publishSession() {
+  uint32_t capturedMs = millis();
+  char payload[SESSION_JSON_MAX];
+  static_assert(SESSION_JSON_MAX <= PUBLISH_MAX_PAYLOAD, "the widest session summary must fit in one publish");
+  size_t length = writeSessionJson(payload, sizeof(payload), practiceSession, capturedMs);
+  if (length == 0) {
+    Serial.println("Session summary too long, dropped");
+    return;
+  }
+  bool sent = sendOrQueue(sessionTopic, (const uint8_t*)payload, length, capturedMs, PRIORITY_NOTES);
+  Serial.print(sent ? "Published session: " : "Queued session: ");
+  Serial.println(payload);
+}
+#endif
+
+// Publish now, or keep the message for backfillTask() while the link is down.
+// Returns true if it went out straight away (or into the publish pipeline).
+bool sendOrQueue(const char* messageTopic, const uint8_t* payload, size_t length,
+                 uint32_t capturedMs, uint8_t priority) {
+  if (publishMessage(messageTopic, payload, length, capturedMs, priority)) {
+    return true;
+  }
+  if (!offlineQueue.push(messageTopic, payload, length, capturedMs, priority)) {
+    Serial.println("Offline queue full, message dropped");
+  }
+  return false;
+}
+
+// Serialize a reading into a stack buffer and publish it - no String temporaries
+void publishReading(const PianoReading& reading, const char* label) {
+  uint32_t capturedMs = millis();
+  bool sent = true;
+
+  // When the offline queue fills up, notes that were played outlive idle pings
+  uint8_t priority = (reading.playing || !noteTimeline.empty()) ? PRIORITY_NOTES : PRIORITY_PRESENCE;
+
+#if TELEMETRY_BINARY
+  uint8_t frame[TELEMETRY_BINARY_SIZE];
+  size_t frameLength = encodeReadingBinary(frame, sizeof(frame), reading);
+  sent &= sendOrQueue(binaryTopic, frame, frameLength, capturedMs, priority);
+#endif
+
+  // The JSON text is still built for the Serial log in binary-only mode.
+  // Pending note events ride along in JSON only, so only handing the JSON
+  // over starts a new window.
+  char payload[TELEMETRY_BATCH_JSON_MAX];
+  static_assert(TELEMETRY_BATCH_JSON_MAX <= PUBLISH_MAX_PAYLOAD, "a reading must fit in one publish");
+  size_t payloadLength = writeReadingJson(payload, sizeof(payload), reading, noteTimeline);
+
+#if TELEMETRY_JSON
+  sent &= sendOrQueue(topic, (const uint8_t*)payload, payloadLength, capturedMs, priority);
+  noteTimeline.clear(millis());
+#else
+  (void)payloadLength;
+#endif
+
+  Serial.print(sent ? "Published " : "Queued ");
+  Serial.print(label);
+#if REPORT_BY_EXCEPTION
+  static const char* const reasonNames[REPORT_REASONS] = {"", " (state)", " (notes)", " (change)",
+                                                          " (heartbeat)"};
+  Serial.print(reasonNames[reportReason]);
+  reportPolicy.sent(reading, reportReason, capturedMs);
+#endif
+  Serial.print(": ");
+  Serial.println(payload);
+
+#if LOW_POWER_IDLE
+  if (wakePublishPending) {
+    uint32_t latency = capturedMs - wakeMs;
+    wakePublishPending = false;
+    Serial.print("Wake to first publish: ");
+    Serial.print(latency);
+    Serial.println(" ms");
+#if DIAGNOSTICS
+    diagnostics.recordWake(latency);
+#endif
+  }
+#endif
 }
 
 bool needsDisplayUpdate(PianoState state, int micValue) {
@@ -536,8 +1526,7 @@ bool needsDisplayUpdate(PianoState state, int micValue) {
     
     case STATE_PLAYING:
       // Only update when the note or frequency changes significantly
-      if (currentNote != lastDisplayedNote || 
-          currentOctave != lastDisplayedOctave ||
+      if (currentNote.midi != lastDisplayedMidi ||
           abs(dominantFrequency - lastDisplayedFrequency) > 2.0) {
         return true;
       }
@@ -548,64 +1537,61 @@ bool needsDisplayUpdate(PianoState state, int micValue) {
 }
 
 void updateDisplay(PianoState state, int micValue) {
-  display.clearDisplay();
-  display.setTextColor(SSD1306_WHITE);
-  
+  // A new screen starts from blank; within a screen the widgets only redraw
+  // what changed, and display() only sends the pages that differ
+  if (drawnScreen != state) {
+    display.clearDisplay();
+    titleText.invalidate();
+    lineText.invalidate();
+    volumeLabel.invalidate();
+    volumeBar.invalidate();
+    noteText.invalidate();
+    frequencyText.invalidate();
+    drawnScreen = state;
+  }
+
   // Variable declarations outside of case statements to avoid jump errors
   int barLength = 0;
+  char label[TEXT_WIDGET_MAX];
   
   switch(state) {
     case STATE_NO_PRESENCE:
       // "Ready" display
-      display.setTextSize(1);
-      display.setCursor(0, 0);
-      display.println("Ready to play!");
-      display.setCursor(0, 16);
-      display.println("Please sit down");
+      titleText.show(display, "Ready to play!");
+      lineText.show(display, "Please sit down");
       break;
       
     case STATE_PRESENCE_ONLY:
       // "Listening" display
-      display.setTextSize(1);
-      display.setCursor(0, 0);
-      display.println("Listening...");
+      titleText.show(display, "Listening...");
       
       // Simple volume bar
-      display.setCursor(0, 12);
-      display.print("Volume: ");
+      volumeLabel.show(display, "Volume: ");
       barLength = map(constrain(micValue, 0, MIC_MAX_AMPLITUDE), 
                       0, MIC_MAX_AMPLITUDE, 0, 40);
-      for (int i = 0; i < barLength; i++) {
-        display.fillRect(40 + i, 12, 1, 8, SSD1306_WHITE);
-      }
+      volumeBar.show(display, barLength);
       break;
       
     case STATE_PLAYING:
       // "Playing" display with note information
-      display.setTextSize(1);
-      display.setCursor(0, 0);
-      display.println("Playing:");
+      titleText.show(display, "Playing:");
       
       // Note name in large text
-      display.setTextSize(2);
-      display.setCursor(0, 10);
-      display.print(currentNote);
-      display.print(currentOctave);
+      snprintf(label, sizeof(label), "%s%d", currentNote.name, currentNote.octave);
+      noteText.show(display, label);
       
       // Frequency in smaller text
-      display.setTextSize(1);
-      display.setCursor(70, 16);
-      display.print(int(dominantFrequency));
-      display.print(" Hz");
+      snprintf(label, sizeof(label), "%d Hz", int(dominantFrequency));
+      frequencyText.show(display, label);
       
       // Save what we displayed for comparison later
-      lastDisplayedNote = currentNote;
-      lastDisplayedOctave = currentOctave;
+      lastDisplayedMidi = currentNote.midi;
       lastDisplayedFrequency = dominantFrequency;
       break;
   }
   
-  display.display();
+  flushDisplay();
+  displayAsleep = false;
   lastSoundTime = millis();
   lastDisplayUpdateTime = millis(); // Track when we updated the display
-}
\ No newline at end of file
+}
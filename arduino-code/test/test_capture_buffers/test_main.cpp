@@ -0,0 +1,116 @@
+// Ping-pong handoff of AdcCapture's host stub: blocks become ready only when
+// full, a block left waiting is replaced and counted, a producer wrapping
+// onto a held block is counted as an overrun, and latestSample() follows the
+// samples as they arrive instead of the end of the last block.
+//
+//   pio test -e native -f test_capture_buffers
+
+#include <unity.h>
+#include "AdcCapture.h"
+
+static AdcCapture capture;
+static int16_t block[CAPTURE_SAMPLES];
+
+// CAPTURE_SAMPLES samples counting up from first
+static void feedRamp(int16_t first, size_t count = CAPTURE_SAMPLES) {
+  for (size_t i = 0; i < count; i++) {
+    block[i] = (int16_t)(first + i);
+  }
+  capture.feedSamples(block, count);
+}
+
+void setUp() {
+  capture.begin(0, 5000);
+}
+
+void tearDown() {
+  capture.end();
+}
+
+void test_block_ready_only_when_full() {
+  feedRamp(0, CAPTURE_SAMPLES - 1);
+  TEST_ASSERT_NULL(capture.acquire());
+  feedRamp(CAPTURE_SAMPLES - 1, 1);
+
+  const int16_t* ready = capture.acquire();
+  TEST_ASSERT_NOT_NULL(ready);
+  for (int i = 0; i < CAPTURE_SAMPLES; i++) {
+    TEST_ASSERT_EQUAL_INT16(i, ready[i]);
+  }
+  capture.release();
+  TEST_ASSERT_NULL(capture.acquire());
+  TEST_ASSERT_EQUAL_UINT32(1, capture.stats().blocksCompleted());
+}
+
+void test_unread_block_is_replaced() {
+  feedRamp(0);
+  feedRamp(1000);
+  TEST_ASSERT_EQUAL_UINT32(1, capture.stats().dropped());
+
+  const int16_t* ready = capture.acquire();
+  TEST_ASSERT_NOT_NULL(ready);
+  TEST_ASSERT_EQUAL_INT16(1000, ready[0]);  // The newer block
+  capture.release();
+  TEST_ASSERT_EQUAL_UINT32(0, capture.stats().overruns());
+}
+
+void test_held_block_overrun() {
+  feedRamp(0);
+  const int16_t* held = capture.acquire();
+  TEST_ASSERT_NOT_NULL(held);
+
+  // The next block fills the other buffer and finishing it moves the
+  // producer onto the one still held
+  feedRamp(200);
+  TEST_ASSERT_EQUAL_UINT32(1, capture.stats().overruns());
+  TEST_ASSERT_EQUAL_INT16(0, held[0]);  // Not written yet
+  capture.release();
+
+  // Released in time: no more overruns
+  const int16_t* next = capture.acquire();
+  TEST_ASSERT_NOT_NULL(next);
+  TEST_ASSERT_EQUAL_INT16(200, next[0]);
+  capture.release();
+  feedRamp(400);
+  TEST_ASSERT_EQUAL_UINT32(1, capture.stats().overruns());
+}
+
+void test_latest_sample_is_live() {
+  feedRamp(0);
+  TEST_ASSERT_EQUAL_INT16(CAPTURE_SAMPLES - 1, capture.latestSample());
+
+  // A few samples into the next block, long before it completes
+  feedRamp(500, 10);
+  TEST_ASSERT_EQUAL_INT16(509, capture.latestSample());
+  feedRamp(700, 1);
+  TEST_ASSERT_EQUAL_INT16(700, capture.latestSample());
+  TEST_ASSERT_EQUAL_UINT32(1, capture.stats().blocksCompleted());
+}
+
+void test_paused_capture_takes_nothing() {
+  feedRamp(0, 5);
+  capture.pause();
+  feedRamp(100);
+  TEST_ASSERT_NULL(capture.acquire());
+  TEST_ASSERT_EQUAL_INT16(4, capture.latestSample());
+
+  capture.resume();
+  feedRamp(5, CAPTURE_SAMPLES - 5);
+  const int16_t* ready = capture.acquire();
+  TEST_ASSERT_NOT_NULL(ready);
+  TEST_ASSERT_EQUAL_INT16(4, ready[4]);
+  TEST_ASSERT_EQUAL_INT16(5, ready[5]);
+  capture.release();
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_block_ready_only_when_full);
+  RUN_TEST(test_unread_block_is_replaced);
+  RUN_TEST(test_held_block_overrun);
+  RUN_TEST(test_latest_sample_is_live);
+  RUN_TEST(test_paused_capture_takes_nothing);
+  return UNITY_END();
+}
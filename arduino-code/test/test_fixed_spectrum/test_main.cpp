@@ -0,0 +1,138 @@
+// FixedSpectrum against a double-precision reference: the same DC removal,
+// Hamming window, DFT, magnitudes and 3-harmonic product spectrum worked out
+// in double, as the ArduinoFFT<double> path did. The integer engine must
+// find the same HPS peak bin, with every magnitude and the peak value
+// within the tolerances below.
+//
+//   pio test -e native -f test_fixed_spectrum
+
+#include <math.h>
+#include <unity.h>
+#include "FixedSpectrum.h"
+
+#define SAMPLES FixedSpectrum::SAMPLES
+#define BINS FixedSpectrum::BINS
+#define SAMPLING_FREQUENCY 5000
+#define DC_OFFSET 512
+#define HARMONICS 3
+#define FIRST_BIN 3
+
+// alpha-max-plus-beta-min is within about 4% of |X|, and the Q15 window,
+// twiddles and block-floating-point halvings add rounding on top. A bin's
+// error is taken relative to the frame's largest magnitude, since a small
+// bin's absolute error comes from the rounding of the whole transform.
+#define MAGNITUDE_TOLERANCE 0.05
+// Three factors, each within MAGNITUDE_TOLERANCE of the reference
+#define HPS_TOLERANCE 0.16
+
+static FixedSpectrum spectrum;
+static int16_t raw[SAMPLES];
+static double reference[BINS];
+
+// A tone at frequency with two overtones at 1/2 and 1/3, amplitude counts
+// about DC_OFFSET, clipped to the 10-bit ADC's range
+static void makeTone(double frequency, double amplitude) {
+  for (int i = 0; i < SAMPLES; i++) {
+    double t = (double)i / SAMPLING_FREQUENCY;
+    double v = sin(2 * M_PI * frequency * t) + 0.5 * sin(2 * M_PI * 2 * frequency * t) +
+               0.33 * sin(2 * M_PI * 3 * frequency * t);
+    double sample = DC_OFFSET + amplitude * v / 1.83;
+    raw[i] = (int16_t)(sample < 0 ? 0 : sample > 1023 ? 1023 : lround(sample));
+  }
+}
+
+// The double path: window, DFT and magnitudes
+static void referenceMagnitudes() {
+  for (int k = 0; k < BINS; k++) {
+    double re = 0;
+    double im = 0;
+    for (int i = 0; i < SAMPLES; i++) {
+      double window = 0.54 - 0.46 * cos(2 * M_PI * i / (SAMPLES - 1));
+      double x = (raw[i] - DC_OFFSET) * window;
+      re += x * cos(2 * M_PI * k * i / SAMPLES);
+      im -= x * sin(2 * M_PI * k * i / SAMPLES);
+    }
+    reference[k] = sqrt(re * re + im * im);
+  }
+}
+
+// The double path's HPS: bins above SAMPLES/(2*h) keep fewer factors
+static void referenceHps(int* bin, double* value) {
+  *bin = 0;
+  *value = 0;
+  for (int i = FIRST_BIN; i < BINS; i++) {
+    double product = reference[i];
+    for (int harmonic = 2; harmonic <= HARMONICS && i < SAMPLES / (2 * harmonic); harmonic++) {
+      product *= reference[i * harmonic];
+    }
+    if (product > *value) {
+      *value = product;
+      *bin = i;
+    }
+  }
+}
+
+static void checkAgainstReference(double frequency, double amplitude) {
+  makeTone(frequency, amplitude);
+  referenceMagnitudes();
+  spectrum.loadBlock(raw, DC_OFFSET);
+  spectrum.compute();
+  spectrum.complexToMagnitude();
+
+  double largest = 0;
+  for (int k = 0; k < BINS; k++) {
+    largest = fmax(largest, reference[k]);
+  }
+  for (int k = 1; k < BINS; k++) {
+    double fixed = (double)spectrum.inputUnits(spectrum.magnitudes()[k]);
+    TEST_ASSERT_FLOAT_WITHIN(MAGNITUDE_TOLERANCE * largest, reference[k], fixed);
+  }
+
+  int referenceBin;
+  double referenceValue;
+  referenceHps(&referenceBin, &referenceValue);
+  HpsPeak peak = spectrum.harmonicProductPeak(HARMONICS, FIRST_BIN);
+  TEST_ASSERT_EQUAL_INT(referenceBin, peak.bin);
+  TEST_ASSERT_FLOAT_WITHIN(HPS_TOLERANCE * referenceValue, referenceValue, (double)peak.value);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_a4_at_playing_level() {
+  checkAgainstReference(440.0, 180);
+}
+
+void test_c3_bass() {
+  checkAgainstReference(130.8, 180);
+}
+
+void test_e6_treble() {
+  checkAgainstReference(1318.5, 180);
+}
+
+// Near full scale, where the FFT has to halve stages to stay in range
+void test_loud_g4() {
+  checkAgainstReference(392.0, 500);
+}
+
+// A few counts, where the input shift and rounding matter most
+void test_quiet_d5() {
+  checkAgainstReference(587.3, 12);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  spectrum.begin();
+  UNITY_BEGIN();
+  RUN_TEST(test_a4_at_playing_level);
+  RUN_TEST(test_c3_bass);
+  RUN_TEST(test_e6_treble);
+  RUN_TEST(test_loud_g4);
+  RUN_TEST(test_quiet_d5);
+  return UNITY_END();
+}
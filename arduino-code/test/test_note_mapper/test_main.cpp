@@ -0,0 +1,84 @@
+// mapFrequencyToNote() against the linear scan it replaced in
+// frequencyToNote(): closest entry of NOTE_FREQUENCIES by percentage
+// difference, first entry on a tie, nothing when 10% or more off. Checked
+// at every 1 ppm step over the piano's range, A0 (27.5 Hz) to C8 (4186 Hz).
+//
+//   pio test -e native -f test_note_mapper
+
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+#include "NoteMapper.h"
+
+// The old scan, with the note and octave it produced turned into a table
+// index (octave * 12 + note), or -1 for "---"
+static int tableScan(float frequency) {
+  double correctedFreq = frequency;
+  int closestNoteIndex = -1;
+  double minDifference = 99999;
+  for (int i = 0; i < NOTE_TABLE_SIZE; i++) {
+    double difference = fabs(correctedFreq - NOTE_FREQUENCIES[i]);
+    double percentDifference = difference / NOTE_FREQUENCIES[i];
+    if (percentDifference < minDifference) {
+      minDifference = percentDifference;
+      closestNoteIndex = i;
+    }
+  }
+  return closestNoteIndex >= 0 && minDifference < 0.1 ? closestNoteIndex : -1;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_piano_range_matches_table_scan() {
+  long checked = 0;
+  long mismatches = 0;
+  for (float frequency = 27.5f; frequency <= 4186.0f; frequency *= 1.000001f) {
+    int expected = tableScan(frequency);
+    NoteInfo note = mapFrequencyToNote(frequency);
+    int index = note.valid() ? note.midi - 12 : -1;
+    if (index != expected) {
+      if (mismatches == 0) {
+        char message[64];
+        snprintf(message, sizeof(message), "first mismatch at %.6f Hz", frequency);
+        TEST_MESSAGE(message);
+      }
+      mismatches++;
+    } else if (note.valid()) {
+      TEST_ASSERT_EQUAL_STRING(noteNames[index % 12], note.name);
+      TEST_ASSERT_EQUAL_INT(index / 12, note.octave);
+      TEST_ASSERT_INT_WITHIN(51, 0, note.cents);
+    }
+    checked++;
+  }
+  TEST_ASSERT_GREATER_THAN(5000000, checked);
+  TEST_ASSERT_EQUAL_INT(0, mismatches);
+}
+
+void test_table_entries_map_to_themselves() {
+  for (int i = 0; i < NOTE_TABLE_SIZE; i++) {
+    NoteInfo note = mapFrequencyToNote((float)NOTE_FREQUENCIES[i]);
+    TEST_ASSERT_EQUAL_INT(i + 12, note.midi);
+    TEST_ASSERT_INT_WITHIN(3, 0, note.cents);  // The table is rounded
+  }
+}
+
+void test_out_of_range_is_no_note() {
+  TEST_ASSERT_FALSE(mapFrequencyToNote(0.0f).valid());
+  TEST_ASSERT_FALSE(mapFrequencyToNote(14.0f).valid());
+  TEST_ASSERT_FALSE(mapFrequencyToNote(4700.0f).valid());
+  TEST_ASSERT_EQUAL_STRING("---", mapFrequencyToNote(-1.0f).name);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_piano_range_matches_table_scan);
+  RUN_TEST(test_table_entries_map_to_themselves);
+  RUN_TEST(test_out_of_range_is_no_note);
+  return UNITY_END();
+}
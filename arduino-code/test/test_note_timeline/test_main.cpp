@@ -0,0 +1,100 @@
+// NoteTimeline: events come back oldest first, a full ring drops (and
+// counts) the oldest event instead of the newest, and a batch is due once
+// the window has passed or the ring is full - never while it is empty.
+//
+//   pio test -e native -f test_note_timeline
+
+#include <unity.h>
+#include "NoteTimeline.h"
+
+#define INTERVAL_MS 2000
+
+static NoteTimeline timeline(INTERVAL_MS);
+
+static NoteEvent eventAt(uint32_t timeMs) {
+  NoteEvent event = {timeMs, "A", 4, 440, (uint16_t)timeMs};
+  return event;
+}
+
+void setUp() {
+  timeline = NoteTimeline(INTERVAL_MS);
+  timeline.clear(1000);
+}
+
+void tearDown() {
+}
+
+void test_events_in_order() {
+  for (uint32_t i = 0; i < 3; i++) {
+    timeline.push(eventAt(1000 + i * 100));
+  }
+  TEST_ASSERT_EQUAL_INT(3, timeline.size());
+  TEST_ASSERT_FALSE(timeline.full());
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_UINT32(1000 + i * 100, timeline.at(i).timeMs);
+  }
+}
+
+void test_overflow_drops_oldest() {
+  const int extra = 5;
+  for (uint32_t i = 0; i < NOTE_TIMELINE_CAPACITY + extra; i++) {
+    timeline.push(eventAt(i));
+  }
+  TEST_ASSERT_TRUE(timeline.full());
+  TEST_ASSERT_EQUAL_INT(NOTE_TIMELINE_CAPACITY, timeline.size());
+  TEST_ASSERT_EQUAL_UINT32(extra, timeline.overwritten());
+  for (int i = 0; i < NOTE_TIMELINE_CAPACITY; i++) {
+    TEST_ASSERT_EQUAL_UINT32(extra + i, timeline.at(i).timeMs);
+  }
+
+  // Clearing empties the ring but the overwrite count is a running total
+  timeline.clear(5000);
+  TEST_ASSERT_TRUE(timeline.empty());
+  TEST_ASSERT_EQUAL_UINT32(extra, timeline.overwritten());
+  timeline.push(eventAt(5001));
+  TEST_ASSERT_EQUAL_UINT32(5001, timeline.at(0).timeMs);
+}
+
+void test_flush_after_window() {
+  TEST_ASSERT_FALSE(timeline.shouldFlush(1000 + INTERVAL_MS + 1));  // Nothing to send
+  timeline.push(eventAt(1500));
+  TEST_ASSERT_FALSE(timeline.shouldFlush(1500));
+  TEST_ASSERT_FALSE(timeline.shouldFlush(1000 + INTERVAL_MS));
+  TEST_ASSERT_TRUE(timeline.shouldFlush(1000 + INTERVAL_MS + 1));
+
+  // A new window starts at the clear, not at the first event
+  timeline.clear(4000);
+  timeline.push(eventAt(5900));
+  TEST_ASSERT_EQUAL_UINT32(4000, timeline.windowStart());
+  TEST_ASSERT_FALSE(timeline.shouldFlush(4000 + INTERVAL_MS));
+  TEST_ASSERT_TRUE(timeline.shouldFlush(4000 + INTERVAL_MS + 1));
+}
+
+void test_flush_when_full() {
+  for (uint32_t i = 0; i < NOTE_TIMELINE_CAPACITY - 1; i++) {
+    timeline.push(eventAt(1000 + i));
+  }
+  TEST_ASSERT_FALSE(timeline.shouldFlush(1100));
+  timeline.push(eventAt(1100));
+  TEST_ASSERT_TRUE(timeline.shouldFlush(1100));
+  TEST_ASSERT_EQUAL_UINT32(0, timeline.overwritten());
+}
+
+void test_window_across_millis_wrap() {
+  timeline.clear(UINT32_MAX - 500);
+  timeline.push(eventAt(UINT32_MAX - 100));
+  TEST_ASSERT_FALSE(timeline.shouldFlush(1000));  // 1501 ms into the window
+  TEST_ASSERT_TRUE(timeline.shouldFlush(1500));   // 2001 ms
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_events_in_order);
+  RUN_TEST(test_overflow_drops_oldest);
+  RUN_TEST(test_flush_after_window);
+  RUN_TEST(test_flush_when_full);
+  RUN_TEST(test_window_across_millis_wrap);
+  return UNITY_END();
+}
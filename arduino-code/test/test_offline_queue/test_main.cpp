@@ -0,0 +1,221 @@
+// OfflineQueue's store-and-forward rules: messages replay oldest first, a
+// full queue evicts the oldest of the lowest priority (or refuses a message
+// worth less than everything held), and with OFFLINE_QUEUE_FLASH the RAM
+// overflow spills to FlashSpill and still replays in order, byte for byte,
+// across the end of the spill ring.
+//
+//   pio test -e native -f test_offline_queue
+//   pio test -e native_spill
+
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "OfflineQueue.h"
+
+static const char* TOPIC = "conndev/piano";
+
+// Small messages: RAM runs out of entries before bytes, flash of entries
+// before pages
+#if OFFLINE_QUEUE_FLASH
+static const int CAPACITY = OFFLINE_QUEUE_RAM_ENTRIES + OFFLINE_QUEUE_FLASH_ENTRIES;
+#else
+static const int CAPACITY = OFFLINE_QUEUE_RAM_ENTRIES;
+#endif
+
+static OfflineQueue queue;
+
+// "message <n>", captured at n ms
+static bool pushNumbered(int n, uint8_t priority = PRIORITY_NOTES) {
+  char payload[24];
+  int length = snprintf(payload, sizeof(payload), "message %d", n);
+  return queue.push(TOPIC, (const uint8_t*)payload, (size_t)length, (uint32_t)n, priority);
+}
+
+// The front of the queue must be message n - then it is sent
+static void popNumbered(int n) {
+  char expected[24];
+  int length = snprintf(expected, sizeof(expected), "message %d", n);
+  QueuedMessage message;
+  TEST_ASSERT_TRUE(queue.peek(message));
+  TEST_ASSERT_EQUAL_STRING(TOPIC, message.topic);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)n, message.capturedMs);
+  TEST_ASSERT_EQUAL_UINT16((uint16_t)length, message.length);
+  TEST_ASSERT_EQUAL_MEMORY(expected, message.payload, (size_t)length);
+  queue.pop();
+}
+
+void setUp() {
+  queue = OfflineQueue();
+}
+
+void tearDown() {
+}
+
+void test_replays_oldest_first() {
+  for (int i = 0; i < CAPACITY; i++) {
+    TEST_ASSERT_TRUE(pushNumbered(i));
+  }
+  TEST_ASSERT_EQUAL_INT(CAPACITY, queue.size());
+  TEST_ASSERT_EQUAL_UINT32(0, queue.dropped());
+
+  for (int i = 0; i < CAPACITY; i++) {
+    popNumbered(i);
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+  TEST_ASSERT_EQUAL_UINT32(CAPACITY, queue.backfilled());
+
+  QueuedMessage message;
+  TEST_ASSERT_FALSE(queue.peek(message));
+}
+
+void test_full_queue_evicts_oldest() {
+  for (int i = 0; i < CAPACITY + 3; i++) {
+    TEST_ASSERT_TRUE(pushNumbered(i));
+  }
+  TEST_ASSERT_EQUAL_INT(CAPACITY, queue.size());
+  TEST_ASSERT_EQUAL_UINT32(3, queue.dropped());
+
+  for (int i = 3; i < CAPACITY + 3; i++) {
+    popNumbered(i);
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_full_queue_evicts_lowest_priority_first() {
+  for (int i = 0; i < CAPACITY; i++) {
+    bool presence = i == 5 || i == CAPACITY - 2;
+    TEST_ASSERT_TRUE(pushNumbered(i, presence ? PRIORITY_PRESENCE : PRIORITY_NOTES));
+  }
+  TEST_ASSERT_TRUE(pushNumbered(CAPACITY));
+  TEST_ASSERT_TRUE(pushNumbered(CAPACITY + 1));
+  TEST_ASSERT_EQUAL_UINT32(2, queue.dropped());
+
+  // The two pings went, however new; the notes replay in order around them
+  for (int i = 0; i < CAPACITY + 2; i++) {
+    if (i != 5 && i != CAPACITY - 2) {
+      popNumbered(i);
+    }
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_refuses_message_worth_less_than_everything_held() {
+  for (int i = 0; i < CAPACITY; i++) {
+    TEST_ASSERT_TRUE(pushNumbered(i));
+  }
+  TEST_ASSERT_FALSE(pushNumbered(CAPACITY, PRIORITY_PRESENCE));
+  TEST_ASSERT_EQUAL_UINT32(1, queue.dropped());
+  TEST_ASSERT_EQUAL_INT(CAPACITY, queue.size());
+  popNumbered(0);
+}
+
+void test_pushes_between_sends_keep_order() {
+  // The backlog grows by an eighth each round without ever filling up, so
+  // with flash the sends alternate between spilled and RAM messages
+  int next = 0;
+  int sent = 0;
+  for (int round = 0; round < 6; round++) {
+    for (int i = 0; i < CAPACITY / 4; i++) {
+      TEST_ASSERT_TRUE(pushNumbered(next++));
+    }
+    for (int i = 0; i < CAPACITY / 8; i++) {
+      popNumbered(sent++);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, queue.dropped());
+  while (!queue.empty()) {
+    popNumbered(sent++);
+  }
+  TEST_ASSERT_EQUAL_INT(next, sent);
+}
+
+#if OFFLINE_QUEUE_FLASH
+
+// length bytes that differ for every n, so a page written out of place or
+// read back from the wrong record shows up
+static void fillPattern(uint8_t* data, size_t length, int n) {
+  for (size_t i = 0; i < length; i++) {
+    data[i] = (uint8_t)(n * 31 + i * 7);
+  }
+}
+
+void test_overflow_spills_to_flash() {
+  for (int i = 0; i < OFFLINE_QUEUE_RAM_ENTRIES + 5; i++) {
+    TEST_ASSERT_TRUE(pushNumbered(i));
+  }
+  // The five oldest moved to flash instead of being dropped
+  TEST_ASSERT_EQUAL_UINT32(5, queue.spilled());
+  TEST_ASSERT_EQUAL_UINT32(0, queue.dropped());
+  TEST_ASSERT_EQUAL_INT(OFFLINE_QUEUE_RAM_ENTRIES + 5, queue.size());
+
+  for (int i = 0; i < OFFLINE_QUEUE_RAM_ENTRIES + 5; i++) {
+    popNumbered(i);
+  }
+  TEST_ASSERT_TRUE(queue.empty());
+}
+
+void test_large_messages_spill_by_bytes() {
+  // Five pages each, and RAM's bytes run out long before its entries
+  const size_t LENGTH = 300;
+  const int COUNT = OFFLINE_QUEUE_RAM_BYTES / LENGTH + 4;
+  uint8_t payload[LENGTH];
+  for (int i = 0; i < COUNT; i++) {
+    fillPattern(payload, LENGTH, i);
+    TEST_ASSERT_TRUE(queue.push(TOPIC, payload, LENGTH, (uint32_t)i, PRIORITY_NOTES));
+  }
+  TEST_ASSERT_EQUAL_UINT32(4, queue.spilled());
+
+  uint8_t expected[LENGTH];
+  for (int i = 0; i < COUNT; i++) {
+    QueuedMessage message;
+    TEST_ASSERT_TRUE(queue.peek(message));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)i, message.capturedMs);
+    TEST_ASSERT_EQUAL_UINT16(LENGTH, message.length);
+    fillPattern(expected, LENGTH, i);
+    TEST_ASSERT_EQUAL_MEMORY(expected, message.payload, LENGTH);
+    queue.pop();
+  }
+}
+
+void test_spill_ring_wraps_in_order() {
+  // A long outage and a slow backfill: the spill ring goes round several
+  // times, with records skipping the pages left at its end
+  const size_t LENGTH = 200;  // Four pages, so records don't line up with rows
+  uint8_t payload[LENGTH];
+  uint8_t expected[LENGTH];
+  int sent = 0;
+  for (int i = 0; i < 600; i++) {
+    fillPattern(payload, LENGTH, i);
+    TEST_ASSERT_TRUE(queue.push(TOPIC, payload, LENGTH, (uint32_t)i, PRIORITY_NOTES));
+    if (queue.size() > 20) {
+      QueuedMessage message;
+      TEST_ASSERT_TRUE(queue.peek(message));
+      TEST_ASSERT_EQUAL_UINT32((uint32_t)sent, message.capturedMs);
+      fillPattern(expected, LENGTH, sent);
+      TEST_ASSERT_EQUAL_MEMORY(expected, message.payload, LENGTH);
+      queue.pop();
+      sent++;
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, queue.dropped());
+  TEST_ASSERT_GREATER_THAN_UINT32(FlashSpill::PAGES * 2, queue.spilled() * FlashSpill::pagesFor(LENGTH));
+}
+
+#endif
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_replays_oldest_first);
+  RUN_TEST(test_full_queue_evicts_oldest);
+  RUN_TEST(test_full_queue_evicts_lowest_priority_first);
+  RUN_TEST(test_refuses_message_worth_less_than_everything_held);
+  RUN_TEST(test_pushes_between_sends_keep_order);
+#if OFFLINE_QUEUE_FLASH
+  RUN_TEST(test_overflow_spills_to_flash);
+  RUN_TEST(test_large_messages_spill_by_bytes);
+  RUN_TEST(test_spill_ring_wraps_in_order);
+#endif
+  return UNITY_END();
+}
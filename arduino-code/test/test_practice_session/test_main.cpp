@@ -0,0 +1,246 @@
+// PracticeSession and QuantileSketch against scripted visits whose answers
+// are known. Each visit drives a PracticeSession at the firmware's 10 ms
+// sense tick with presence, playing and volume from a script, adds the
+// notes the script plays, and checks the summary against what the script
+// implies: one visit, a short absence that stays one session, two visits
+// the second of which starts clean, and the sketch's percentiles against
+// the exact sorted values, past the point where its counts are halved.
+//
+//   pio test -e native -f test_practice_session
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <unity.h>
+#include "PianoHal.h"
+#include "PracticeSession.h"
+
+static const uint32_t TICK_MS = 10;
+static const uint32_t END_TIMEOUT_MS = 20000;
+
+// Whole seconds of ms, the way the summary rounds them
+static uint32_t seconds(uint32_t ms) {
+  return (ms + 500) / 1000;
+}
+
+// Drives one session at the sense tick, counting what update() reports
+struct Visit {
+  PracticeSession session;
+  uint32_t now;
+  int started;
+  int ended;
+  int midi;
+
+  Visit() : now(1000), started(0), ended(0), midi(60) {
+    session.begin(END_TIMEOUT_MS);
+  }
+
+  void run(uint32_t durationMs, bool present, bool playing, int volume, uint32_t noteEveryMs = 0) {
+    for (uint32_t t = 0; t < durationMs; t += TICK_MS) {
+      SessionEvent event = session.update(present, playing, volume, now);
+      if (event == SESSION_STARTED) {
+        started++;
+      } else if (event == SESSION_ENDED) {
+        ended++;
+      }
+      if (noteEveryMs > 0 && t % noteEveryMs == 0) {
+        session.addNote((uint8_t)midi);
+        // C major scale up from middle C, then back down an octave lower
+        midi = midi == 72 ? 48 : midi + 1;
+      }
+      now += TICK_MS;
+    }
+  }
+};
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_single_visit() {
+  Visit visit;
+  visit.run(5000, false, false, 0);
+  uint32_t arrived = visit.now;
+  visit.run(10000, true, false, 20);
+  visit.run(30000, true, true, 200, 500);
+  visit.run(5000, true, false, 20);
+  uint32_t left = visit.now;
+  visit.run(END_TIMEOUT_MS + 1000, false, false, 0);
+
+  const PracticeSession& s = visit.session;
+  TEST_ASSERT_EQUAL_INT(1, visit.started);
+  TEST_ASSERT_EQUAL_INT(1, visit.ended);
+  TEST_ASSERT_EQUAL_UINT32(arrived, s.startMs());
+  TEST_ASSERT_EQUAL_UINT32(left - TICK_MS, s.endMs());  // The last tick with somebody there
+  TEST_ASSERT_EQUAL_UINT32(30, seconds(s.playingMs()));
+  TEST_ASSERT_EQUAL_UINT32(15, seconds(s.idleMs()));
+  TEST_ASSERT_EQUAL_UINT32(0, seconds(s.awayMs()));
+  TEST_ASSERT_EQUAL_UINT32(60, s.notes());
+  TEST_ASSERT_EQUAL_UINT32(1200, s.notesPerMinuteX10());
+
+  // 60 notes stepping 60..72 then 48..72: count them the same way
+  uint32_t pitchClasses[12] = {0};
+  uint32_t octaves[SESSION_OCTAVES] = {0};
+  int midi = 60;
+  for (int n = 0; n < 60; n++) {
+    pitchClasses[midi % 12]++;
+    octaves[midi / 12 - 1]++;
+    midi = midi == 72 ? 48 : midi + 1;
+  }
+  TEST_ASSERT_EQUAL_MEMORY(pitchClasses, s.pitchClassCounts(), sizeof(pitchClasses));
+  TEST_ASSERT_EQUAL_MEMORY(octaves, s.octaveCounts(), sizeof(octaves));
+
+  // Every playing tick went into the volume sketch, nothing else did
+  TEST_ASSERT_EQUAL_UINT32(3000, s.volume().count());
+  TEST_ASSERT_EQUAL_UINT16(200, s.volume().quantile(500));
+}
+
+void test_short_absence_is_one_session() {
+  Visit visit;
+  visit.run(20000, true, true, 150, 1000);
+  visit.run(5000, false, false, 0);
+  visit.run(20000, true, true, 150, 1000);
+  visit.run(END_TIMEOUT_MS + 1000, false, false, 0);
+
+  const PracticeSession& s = visit.session;
+  TEST_ASSERT_EQUAL_INT(1, visit.started);
+  TEST_ASSERT_EQUAL_INT(1, visit.ended);
+  TEST_ASSERT_EQUAL_UINT32(45, seconds(s.durationMs()));
+  TEST_ASSERT_EQUAL_UINT32(40, seconds(s.playingMs()));
+  TEST_ASSERT_EQUAL_UINT32(5, seconds(s.awayMs()));
+  TEST_ASSERT_EQUAL_UINT32(40, s.notes());
+  TEST_ASSERT_EQUAL_UINT32(600, s.notesPerMinuteX10());
+}
+
+void test_second_visit_starts_clean() {
+  Visit visit;
+  visit.run(30000, true, true, 300, 250);
+  visit.run(END_TIMEOUT_MS + 5000, false, false, 0);
+  TEST_ASSERT_EQUAL_INT(1, visit.ended);
+  TEST_ASSERT_EQUAL_UINT32(120, visit.session.notes());
+
+  // Notes heard with no session open (the summary is out) are not counted
+  visit.session.addNote(60);
+  TEST_ASSERT_EQUAL_UINT32(120, visit.session.notes());
+
+  uint32_t arrived = visit.now;
+  visit.run(10000, true, false, 10);
+  visit.run(END_TIMEOUT_MS + 1000, false, false, 0);
+
+  const PracticeSession& s = visit.session;
+  TEST_ASSERT_EQUAL_INT(2, visit.started);
+  TEST_ASSERT_EQUAL_INT(2, visit.ended);
+  TEST_ASSERT_EQUAL_UINT32(arrived, s.startMs());
+  TEST_ASSERT_EQUAL_UINT32(0, seconds(s.playingMs()));
+  TEST_ASSERT_EQUAL_UINT32(10, seconds(s.idleMs()));
+  TEST_ASSERT_EQUAL_UINT32(0, s.notes());
+  TEST_ASSERT_EQUAL_UINT32(0, s.notesPerMinuteX10());
+  TEST_ASSERT_EQUAL_UINT32(0, s.volume().count());
+}
+
+// Within 1/8 of the exact value (or 1 for the small exact buckets)
+static void assertQuantiles(std::vector<uint16_t> values) {
+  QuantileSketch sketch;
+  for (size_t i = 0; i < values.size(); i++) {
+    sketch.add(values[i]);
+  }
+  std::sort(values.begin(), values.end());
+  static const int PERMILLE[] = {0, 100, 250, 500, 750, 900, 990, 1000};
+  for (size_t q = 0; q < sizeof(PERMILLE) / sizeof(PERMILLE[0]); q++) {
+    size_t rank = (values.size() * PERMILLE[q] + 999) / 1000;
+    int want = values[rank > 0 ? rank - 1 : 0];
+    int tolerance = want / 8 > 1 ? want / 8 : 1;
+    char message[24];
+    snprintf(message, sizeof(message), "p%d", PERMILLE[q] / 10);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(tolerance, want, sketch.quantile(PERMILLE[q]), message);
+  }
+  TEST_ASSERT_EQUAL_UINT32(values.size(), sketch.count());
+}
+
+void test_sketch_mic_levels() {
+  // Quiet floor with loud notes, as the mic levels come
+  srand(12345);
+  std::vector<uint16_t> values;
+  for (int i = 0; i < 20000; i++) {
+    values.push_back((uint16_t)(rand() % 100 < 70 ? 40 + rand() % 40 : 150 + rand() % 350));
+  }
+  assertQuantiles(values);
+}
+
+void test_sketch_full_range() {
+  std::vector<uint16_t> values;
+  for (uint32_t v = 0; v <= UINT16_MAX; v += 7) {
+    values.push_back((uint16_t)v);
+  }
+  assertQuantiles(values);
+}
+
+void test_sketch_keeps_proportions_when_halved() {
+  // 200000 samples of two values: the busy bucket overflows and all are
+  // halved several times, the proportions stay
+  std::vector<uint16_t> values;
+  for (int i = 0; i < 200000; i++) {
+    values.push_back(i % 4 == 0 ? 900 : 100);
+  }
+  assertQuantiles(values);
+
+  QuantileSketch empty;
+  TEST_ASSERT_EQUAL_UINT16(0, empty.quantile(500));
+}
+
+void test_summary_json_fits() {
+  Visit visit;
+  visit.now = UINT32_MAX - 200000;
+  visit.run(100000, true, true, UINT16_MAX, 10);
+  char buffer[SESSION_JSON_MAX];
+  size_t length = writeSessionJson(buffer, sizeof(buffer), visit.session, UINT32_MAX);
+  TEST_ASSERT_GREATER_THAN(0, length);
+  TEST_ASSERT_EQUAL_INT('}', buffer[length - 1]);
+
+  // A buffer that's too small gives 0, not half a message
+  TEST_ASSERT_EQUAL_UINT32(0, writeSessionJson(buffer, 40, visit.session, UINT32_MAX));
+}
+
+void test_widest_summary_fits_one_publish() {
+  // The empty summary has every number at one digit - nine more each is
+  // the widest a summary can get
+  PracticeSession empty;
+  empty.begin(END_TIMEOUT_MS);
+  char buffer[SESSION_JSON_MAX];
+  size_t length = writeSessionJson(buffer, sizeof(buffer), empty, 0);
+  TEST_ASSERT_GREATER_THAN(0, length);
+  int numbers = 0;
+  for (size_t i = 1; i < length; i++) {
+    // A digit straight after ':', ',', '[' or '.' starts a value ("p10" is a key)
+    numbers += isdigit((unsigned char)buffer[i]) && strchr(":,[.", buffer[i - 1]) != nullptr;
+  }
+  TEST_ASSERT_EQUAL_INT(SESSION_JSON_NUMBERS, numbers);
+
+  size_t widest = length + (size_t)numbers * 9;
+  char message[64];
+  snprintf(message, sizeof(message), "widest summary %u bytes", (unsigned)widest);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN(SESSION_JSON_MAX, widest);  // And the terminator
+  TEST_ASSERT_GREATER_THAN(256, widest);  // More than the MQTT client buffers
+  TEST_ASSERT_LESS_OR_EQUAL(PUBLISH_MAX_PAYLOAD, SESSION_JSON_MAX);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_single_visit);
+  RUN_TEST(test_short_absence_is_one_session);
+  RUN_TEST(test_second_visit_starts_clean);
+  RUN_TEST(test_sketch_mic_levels);
+  RUN_TEST(test_sketch_full_range);
+  RUN_TEST(test_sketch_keeps_proportions_when_halved);
+  RUN_TEST(test_summary_json_fits);
+  RUN_TEST(test_widest_summary_fits_one_publish);
+  return UNITY_END();
+}
@@ -0,0 +1,447 @@
+// PublishRing and PublishPipeline against a fake transport that injects
+// slow writes. The transport stands in for MQTT over WiFiNINA: each write
+// costs a fixed command overhead plus SPI time per byte on a fake clock,
+// every so often one stalls (the radio's socket buffer is full), and the
+// link can go down. Frames that would run past the end of the ring start
+// over at the front, behind a wrap marker or a tail too short for one; a
+// drain stops at its time slice or byte budget but always sends one
+// message; a full ring refuses and counts; a failed send still reaches the
+// hook. Last, the firmware's traffic published inline from the sense task
+// against the same traffic through the pipeline.
+//
+//   pio test -e native -f test_publish_pipeline
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <unity.h>
+#include "PublishPipeline.h"
+
+static const char TOPIC[] = "conndev/piano";
+
+class FakeClock : public Clock {
+public:
+  uint32_t millis() override { return (uint32_t)(nowUs / 1000); }
+  uint32_t micros() override { return (uint32_t)nowUs; }
+  void advance(uint64_t us) { nowUs += us; }
+
+  uint64_t nowUs = 0;
+};
+
+// A write takes overheadUs plus perByteUs for each byte, and every
+// stallEvery-th one stallUs on top
+class SlowPublisher : public Publisher {
+public:
+  struct Message {
+    const char* topic;
+    std::vector<uint8_t> payload;
+  };
+
+  SlowPublisher(FakeClock& clock) : clock(clock) {}
+
+  void reset() {
+    up = true;
+    keep = true;
+    overheadUs = perByteUs = stallEvery = stallUs = writes = 0;
+    longestWrite = 0;
+    log.clear();
+  }
+
+  bool connected() override { return up; }
+
+  bool publish(const char* topic, const uint8_t* payload, size_t length) override {
+    if (!up) {
+      return false;
+    }
+    writes++;
+    uint64_t cost = overheadUs + perByteUs * length;
+    if (stallEvery > 0 && writes % stallEvery == 0) {
+      cost += stallUs;
+    }
+    clock.advance(cost);
+    if (cost > longestWrite) {
+      longestWrite = cost;
+    }
+    if (keep) {
+      log.push_back({topic, std::vector<uint8_t>(payload, payload + length)});
+    }
+    return true;
+  }
+
+  FakeClock& clock;
+  bool up = true;
+  bool keep = true;
+  uint32_t overheadUs = 0;
+  uint32_t perByteUs = 0;
+  uint32_t stallEvery = 0;
+  uint32_t stallUs = 0;
+  uint32_t writes = 0;
+  uint64_t longestWrite = 0;
+  std::vector<Message> log;
+};
+
+static FakeClock fakeClock;
+static SlowPublisher transport(fakeClock);
+static PublishPipeline pipeline;
+static PublishRing ring;
+
+// Payload i: its sequence number up front, then a pattern from it, so a
+// message that is cut, shifted or swapped shows
+static size_t makePayload(uint8_t* payload, uint32_t sequence, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    payload[i] = (uint8_t)(sequence * 31 + i * 7);
+  }
+  if (length >= 4) {
+    memcpy(payload, &sequence, 4);
+  }
+  return length;
+}
+
+static void assertPayload(const uint8_t* payload, size_t length, uint32_t sequence, size_t wantLength) {
+  uint8_t want[PUBLISH_RING_BYTES];
+  char message[32];
+  snprintf(message, sizeof(message), "message %lu", (unsigned long)sequence);
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(wantLength, length, message);
+  if (length > 0) {
+    makePayload(want, sequence, wantLength);
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(want, payload, length, message);
+  }
+}
+
+// The ring's front must be message sequence - then it is released
+static void popRing(uint32_t sequence, size_t length) {
+  PublishFrame frame;
+  TEST_ASSERT_TRUE(ring.peek(frame));
+  TEST_ASSERT_EQUAL_UINT32(sequence, frame.capturedMs);
+  assertPayload(frame.payload, frame.length, sequence, length);
+  ring.pop();
+}
+
+static std::vector<uint32_t> hookSequences;
+static int hookSent;
+
+static void recordSend(const PublishFrame& frame, bool sent, uint32_t writeUs) {
+  (void)writeUs;
+  uint32_t sequence;
+  memcpy(&sequence, frame.payload, 4);
+  hookSequences.push_back(sequence);
+  hookSent += sent ? 1 : 0;
+}
+
+void setUp() {
+  fakeClock.nowUs = 0;
+  transport.reset();
+  pipeline = PublishPipeline();
+  ring = PublishRing();
+  hookSequences.clear();
+  hookSent = 0;
+}
+
+void tearDown() {
+}
+
+void test_wrap_marker_skips_to_front() {
+  // Three frames of a bit over a third of the ring: the third doesn't fit
+  // before the end, so it starts over at the front behind a marker
+  const size_t LENGTH = PUBLISH_RING_BYTES / 3 + 16;
+  uint8_t payload[LENGTH];
+  TEST_ASSERT_TRUE(ring.push(TOPIC, payload, makePayload(payload, 0, LENGTH), 0, 0, 0));
+  TEST_ASSERT_TRUE(ring.push(TOPIC, payload, makePayload(payload, 1, LENGTH), 1, 0, 0));
+  size_t frame = ring.used() / 2;
+  popRing(0, LENGTH);
+
+  TEST_ASSERT_TRUE(ring.push(TOPIC, payload, makePayload(payload, 2, LENGTH), 2, 0, 0));
+  // The skipped tail counts as used until the frame behind the marker goes
+  TEST_ASSERT_EQUAL_UINT32(PUBLISH_RING_BYTES, ring.used());
+  TEST_ASSERT_EQUAL_INT(2, ring.depth());
+  TEST_ASSERT_FALSE(ring.push(TOPIC, payload, 0, 3, 0, 0));
+
+  popRing(1, LENGTH);
+  TEST_ASSERT_EQUAL_UINT32(PUBLISH_RING_BYTES - frame, ring.used());
+  popRing(2, LENGTH);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.used());
+  TEST_ASSERT_EQUAL_INT(0, ring.depth());
+}
+
+void test_tail_too_short_for_marker_is_skipped() {
+  // The frame granularity, from what an empty and a one-byte frame take
+  uint8_t payload[PUBLISH_RING_BYTES] = {0};
+  ring.push(TOPIC, payload, 0, 0, 0, 0);
+  size_t header = ring.used();
+  ring.pop();
+  ring.push(TOPIC, payload, 1, 0, 0, 0);
+  size_t step = ring.used() - header;
+  ring.pop();
+  TEST_ASSERT_LESS_THAN_UINT32(header, step);
+
+  // Walk the head round to one step short of the end: there's no room for
+  // a marker there, and the consumer has to skip it by itself
+  ring = PublishRing();
+  size_t first = PublishRing::maxPayload();
+  size_t second = PublishRing::maxPayload() - step;
+  TEST_ASSERT_TRUE(ring.push(TOPIC, payload, makePayload(payload, 0, first), 0, 0, 0));
+  popRing(0, first);
+  TEST_ASSERT_TRUE(ring.push(TOPIC, payload, makePayload(payload, 1, second), 1, 0, 0));
+  popRing(1, second);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.used());
+
+  TEST_ASSERT_TRUE(ring.push(TOPIC, payload, makePayload(payload, 2, 10), 2, 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(step + header + step * ((10 + step - 1) / step), ring.used());
+  popRing(2, 10);
+  TEST_ASSERT_EQUAL_UINT32(0, ring.used());
+  TEST_ASSERT_EQUAL_INT(0, ring.depth());
+}
+
+void test_messages_stay_in_order_across_wraps() {
+  pipeline.begin(transport, fakeClock, 1000000, 100000);
+  srand(4321);
+  std::vector<size_t> lengths;
+  uint8_t payload[PUBLISH_RING_BYTES];
+  uint32_t refused = 0;
+  while (lengths.size() < 20000) {
+    int burst = 1 + rand() % 6;
+    for (int i = 0; i < burst; i++) {
+      size_t length = rand() % 3 == 0 ? rand() % (PublishPipeline::maxPayload() + 1) : rand() % 64;
+      makePayload(payload, (uint32_t)lengths.size(), length);
+      if (pipeline.enqueue(TOPIC, payload, length, 0, 0)) {
+        lengths.push_back(length);
+      } else {
+        refused++;
+      }
+    }
+    if (rand() % 3 == 0) {
+      pipeline.drain();
+    }
+  }
+  while (!pipeline.empty()) {
+    pipeline.drain();
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(lengths.size(), transport.log.size());
+  for (size_t i = 0; i < lengths.size(); i++) {
+    TEST_ASSERT_EQUAL_PTR(TOPIC, transport.log[i].topic);
+    assertPayload(transport.log[i].payload.data(), transport.log[i].payload.size(), (uint32_t)i, lengths[i]);
+  }
+  TEST_ASSERT_GREATER_THAN_UINT32(0, refused);  // The ring did fill up now and then
+  TEST_ASSERT_EQUAL_UINT32(refused, pipeline.full());
+  TEST_ASSERT_EQUAL_UINT32(0, pipeline.used());
+  TEST_ASSERT_EQUAL_INT(0, pipeline.depth());
+}
+
+void test_full_ring_refuses_then_takes_again() {
+  pipeline.begin(transport, fakeClock, 1000000, 100000);
+  uint8_t payload[100];
+  int accepted = 0;
+  while (pipeline.enqueue(TOPIC, payload, sizeof(payload), 0, 0)) {
+    accepted++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, pipeline.full());
+  TEST_ASSERT_EQUAL_INT(accepted, pipeline.maxDepth());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(PUBLISH_RING_BYTES, pipeline.maxUsed());
+
+  pipeline.drain();
+  TEST_ASSERT_TRUE(pipeline.enqueue(TOPIC, payload, sizeof(payload), 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(1, pipeline.full());
+}
+
+void test_drain_stops_at_time_slice() {
+  transport.overheadUs = 3000;
+  pipeline.begin(transport, fakeClock, 4000, 100000);
+  uint8_t payload[32];
+  for (int i = 0; i < 10; i++) {
+    pipeline.enqueue(TOPIC, payload, makePayload(payload, i, sizeof(payload)), 0, 0);
+  }
+  // 0 and 3 ms into the slice a write may start, at 6 ms it is over
+  TEST_ASSERT_EQUAL_INT(2, pipeline.drain());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(4000 + transport.longestWrite, pipeline.longestSliceUs());
+  int drains = 1;
+  while (!pipeline.empty()) {
+    pipeline.drain();
+    drains++;
+  }
+  TEST_ASSERT_EQUAL_INT(5, drains);
+  TEST_ASSERT_EQUAL_UINT32(4, pipeline.deferred());
+
+  // One write that stalls for 80 ms: the drain ends right after it
+  transport.overheadUs = 500;
+  transport.stallEvery = transport.writes + 1;
+  transport.stallUs = 80000;
+  for (int i = 0; i < 4; i++) {
+    pipeline.enqueue(TOPIC, payload, sizeof(payload), 0, 0);
+  }
+  TEST_ASSERT_EQUAL_INT(1, pipeline.drain());
+  TEST_ASSERT_EQUAL_INT(3, pipeline.depth());
+}
+
+void test_drain_stops_at_byte_budget() {
+  pipeline.begin(transport, fakeClock, 1000000, 1024);
+  uint8_t payload[900] = {0};
+  for (int i = 0; i < 6; i++) {
+    TEST_ASSERT_TRUE(pipeline.enqueue(TOPIC, payload, 300, 0, 0));
+  }
+  TEST_ASSERT_EQUAL_INT(3, pipeline.drain());
+  TEST_ASSERT_EQUAL_UINT32(1, pipeline.deferred());
+  while (!pipeline.empty()) {
+    pipeline.drain();
+  }
+
+  // The first message goes even when it alone is over the budget
+  pipeline.begin(transport, fakeClock, 1000000, 512);
+  TEST_ASSERT_TRUE(pipeline.enqueue(TOPIC, payload, 900, 0, 0));
+  TEST_ASSERT_TRUE(pipeline.enqueue(TOPIC, payload, 10, 0, 0));
+  TEST_ASSERT_EQUAL_INT(1, pipeline.drain());
+  TEST_ASSERT_EQUAL_INT(1, pipeline.drain());
+  TEST_ASSERT_EQUAL_UINT32(6 * 300 + 900 + 10, pipeline.sentBytes());
+}
+
+void test_longer_than_max_payload_refused() {
+  pipeline.begin(transport, fakeClock, 1000000, 100000);
+  uint8_t payload[PUBLISH_RING_BYTES] = {0};
+  TEST_ASSERT_TRUE(pipeline.enqueue(TOPIC, payload, PublishPipeline::maxPayload(), 0, 0));
+  TEST_ASSERT_FALSE(pipeline.enqueue(TOPIC, payload, PublishPipeline::maxPayload() + 1, 0, 0));
+  // Too long isn't full: waiting wouldn't help
+  TEST_ASSERT_EQUAL_UINT32(0, pipeline.full());
+  TEST_ASSERT_EQUAL_INT(1, pipeline.depth());
+}
+
+void test_failed_sends_reach_hook_oldest_first() {
+  pipeline.begin(transport, fakeClock, 1000000, 100000);
+  pipeline.onSend(recordSend);
+  uint8_t payload[40];
+  for (uint32_t i = 0; i < 6; i++) {
+    pipeline.enqueue(TOPIC, payload, makePayload(payload, i, sizeof(payload)), 1000 + i, 1);
+  }
+  transport.up = false;
+  TEST_ASSERT_EQUAL_INT(6, pipeline.drain());
+
+  TEST_ASSERT_EQUAL_UINT32(6, hookSequences.size());
+  for (uint32_t i = 0; i < 6; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i, hookSequences[i]);
+  }
+  TEST_ASSERT_EQUAL_INT(0, hookSent);
+  TEST_ASSERT_EQUAL_UINT32(0, pipeline.sent());
+  TEST_ASSERT_EQUAL_UINT32(6, pipeline.failed());
+  TEST_ASSERT_TRUE(pipeline.empty());
+}
+
+// The firmware's traffic: every 10 ms the sense task runs for 1 ms, a
+// reading (binary + JSON) goes out every 500 ms, a spectrum frame every
+// 100 ms, a diagnostics report every 5 s. A write costs 1.5 ms plus 8 us a
+// byte, and every 40th one stalls for 40 ms. Like the Scheduler, a sense
+// tick that is missed altogether isn't caught up.
+struct TrafficResult {
+  uint32_t made;
+  uint32_t written;
+  uint64_t senseRunMaxUs;  // Longest single sense run, writes included
+  uint64_t senseGapMaxUs;  // Longest from one sense run to the next
+  uint32_t missedTicks;
+};
+
+static TrafficResult runTraffic(bool usePipeline) {
+  setUp();
+  transport.keep = false;
+  transport.overheadUs = 1500;
+  transport.perByteUs = 8;
+  transport.stallEvery = 40;
+  transport.stallUs = 40000;
+  pipeline.begin(transport, fakeClock, 4000, 1024);
+
+  static const uint8_t binary[24] = {0};
+  static const uint8_t json[240] = {0};
+  static const uint8_t spectrum[36] = {0};
+  static const uint8_t diag[450] = {0};
+
+  TrafficResult result = {0, 0, 0, 0, 0};
+  uint64_t senseDue = 0;
+  uint64_t lastSense = 0;
+  uint64_t mqttDue = 0;
+  uint32_t tick = 0;
+  while (fakeClock.nowUs < 60ull * 1000000) {
+    if (fakeClock.nowUs >= senseDue) {
+      uint64_t started = fakeClock.nowUs;
+      if (tick > 0) {
+        result.senseGapMaxUs = std::max(result.senseGapMaxUs, started - lastSense);
+      }
+      lastSense = started;
+      fakeClock.advance(1000);
+
+      const uint8_t* out[4];
+      size_t lengths[4];
+      int count = 0;
+      if (tick % 50 == 0) {
+        out[count] = binary;
+        lengths[count++] = sizeof(binary);
+        out[count] = json;
+        lengths[count++] = sizeof(json);
+      }
+      if (tick % 10 == 5) {
+        out[count] = spectrum;
+        lengths[count++] = sizeof(spectrum);
+      }
+      if (tick % 500 == 250) {
+        out[count] = diag;
+        lengths[count++] = sizeof(diag);
+      }
+      for (int i = 0; i < count; i++) {
+        result.made++;
+        if (usePipeline) {
+          pipeline.enqueue(TOPIC, out[i], lengths[i], 0, 0);
+        } else {
+          transport.publish(TOPIC, out[i], lengths[i]);
+        }
+      }
+      result.senseRunMaxUs = std::max(result.senseRunMaxUs, fakeClock.nowUs - started);
+
+      tick++;
+      senseDue += 10000;
+      while (senseDue + 10000 <= fakeClock.nowUs) {
+        senseDue += 10000;
+        result.missedTicks++;
+      }
+    }
+    // mqttTask: every 20 ms, or right away when signalled by an enqueue
+    if (usePipeline && (fakeClock.nowUs >= mqttDue || !pipeline.empty())) {
+      pipeline.drain();
+      mqttDue = fakeClock.nowUs + 20000;
+    }
+    fakeClock.advance(100);
+  }
+  while (!pipeline.empty()) {
+    pipeline.drain();
+  }
+  result.written = transport.writes;
+  return result;
+}
+
+void test_pipeline_keeps_writes_out_of_sense_task() {
+  TrafficResult inlined = runTraffic(false);
+  TrafficResult piped = runTraffic(true);
+
+  char message[128];
+  snprintf(message, sizeof(message), "inline: sense run max %lu us, missed %lu ticks; pipeline: %lu us, missed %lu",
+           (unsigned long)inlined.senseRunMaxUs, (unsigned long)inlined.missedTicks,
+           (unsigned long)piped.senseRunMaxUs, (unsigned long)piped.missedTicks);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT32(piped.made, piped.written);
+  TEST_ASSERT_EQUAL_UINT32(1000, piped.senseRunMaxUs);  // No write inside the sense task
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(inlined.senseGapMaxUs, piped.senseGapMaxUs);
+  TEST_ASSERT_GREATER_THAN_UINT32(1000, inlined.senseRunMaxUs);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_wrap_marker_skips_to_front);
+  RUN_TEST(test_tail_too_short_for_marker_is_skipped);
+  RUN_TEST(test_messages_stay_in_order_across_wraps);
+  RUN_TEST(test_full_ring_refuses_then_takes_again);
+  RUN_TEST(test_drain_stops_at_time_slice);
+  RUN_TEST(test_drain_stops_at_byte_budget);
+  RUN_TEST(test_longer_than_max_payload_refused);
+  RUN_TEST(test_failed_sends_reach_hook_oldest_first);
+  RUN_TEST(test_pipeline_keeps_writes_out_of_sense_task);
+  return UNITY_END();
+}
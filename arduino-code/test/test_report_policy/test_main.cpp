@@ -0,0 +1,170 @@
+// ReportPolicy against the fixed timers it replaced, over a scripted
+// ten-minute visit sampled every sense tick: report-by-exception sends
+// fewer messages - at most a quarter while someone sits without playing -
+// yet every presence/playing transition goes out on the tick it happens
+// and every note played reaches a message.
+//
+//   pio test -e native -f test_report_policy
+
+#include <stdio.h>
+#include <unity.h>
+#include "NoteTimeline.h"
+#include "ReportPolicy.h"
+
+static const uint32_t TICK_MS = 10;  // SENSE_PERIOD in src/main.cpp
+static const uint32_t SESSION_MS = 600000;
+static const uint32_t FIXED_INTERVAL_MS = 2000;     // interval in src/main.cpp
+static const uint32_t FIXED_IDLE_INTERVAL_MS = 60000;  // noPresenceInterval
+static const uint32_t NOTE_GAP_MS = 400;
+
+static const int SCALE[] = {262, 294, 330, 349, 392, 440, 494, 523};
+
+static uint32_t seed;
+
+// Sensor noise, -range..range
+static int jitter(int range) {
+  seed = seed * 1664525u + 1013904223u;
+  return (int)((seed >> 8) % (uint32_t)(2 * range + 1)) - range;
+}
+
+// The visit: nobody for 90 s, sits down and plays with a pause, a
+// one-tick-short flicker out of playing and a shift on the bench, then
+// leaves for the rest of the ten minutes
+static PianoReading readingAt(uint32_t t) {
+  bool presence = t >= 90000 && t < 240000;
+  bool playing = presence && t >= 100000 && t < 220000 && !(t >= 150000 && t < 160000) &&
+                 !(t >= 180000 && t < 180500);
+  int distance = presence ? (t < 230000 ? 300 : 420) + jitter(5) : 1200 + jitter(40);
+  int volume = playing ? 300 + (int)(t % NOTE_GAP_MS) / 2 : 20 + jitter(10);
+  int frequency = playing ? SCALE[(t / NOTE_GAP_MS) % 8] : 0;
+  PianoReading reading = {distance, volume, playing, frequency, nullptr, 0, presence, playing, nullptr, 0};
+  return reading;
+}
+
+// A new note is struck on this tick
+static bool noteStruck(const PianoReading& reading, uint32_t t) {
+  return reading.playing && t % NOTE_GAP_MS == 0;
+}
+
+static NoteEvent noteEvent(const PianoReading& reading, uint32_t t) {
+  NoteEvent event = {t, "C", 4, (uint16_t)reading.frequency, (uint16_t)reading.volume};
+  return event;
+}
+
+void setUp() {
+  seed = 2024;
+}
+
+void tearDown() {
+}
+
+// The fixed timers (REPORT_BY_EXCEPTION 0): every interval while someone is
+// there (playing only with a pitch, or early for a full timeline), every
+// minute otherwise
+void test_fewer_messages_than_fixed_timers() {
+  NoteTimeline fixedTimeline(FIXED_INTERVAL_MS);
+  NoteTimeline policyTimeline(FIXED_INTERVAL_MS);
+  ReportPolicy policy;
+  ReportDeadbands deadbands = {25, 50, 29, 2000, 60000};
+  policy.begin(deadbands);
+
+  uint32_t fixedMessages = 0;
+  uint32_t policyMessages = 0;
+  uint32_t fixedQuiet = 0;   // Sent while someone sat there not playing
+  uint32_t policyQuiet = 0;
+  uint32_t lastFixedMs = 0;
+  for (uint32_t t = 0; t < SESSION_MS; t += TICK_MS) {
+    PianoReading reading = readingAt(t);
+    if (noteStruck(reading, t)) {
+      fixedTimeline.push(noteEvent(reading, t));
+      policyTimeline.push(noteEvent(reading, t));
+    }
+
+    uint32_t period = !reading.presence ? FIXED_IDLE_INTERVAL_MS : FIXED_INTERVAL_MS;
+    bool fixedDue = t - lastFixedMs > period;
+    if (reading.playing) {
+      fixedDue = reading.hasFrequency && (fixedDue || fixedTimeline.shouldFlush(t));
+    }
+    if (fixedDue) {
+      lastFixedMs = t;
+      fixedTimeline.clear(t);
+      fixedMessages++;
+      fixedQuiet += reading.presence && !reading.playing;
+    }
+
+    bool eventsDue = !policyTimeline.empty() && policyTimeline.shouldFlush(t);
+    ReportReason reason = policy.due(reading, eventsDue, t);
+    if (reason != REPORT_NONE) {
+      policy.sent(reading, reason, t);
+      policyTimeline.clear(t);
+      policyMessages++;
+      policyQuiet += reading.presence && !reading.playing;
+    }
+  }
+
+  char message[128];
+  snprintf(message, sizeof(message), "fixed timers %lu messages (%lu quiet), report by exception %lu (%lu quiet)",
+           (unsigned long)fixedMessages, (unsigned long)fixedQuiet, (unsigned long)policyMessages,
+           (unsigned long)policyQuiet);
+  TEST_MESSAGE(message);
+  // Playing costs the same either way - a batch of notes every interval -
+  // so the saving is all in the quiet stretches
+  TEST_ASSERT_LESS_THAN_UINT32(fixedMessages, policyMessages);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(fixedQuiet / 4, policyQuiet);
+}
+
+void test_every_transition_and_note_is_published() {
+  NoteTimeline timeline(FIXED_INTERVAL_MS);
+  ReportPolicy policy;
+  ReportDeadbands deadbands = {25, 50, 29, 2000, 60000};
+  policy.begin(deadbands);
+
+  bool lastPresence = false;
+  bool lastPlaying = false;
+  int transitions = 0;
+  uint32_t notesPlayed = 0;
+  uint32_t notesSent = 0;
+  for (uint32_t t = 0; t < SESSION_MS; t += TICK_MS) {
+    PianoReading reading = readingAt(t);
+    if (noteStruck(reading, t)) {
+      timeline.push(noteEvent(reading, t));
+      notesPlayed++;
+    }
+
+    bool transition = t > 0 && (reading.presence != lastPresence || reading.playing != lastPlaying);
+    lastPresence = reading.presence;
+    lastPlaying = reading.playing;
+
+    bool eventsDue = !timeline.empty() && timeline.shouldFlush(t);
+    ReportReason reason = policy.due(reading, eventsDue, t);
+    if (transition) {
+      transitions++;
+      char message[48];
+      snprintf(message, sizeof(message), "transition at %lu ms", (unsigned long)t);
+      TEST_ASSERT_EQUAL_INT_MESSAGE(REPORT_STATE, reason, message);
+    }
+    if (reason != REPORT_NONE) {
+      policy.sent(reading, reason, t);
+      notesSent += (uint32_t)timeline.size();
+      timeline.clear(t);
+    }
+  }
+
+  // Arriving, starting, the pause, the flicker, stopping and leaving
+  TEST_ASSERT_EQUAL_INT(8, transitions);
+  // The first reading is a state report too
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)transitions + 1, policy.count(REPORT_STATE));
+  TEST_ASSERT_EQUAL_UINT32(0, timeline.overwritten());
+  TEST_ASSERT_EQUAL_UINT32(notesPlayed, notesSent + (uint32_t)timeline.size());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, policy.count(REPORT_CHANGE));     // The shift on the bench
+  TEST_ASSERT_GREATER_THAN_UINT32(0, policy.count(REPORT_HEARTBEAT));  // The empty room
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_fewer_messages_than_fixed_timers);
+  RUN_TEST(test_every_transition_and_note_is_published);
+  return UNITY_END();
+}
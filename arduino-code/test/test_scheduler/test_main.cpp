@@ -0,0 +1,178 @@
+// Scheduler and Backoff against a fake clock: periodic tasks keep their
+// rate, a late start is counted as a missed deadline (and reported), missed
+// periods aren't caught up, event tasks run once per signal, and all of it
+// keeps working when millis() wraps around.
+//
+//   pio test -e native -f test_scheduler
+
+#include <unity.h>
+#include "Backoff.h"
+#include "Scheduler.h"
+
+static Scheduler* scheduler;
+static int fastRuns;
+static int slowRuns;
+static int eventRuns;
+static int hookCalls;
+static uint32_t lastLateness;
+
+static void fastTask(uint32_t nowMs) {
+  (void)nowMs;
+  fastRuns++;
+}
+
+static void slowTask(uint32_t nowMs) {
+  (void)nowMs;
+  slowRuns++;
+}
+
+static void eventTask(uint32_t nowMs) {
+  (void)nowMs;
+  eventRuns++;
+}
+
+static void onMissed(const Task& task, uint32_t latenessMs) {
+  (void)task;
+  hookCalls++;
+  lastLateness = latenessMs;
+}
+
+// Call runOnce() every stepMs from fromMs for durationMs, as loop() would
+static void runFor(uint32_t fromMs, uint32_t durationMs, uint32_t stepMs) {
+  for (uint32_t t = 0; t < durationMs; t += stepMs) {
+    scheduler->runOnce(fromMs + t);
+  }
+}
+
+void setUp() {
+  static Scheduler fresh;
+  fresh = Scheduler();
+  scheduler = &fresh;
+  scheduler->onMissedDeadline(onMissed);
+  fastRuns = 0;
+  slowRuns = 0;
+  eventRuns = 0;
+  hookCalls = 0;
+  lastLateness = 0;
+}
+
+void tearDown() {
+}
+
+void test_periodic_rate() {
+  scheduler->addPeriodic("fast", fastTask, 10, 5, 0);
+  scheduler->addPeriodic("slow", slowTask, 100, 20, 0);
+  runFor(0, 1000, 1);
+  TEST_ASSERT_EQUAL_INT(100, fastRuns);
+  TEST_ASSERT_EQUAL_INT(10, slowRuns);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->missedDeadlines());
+  TEST_ASSERT_EQUAL_UINT32(5, scheduler->idleTime(995));
+}
+
+void test_late_start_is_a_missed_deadline() {
+  int id = scheduler->addPeriodic("fast", fastTask, 10, 5, 0);
+  scheduler->runOnce(0);
+  scheduler->runOnce(15);  // 5 ms late - still within the deadline
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->missedDeadlines());
+
+  scheduler->runOnce(47);  // Due at 20, 27 ms late
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->missedDeadlines());
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->task(id).missedDeadlines);
+  TEST_ASSERT_EQUAL_UINT32(27, scheduler->task(id).maxLatenessMs);
+  TEST_ASSERT_EQUAL_INT(1, hookCalls);
+  TEST_ASSERT_EQUAL_UINT32(27, lastLateness);
+
+  // The periods that were skipped aren't run back to back
+  TEST_ASSERT_EQUAL_INT(0, scheduler->runOnce(48));
+  TEST_ASSERT_EQUAL_INT(1, scheduler->runOnce(57));
+  TEST_ASSERT_EQUAL_INT(4, fastRuns);
+}
+
+void test_event_task_runs_once_per_signal() {
+  int id = scheduler->addEvent("event", eventTask, 50);
+  runFor(0, 100, 10);
+  TEST_ASSERT_EQUAL_INT(0, eventRuns);
+
+  scheduler->signal(id, 100);
+  scheduler->signal(id, 130);  // Lateness counts from the first signal
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->idleTime(140));
+  scheduler->runOnce(160);
+  scheduler->runOnce(170);
+  TEST_ASSERT_EQUAL_INT(1, eventRuns);
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->missedDeadlines());
+  TEST_ASSERT_EQUAL_UINT32(60, lastLateness);
+}
+
+void test_disabled_time_is_not_lateness() {
+  int id = scheduler->addPeriodic("slow", slowTask, 100, 10, 0);
+  scheduler->runOnce(0);
+  scheduler->setEnabled(id, false, 50);
+  runFor(50, 1000, 10);
+  TEST_ASSERT_EQUAL_INT(1, slowRuns);
+  scheduler->setEnabled(id, true, 1050);
+  scheduler->runOnce(1050);
+  TEST_ASSERT_EQUAL_INT(2, slowRuns);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->missedDeadlines());
+}
+
+void test_millis_wraparound() {
+  const uint32_t start = UINT32_MAX - 45;  // Wraps 46 ms in
+  scheduler->addPeriodic("fast", fastTask, 10, 5, start);
+  scheduler->addPeriodic("slow", slowTask, 100, 20, start);
+  runFor(start, 1000, 1);
+  TEST_ASSERT_EQUAL_INT(100, fastRuns);
+  TEST_ASSERT_EQUAL_INT(10, slowRuns);
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler->missedDeadlines());
+
+  // Just before the wrap the next run is a few ms away, not 4 billion
+  setUp();
+  scheduler->addPeriodic("fast", fastTask, 10, 5, UINT32_MAX - 2);
+  scheduler->runOnce(UINT32_MAX - 2);
+  TEST_ASSERT_EQUAL_UINT32(8, scheduler->idleTime(UINT32_MAX));
+  TEST_ASSERT_EQUAL_INT(0, scheduler->runOnce(6));
+  TEST_ASSERT_EQUAL_INT(1, scheduler->runOnce(7));
+
+  // And lateness across the wrap is measured, not huge
+  scheduler->runOnce(40);  // Due at 17
+  TEST_ASSERT_EQUAL_UINT32(23, lastLateness);
+}
+
+void test_table_full() {
+  for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+    TEST_ASSERT_EQUAL_INT(i, scheduler->addPeriodic("task", fastTask, 10, 5, 0));
+  }
+  TEST_ASSERT_EQUAL_INT(-1, scheduler->addPeriodic("one more", fastTask, 10, 5, 0));
+  TEST_ASSERT_EQUAL_INT(-1, scheduler->addEvent("one more", eventTask, 5));
+}
+
+void test_backoff_doubles_and_resets() {
+  Backoff backoff(500, 4000);
+  TEST_ASSERT_TRUE(backoff.ready(0));
+  uint32_t now = UINT32_MAX - 1000;  // Wraps during the waits
+  uint32_t expected[] = {500, 1000, 2000, 4000, 4000};
+  for (int i = 0; i < 5; i++) {
+    backoff.failed(now);
+    TEST_ASSERT_EQUAL_UINT32(expected[i], backoff.currentDelay());
+    TEST_ASSERT_FALSE(backoff.ready(now + expected[i] - 1));
+    now += expected[i];
+    TEST_ASSERT_TRUE(backoff.ready(now));
+  }
+  backoff.succeeded();
+  TEST_ASSERT_EQUAL_UINT32(0, backoff.failures());
+  backoff.failed(now);
+  TEST_ASSERT_EQUAL_UINT32(500, backoff.currentDelay());
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_periodic_rate);
+  RUN_TEST(test_late_start_is_a_missed_deadline);
+  RUN_TEST(test_event_task_runs_once_per_signal);
+  RUN_TEST(test_disabled_time_is_not_lateness);
+  RUN_TEST(test_millis_wraparound);
+  RUN_TEST(test_table_full);
+  RUN_TEST(test_backoff_doubles_and_resets);
+  return UNITY_END();
+}
@@ -0,0 +1,223 @@
+// SpectrumEncoder and SpectrumDecoder round trip: key frames carry every
+// level exactly, a stream of delta frames keeps the decoder within the
+// deadband of the encoder's input through the sequence wrap, and a dropped
+// frame makes the decoder refuse deltas until the next key frame puts it
+// back in step.
+//
+//   pio test -e native -f test_spectrum_frame
+
+#include <string.h>
+#include <unity.h>
+#include "SpectrumFrame.h"
+
+static const int BINS = 64;
+static const uint16_t BIN_WIDTH_Q4 = 15 * 16 + 10;  // 15.625 Hz
+
+static SpectrumEncoder encoder;
+static SpectrumDecoder decoder;
+static uint8_t levels[SPECTRUM_MAX_BINS];
+static uint8_t frame[SPECTRUM_FRAME_MAX];
+static uint32_t seed;
+
+static uint32_t nextRandom() {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// The next spectrum: most bins wander by a step or two, now and then one
+// jumps (a note struck), clamped to the level range of bits
+static void wander(int bits) {
+  int top = bits == 8 ? 0xFF : 0x0F;
+  for (int i = 0; i < BINS; i++) {
+    int level = levels[i];
+    uint32_t roll = nextRandom() % 100;
+    if (roll < 5) {
+      level = (int)(nextRandom() % (top + 1));
+    } else if (roll < 60) {
+      level += (int)(nextRandom() % 5) - 2;
+    }
+    levels[i] = (uint8_t)(level < 0 ? 0 : level > top ? top : level);
+  }
+}
+
+static size_t encodeLevels() {
+  size_t length = encoder.encode(frame, sizeof(frame), levels, BINS, BIN_WIDTH_Q4);
+  TEST_ASSERT_GREATER_THAN(0, length);
+  return length;
+}
+
+// Decoded levels within tolerance of what went in
+static void assertLevelsWithin(int tolerance, const SpectrumLevels& decoded) {
+  TEST_ASSERT_EQUAL_INT(BINS, decoded.bins);
+  for (int i = 0; i < BINS; i++) {
+    TEST_ASSERT_INT_WITHIN(tolerance, levels[i], decoded.levels[i]);
+  }
+}
+
+void setUp() {
+  encoder = SpectrumEncoder();
+  decoder = SpectrumDecoder();
+  seed = 12345;
+  for (int i = 0; i < BINS; i++) {
+    levels[i] = (uint8_t)(i * 3);
+  }
+}
+
+void tearDown() {
+}
+
+void test_key_frame_round_trips() {
+  const int bitsList[] = {8, 4};
+  for (int bits : bitsList) {
+    encoder.begin(bits, 10);
+    decoder = SpectrumDecoder();
+    for (int i = 0; i < BINS; i++) {
+      levels[i] = (uint8_t)(bits == 8 ? i * 4 : i % 16);
+    }
+    size_t length = encodeLevels();
+    TEST_ASSERT_EQUAL_UINT32(SPECTRUM_HEADER_SIZE + (bits == 8 ? BINS : BINS / 2), length);
+
+    SpectrumLevels decoded;
+    TEST_ASSERT_TRUE(decoder.decode(frame, length, decoded));
+    TEST_ASSERT_TRUE(decoded.key);
+    TEST_ASSERT_EQUAL_INT(bits, decoded.bits);
+    TEST_ASSERT_EQUAL_UINT8(0, decoded.sequence);
+    TEST_ASSERT_EQUAL_UINT16(BIN_WIDTH_Q4, decoded.binWidthQ4);
+    assertLevelsWithin(0, decoded);
+  }
+}
+
+void test_unchanged_spectrum_sends_only_the_mask() {
+  encoder.begin(8, 10);
+  SpectrumLevels decoded;
+  TEST_ASSERT_TRUE(decoder.decode(frame, encodeLevels(), decoded));
+
+  levels[7] += 1;  // Inside the deadband
+  size_t length = encodeLevels();
+  TEST_ASSERT_EQUAL_UINT32(SPECTRUM_HEADER_SIZE + BINS / 8, length);
+  TEST_ASSERT_TRUE(decoder.decode(frame, length, decoded));
+  TEST_ASSERT_FALSE(decoded.key);
+  assertLevelsWithin(1, decoded);
+}
+
+void test_delta_stream_tracks_levels() {
+  // 8-bit deltas may lag by the one-step deadband, 4-bit ones are exact
+  const int bitsList[] = {8, 4};
+  for (int bits : bitsList) {
+    encoder.begin(bits, 10);
+    decoder = SpectrumDecoder();
+    int deltaFrames = 0;
+    for (int n = 0; n < 300; n++) {
+      wander(bits);
+      size_t length = encodeLevels();
+      SpectrumLevels decoded;
+      TEST_ASSERT_TRUE(decoder.decode(frame, length, decoded));
+      TEST_ASSERT_EQUAL_UINT8((uint8_t)n, decoded.sequence);
+      assertLevelsWithin(bits == 8 ? 1 : 0, decoded);
+      if (!decoded.key) {
+        deltaFrames++;
+      }
+    }
+    TEST_ASSERT_GREATER_THAN(100, deltaFrames);
+  }
+}
+
+void test_sequence_wraps_without_a_gap() {
+  // No key frames on schedule, so deltas run across 255 -> 0
+  encoder.begin(8, 1000);
+  SpectrumLevels decoded;
+  for (int n = 0; n < 600; n++) {
+    levels[n % BINS] = (uint8_t)(levels[n % BINS] + 2);
+    TEST_ASSERT_TRUE(decoder.decode(frame, encodeLevels(), decoded));
+    TEST_ASSERT_EQUAL(n == 0, decoded.key);
+  }
+  assertLevelsWithin(1, decoded);
+}
+
+void test_dropped_frame_rejects_deltas_until_key() {
+  encoder.begin(8, 10);
+  SpectrumLevels decoded;
+  TEST_ASSERT_TRUE(decoder.decode(frame, encodeLevels(), decoded));  // Key, sequence 0
+  levels[3] += 5;
+  encodeLevels();  // Sequence 1 never arrives
+
+  // Every delta until the next key frame is refused - they'd apply on top
+  // of levels the decoder doesn't have
+  for (int n = 2; n < 10; n++) {
+    levels[n] += 5;
+    size_t length = encodeLevels();
+    TEST_ASSERT_EQUAL_UINT8(0, frame[1] & SPECTRUM_FLAG_KEY);
+    TEST_ASSERT_FALSE(decoder.decode(frame, length, decoded));
+  }
+
+  levels[20] += 5;
+  size_t length = encodeLevels();  // Sequence 10, the scheduled key frame
+  TEST_ASSERT_TRUE(decoder.decode(frame, length, decoded));
+  TEST_ASSERT_TRUE(decoded.key);
+  TEST_ASSERT_EQUAL_UINT8(10, decoded.sequence);
+  assertLevelsWithin(0, decoded);
+
+  levels[21] += 5;
+  TEST_ASSERT_TRUE(decoder.decode(frame, encodeLevels(), decoded));
+  TEST_ASSERT_FALSE(decoded.key);
+  assertLevelsWithin(1, decoded);
+}
+
+void test_restart_sends_a_key_frame() {
+  encoder.begin(8, 10);
+  encodeLevels();
+  encodeLevels();
+  TEST_ASSERT_EQUAL_UINT8(0, frame[1] & SPECTRUM_FLAG_KEY);
+  encoder.restart();
+  encodeLevels();
+  TEST_ASSERT_EQUAL_UINT8(SPECTRUM_FLAG_KEY, frame[1] & SPECTRUM_FLAG_KEY);
+}
+
+void test_bad_frames_are_rejected() {
+  encoder.begin(8, 10);
+  size_t length = encodeLevels();
+  SpectrumLevels decoded;
+
+  TEST_ASSERT_FALSE(decoder.decode(frame, length - 1, decoded));  // Short key frame
+  frame[0] = SPECTRUM_FRAME_VERSION + 1;
+  TEST_ASSERT_FALSE(decoder.decode(frame, length, decoded));
+  frame[0] = SPECTRUM_FRAME_VERSION;
+  frame[3] = SPECTRUM_MAX_BINS + 1;
+  TEST_ASSERT_FALSE(decoder.decode(frame, length, decoded));
+  frame[3] = BINS;
+  TEST_ASSERT_TRUE(decoder.decode(frame, length, decoded));
+
+  levels[0] += 9;
+  length = encodeLevels();
+  TEST_ASSERT_FALSE(decoder.decode(frame, length - 1, decoded));  // Short delta frame
+  TEST_ASSERT_FALSE(decoder.decode(frame, SPECTRUM_HEADER_SIZE - 1, decoded));
+
+  TEST_ASSERT_EQUAL_UINT32(0, encoder.encode(frame, SPECTRUM_HEADER_SIZE, levels, BINS, BIN_WIDTH_Q4));
+}
+
+void test_levels_are_log2_steps() {
+  TEST_ASSERT_EQUAL_UINT8(0, spectrumLevel(0, 8));
+  for (int octave = 1; octave < 32; octave++) {
+    uint64_t magnitude = ((uint64_t)1 << octave) - 1;
+    TEST_ASSERT_EQUAL_UINT8(octave * 8, spectrumLevel(magnitude, 8));
+    TEST_ASSERT_EQUAL_UINT8(octave > 15 ? 15 : octave, spectrumLevel(magnitude, 4));
+  }
+  TEST_ASSERT_EQUAL_UINT8(0xFF, spectrumLevel((uint64_t)1 << 40, 8));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 60.206f, spectrumLevelDb(80, 8));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 60.206f, spectrumLevelDb(10, 4));
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_key_frame_round_trips);
+  RUN_TEST(test_unchanged_spectrum_sends_only_the_mask);
+  RUN_TEST(test_delta_stream_tracks_levels);
+  RUN_TEST(test_sequence_wraps_without_a_gap);
+  RUN_TEST(test_dropped_frame_rejects_deltas_until_key);
+  RUN_TEST(test_restart_sends_a_key_frame);
+  RUN_TEST(test_bad_frames_are_rejected);
+  RUN_TEST(test_levels_are_log2_steps);
+  return UNITY_END();
+}
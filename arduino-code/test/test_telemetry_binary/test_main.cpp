@@ -0,0 +1,133 @@
+// encodeReadingBinary() and decodeReadingBinary() round trip: every field
+// the 9-byte frame carries comes back as it went in, out-of-range values are
+// clamped, and frames the decoder can't trust are rejected. Also checks
+// the frame is at least 90% smaller than the JSON it replaces.
+//
+//   pio test -e native -f test_telemetry_binary
+
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "NoteMapper.h"
+#include "TelemetryBinary.h"
+#include "TelemetryJson.h"
+
+static PianoReading roundTrip(const PianoReading& reading) {
+  uint8_t frame[TELEMETRY_BINARY_SIZE];
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_BINARY_SIZE, encodeReadingBinary(frame, sizeof(frame), reading));
+  PianoReading decoded;
+  memset(&decoded, 0, sizeof(decoded));
+  TEST_ASSERT_TRUE(decodeReadingBinary(frame, sizeof(frame), decoded));
+  return decoded;
+}
+
+static void assertSameReading(const PianoReading& expected, const PianoReading& actual) {
+  TEST_ASSERT_EQUAL_INT(expected.distance, actual.distance);
+  TEST_ASSERT_EQUAL_INT(expected.volume, actual.volume);
+  TEST_ASSERT_EQUAL(expected.hasFrequency, actual.hasFrequency);
+  if (expected.hasFrequency) {
+    TEST_ASSERT_EQUAL_INT(expected.frequency, actual.frequency);
+  }
+  if (expected.note == nullptr) {
+    TEST_ASSERT_NULL(actual.note);
+  } else {
+    TEST_ASSERT_EQUAL_STRING(expected.note, actual.note);
+    TEST_ASSERT_EQUAL_INT(expected.octave, actual.octave);
+  }
+  TEST_ASSERT_EQUAL(expected.presence, actual.presence);
+  TEST_ASSERT_EQUAL(expected.playing, actual.playing);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_every_note_round_trips() {
+  for (int octave = 0; octave <= 8; octave++) {
+    for (int pitch = 0; pitch < 12; pitch++) {
+      PianoReading reading = {120, 231, true, 440, noteNames[pitch], octave, true, true, nullptr, 0};
+      assertSameReading(reading, roundTrip(reading));
+    }
+  }
+}
+
+void test_idle_and_absent_round_trip() {
+  PianoReading absent = {1200, 51, false, 0, nullptr, 0, false, false, nullptr, 0};
+  assertSameReading(absent, roundTrip(absent));
+  PianoReading present = {395, 0, false, 0, nullptr, 0, true, false, nullptr, 0};
+  assertSameReading(present, roundTrip(present));
+  PianoReading unmapped = {124, 300, true, 4700, nullptr, 0, true, true, nullptr, 0};
+  assertSameReading(unmapped, roundTrip(unmapped));
+}
+
+void test_fields_are_clamped() {
+  PianoReading reading = {-5, 70000, true, 100000, "A", 4, true, true, nullptr, 0};
+  PianoReading decoded = roundTrip(reading);
+  TEST_ASSERT_EQUAL_INT(0, decoded.distance);
+  TEST_ASSERT_EQUAL_INT(65535, decoded.volume);
+  TEST_ASSERT_EQUAL_INT(65535, decoded.frequency);
+}
+
+void test_unknown_note_is_sent_as_none() {
+  PianoReading reading = {120, 231, true, 440, "H", 4, true, true, nullptr, 0};
+  TEST_ASSERT_NULL(roundTrip(reading).note);
+}
+
+void test_bad_frames_are_rejected() {
+  PianoReading reading = {120, 231, true, 440, "A", 4, true, true, nullptr, 0};
+  uint8_t frame[TELEMETRY_BINARY_SIZE];
+  encodeReadingBinary(frame, sizeof(frame), reading);
+  PianoReading decoded;
+
+  TEST_ASSERT_FALSE(decodeReadingBinary(frame, sizeof(frame) - 1, decoded));
+  frame[0] = TELEMETRY_BINARY_VERSION + 1;
+  TEST_ASSERT_FALSE(decodeReadingBinary(frame, sizeof(frame), decoded));
+  frame[0] = TELEMETRY_BINARY_VERSION;
+  frame[8] = 0xC4;  // Pitch class 12
+  TEST_ASSERT_FALSE(decodeReadingBinary(frame, sizeof(frame), decoded));
+
+  TEST_ASSERT_EQUAL_UINT32(0, encodeReadingBinary(frame, sizeof(frame) - 1, reading));
+}
+
+// How much smaller the frame must be than the JSON of the same reading
+static const unsigned MIN_SAVING_PERCENT = 90;
+
+// The frame against the JSON payload of the same reading, for the readings
+// a session sends most and the one with the shortest JSON there can be
+void test_smaller_than_json() {
+  const PianoReading readings[] = {
+    {120, 231, true, 440, "A", 4, true, true, nullptr, 0},         // Playing
+    {395, 0, false, 0, nullptr, 0, true, false, nullptr, 0},       // Present, quiet
+    {1200, 51, false, 0, nullptr, 0, false, false, nullptr, 0},    // Nobody there
+    {0, 0, true, 0, "A", 0, false, false, nullptr, 0},             // Shortest JSON
+  };
+  for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
+    char json[TELEMETRY_JSON_MAX];
+    size_t jsonLength = writeReadingJson(json, sizeof(json), readings[i]);
+    TEST_ASSERT_GREATER_THAN(0, jsonLength);
+    uint8_t frame[TELEMETRY_BINARY_SIZE];
+    TEST_ASSERT_EQUAL_UINT32(TELEMETRY_BINARY_SIZE, encodeReadingBinary(frame, sizeof(frame), readings[i]));
+
+    unsigned saving = (unsigned)(100 - TELEMETRY_BINARY_SIZE * 100 / jsonLength);
+    char message[80];
+    snprintf(message, sizeof(message), "json %u bytes, binary %u bytes, %u%% smaller", (unsigned)jsonLength,
+             (unsigned)TELEMETRY_BINARY_SIZE, saving);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE_MESSAGE(TELEMETRY_BINARY_SIZE * 100 <= jsonLength * (100 - MIN_SAVING_PERCENT), message);
+  }
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_every_note_round_trips);
+  RUN_TEST(test_idle_and_absent_round_trip);
+  RUN_TEST(test_fields_are_clamped);
+  RUN_TEST(test_unknown_note_is_sent_as_none);
+  RUN_TEST(test_bad_frames_are_rejected);
+  RUN_TEST(test_smaller_than_json);
+  return UNITY_END();
+}
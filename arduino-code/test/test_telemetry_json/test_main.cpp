@@ -0,0 +1,140 @@
+// writeReadingJson() against the String concatenation it replaced in
+// handleState() and calculateAndProcessAudio(), rebuilt here with
+// std::string: a playing reading, an idle one and one carrying note events
+// must come out byte for byte the same.
+//
+//   pio test -e native -f test_telemetry_json
+
+#include <limits.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include "TelemetryJson.h"
+
+// The old payload, field by field as the String code appended it
+static std::string stringBuilt(const PianoReading& reading) {
+  std::string json = "{";
+  json += "\"distance\":" + std::to_string(reading.distance) + ",";
+  json += "\"volume\":" + std::to_string(reading.volume) + ",";
+  if (reading.hasFrequency) {
+    json += "\"frequency\":" + std::to_string(reading.frequency) + ",";
+  } else {
+    json += "\"frequency\":null,";
+  }
+  if (reading.note != nullptr) {
+    json += "\"note\":\"" + std::string(reading.note) + "\",";
+    json += "\"octave\":" + std::to_string(reading.octave) + ",";
+  } else {
+    json += "\"note\":null,";
+    json += "\"octave\":null,";
+  }
+  json += std::string("\"presence\":") + (reading.presence ? "true" : "false") + ",";
+  json += std::string("\"playing\":") + (reading.playing ? "true" : "false");
+  json += "}";
+  return json;
+}
+
+static PianoReading playing() {
+  PianoReading reading = {120, 140, true, 262, "C", 4, true, true, nullptr, 0};
+  return reading;
+}
+
+static PianoReading idle() {
+  PianoReading reading = {873, 3, false, 0, nullptr, 0, false, false, nullptr, 0};
+  return reading;
+}
+
+static void assertSameAsString(const PianoReading& reading) {
+  char buffer[TELEMETRY_JSON_MAX];
+  size_t length = writeReadingJson(buffer, sizeof(buffer), reading);
+  std::string expected = stringBuilt(reading);
+  TEST_ASSERT_EQUAL_UINT32(expected.size(), length);
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), buffer);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_playing_reading() {
+  assertSameAsString(playing());
+
+  PianoReading sharp = playing();
+  sharp.note = "C#";
+  sharp.octave = 7;
+  sharp.frequency = 2217;
+  assertSameAsString(sharp);
+
+  // Playing with a frequency but no note in range
+  PianoReading unmapped = playing();
+  unmapped.note = nullptr;
+  unmapped.frequency = 4700;
+  assertSameAsString(unmapped);
+}
+
+void test_idle_reading() {
+  assertSameAsString(idle());
+
+  PianoReading present = idle();
+  present.presence = true;
+  present.distance = 412;
+  assertSameAsString(present);
+}
+
+void test_extreme_integers() {
+  PianoReading reading = playing();
+  reading.distance = INT_MIN;
+  reading.volume = INT_MAX;
+  reading.frequency = INT_MIN;
+  reading.octave = INT_MIN;
+  reading.note = "C#x";
+  assertSameAsString(reading);
+}
+
+// The events array goes in before the closing brace, and an empty timeline
+// leaves the payload exactly as before
+void test_reading_with_events() {
+  NoteTimeline timeline(2000);
+  timeline.clear(10000);
+  char buffer[TELEMETRY_BATCH_JSON_MAX];
+  PianoReading reading = playing();
+  std::string expected = stringBuilt(reading);
+
+  size_t length = writeReadingJson(buffer, sizeof(buffer), reading, timeline);
+  TEST_ASSERT_EQUAL_UINT32(expected.size(), length);
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), buffer);
+
+  NoteEvent c4 = {10035, "C", 4, 262, 140};
+  NoteEvent e4 = {10410, "E", 4, 330, 152};
+  NoteEvent gSharp5 = {11999, "G#", 5, 831, 97};
+  timeline.push(c4);
+  timeline.push(e4);
+  timeline.push(gSharp5);
+  expected.erase(expected.size() - 1);
+  expected += ",\"events\":[[35,\"C\",4,262,140],[410,\"E\",4,330,152],[1999,\"G#\",5,831,97]]}";
+
+  length = writeReadingJson(buffer, sizeof(buffer), reading, timeline);
+  TEST_ASSERT_EQUAL_UINT32(expected.size(), length);
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), buffer);
+}
+
+void test_too_small_buffer_writes_nothing() {
+  char buffer[16];
+  memset(buffer, 'x', sizeof(buffer));
+  TEST_ASSERT_EQUAL_UINT32(0, writeReadingJson(buffer, sizeof(buffer), playing()));
+  TEST_ASSERT_EQUAL_STRING("", buffer);
+}
+
+int main(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  UNITY_BEGIN();
+  RUN_TEST(test_playing_reading);
+  RUN_TEST(test_idle_reading);
+  RUN_TEST(test_extreme_integers);
+  RUN_TEST(test_reading_with_events);
+  RUN_TEST(test_too_small_buffer_writes_nothing);
+  return UNITY_END();
+}
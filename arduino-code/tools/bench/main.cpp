@@ -0,0 +1,537 @@
+// bench - time every hot-path stage of one loop() on its own.
+//
+// Runs on the Linux host (ns from the steady clock) and on the Nano 33 IoT
+// (CPU cycles from SysTick - the Cortex-M0+ has no DWT cycle counter).
+//
+//   pio run -e bench_native && .pio/build/bench_native/program > bench.csv
+//   pio run -e bench_nano33 -t upload && pio device monitor
+//
+// Output is CSV, one row per stage in a fixed order, so two runs can be
+// diffed directly:
+//
+//   # piano-bench 1 platform=<native|nano33> unit=<ns|cycles> ...
+//   stage,unit,calls,min,median,max
+//   fixed.compute,cycles,64,...
+//
+// Every value is the cost of one call. Each stage is sampled BENCH_SAMPLES
+// times; the input is re-prepared outside the timed region before every
+// sample and the timer's own overhead is subtracted. Lines starting with #
+// are comments. Stages that can't run on a platform are simply left out.
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "AdcCapture.h"
+#include "Board.h"
+#include "ChordDetector.h"
+#include "DecimationCascade.h"
+#include "Diagnostics.h"
+#include "FixedSpectrum.h"
+#include "HpsPitch.h"
+#include "InterpolatedPitch.h"
+#include "MultiRatePitch.h"
+#include "NoteMapper.h"
+#include "NoteTimeline.h"
+#include "PublishPipeline.h"
+#include "SpectrumFrame.h"
+#include "TelemetryBinary.h"
+#include "TelemetryJson.h"
+#include "YinPitch.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+// The double engine is benchmarked whenever arduinoFFT is available
+#ifndef BENCH_DOUBLE_FFT
+#if defined(__has_include)
+#if __has_include(<arduinoFFT.h>)
+#define BENCH_DOUBLE_FFT 1
+#endif
+#endif
+#endif
+#ifndef BENCH_DOUBLE_FFT
+#define BENCH_DOUBLE_FFT 0
+#endif
+
+#if BENCH_DOUBLE_FFT
+#include <arduinoFFT.h>
+#endif
+
+#define BENCH_SAMPLES 64
+#define SAMPLES CAPTURE_SAMPLES
+#define SAMPLING_FREQUENCY 5000
+#define MIC_DC_OFFSET 512
+
+static_assert(FIXED_SPECTRUM_SAMPLES == SAMPLES, "FIXED_SPECTRUM_SAMPLES must match CAPTURE_SAMPLES");
+
+// Timer
+
+#ifdef ARDUINO_ARCH_SAMD
+static const char* PLATFORM = "nano33";
+static const char* UNIT = "cycles";
+
+// The core runs SysTick at one interrupt per millisecond and counts them in
+// millis(), so cycles = ms * reload + cycles into the current tick. Wraps
+// after about 89 s at 48 MHz, which only matters for one sample's length.
+static uint32_t benchTime() {
+  uint32_t ms;
+  uint32_t value;
+  do {
+    ms = millis();
+    value = SysTick->VAL;
+  } while (ms != millis());  // A tick landed in between - read again
+  uint32_t reload = SysTick->LOAD + 1;
+  return ms * reload + (reload - 1 - value);
+}
+#else
+static const char* PLATFORM = "native";
+static const char* UNIT = "ns";
+
+static uint32_t benchTime() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+static void emit(const char* line) {
+#ifdef ARDUINO
+  Serial.println(line);
+#else
+  puts(line);
+#endif
+}
+
+static volatile uint32_t sink;  // Keeps results the compiler would drop
+static uint32_t timerOverhead = 0;
+
+static void sortSamples(uint32_t* values, int count) {
+  for (int i = 1; i < count; i++) {
+    uint32_t value = values[i];
+    int j = i - 1;
+    while (j >= 0 && values[j] > value) {
+      values[j + 1] = values[j];
+      j--;
+    }
+    values[j + 1] = value;
+  }
+}
+
+// Time body() BENCH_SAMPLES times, calling prepare() untimed before each.
+// body() makes `calls` calls of the stage, so tiny stages are timed in a
+// batch and reported per call. Returns the median.
+template <typename Prepare, typename Body>
+static uint32_t runStage(const char* name, int calls, Prepare prepare, Body body) {
+  uint32_t samples[BENCH_SAMPLES];
+
+  prepare();
+  body();  // Warm up caches and lazily built tables
+  for (int s = 0; s < BENCH_SAMPLES; s++) {
+    prepare();
+    uint32_t start = benchTime();
+    body();
+    uint32_t elapsed = benchTime() - start;
+    elapsed = elapsed > timerOverhead ? elapsed - timerOverhead : 0;
+    samples[s] = (elapsed + calls / 2) / calls;
+  }
+  sortSamples(samples, BENCH_SAMPLES);
+
+  char line[96];
+  snprintf(line, sizeof(line), "%s,%s,%d,%lu,%lu,%lu", name, UNIT, calls,
+           (unsigned long)samples[0], (unsigned long)samples[BENCH_SAMPLES / 2],
+           (unsigned long)samples[BENCH_SAMPLES - 1]);
+  emit(line);
+  return samples[BENCH_SAMPLES / 2];
+}
+
+template <typename Body>
+static uint32_t runStage(const char* name, int calls, Body body) {
+  return runStage(name, calls, [] {}, body);
+}
+
+// Inputs
+
+// A decaying A4 with two overtones, as the 10-bit ADC would see it
+static int16_t testBlock[SAMPLES];
+// F4 major (F4, A4, C5), three partials each
+static int16_t chordBlock[SAMPLES];
+
+static void makeTestBlock() {
+  static const double chord[] = {349.2, 440.0, 523.3};
+  for (int i = 0; i < SAMPLES; i++) {
+    double t = (double)i / SAMPLING_FREQUENCY;
+    double v = sin(2 * M_PI * 440 * t) + 0.5 * sin(2 * M_PI * 880 * t) +
+               0.33 * sin(2 * M_PI * 1320 * t);
+    testBlock[i] = (int16_t)(MIC_DC_OFFSET + 180 * v);
+
+    double c = 0;
+    for (int n = 0; n < 3; n++) {
+      for (int h = 1; h <= 3; h++) {
+        c += sin(2 * M_PI * chord[n] * h * t + n) / h;
+      }
+    }
+    chordBlock[i] = (int16_t)(MIC_DC_OFFSET + 70 * c);
+  }
+}
+
+static FixedSpectrum spectrum;
+static HpsPitch hpsPitch;
+static InterpolatedPitch interpolatedPitch;
+static YinPitch yinPitch;
+static AdcCapture capture;
+static DecimationCascade cascade;
+static NoteTimeline timeline(2000);
+static Diagnostics diagnostics;
+
+// Takes every message at once, so publish.drain is the pipeline's own cost
+class NullPublisher : public Publisher {
+public:
+  bool connected() override { return true; }
+  bool publish(const char* topic, const uint8_t* payload, size_t length) override {
+    (void)topic;
+    (void)payload;
+    return length > 0;
+  }
+};
+static NullPublisher nullPublisher;
+static PublishPipeline pipeline;
+
+#if BENCH_DOUBLE_FFT
+static double vReal[SAMPLES];
+static double vImag[SAMPLES];
+static double magnitudeSpectrum[SAMPLES / 2];
+static double hpsSpectrum[SAMPLES / 2];
+static ArduinoFFT<double> FFT(vReal, vImag, SAMPLES, SAMPLING_FREQUENCY);
+
+static void loadDouble() {
+  for (int i = 0; i < SAMPLES; i++) {
+    vReal[i] = testBlock[i] - MIC_DC_OFFSET;
+    vImag[i] = 0;
+  }
+}
+#endif
+
+static void captureStages() {
+#ifdef ARDUINO_ARCH_SAMD
+  // The polled capture the firmware used before the DMA, for comparison -
+  // has to run while the ADC is still free
+  runStage("capture.analogread_block", 1, [] {
+    for (int i = 0; i < SAMPLES; i++) {
+      sink = analogRead(A0);
+    }
+  });
+
+  // Cost to the CPU of taking a finished DMA block and handing it back
+  capture.begin(A0, SAMPLING_FREQUENCY);
+  runStage("capture.handoff", 1,
+           [] {
+             // Wait (untimed) for the DMA to finish a fresh block
+             uint32_t seen = capture.stats().blocksCompleted();
+             while (capture.stats().blocksCompleted() == seen) {}
+           },
+           [] {
+             const int16_t* block = capture.acquire();
+             if (block != nullptr) sink = block[0];
+             capture.release();
+           });
+  capture.end();
+#else
+  // Host stub: the producer side of one block plus the handoff
+  capture.begin(0, SAMPLING_FREQUENCY);
+  runStage("capture.feed_block", 1, [] { capture.feedSamples(testBlock, SAMPLES); });
+  runStage("capture.handoff", 1, [] { capture.feedSamples(testBlock, SAMPLES); }, [] {
+    const int16_t* block = capture.acquire();
+    if (block != nullptr) sink = block[0];
+    capture.release();
+  });
+  capture.end();
+#endif
+}
+
+// Medians of window + FFT + magnitude + HPS peak, summed over each engine,
+// for the comparison line at the end
+static uint32_t fixedTotal = 0;
+#if BENCH_DOUBLE_FFT
+static uint32_t doubleTotal = 0;
+#endif
+
+static void fixedStages() {
+  spectrum.begin();
+  fixedTotal = runStage("fixed.load_window", 1, [] { spectrum.loadBlock(testBlock, MIC_DC_OFFSET); });
+  fixedTotal += runStage("fixed.compute", 1, [] { spectrum.loadBlock(testBlock, MIC_DC_OFFSET); },
+                         [] { spectrum.compute(); });
+  fixedTotal += runStage("fixed.magnitude", 1, [] { spectrum.complexToMagnitude(); });
+  // The integer HPS forms the products inside the peak search, so the two
+  // are one stage here
+  fixedTotal += runStage("fixed.hps_peak", 1, [] { sink = spectrum.harmonicProductPeak(3, 3).bin; });
+
+  // The selectable pitch engines on the same spectrum, load included (see
+  // tools/pitch_check for what each one buys in accuracy)
+  runStage("pitch.hps", 1, [] {
+    hpsPitch.load(testBlock, MIC_DC_OFFSET);
+    sink = hpsPitch.estimate(spectrum, SAMPLING_FREQUENCY, 3).frequencyQ4;
+  });
+  runStage("pitch.interpolated", 1, [] {
+    interpolatedPitch.load(testBlock, MIC_DC_OFFSET);
+    sink = interpolatedPitch.estimate(spectrum, SAMPLING_FREQUENCY, 3).frequencyQ4;
+  });
+  runStage("pitch.yin", 1, [] {
+    yinPitch.load(testBlock, MIC_DC_OFFSET);
+    sink = yinPitch.estimate(spectrum, SAMPLING_FREQUENCY, 3).frequencyQ4;
+  });
+
+  // Chord mode runs on the same magnitudes, here of a three-note chord
+  spectrum.loadBlock(chordBlock, MIC_DC_OFFSET);
+  spectrum.compute();
+  spectrum.complexToMagnitude();
+  runStage("chord.detect", 1, [] {
+    ChordNote notes[CHORD_MAX_NOTES];
+    sink = detectChord(spectrum.magnitudes(), SAMPLES, SAMPLING_FREQUENCY, 3, notes, CHORD_MAX_NOTES);
+  });
+
+  // Multi-rate analysis at its 10 kHz capture: one block through the
+  // decimation cascade, then the note decision. The A4 block read at
+  // 10 kHz is an A5 that band 0 settles alone; an A1 needs every band.
+  const uint32_t multiRate = 2 * SAMPLING_FREQUENCY;
+  cascade.begin(multiRate, MIC_DC_OFFSET);
+  runStage("multirate.push_block", 1, [] { cascade.push(testBlock, SAMPLES); });
+  runStage("multirate.estimate_treble", 1, [] {
+    sink = estimateMultiRate(cascade, spectrum, interpolatedPitch, MIC_DC_OFFSET, 3,
+                             DecimationCascade::BANDS).band;
+  });
+  cascade.begin(multiRate, MIC_DC_OFFSET);
+  int16_t bassBlock[SAMPLES];
+  for (int start = 0; start < (SAMPLES << (DecimationCascade::BANDS - 1)); start += SAMPLES) {
+    for (int i = 0; i < SAMPLES; i++) {
+      double t = (double)(start + i) / multiRate;
+      double v = 0;
+      for (int h = 1; h <= 6; h++) {
+        v += sin(2 * M_PI * 55 * h * t) / h;
+      }
+      bassBlock[i] = (int16_t)(MIC_DC_OFFSET + 120 * v);
+    }
+    cascade.push(bassBlock, SAMPLES);
+  }
+  runStage("multirate.estimate_bass", 1, [] {
+    sink = estimateMultiRate(cascade, spectrum, interpolatedPitch, MIC_DC_OFFSET, 3,
+                             DecimationCascade::BANDS).band;
+  });
+
+  // One frame of the live spectrum stream (SPECTRUM_STREAM), as
+  // spectrumTask() in src/main.cpp makes it: the chord band's transform,
+  // the log levels, then a key frame and a delta frame against it
+  runStage("spectrum.band", 1, [] { bandSpectrum(cascade, 1, spectrum, MIC_DC_OFFSET); });
+  static uint8_t levels[SAMPLES / 2];
+  runStage("spectrum.levels", 1, [] {
+    const uint16_t* magnitudes = spectrum.magnitudes();
+    for (int i = 0; i < SAMPLES / 2; i++) {
+      levels[i] = spectrumLevel(spectrum.inputUnits(magnitudes[i]), 8);
+    }
+  });
+  static SpectrumEncoder encoder;
+  runStage("spectrum.encode_key", 1, [] { encoder.restart(); }, [] {
+    uint8_t frame[SPECTRUM_FRAME_MAX];
+    sink = encoder.encode(frame, sizeof(frame), levels, SAMPLES / 2, 625);
+  });
+  // Every fourth bin moved by two steps since the key frame
+  runStage("spectrum.encode_delta", 1,
+           [] {
+             uint8_t frame[SPECTRUM_FRAME_MAX];
+             encoder.restart();
+             encoder.encode(frame, sizeof(frame), levels, SAMPLES / 2, 625);
+             for (int i = 0; i < SAMPLES / 2; i += 4) {
+               levels[i] ^= 2;
+             }
+           },
+           [] {
+             uint8_t frame[SPECTRUM_FRAME_MAX];
+             sink = encoder.encode(frame, sizeof(frame), levels, SAMPLES / 2, 625);
+           });
+}
+
+static void doubleStages() {
+#if BENCH_DOUBLE_FFT
+  doubleTotal = runStage("double.window", 1, loadDouble,
+                         [] { FFT.windowing(FFT_WIN_TYP_HAMMING, FFT_FORWARD); });
+  doubleTotal += runStage("double.compute", 1,
+                          [] { loadDouble(); FFT.windowing(FFT_WIN_TYP_HAMMING, FFT_FORWARD); },
+                          [] { FFT.compute(FFT_FORWARD); });
+  doubleTotal += runStage("double.magnitude", 1,
+           [] { loadDouble(); FFT.windowing(FFT_WIN_TYP_HAMMING, FFT_FORWARD); FFT.compute(FFT_FORWARD); },
+           [] { FFT.complexToMagnitude(); });
+  for (int i = 0; i < SAMPLES / 2; i++) {
+    magnitudeSpectrum[i] = vReal[i];
+  }
+
+  // Same loops as calculateDominantFrequency() in src/main.cpp
+  doubleTotal += runStage("double.hps", 1, [] {
+    for (int i = 0; i < SAMPLES / 2; i++) {
+      hpsSpectrum[i] = magnitudeSpectrum[i];
+    }
+    for (int harmonic = 2; harmonic <= 3; harmonic++) {
+      for (int i = 0; i < SAMPLES / (2 * harmonic); i++) {
+        hpsSpectrum[i] *= magnitudeSpectrum[i * harmonic];
+      }
+    }
+  });
+  doubleTotal += runStage("double.peak", 1, [] {
+    double peakValue = 0;
+    uint16_t peakIndex = 0;
+    for (int i = 3; i < SAMPLES / 2; i++) {
+      if (hpsSpectrum[i] > peakValue) {
+        peakValue = hpsSpectrum[i];
+        peakIndex = i;
+      }
+    }
+    sink = peakIndex;
+  });
+
+  // One frame through each engine, end to end
+  char line[128];
+  snprintf(line, sizeof(line), "# spectrum fixed=%lu double=%lu %s speedup=%lu.%02lux",
+           (unsigned long)fixedTotal, (unsigned long)doubleTotal, UNIT,
+           (unsigned long)(doubleTotal / (fixedTotal ? fixedTotal : 1)),
+           (unsigned long)(doubleTotal * 100ULL / (fixedTotal ? fixedTotal : 1) % 100));
+  emit(line);
+#endif
+}
+
+static void outputStages() {
+  // A sweep over the whole keyboard, 88 calls per sample
+  runStage("note.map", 88, [] {
+    for (int key = 0; key < 88; key++) {
+      sink = mapFrequencyToNote(27.5f * powf(2.0f, key / 12.0f + 0.01f)).midi;
+    }
+  });
+
+  static const PianoReading reading = {120, 231, true, 440, "A", 4, true, true, nullptr, 0};
+  uint32_t jsonTime = runStage("json.reading", 1, [] {
+    char payload[TELEMETRY_JSON_MAX];
+    sink = writeReadingJson(payload, sizeof(payload), reading);
+  });
+
+  // A full two-second window of note events
+  runStage("json.batch", 1,
+           [] {
+             timeline.clear(0);
+             for (int i = 0; i < NOTE_TIMELINE_CAPACITY; i++) {
+               NoteEvent event = {(uint32_t)(i * 120), "C#", 4, 277, 200};
+               timeline.push(event);
+             }
+           },
+           [] {
+             char payload[TELEMETRY_BATCH_JSON_MAX];
+             sink = writeReadingJson(payload, sizeof(payload), reading, timeline);
+           });
+
+  uint32_t binaryTime = runStage("binary.encode", 1, [] {
+    uint8_t frame[TELEMETRY_BINARY_SIZE];
+    sink = encodeReadingBinary(frame, sizeof(frame), reading);
+  });
+
+  // The same reading in each encoding: payload bytes and encode time
+  char payload[TELEMETRY_JSON_MAX];
+  char line[128];
+  snprintf(line, sizeof(line), "# telemetry json=%uB,%lu%s binary=%uB,%lu%s",
+           (unsigned)writeReadingJson(payload, sizeof(payload), reading), (unsigned long)jsonTime, UNIT,
+           (unsigned)TELEMETRY_BINARY_SIZE, (unsigned long)binaryTime, UNIT);
+  emit(line);
+
+  // One DIAG_START/DIAG_STOP pair as src/main.cpp expands it (here through
+  // the HAL clock, one virtual call more per read), then a diagnostics
+  // report with every bucket of every stage in use
+  runStage("diag.probe", 1, [] {
+    Clock& clock = boardClock();
+    uint32_t start = clock.micros();
+    diagnostics.record(DIAG_ANALYSIS, clock.micros() - start);
+  });
+  for (int stage = 0; stage < DIAG_STAGES; stage++) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      diagnostics.record((DiagStage)stage, 3u << (i + 2));
+    }
+  }
+  runStage("diag.json", 1, [] {
+    char payload[DIAG_JSON_MAX];
+    DiagSystem system = {60000, 0, 17012, 3320, 0, 3, 0};
+    sink = writeDiagnosticsJson(payload, sizeof(payload), diagnostics, system);
+  });
+
+  // A reading's JSON into the publish ring, and the sender taking it out
+  static uint8_t message[240];
+  pipeline.begin(nullPublisher, boardClock(), 4000, 1024);
+  runStage("publish.enqueue", 1, [] { pipeline.drain(); }, [] {
+    sink = pipeline.enqueue("conndev/piano", message, sizeof(message), 0, 0);
+  });
+  runStage("publish.drain", 1, [] { pipeline.enqueue("conndev/piano", message, sizeof(message), 0, 0); },
+           [] { sink = pipeline.drain(); });
+}
+
+static void displayStages(bool haveDisplay) {
+  if (!haveDisplay) {
+    emit("# display stages skipped: board init failed");
+    return;
+  }
+  TextDisplay& display = boardDisplay();
+  // The "Playing" screen from updateDisplay(), without the flush
+  runStage("display.draw", 1, [&display] {
+    display.clearDisplay();
+    display.setTextColor(DISPLAY_WHITE);
+    display.setTextSize(1);
+    display.setCursor(0, 0);
+    display.println("Playing:");
+    display.setTextSize(2);
+    display.setCursor(0, 10);
+    display.print("A#");
+    display.print(4);
+    display.setTextSize(1);
+    display.setCursor(70, 16);
+    display.print(466);
+    display.print(" Hz");
+  });
+  runStage("display.flush", 1, [&display] { display.display(); });
+}
+
+static void runBenchmarks() {
+  makeTestBlock();
+
+  // Calibrate: an empty timed region
+  uint32_t best = UINT32_MAX;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = benchTime();
+    uint32_t elapsed = benchTime() - start;
+    if (elapsed < best) best = elapsed;
+  }
+  timerOverhead = best;
+
+  char header[128];
+  snprintf(header, sizeof(header), "# piano-bench 1 platform=%s unit=%s samples=%d overhead=%lu",
+           PLATFORM, UNIT, BENCH_SAMPLES, (unsigned long)timerOverhead);
+  emit(header);
+  emit("stage,unit,calls,min,median,max");
+
+  captureStages();
+  fixedStages();
+  doubleStages();
+  outputStages();
+  displayStages(boardBegin());
+  emit("# done");
+}
+
+#ifdef ARDUINO
+void setup() {
+  Serial.begin(9600);
+  while (!Serial) {}
+  runBenchmarks();
+}
+
+void loop() {
+}
+#else
+int main() {
+  runBenchmarks();
+  return 0;
+}
+#endif
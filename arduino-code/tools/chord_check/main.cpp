@@ -0,0 +1,221 @@
+// chord_check - validate the chord detector against synthesized chords.
+//
+// Each chord is rendered as piano-like tones (6 partials at 1/h, slightly
+// stretched) into a 1 s, 44.1 kHz WAV. The WAV is read back the way the
+// native simulator plays it: point-sampled at the firmware's 10 kHz capture
+// rate into the 10-bit ADC's range. It then goes through the decimation
+// cascade, and the 5 kHz band's frame ending 100 ms + one window in goes
+// through FixedSpectrum + detectChord(), exactly as on the board. Prints one CSV row per chord and
+// the overall precision/recall. Exits 1 if either is under its minimum.
+//
+//   pio run -e chord_check && .pio/build/chord_check/program
+//   .pio/build/chord_check/program --wav-dir chords/   (keep the WAVs, e.g.
+//                                                      for the native simulator)
+//
+// Frame length is FIXED_SPECTRUM_SAMPLES, 256 in [env:chord_check] as chord
+// mode needs (see CHORD_DETECTION in src/main.cpp). Build with another value
+// to see what that frame resolves - 128 misses the minimums.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ChordDetector.h"
+#include "DecimationCascade.h"
+#include "FixedSpectrum.h"
+#include "MultiRatePitch.h"
+#include "NoteMapper.h"
+#include "SimBoard.h"
+
+// The firmware's capture rate and chord band (src/main.cpp)
+static const uint32_t CAPTURE_RATE = 10000;
+static const int CHORD_BAND = 1;
+static const uint32_t SAMPLE_RATE = CAPTURE_RATE >> CHORD_BAND;
+static const int16_t DC_OFFSET = 512;
+static const uint32_t WAV_RATE = 44100;
+static const int FIRST_BIN = 3;
+
+// Pass marks over all chords, for 256-sample frames (0.94 / 0.94 measured)
+#ifndef CHORD_MIN_PRECISION
+#define CHORD_MIN_PRECISION 0.90
+#endif
+#ifndef CHORD_MIN_RECALL
+#define CHORD_MIN_RECALL 0.90
+#endif
+
+struct TestChord {
+  const char* name;
+  int midi[4];  // 0 terminated
+};
+
+static const TestChord CHORDS[] = {
+  {"A4", {69, 0}},
+  {"C3+G3", {48, 55, 0}},
+  {"C4+C5", {60, 72, 0}},
+  {"C4+G4", {60, 67, 0}},
+  {"C4 major", {60, 64, 67, 0}},
+  {"A3 minor", {57, 60, 64, 0}},
+  {"F4 major", {65, 69, 72, 0}},
+  {"C5 major", {72, 76, 79, 0}},
+  {"A5 minor", {81, 84, 88, 0}},
+  {"G5 major", {79, 83, 86, 0}},
+  {"C6 major", {84, 88, 91, 0}},
+  {"C4+E5+G5", {60, 76, 79, 0}},
+  {"D4+A4+F5", {62, 69, 77, 0}},
+  {"E5+B5", {76, 83, 0}},
+};
+
+static double midiFrequency(int midi) {
+  return 440.0 * pow(2.0, (midi - 69) / 12.0);
+}
+
+// Piano-ish tone: 6 partials at 1/h, stretched by a small inharmonicity
+static double chordSample(const TestChord& chord, double t) {
+  double value = 0;
+  int count = 0;
+  for (int n = 0; n < 4 && chord.midi[n] != 0; n++) {
+    double f0 = midiFrequency(chord.midi[n]);
+    for (int h = 1; h <= 6; h++) {
+      double partial = f0 * h * sqrt(1 + 0.0004 * h * h);
+      value += sin(2 * M_PI * partial * t + n + h) / h;
+    }
+    count++;
+  }
+  return value / (count * 2.2);
+}
+
+static bool writeWav(const char* path, const TestChord& chord) {
+  FILE* file = fopen(path, "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "Can't write %s\n", path);
+    return false;
+  }
+  const uint32_t rate = WAV_RATE;
+  const uint32_t frames = rate;  // 1 s
+  uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+                        16, 0, 0, 0, 1, 0, 1, 0};
+  uint32_t dataBytes = frames * 2;
+  uint32_t riffBytes = 36 + dataBytes;
+  uint32_t byteRate = rate * 2;
+  memcpy(header + 4, &riffBytes, 4);
+  memcpy(header + 24, &rate, 4);
+  memcpy(header + 28, &byteRate, 4);
+  header[32] = 2;
+  header[34] = 16;
+  memcpy(header + 36, "data", 4);
+  memcpy(header + 40, &dataBytes, 4);
+  fwrite(header, 1, sizeof(header), file);
+  // 25600 is 400 ADC counts either side of mid-scale once the simulator
+  // scales it down by 64
+  for (uint32_t i = 0; i < frames; i++) {
+    int16_t sample = (int16_t)lround(25600 * chordSample(chord, (double)i / rate));
+    fwrite(&sample, 2, 1, file);
+  }
+  return fclose(file) == 0;
+}
+
+// Capture the first durationMs of path as SimMicSource feeds the ADC stub,
+// into cascade
+static bool capture(const char* path, uint32_t durationMs, DecimationCascade& cascade) {
+  WavReader wav;
+  if (!wav.open(path)) {
+    fprintf(stderr, "Can't read %s\n", path);
+    return false;
+  }
+  cascade.begin(CAPTURE_RATE, DC_OFFSET);
+  uint64_t samples = (uint64_t)durationMs * CAPTURE_RATE / 1000;
+  for (uint64_t i = 0; i < samples; i++) {
+    int16_t pcm = 0;
+    wav.sampleAt(i * wav.rate() / CAPTURE_RATE, pcm);
+    long value = DC_OFFSET + lround(pcm / 64.0);
+    int16_t sample = (int16_t)(value < 0 ? 0 : value > 1023 ? 1023 : value);
+    cascade.push(&sample, 1);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* wavDir = nullptr;
+  if (argc == 3 && strcmp(argv[1], "--wav-dir") == 0) {
+    wavDir = argv[2];
+  } else if (argc != 1) {
+    fprintf(stderr, "usage: %s [--wav-dir DIR]\n", argv[0]);
+    return 2;
+  }
+  // Without --wav-dir the WAVs go to a scratch directory, removed at the end
+  char scratch[] = "/tmp/chord_check.XXXXXX";
+  bool keepWavs = wavDir != nullptr;
+  if (!keepWavs) {
+    wavDir = mkdtemp(scratch);
+    if (wavDir == nullptr) {
+      perror("mkdtemp");
+      return 2;
+    }
+  }
+
+  static FixedSpectrum spectrum;
+  static DecimationCascade cascade;
+  spectrum.begin();
+  const uint32_t windowMs = FixedSpectrum::SAMPLES * 1000 / SAMPLE_RATE;
+
+  const int chordCount = sizeof(CHORDS) / sizeof(CHORDS[0]);
+  int expectedTotal = 0;
+  int reportedTotal = 0;
+  int matchedTotal = 0;
+
+  printf("# chord_check samples=%d rate=%lu bin_hz=%.1f\n", FixedSpectrum::SAMPLES,
+         (unsigned long)SAMPLE_RATE, (double)SAMPLE_RATE / FixedSpectrum::SAMPLES);
+  printf("chord,expected,reported,matched,notes\n");
+
+  for (int c = 0; c < chordCount; c++) {
+    const TestChord& chord = CHORDS[c];
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/chord_%02d.wav", wavDir, c);
+    // A window starting 100 ms into the note, like a frame taken while it rings
+    if (!writeWav(path, chord) || !capture(path, 100 + windowMs, cascade)) {
+      return 2;
+    }
+    if (!keepWavs) {
+      remove(path);
+    }
+    bandSpectrum(cascade, CHORD_BAND, spectrum, DC_OFFSET);
+
+    ChordNote notes[CHORD_MAX_NOTES];
+    int count = detectChord(spectrum.magnitudes(), FixedSpectrum::SAMPLES, SAMPLE_RATE, FIRST_BIN,
+                            notes, CHORD_MAX_NOTES);
+
+    int expected = 0;
+    int matched = 0;
+    for (int n = 0; n < 4 && chord.midi[n] != 0; n++) {
+      expected++;
+      NoteInfo want = mapFrequencyToNote((float)midiFrequency(chord.midi[n]));
+      for (int r = 0; r < count; r++) {
+        if (notes[r].note == want.name && notes[r].octave == want.octave) {
+          matched++;
+          break;
+        }
+      }
+    }
+    expectedTotal += expected;
+    reportedTotal += count;
+    matchedTotal += matched;
+
+    printf("%s,%d,%d,%d,", chord.name, expected, count, matched);
+    for (int r = 0; r < count; r++) {
+      printf("%s%s%d:%u%%", r > 0 ? " " : "", notes[r].note, notes[r].octave, notes[r].confidence);
+    }
+    printf("\n");
+  }
+  if (!keepWavs) {
+    rmdir(wavDir);
+  }
+
+  double precision = reportedTotal > 0 ? (double)matchedTotal / reportedTotal : 0.0;
+  double recall = expectedTotal > 0 ? (double)matchedTotal / expectedTotal : 0.0;
+  bool pass = precision >= CHORD_MIN_PRECISION && recall >= CHORD_MIN_RECALL;
+  printf("# precision %.2f recall %.2f (minimum %.2f / %.2f) %s\n", precision, recall,
+         CHORD_MIN_PRECISION, CHORD_MIN_RECALL, pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
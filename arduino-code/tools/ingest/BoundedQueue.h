@@ -0,0 +1,85 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#define QUEUE_WAIT_FOREVER UINT32_MAX
+
+// FIFO between threads with a fixed capacity: push() waits while it is
+// full, so a slow consumer slows its producer down instead of piling up
+// memory. close() lets consumers drain what is left and then stop.
+// Items are batches of messages, so the lock is taken once per batch.
+template <typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+  // False once closed
+  bool push(const T& item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return items.size() < capacity || closed; });
+    if (closed) {
+      return false;
+    }
+    items.push_back(item);
+    notEmpty.notify_one();
+    return true;
+  }
+
+  // Never waits; false if full or closed
+  bool tryPush(const T& item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed || items.size() >= capacity) {
+      return false;
+    }
+    items.push_back(item);
+    notEmpty.notify_one();
+    return true;
+  }
+
+  // Waits up to waitMs for an item (0 never waits). False on timeout, or
+  // once closed and empty - finished() tells the two apart.
+  bool pop(T& item, uint32_t waitMs = QUEUE_WAIT_FOREVER) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (waitMs == QUEUE_WAIT_FOREVER) {
+      notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+    } else {
+      notEmpty.wait_for(lock, std::chrono::milliseconds(waitMs),
+                        [this] { return !items.empty() || closed; });
+    }
+    if (items.empty()) {
+      return false;
+    }
+    item = items.front();
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+    notFull.notify_all();
+  }
+
+  bool finished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return closed && items.empty();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::deque<T> items;
+  size_t capacity;
+  bool closed;
+};
+
+#endif
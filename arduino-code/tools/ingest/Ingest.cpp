@@ -0,0 +1,453 @@
+#include "Ingest.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+int64_t ingestWallMs() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int64_t ingestSteadyNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+IngestOptions::IngestOptions()
+    : workers(0), batchRows(2000), flushMs(20), handoffMessages(256), queueBatches(8) {
+  // The reader and the writer take a core each
+  int cores = (int)std::thread::hardware_concurrency();
+  workers = cores > 3 ? cores - 2 : 1;
+}
+
+LatencyPercentiles::LatencyPercentiles() : total(0), largest(0) {
+  memset(buckets, 0, sizeof(buckets));
+}
+
+// Bucket of us: 4 per power of two, from the two bits under the top one
+static int latencyBucket(uint32_t us) {
+  if (us < 4) {
+    return us;
+  }
+  int top = 31 - __builtin_clz(us);
+  return top * 4 + ((us >> (top - 2)) & 3);
+}
+
+static uint32_t bucketTop(int bucket) {
+  if (bucket < 8) {  // 4-7 are never used
+    return bucket;
+  }
+  int top = bucket / 4;
+  uint64_t edge = ((uint64_t)(4 + bucket % 4 + 1) << (top - 2)) - 1;
+  return edge > UINT32_MAX ? UINT32_MAX : (uint32_t)edge;
+}
+
+void LatencyPercentiles::record(uint32_t us) {
+  buckets[latencyBucket(us)]++;
+  total++;
+  if (us > largest) {
+    largest = us;
+  }
+}
+
+uint32_t LatencyPercentiles::percentile(double p) const {
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * total);
+  if (rank >= total) {
+    rank = total - 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen > rank) {
+      uint32_t top = bucketTop(i);
+      return top < largest ? top : largest;
+    }
+  }
+  return largest;
+}
+
+Ingest::Worker::Worker(size_t queueBatches)
+    : input(queueBatches), spare(queueBatches + 1), filling(nullptr),
+      malformed(0), duplicateBinary(0), droppedEvents(0) {
+  for (int i = 0; i < MESSAGE_KINDS; i++) {
+    messages[i] = 0;
+  }
+}
+
+Ingest::Ingest()
+    : rows(nullptr), spareRows(nullptr), running(false),
+      readingRows(0), sessionRows(0), commits(0), writeErrors(0) {
+  errorText[0] = '\0';
+}
+
+Ingest::~Ingest() {
+  end();
+  for (size_t i = 0; i < workers.size(); i++) {
+    delete workers[i];
+  }
+}
+
+bool Ingest::begin(const char* dbPath, const IngestOptions& options) {
+  this->options = options;
+  if (this->options.workers < 1) {
+    this->options.workers = 1;
+  }
+  if (!store.open(dbPath)) {
+    snprintf(errorText, sizeof(errorText), "%s: %s", dbPath, store.error());
+    store.close();
+    return false;
+  }
+  rows = new BoundedQueue<OutputBatch*>(this->options.queueBatches * this->options.workers);
+  spareRows = new BoundedQueue<OutputBatch*>(this->options.queueBatches * this->options.workers + 1);
+  for (int i = 0; i < this->options.workers; i++) {
+    Worker* worker = new Worker(this->options.queueBatches);
+    worker->filling = new InputBatch();
+    workers.push_back(worker);
+  }
+  for (size_t i = 0; i < workers.size(); i++) {
+    Worker* worker = workers[i];
+    worker->thread = std::thread([this, worker] { runWorker(*worker); });
+  }
+  writer = std::thread([this] { runWriter(); });
+  running = true;
+  return true;
+}
+
+void Ingest::submit(const char* topic, size_t topicLength, const char* payload, size_t payloadLength,
+                    bool hex) {
+  Slice device;
+  classifyTopic(topic, topicLength, device);
+  Worker& worker = *workers[deviceHash(device) % workers.size()];
+  InputBatch& batch = *worker.filling;
+
+  Message message;
+  message.topicAt = (uint32_t)batch.arena.size();
+  message.topicLength = (uint32_t)topicLength;
+  batch.arena.insert(batch.arena.end(), topic, topic + topicLength);
+  message.payloadAt = (uint32_t)batch.arena.size();
+  message.payloadLength = (uint32_t)payloadLength;
+  batch.arena.insert(batch.arena.end(), payload, payload + payloadLength);
+  message.hex = hex;
+  message.receivedMs = ingestWallMs();
+  message.receivedNs = ingestSteadyNs();
+  batch.messages.push_back(message);
+
+  if (batch.messages.size() >= options.handoffMessages) {
+    handOff(worker);
+  }
+}
+
+void Ingest::handOff(Worker& worker) {
+  if (worker.filling->messages.empty()) {
+    return;
+  }
+  worker.input.push(worker.filling);
+  // Reuse a batch the worker is done with, so the arenas keep their capacity
+  if (!worker.spare.pop(worker.filling, 0)) {
+    worker.filling = new InputBatch();
+  }
+}
+
+void Ingest::flush() {
+  for (size_t i = 0; i < workers.size(); i++) {
+    handOff(*workers[i]);
+  }
+}
+
+void Ingest::end() {
+  if (!running) {
+    return;
+  }
+  running = false;
+  flush();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i]->input.close();
+    workers[i]->thread.join();
+  }
+  rows->close();
+  writer.join();
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    InputBatch* batch;
+    while (workers[i]->spare.pop(batch, 0)) {
+      delete batch;
+    }
+    delete workers[i]->filling;
+    workers[i]->filling = nullptr;
+  }
+  OutputBatch* batch;
+  while (spareRows->pop(batch, 0)) {
+    delete batch;
+  }
+  delete rows;
+  delete spareRows;
+  rows = nullptr;
+  spareRows = nullptr;
+  store.close();
+}
+
+void Ingest::runWorker(Worker& worker) {
+  InputBatch* batch;
+  while (worker.input.pop(batch)) {
+    OutputBatch* output;
+    if (!spareRows->pop(output, 0)) {
+      output = new OutputBatch();
+    }
+    for (size_t i = 0; i < batch->messages.size(); i++) {
+      const Message& message = batch->messages[i];
+      char* base = batch->arena.data();
+      if (process(worker, base + message.topicAt, message.topicLength,
+                  base + message.payloadAt, message.payloadLength,
+                  message.hex, message.receivedMs, *output)) {
+        output->receivedNs.push_back(message.receivedNs);
+      }
+    }
+    batch->arena.clear();
+    batch->messages.clear();
+    if (!worker.spare.tryPush(batch)) {
+      delete batch;
+    }
+    if (!output->receivedNs.empty()) {
+      rows->push(output);
+    } else if (!spareRows->tryPush(output)) {
+      delete output;
+    }
+  }
+}
+
+static bool copyNote(char* note, const Slice& name) {
+  if (name.size > INGEST_NOTE_MAX) {
+    return false;
+  }
+  if (name.size > 0) {  // A null note has no data at all
+    memcpy(note, name.data, name.size);
+  }
+  note[name.size] = '\0';
+  return true;
+}
+
+// Rows for one message, false if it made none
+bool Ingest::process(Worker& worker, char* topic, size_t topicLength, char* payload, size_t payloadLength,
+                     bool hex, int64_t receivedMs, OutputBatch& output) {
+  Slice device;
+  MessageKind kind = classifyTopic(topic, topicLength, device);
+  worker.messages[kind].fetch_add(1, std::memory_order_relaxed);
+  if (kind == MESSAGE_IGNORED) {
+    return false;
+  }
+  if (hex) {
+    long length = decodeHexInPlace(payload, payloadLength);
+    if (length < 0) {
+      worker.malformed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    payloadLength = (size_t)length;
+  }
+
+  // Zero-initialized the first time a device shows up
+  worker.device.assign(device.data, device.size);
+  DeviceState& state = worker.devices[worker.device];
+  ReadingFields reading;
+  SessionFields session;
+  switch (kind) {
+    case MESSAGE_READING:
+      if (!parseReadingJson(payload, payloadLength, reading)) {
+        break;
+      }
+      state.sawJson = true;
+      addReading(worker, state, reading, receivedMs, output);
+      return true;
+
+    case MESSAGE_BINARY:
+      if (!parseReadingBinary((const uint8_t*)payload, payloadLength, reading)) {
+        break;
+      }
+      // main.cpp sends the frame first, so a device sending both has one
+      // stored from each before its JSON is seen - the price of no config
+      if (state.sawJson) {
+        worker.duplicateBinary.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      addReading(worker, state, reading, receivedMs, output);
+      return true;
+
+    case MESSAGE_SESSION: {
+      if (!parseSessionJson(payload, payloadLength, session) ||
+          session.startMs > session.endMs || session.endMs > session.uptimeMs) {
+        break;
+      }
+      SessionRow row;
+      row.device = worker.device;
+      row.startMs = receivedMs - (session.uptimeMs - session.startMs);
+      row.endMs = receivedMs - (session.uptimeMs - session.endMs);
+      row.durationS = session.durationS;
+      output.sessions.push_back(row);
+      return true;
+    }
+
+    default:
+      break;
+  }
+  worker.malformed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void Ingest::addReading(Worker& worker, DeviceState& device, const ReadingFields& reading,
+                        int64_t receivedMs, OutputBatch& output) {
+  int64_t capturedMs = receivedMs - reading.ageMs;
+
+  ReadingRow row;
+  row.device = worker.device;
+  row.timeMs = capturedMs;
+  row.hasDistance = reading.hasDistance;
+  row.distance = reading.distance;
+  row.hasVolume = reading.hasVolume;
+  row.volume = reading.volume;
+  row.hasFrequency = reading.hasFrequency;
+  row.frequency = reading.frequency;
+  row.hasOctave = reading.hasOctave;
+  row.octave = reading.octave;
+  if (reading.eventCount > 0 || !copyNote(row.note, reading.note)) {
+    row.note[0] = '\0';
+  }
+  if (reading.eventCount > 0) {
+    // The events carry the notes
+    row.hasFrequency = false;
+    row.hasOctave = false;
+  }
+  output.readings.push_back(row);
+
+  if (reading.eventCount > 0) {
+    // Offsets count from the previous publish. For a device's first
+    // reading that is unknown, so its last event is put at the capture.
+    int64_t windowStart;
+    if (device.hasLastReading && device.lastReadingMs <= capturedMs) {
+      windowStart = device.lastReadingMs;
+    } else {
+      windowStart = capturedMs - reading.events[reading.eventCount - 1].offsetMs;
+    }
+    uint64_t dropped = reading.droppedEvents;
+    for (int i = 0; i < reading.eventCount; i++) {
+      const EventFields& event = reading.events[i];
+      ReadingRow note;
+      if (!copyNote(note.note, event.note) || note.note[0] == '\0') {
+        dropped++;
+        continue;
+      }
+      note.device = worker.device;
+      note.timeMs = windowStart + event.offsetMs;
+      note.hasDistance = false;
+      note.distance = 0;
+      note.hasVolume = true;
+      note.volume = event.volume;
+      note.hasFrequency = true;
+      note.frequency = event.frequency;
+      note.hasOctave = true;
+      note.octave = event.octave;
+      output.readings.push_back(note);
+    }
+    if (dropped > 0) {
+      worker.droppedEvents.fetch_add(dropped, std::memory_order_relaxed);
+    }
+  }
+  device.hasLastReading = true;
+  device.lastReadingMs = capturedMs;
+}
+
+void Ingest::runWriter() {
+  std::vector<int64_t> pendingNs;
+  size_t pendingRows = 0;
+  int64_t openedNs = 0;
+  for (;;) {
+    // With a transaction open, wait no longer than until it is due
+    uint32_t waitMs = QUEUE_WAIT_FOREVER;
+    if (pendingRows > 0) {
+      int64_t dueNs = openedNs + (int64_t)options.flushMs * 1000000 - ingestSteadyNs();
+      waitMs = dueNs > 0 ? (uint32_t)(dueNs / 1000000) + 1 : 0;
+    }
+    OutputBatch* batch;
+    if (rows->pop(batch, waitMs)) {
+      if (pendingRows == 0) {
+        if (!store.begin()) {
+          writeErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+        openedNs = ingestSteadyNs();
+      }
+      for (size_t i = 0; i < batch->readings.size(); i++) {
+        if (!store.insertReading(batch->readings[i])) {
+          writeErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      for (size_t i = 0; i < batch->sessions.size(); i++) {
+        if (!store.insertSession(batch->sessions[i])) {
+          writeErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+      readingRows.fetch_add(batch->readings.size(), std::memory_order_relaxed);
+      sessionRows.fetch_add(batch->sessions.size(), std::memory_order_relaxed);
+      pendingRows += batch->readings.size() + batch->sessions.size();
+      pendingNs.insert(pendingNs.end(), batch->receivedNs.begin(), batch->receivedNs.end());
+      batch->readings.clear();
+      batch->sessions.clear();
+      batch->receivedNs.clear();
+      if (!spareRows->tryPush(batch)) {
+        delete batch;
+      }
+    }
+    bool finished = rows->finished();
+    if (pendingRows > 0 &&
+        (finished || pendingRows >= options.batchRows ||
+         ingestSteadyNs() - openedNs >= (int64_t)options.flushMs * 1000000)) {
+      commit(pendingNs);
+      pendingRows = 0;
+    }
+    if (finished) {
+      return;
+    }
+  }
+}
+
+void Ingest::commit(std::vector<int64_t>& pendingNs) {
+  if (!store.commit()) {
+    writeErrors.fetch_add(1, std::memory_order_relaxed);
+  }
+  commits.fetch_add(1, std::memory_order_relaxed);
+  int64_t now = ingestSteadyNs();
+  std::lock_guard<std::mutex> lock(statsMutex);
+  for (size_t i = 0; i < pendingNs.size(); i++) {
+    int64_t us = (now - pendingNs[i]) / 1000;
+    latency.record(us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+  }
+  pendingNs.clear();
+}
+
+IngestStats Ingest::stats() {
+  IngestStats stats;
+  for (int kind = 0; kind < MESSAGE_KINDS; kind++) {
+    stats.messages[kind] = 0;
+  }
+  stats.malformed = 0;
+  stats.duplicateBinary = 0;
+  stats.droppedEvents = 0;
+  for (size_t i = 0; i < workers.size(); i++) {
+    const Worker& worker = *workers[i];
+    for (int kind = 0; kind < MESSAGE_KINDS; kind++) {
+      stats.messages[kind] += worker.messages[kind].load(std::memory_order_relaxed);
+    }
+    stats.malformed += worker.malformed.load(std::memory_order_relaxed);
+    stats.duplicateBinary += worker.duplicateBinary.load(std::memory_order_relaxed);
+    stats.droppedEvents += worker.droppedEvents.load(std::memory_order_relaxed);
+  }
+  stats.readingRows = readingRows.load(std::memory_order_relaxed);
+  stats.sessionRows = sessionRows.load(std::memory_order_relaxed);
+  stats.commits = commits.load(std::memory_order_relaxed);
+  stats.writeErrors = writeErrors.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(statsMutex);
+  stats.latency = latency;
+  return stats;
+}
@@ -0,0 +1,174 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "BoundedQueue.h"
+#include "IngestPayload.h"
+#include "IngestStore.h"
+
+struct IngestOptions {
+  int workers;             // Parsing threads, devices are spread over them
+  size_t batchRows;        // A transaction commits after this many rows...
+  uint32_t flushMs;        // ...or once it has been open this long
+  size_t handoffMessages;  // Messages per batch handed to a worker
+  size_t queueBatches;     // Batches a queue holds before its producer waits
+
+  IngestOptions();
+};
+
+// Receipt to commit, in 4 buckets per power of two so percentiles come out
+// within 25% (the firmware's LatencyHistogram has one per power of two)
+class LatencyPercentiles {
+public:
+  LatencyPercentiles();
+
+  void record(uint32_t us);
+  uint64_t count() const { return total; }
+  uint32_t max() const { return largest; }
+  // Upper edge of the bucket holding the fraction p (0-1) of the samples
+  uint32_t percentile(double p) const;
+
+private:
+  static const int BUCKETS = 32 * 4;
+  uint64_t buckets[BUCKETS];
+  uint64_t total;
+  uint32_t largest;
+};
+
+struct IngestStats {
+  uint64_t messages[MESSAGE_KINDS];  // Taken in, by kind (ignored ones too)
+  uint64_t malformed;                // Rejected: bad hex, JSON or frame
+  uint64_t duplicateBinary;          // /bin readings of a device that also sends JSON
+  uint64_t droppedEvents;            // Past INGEST_MAX_EVENTS or with an unknown note
+  uint64_t readingRows;
+  uint64_t sessionRows;
+  uint64_t commits;
+  uint64_t writeErrors;
+  LatencyPercentiles latency;
+};
+
+// The ingest pipeline: one reader, a pool of workers, one SQLite writer.
+//
+//   submit() ──per device──> worker 0..N-1 ──rows──> writer ──> SQLite
+//
+// The reader copies each message once, into the batch of the worker its
+// device hashes to, so one device always lands on the same worker and its
+// messages stay in order. Workers parse the payloads in place (no copies
+// per message beyond the device name each row carries), keep per-device
+// state with no locks and turn messages into rows. The writer is the only connection to the
+// database - SQLite takes one writer at a time anyway - and puts the rows
+// in with few, big transactions. Every hop is a bounded queue, so a slow
+// disk holds up submit() rather than growing memory.
+//
+// A reading becomes one row of readings, stamped with when it was
+// captured (receipt minus its "age"). Its note events become one row each
+// at the time they were heard, and the reading row then leaves the note
+// out so no note is counted twice. Binary readings are stored only for
+// devices that don't send JSON as well. A session summary becomes one row
+// of player_sessions. Every row is stamped with its device's base topic.
+class Ingest {
+public:
+  Ingest();
+  ~Ingest();
+
+  // Open the database and start the threads. False with error() set.
+  bool begin(const char* dbPath, const IngestOptions& options);
+
+  // Reader side, from one thread. The topic and payload are copied, hex
+  // (mosquitto_sub -F %x) is decoded by the worker.
+  void submit(const char* topic, size_t topicLength, const char* payload, size_t payloadLength, bool hex);
+  // Hand the partly filled batches over now, e.g. when the input went quiet
+  void flush();
+
+  // Flush, write everything still queued, commit and join the threads
+  void end();
+
+  // A snapshot; safe while running and still there after end()
+  IngestStats stats();
+  const char* error() const { return errorText; }
+
+private:
+  struct Message {
+    uint32_t topicAt;
+    uint32_t topicLength;
+    uint32_t payloadAt;
+    uint32_t payloadLength;
+    bool hex;
+    int64_t receivedMs;  // Wall clock, for the timestamps
+    int64_t receivedNs;  // Steady clock, for the latency
+  };
+
+  struct InputBatch {
+    std::vector<char> arena;
+    std::vector<Message> messages;
+  };
+
+  struct OutputBatch {
+    std::vector<ReadingRow> readings;
+    std::vector<SessionRow> sessions;
+    std::vector<int64_t> receivedNs;  // One per message that made rows
+  };
+
+  struct DeviceState {
+    bool sawJson;
+    bool hasLastReading;
+    int64_t lastReadingMs;  // When its previous reading was captured - the
+                            // start of the window its events count from
+  };
+
+  struct Worker {
+    Worker(size_t queueBatches);
+
+    BoundedQueue<InputBatch*> input;
+    BoundedQueue<InputBatch*> spare;  // Emptied batches back to the reader
+    InputBatch* filling;              // Reader side
+    // By base topic, not its hash: two devices must never share state
+    std::unordered_map<std::string, DeviceState> devices;
+    std::string device;  // The current message's, kept so its buffer is reused
+    std::thread thread;
+
+    std::atomic<uint64_t> messages[MESSAGE_KINDS];
+    std::atomic<uint64_t> malformed;
+    std::atomic<uint64_t> duplicateBinary;
+    std::atomic<uint64_t> droppedEvents;
+  };
+
+  void runWorker(Worker& worker);
+  void runWriter();
+  void handOff(Worker& worker);
+  bool process(Worker& worker, char* topic, size_t topicLength, char* payload, size_t payloadLength,
+               bool hex, int64_t receivedMs, OutputBatch& output);
+  void addReading(Worker& worker, DeviceState& device, const ReadingFields& reading,
+                  int64_t receivedMs, OutputBatch& output);
+  void commit(std::vector<int64_t>& pendingNs);
+
+  IngestOptions options;
+  IngestStore store;
+  std::vector<Worker*> workers;
+  BoundedQueue<OutputBatch*>* rows;
+  BoundedQueue<OutputBatch*>* spareRows;
+  std::thread writer;
+  bool running;
+  char errorText[160];
+
+  // Writer side
+  std::mutex statsMutex;
+  LatencyPercentiles latency;
+  std::atomic<uint64_t> readingRows;
+  std::atomic<uint64_t> sessionRows;
+  std::atomic<uint64_t> commits;
+  std::atomic<uint64_t> writeErrors;
+};
+
+// Wall and steady clocks as the pipeline stamps messages
+int64_t ingestWallMs();
+int64_t ingestSteadyNs();
+
+#endif
@@ -0,0 +1,396 @@
+#include "IngestPayload.h"
+#include <stdlib.h>
+#include <string.h>
+#include "TelemetryBinary.h"
+
+bool Slice::equals(const char* text) const {
+  size_t length = strlen(text);
+  return length == size && memcmp(data, text, size) == 0;
+}
+
+// Topic levels after the device's base topic, as main.cpp names them
+struct TopicSuffix {
+  const char* suffix;
+  MessageKind kind;
+};
+
+static const TopicSuffix SUFFIXES[] = {
+  {"/bin", MESSAGE_BINARY},
+  {"/session", MESSAGE_SESSION},
+  {"/diag", MESSAGE_IGNORED},
+  {"/spectrum", MESSAGE_IGNORED},
+};
+
+MessageKind classifyTopic(const char* topic, size_t length, Slice& device) {
+  for (size_t i = 0; i < sizeof(SUFFIXES) / sizeof(SUFFIXES[0]); i++) {
+    size_t suffixLength = strlen(SUFFIXES[i].suffix);
+    if (length > suffixLength &&
+        memcmp(topic + length - suffixLength, SUFFIXES[i].suffix, suffixLength) == 0) {
+      device.data = topic;
+      device.size = length - suffixLength;
+      return SUFFIXES[i].kind;
+    }
+  }
+  device.data = topic;
+  device.size = length;
+  return MESSAGE_READING;
+}
+
+uint64_t deviceHash(const Slice& device) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < device.size; i++) {
+    hash ^= (uint8_t)device.data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+long decodeHexInPlace(char* text, size_t length) {
+  if (length % 2 != 0) {
+    return -1;
+  }
+  for (size_t i = 0; i < length; i += 2) {
+    int high = hexValue(text[i]);
+    int low = hexValue(text[i + 1]);
+    if (high < 0 || low < 0) {
+      return -1;
+    }
+    text[i / 2] = (char)((high << 4) | low);
+  }
+  return (long)(length / 2);
+}
+
+// Just enough JSON for the firmware's flat objects and arrays of arrays:
+// walks the text once, hands out values as they come and keeps nothing
+class JsonScanner {
+public:
+  JsonScanner(const char* text, size_t length) : at(text), end(text + length), ok(true) {}
+
+  bool failed() const { return !ok; }
+
+  bool beginObject() { return expect('{'); }
+  bool beginArray() { return expect('['); }
+
+  // Next "key": of the object, false at its end (or on an error)
+  bool nextKey(Slice& key, bool& first) {
+    if (!nextMember('}', first)) {
+      return false;
+    }
+    if (!readString(key)) {
+      return false;
+    }
+    return expect(':');
+  }
+
+  // Whether there is another element before the array's end
+  bool nextElement(bool& first) { return nextMember(']', first); }
+
+  bool isNull() {
+    skipSpace();
+    if (end - at >= 4 && memcmp(at, "null", 4) == 0) {
+      at += 4;
+      return true;
+    }
+    return false;
+  }
+
+  bool readString(Slice& value) {
+    if (!expect('"')) {
+      return false;
+    }
+    const char* start = at;
+    while (at < end && *at != '"') {
+      at += *at == '\\' ? 2 : 1;  // Escapes stay in the slice as they are
+    }
+    if (at >= end) {
+      return fail();
+    }
+    value.data = start;
+    value.size = at - start;
+    at++;
+    return true;
+  }
+
+  // null reads as false, so nullable flags need no extra case
+  bool readBool(bool& value) {
+    skipSpace();
+    if (end - at >= 4 && memcmp(at, "true", 4) == 0) {
+      at += 4;
+      value = true;
+      return true;
+    }
+    if (end - at >= 5 && memcmp(at, "false", 5) == 0) {
+      at += 5;
+      value = false;
+      return true;
+    }
+    value = false;
+    return isNull() || fail();
+  }
+
+  bool readNumber(double& value) {
+    skipSpace();
+    // strtod needs a terminator; the firmware's numbers are short, so copy
+    // the characters a number can have onto the stack
+    char digits[32];
+    size_t count = 0;
+    while (at < end && count < sizeof(digits) - 1 && strchr("+-0123456789.eE", *at) != nullptr) {
+      digits[count++] = *at++;
+    }
+    digits[count] = '\0';
+    char* stop;
+    value = strtod(digits, &stop);
+    return (count > 0 && *stop == '\0') || fail();
+  }
+
+  bool readInt(int& value) {
+    double number;
+    if (!readNumber(number)) {
+      return false;
+    }
+    value = (int)number;
+    return true;
+  }
+
+  // Skip a value of any type, nested ones included
+  bool skipValue() {
+    skipSpace();
+    if (at >= end) {
+      return fail();
+    }
+    if (*at == '"') {
+      Slice ignored;
+      return readString(ignored);
+    }
+    if (*at == '{' || *at == '[') {
+      int depth = 0;
+      while (at < end) {
+        char c = *at;
+        if (c == '"') {
+          Slice ignored;
+          if (!readString(ignored)) {
+            return false;
+          }
+          continue;
+        }
+        at++;
+        if (c == '{' || c == '[') {
+          depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+          return true;
+        }
+      }
+      return fail();
+    }
+    // Number or literal: up to the next separator
+    while (at < end && *at != ',' && *at != '}' && *at != ']') {
+      at++;
+    }
+    return true;
+  }
+
+  bool atEnd() {
+    skipSpace();
+    return at == end;
+  }
+
+private:
+  void skipSpace() {
+    while (at < end && (*at == ' ' || *at == '\t' || *at == '\r' || *at == '\n')) {
+      at++;
+    }
+  }
+
+  bool expect(char c) {
+    skipSpace();
+    if (at < end && *at == c) {
+      at++;
+      return true;
+    }
+    return fail();
+  }
+
+  bool nextMember(char close, bool& first) {
+    if (!ok) {
+      return false;
+    }
+    skipSpace();
+    if (at < end && *at == close) {
+      at++;
+      return false;
+    }
+    if (!first && !expect(',')) {
+      return false;
+    }
+    first = false;
+    return true;
+  }
+
+  bool fail() {
+    ok = false;
+    return false;
+  }
+
+  const char* at;
+  const char* end;
+  bool ok;
+};
+
+static void clearReading(ReadingFields& reading) {
+  reading.hasDistance = false;
+  reading.hasVolume = false;
+  reading.hasFrequency = false;
+  reading.note.data = nullptr;
+  reading.note.size = 0;
+  reading.hasOctave = false;
+  reading.presence = false;
+  reading.playing = false;
+  reading.ageMs = 0;
+  reading.eventCount = 0;
+  reading.droppedEvents = 0;
+}
+
+// [offsetMs,"C",4,262,140]
+static bool parseEvent(JsonScanner& json, EventFields& event) {
+  int offset;
+  bool first = true;
+  if (!json.beginArray() || !json.nextElement(first) || !json.readInt(offset) ||
+      !json.nextElement(first) || !json.readString(event.note) ||
+      !json.nextElement(first) || !json.readInt(event.octave) ||
+      !json.nextElement(first) || !json.readInt(event.frequency) ||
+      !json.nextElement(first) || !json.readInt(event.volume)) {
+    return false;
+  }
+  event.offsetMs = offset;
+  // Fields a later firmware might add
+  while (json.nextElement(first)) {
+    if (!json.skipValue()) {
+      return false;
+    }
+  }
+  return !json.failed();
+}
+
+static bool parseEvents(JsonScanner& json, ReadingFields& reading) {
+  bool first = true;
+  if (!json.beginArray()) {
+    return false;
+  }
+  while (json.nextElement(first)) {
+    if (reading.eventCount == INGEST_MAX_EVENTS) {
+      reading.droppedEvents++;
+      if (!json.skipValue()) {
+        return false;
+      }
+      continue;
+    }
+    if (!parseEvent(json, reading.events[reading.eventCount])) {
+      return false;
+    }
+    reading.eventCount++;
+  }
+  return !json.failed();
+}
+
+bool parseReadingJson(const char* text, size_t length, ReadingFields& reading) {
+  clearReading(reading);
+  JsonScanner json(text, length);
+  if (!json.beginObject()) {
+    return false;
+  }
+  Slice key;
+  bool first = true;
+  while (json.nextKey(key, first)) {
+    bool ok;
+    if (key.equals("distance")) {
+      ok = json.isNull() || (reading.hasDistance = json.readInt(reading.distance));
+    } else if (key.equals("volume")) {
+      ok = json.isNull() || (reading.hasVolume = json.readInt(reading.volume));
+    } else if (key.equals("frequency")) {
+      ok = json.isNull() || (reading.hasFrequency = json.readNumber(reading.frequency));
+    } else if (key.equals("note")) {
+      ok = json.isNull() || json.readString(reading.note);
+    } else if (key.equals("octave")) {
+      ok = json.isNull() || (reading.hasOctave = json.readInt(reading.octave));
+    } else if (key.equals("presence")) {
+      ok = json.readBool(reading.presence);
+    } else if (key.equals("playing")) {
+      ok = json.readBool(reading.playing);
+    } else if (key.equals("age")) {
+      double age;
+      ok = json.readNumber(age);
+      reading.ageMs = age > 0 ? (uint32_t)age : 0;
+    } else if (key.equals("events")) {
+      ok = parseEvents(json, reading);
+    } else {
+      ok = json.skipValue();  // "notes" (chords) and anything newer
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return !json.failed() && json.atEnd();
+}
+
+bool parseSessionJson(const char* text, size_t length, SessionFields& session) {
+  JsonScanner json(text, length);
+  if (!json.beginObject()) {
+    return false;
+  }
+  Slice key;
+  bool first = true;
+  int seen = 0;
+  while (json.nextKey(key, first)) {
+    double value = 0;
+    bool ok;
+    if (key.equals("uptime") || key.equals("start") || key.equals("end") || key.equals("duration_s")) {
+      ok = json.readNumber(value);
+      seen++;
+    } else {
+      ok = json.skipValue();
+    }
+    if (!ok) {
+      return false;
+    }
+    if (key.equals("uptime")) {
+      session.uptimeMs = (uint32_t)value;
+    } else if (key.equals("start")) {
+      session.startMs = (uint32_t)value;
+    } else if (key.equals("end")) {
+      session.endMs = (uint32_t)value;
+    } else if (key.equals("duration_s")) {
+      session.durationS = (uint32_t)value;
+    }
+  }
+  return !json.failed() && json.atEnd() && seen == 4;
+}
+
+bool parseReadingBinary(const uint8_t* frame, size_t length, ReadingFields& reading) {
+  PianoReading decoded;
+  if (!decodeReadingBinary(frame, length, decoded)) {
+    return false;
+  }
+  clearReading(reading);
+  reading.hasDistance = true;
+  reading.distance = decoded.distance;
+  reading.hasVolume = true;
+  reading.volume = decoded.volume;
+  reading.hasFrequency = decoded.hasFrequency;
+  reading.frequency = decoded.frequency;
+  if (decoded.note != nullptr) {
+    reading.note.data = decoded.note;  // Points into noteNames
+    reading.note.size = strlen(decoded.note);
+    reading.hasOctave = true;
+    reading.octave = decoded.octave;
+  }
+  reading.presence = decoded.presence;
+  reading.playing = decoded.playing;
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef INGEST_PAYLOAD_H
+#define INGEST_PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most note events taken from one reading - the firmware sends at most
+// NOTE_TIMELINE_CAPACITY, anything past this is counted and dropped
+#define INGEST_MAX_EVENTS 32
+
+// A piece of the message buffer - nothing is copied out of it
+struct Slice {
+  const char* data;
+  size_t size;
+
+  bool empty() const { return size == 0; }
+  bool equals(const char* text) const;
+};
+
+// What a topic carries, from its last level
+enum MessageKind {
+  MESSAGE_READING,   // <device>          JSON reading (TelemetryJson)
+  MESSAGE_BINARY,    // <device>/bin      binary reading (TelemetryBinary)
+  MESSAGE_SESSION,   // <device>/session  practice session summary
+  MESSAGE_IGNORED,   // <device>/diag, <device>/spectrum
+  MESSAGE_KINDS
+};
+
+// Split a topic into its device (the firmware's base topic) and kind
+MessageKind classifyTopic(const char* topic, size_t length, Slice& device);
+
+// 64-bit FNV-1a of the device, for sharding and per-device state
+uint64_t deviceHash(const Slice& device);
+
+// Hex as printed by mosquitto_sub -F %x, decoded over itself (the bytes
+// always fit). Returns the byte count, or -1 for a malformed payload.
+long decodeHexInPlace(char* text, size_t length);
+
+// One note event from the "events" array: [offsetMs,note,octave,frequency,volume]
+struct EventFields {
+  int32_t offsetMs;
+  Slice note;
+  int octave;
+  int frequency;
+  int volume;
+};
+
+// The fields of a reading the ingest stores. Absent or null fields are
+// left unset, so an old firmware's reading without some of them still goes in.
+struct ReadingFields {
+  bool hasDistance;
+  int distance;
+  bool hasVolume;
+  int volume;
+  bool hasFrequency;
+  double frequency;
+  Slice note;  // Empty for null
+  bool hasOctave;
+  int octave;
+  bool presence;
+  bool playing;
+  uint32_t ageMs;  // Sent late from the offline queue: captured this long before
+  int eventCount;
+  int droppedEvents;
+  EventFields events[INGEST_MAX_EVENTS];
+};
+
+// The fields of a session summary the ingest stores (see
+// lib/PracticeSession/PracticeSession.h for the whole message)
+struct SessionFields {
+  uint32_t uptimeMs;  // Device uptime when it was sent
+  uint32_t startMs;   // Uptime at the start and end of the session
+  uint32_t endMs;
+  uint32_t durationS;
+};
+
+// Parse the JSON the firmware publishes, reading straight from the
+// payload: strings come back as slices into it and nothing is allocated.
+// Unknown fields are skipped. False for anything that isn't such an object.
+bool parseReadingJson(const char* json, size_t length, ReadingFields& reading);
+bool parseSessionJson(const char* json, size_t length, SessionFields& session);
+
+// A binary frame (TelemetryBinary) into the same fields
+bool parseReadingBinary(const uint8_t* frame, size_t length, ReadingFields& reading);
+
+#endif
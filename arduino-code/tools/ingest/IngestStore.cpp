@@ -0,0 +1,151 @@
+#include "IngestStore.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <time.h>
+
+// nodejs-dashboard/schema.sql
+static const char* SCHEMA =
+    "CREATE TABLE IF NOT EXISTS readings ("
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  timestamp TEXT DEFAULT (datetime('now')),"
+    "  distance INTEGER,"
+    "  volume INTEGER,"
+    "  frequency REAL,"
+    "  note TEXT,"
+    "  octave INTEGER,"
+    "  device TEXT"
+    ");"
+    "CREATE TABLE IF NOT EXISTS player_sessions ("
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  start_time TEXT DEFAULT (datetime('now')),"
+    "  end_time TEXT,"
+    "  duration_seconds INTEGER,"
+    "  device TEXT"
+    ");";
+
+// Run after the columns exist, for tables made before them too
+static const char* INDEXES =
+    "CREATE INDEX IF NOT EXISTS readings_device ON readings (device, timestamp);"
+    "CREATE INDEX IF NOT EXISTS player_sessions_device ON player_sessions (device, start_time);";
+
+IngestStore::IngestStore() : db(nullptr), readingInsert(nullptr), sessionInsert(nullptr) {
+}
+
+IngestStore::~IngestStore() {
+  close();
+}
+
+bool IngestStore::open(const char* path, bool batched) {
+  if (sqlite3_open(path, &db) != SQLITE_OK) {
+    return false;
+  }
+  sqlite3_busy_timeout(db, 5000);  // The dashboard may be reading
+  if (batched && (!exec("PRAGMA journal_mode=WAL;") || !exec("PRAGMA synchronous=NORMAL;"))) {
+    return false;
+  }
+  if (!exec(SCHEMA)) {
+    return false;
+  }
+  // Fails with "duplicate column" once they are there, which is fine
+  exec("ALTER TABLE readings ADD COLUMN device TEXT");
+  exec("ALTER TABLE player_sessions ADD COLUMN device TEXT");
+  if (!exec(INDEXES)) {
+    return false;
+  }
+  return sqlite3_prepare_v2(db,
+                            "INSERT INTO readings (timestamp, distance, volume, frequency, note, octave, "
+                            "device) VALUES (?, ?, ?, ?, ?, ?, ?)",
+                            -1, &readingInsert, nullptr) == SQLITE_OK &&
+         sqlite3_prepare_v2(db,
+                            "INSERT INTO player_sessions (start_time, end_time, duration_seconds, device) "
+                            "VALUES (?, ?, ?, ?)",
+                            -1, &sessionInsert, nullptr) == SQLITE_OK;
+}
+
+void IngestStore::close() {
+  sqlite3_finalize(readingInsert);
+  sqlite3_finalize(sessionInsert);
+  readingInsert = nullptr;
+  sessionInsert = nullptr;
+  if (db != nullptr) {
+    sqlite3_close(db);
+    db = nullptr;
+  }
+}
+
+bool IngestStore::exec(const char* sql) {
+  return sqlite3_exec(db, sql, nullptr, nullptr, nullptr) == SQLITE_OK;
+}
+
+bool IngestStore::begin() {
+  return exec("BEGIN");
+}
+
+bool IngestStore::commit() {
+  return exec("COMMIT");
+}
+
+// "YYYY-MM-DD HH:MM:SS.SSS" in UTC
+static void formatTime(char* buffer, size_t size, int64_t timeMs) {
+  time_t seconds = (time_t)(timeMs / 1000);
+  struct tm utc;
+  gmtime_r(&seconds, &utc);
+  snprintf(buffer, size, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
+           utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+           utc.tm_hour, utc.tm_min, utc.tm_sec, (int)(timeMs % 1000));
+}
+
+static bool step(sqlite3_stmt* statement) {
+  bool ok = sqlite3_step(statement) == SQLITE_DONE;
+  sqlite3_reset(statement);
+  return ok;
+}
+
+bool IngestStore::insertReading(const ReadingRow& row) {
+  char timestamp[48];
+  formatTime(timestamp, sizeof(timestamp), row.timeMs);
+  sqlite3_bind_text(readingInsert, 1, timestamp, -1, SQLITE_TRANSIENT);
+  if (row.hasDistance) {
+    sqlite3_bind_int(readingInsert, 2, row.distance);
+  } else {
+    sqlite3_bind_null(readingInsert, 2);
+  }
+  if (row.hasVolume) {
+    sqlite3_bind_int(readingInsert, 3, row.volume);
+  } else {
+    sqlite3_bind_null(readingInsert, 3);
+  }
+  if (row.hasFrequency) {
+    sqlite3_bind_double(readingInsert, 4, row.frequency);
+  } else {
+    sqlite3_bind_null(readingInsert, 4);
+  }
+  if (row.note[0] != '\0') {
+    sqlite3_bind_text(readingInsert, 5, row.note, -1, SQLITE_TRANSIENT);
+  } else {
+    sqlite3_bind_null(readingInsert, 5);
+  }
+  if (row.hasOctave) {
+    sqlite3_bind_int(readingInsert, 6, row.octave);
+  } else {
+    sqlite3_bind_null(readingInsert, 6);
+  }
+  sqlite3_bind_text(readingInsert, 7, row.device.data(), (int)row.device.size(), SQLITE_TRANSIENT);
+  return step(readingInsert);
+}
+
+bool IngestStore::insertSession(const SessionRow& row) {
+  char start[48];
+  char end[48];
+  formatTime(start, sizeof(start), row.startMs);
+  formatTime(end, sizeof(end), row.endMs);
+  sqlite3_bind_text(sessionInsert, 1, start, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_text(sessionInsert, 2, end, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int64(sessionInsert, 3, row.durationS);
+  sqlite3_bind_text(sessionInsert, 4, row.device.data(), (int)row.device.size(), SQLITE_TRANSIENT);
+  return step(sessionInsert);
+}
+
+const char* IngestStore::error() const {
+  return db != nullptr ? sqlite3_errmsg(db) : "out of memory";
+}
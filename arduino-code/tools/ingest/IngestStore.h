@@ -0,0 +1,74 @@
+#ifndef INGEST_STORE_H
+#define INGEST_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// Longest note name kept - the firmware's are at most "C#"
+#define INGEST_NOTE_MAX 3
+
+// One row of readings. Times are wall-clock ms since the epoch; has* false
+// stores NULL. Rows own their note and device so they outlive the message
+// buffer.
+struct ReadingRow {
+  std::string device;  // Base topic of the piano that sent it
+  int64_t timeMs;
+  bool hasDistance;
+  int distance;
+  bool hasVolume;
+  int volume;
+  bool hasFrequency;
+  double frequency;
+  char note[INGEST_NOTE_MAX + 1];  // "" stores NULL
+  bool hasOctave;
+  int octave;
+};
+
+// One row of player_sessions
+struct SessionRow {
+  std::string device;
+  int64_t startMs;
+  int64_t endMs;
+  uint32_t durationS;
+};
+
+// The SQLite file the dashboard reads, with the tables of
+// nodejs-dashboard/schema.sql as they are there. A file from before the
+// device column gets it added on open (NULL in the old rows).
+//
+// Made for one writer putting many rows in per transaction: the journal
+// is WAL with synchronous=NORMAL (a commit is an append, not a sync - a
+// power cut can lose the last commits but never corrupts the file) and
+// the INSERTs are prepared once. Timestamps are written in SQLite's own
+// "YYYY-MM-DD HH:MM:SS.SSS" UTC, so they sort and compare with the
+// datetime('now') defaults.
+class IngestStore {
+public:
+  IngestStore();
+  ~IngestStore();
+
+  // Create the tables if needed. False with error() set on failure.
+  // batched false keeps SQLite's defaults, as a plain client has them.
+  bool open(const char* path, bool batched = true);
+  void close();
+
+  bool begin();
+  bool commit();
+  bool insertReading(const ReadingRow& row);
+  bool insertSession(const SessionRow& row);
+
+  const char* error() const;
+
+private:
+  bool exec(const char* sql);
+
+  sqlite3* db;
+  sqlite3_stmt* readingInsert;
+  sqlite3_stmt* sessionInsert;
+};
+
+#endif
@@ -0,0 +1,174 @@
+// ingest - store what a fleet of pianos publishes in the dashboard's SQLite
+// database, at a rate one Node process inserting row by row can't reach.
+//
+// Reads one message per line, "<topic> <payload>", which is what
+//   mosquitto_sub -t '+/+/#' -F '%t %x'
+// prints (payload in hex, so binary frames survive the line format). A
+// payload starting with '{' is taken as text, so -v output works too for
+// JSON-only devices. Each device is told apart by its base topic (see
+// MQTT_TOPIC in src/main.cpp):
+//   <device>          JSON reading      -> readings
+//   <device>/bin      binary reading    -> readings, unless it sends JSON too
+//   <device>/session  session summary   -> player_sessions
+//   <device>/diag, <device>/spectrum    counted and skipped
+// Tables as in nodejs-dashboard/schema.sql; see Ingest.h for the rows.
+//
+// Build and run with PlatformIO:
+//   pio run -e ingest
+//   mosquitto_sub -h broker -t 'conndev/#' -F '%t %x' | .pio/build/ingest/program --db piano.db
+//
+// Options: --db FILE (piano.db), --workers N (cores - 2), --batch ROWS
+// (2000), --flush-ms MS (20), --stats SECONDS (0, off). Stops at the end
+// of the input or on SIGINT/SIGTERM, after committing what it has.
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "Ingest.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int) {
+  stopping = 1;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [--db FILE] [--workers N] [--batch ROWS] [--flush-ms MS] [--stats SECONDS]\n"
+          "       < lines of \"<topic> <hex or JSON payload>\"\n",
+          program);
+  exit(2);
+}
+
+static long lines = 0;
+static long badLines = 0;
+
+static const char* KIND_NAMES[MESSAGE_KINDS] = {"json", "bin", "session", "ignored"};
+
+static void printStats(Ingest& ingest) {
+  IngestStats stats = ingest.stats();
+  fprintf(stderr, "lines %ld (bad %ld)", lines, badLines);
+  for (int kind = 0; kind < MESSAGE_KINDS; kind++) {
+    fprintf(stderr, " %s %llu", KIND_NAMES[kind], (unsigned long long)stats.messages[kind]);
+  }
+  fprintf(stderr,
+          " malformed %llu dup_bin %llu dropped_events %llu | rows %llu+%llu commits %llu errors %llu"
+          " | latency p50 %uus p99 %uus max %uus\n",
+          (unsigned long long)stats.malformed, (unsigned long long)stats.duplicateBinary,
+          (unsigned long long)stats.droppedEvents, (unsigned long long)stats.readingRows,
+          (unsigned long long)stats.sessionRows, (unsigned long long)stats.commits,
+          (unsigned long long)stats.writeErrors, stats.latency.percentile(0.5),
+          stats.latency.percentile(0.99), stats.latency.max());
+}
+
+// "<topic> <payload>", without the newline
+static void submitLine(Ingest& ingest, char* start, size_t length) {
+  if (length > 0 && start[length - 1] == '\r') {
+    length--;
+  }
+  char* space = (char*)memchr(start, ' ', length);
+  size_t topicLength = space != nullptr ? space - start : length;
+  if (topicLength > 0 && topicLength + 1 < length) {
+    char* payload = space + 1;
+    ingest.submit(start, topicLength, payload, length - topicLength - 1, payload[0] != '{');
+    lines++;
+  } else if (length > 0) {
+    badLines++;
+  }
+}
+
+// Payloads are at most a few KB, so 1 MiB holds many lines per read()
+static const size_t READ_BUFFER = 1 << 20;
+
+int main(int argc, char** argv) {
+  const char* dbPath = "piano.db";
+  IngestOptions options;
+  int statsSeconds = 0;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--db") == 0 && hasValue) {
+      dbPath = argv[++i];
+    } else if (strcmp(argv[i], "--workers") == 0 && hasValue) {
+      options.workers = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--batch") == 0 && hasValue) {
+      options.batchRows = (size_t)atol(argv[++i]);
+    } else if (strcmp(argv[i], "--flush-ms") == 0 && hasValue) {
+      options.flushMs = (uint32_t)atol(argv[++i]);
+    } else if (strcmp(argv[i], "--stats") == 0 && hasValue) {
+      statsSeconds = atoi(argv[++i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.workers < 1 || options.batchRows < 1) {
+    usage(argv[0]);
+  }
+
+  // No SA_RESTART, so a signal also gets a blocked poll() back
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onSignal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  Ingest ingest;
+  if (!ingest.begin(dbPath, options)) {
+    fprintf(stderr, "Can't open %s\n", ingest.error());
+    return 1;
+  }
+  fprintf(stderr, "Ingesting into %s with %d workers\n", dbPath, options.workers);
+
+  std::vector<char> buffer(READ_BUFFER);
+  size_t filled = 0;
+  int64_t nextStatsNs = ingestSteadyNs() + (int64_t)statsSeconds * 1000000000;
+  while (!stopping) {
+    struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+    int ready = poll(&input, 1, statsSeconds > 0 ? 1000 : -1);
+    if (statsSeconds > 0 && ingestSteadyNs() >= nextStatsNs) {
+      printStats(ingest);
+      nextStatsNs += (int64_t)statsSeconds * 1000000000;
+    }
+    if (ready <= 0) {
+      continue;  // Timeout or a signal
+    }
+    ssize_t count = read(STDIN_FILENO, buffer.data() + filled, buffer.size() - filled);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      if (filled > 0) {
+        submitLine(ingest, buffer.data(), filled);  // The last line had no newline
+      }
+      break;
+    }
+    filled += (size_t)count;
+
+    // Every whole line goes in straight from the buffer
+    char* start = buffer.data();
+    char* end = start + filled;
+    char* newline;
+    while ((newline = (char*)memchr(start, '\n', end - start)) != nullptr) {
+      submitLine(ingest, start, newline - start);
+      start = newline + 1;
+    }
+    // Nothing else is coming for now - don't keep what was read waiting
+    ingest.flush();
+
+    filled = end - start;
+    if (filled == buffer.size()) {
+      badLines++;  // A line longer than the buffer, dropped
+      filled = 0;
+    } else {
+      memmove(buffer.data(), start, filled);
+    }
+  }
+
+  ingest.end();
+  printStats(ingest);
+  return 0;
+}
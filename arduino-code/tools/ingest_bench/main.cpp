@@ -0,0 +1,514 @@
+// ingest_bench - the ingest pipeline (tools/ingest) under fleet traffic, with
+// an in-process stand-in for the broker.
+//
+// Builds the traffic of --devices pianos up front with the firmware's own
+// writers (writeReadingJson with note events, writeAgedJson for offline
+// queue replays, encodeReadingBinary, writeSessionJson), hex-encoded the
+// way mosquitto_sub -F %x hands it to the daemon, plus diag messages and
+// truncated readings. A quarter of the devices are binary-only and a
+// quarter send both forms. Then:
+//
+//   saturated  every message submitted as fast as the pipeline takes it:
+//              throughput, and latency when the queues are full
+//   paced      --rate messages/s (half the saturated rate by default) for
+//              --seconds: latency at a load the pipeline keeps up with
+//   baseline   what nodejs-dashboard/server.js does - one thread, one
+//              INSERT per message, each its own transaction, with SQLite's
+//              default rollback journal and full sync
+//
+// Latency runs from submit() to the commit that made the message's rows
+// durable in the WAL. After the saturated run the database is checked
+// against what the traffic implies: row counts, the sum of volume, note
+// rows, session durations, which device each row is from, and the counts
+// of ignored, malformed and duplicate binary messages.
+//
+//   pio run -e ingest_bench && .pio/build/ingest_bench/program
+//
+// Options: --devices N (200), --messages N (200000), --workers N, --batch
+// ROWS, --rate MSGS (0, half the saturated rate), --seconds S (3),
+// --baseline N (20000, 0 skips it), --db FILE (/tmp/ingest_bench.db,
+// recreated). Exits 1 if any check failed.
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "Ingest.h"
+#include "NoteMapper.h"
+#include "NoteTimeline.h"
+#include "PracticeSession.h"
+#include "TelemetryBinary.h"
+#include "TelemetryJson.h"
+
+static const uint32_t PUBLISH_INTERVAL_MS = 2000;
+static const uint32_t SESSION_TIMEOUT_MS = 20000;
+
+// What the database and the stats should show once all of it is in
+struct Expected {
+  uint64_t messages[MESSAGE_KINDS];
+  uint64_t malformed;
+  uint64_t duplicateBinary;
+  uint64_t readingRows;
+  uint64_t noteRows;
+  int64_t volumeSum;
+  uint64_t sessionRows;
+  int64_t durationSum;
+  uint64_t readingDevices;   // Devices with at least one row in readings
+  uint64_t firstDeviceRows;  // Rows of fleet/piano-000 in readings
+};
+
+struct Line {
+  uint32_t topicAt;
+  uint32_t topicLength;
+  uint32_t payloadAt;
+  uint32_t payloadLength;
+};
+
+struct Traffic {
+  std::vector<char> text;
+  std::vector<Line> lines;
+  Expected expected;
+};
+
+enum DeviceMode {
+  SENDS_JSON,
+  SENDS_BINARY,
+  SENDS_BOTH
+};
+
+struct Device {
+  char topic[32];
+  DeviceMode mode;
+  uint32_t uptimeMs;
+  bool sawJson;  // As the ingest will see it
+  uint64_t readingRows;
+};
+
+// xorshift32, so every run builds the same traffic
+static uint32_t randomState = 2463534242u;
+
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static uint32_t randomBelow(uint32_t limit) {
+  return nextRandom() % limit;
+}
+
+static void addLine(Traffic& traffic, const char* topic, const uint8_t* payload, size_t length) {
+  static const char HEX[] = "0123456789abcdef";
+  Line line;
+  line.topicAt = (uint32_t)traffic.text.size();
+  line.topicLength = (uint32_t)strlen(topic);
+  traffic.text.insert(traffic.text.end(), topic, topic + line.topicLength);
+  line.payloadAt = (uint32_t)traffic.text.size();
+  line.payloadLength = (uint32_t)length * 2;
+  for (size_t i = 0; i < length; i++) {
+    traffic.text.push_back(HEX[payload[i] >> 4]);
+    traffic.text.push_back(HEX[payload[i] & 15]);
+  }
+  traffic.lines.push_back(line);
+}
+
+static void addLine(Traffic& traffic, const char* topic, const char* payload, size_t length) {
+  addLine(traffic, topic, (const uint8_t*)payload, length);
+}
+
+static void randomReading(PianoReading& reading) {
+  reading.distance = 80 + randomBelow(1200);
+  reading.volume = randomBelow(400);
+  reading.presence = reading.distance < 800;
+  reading.playing = reading.presence && randomBelow(3) != 0;
+  reading.hasFrequency = reading.playing;
+  reading.frequency = reading.playing ? 110 + randomBelow(1500) : 0;
+  reading.note = reading.playing ? noteNames[randomBelow(12)] : nullptr;
+  reading.octave = 2 + randomBelow(5);
+  reading.chord = nullptr;
+  reading.chordSize = 0;
+}
+
+static void addReading(Traffic& traffic, Device& device, NoteTimeline& timeline) {
+  Expected& expected = traffic.expected;
+  PianoReading reading;
+  randomReading(reading);
+  uint32_t windowStart = device.uptimeMs;
+  device.uptimeMs += PUBLISH_INTERVAL_MS;
+
+  if (device.mode != SENDS_JSON) {
+    uint8_t frame[TELEMETRY_BINARY_SIZE];
+    size_t length = encodeReadingBinary(frame, sizeof(frame), reading);
+    char topic[48];
+    snprintf(topic, sizeof(topic), "%s/bin", device.topic);
+    addLine(traffic, topic, frame, length);
+    expected.messages[MESSAGE_BINARY]++;
+    if (device.sawJson) {
+      expected.duplicateBinary++;
+    } else {
+      expected.readingRows++;
+      device.readingRows++;
+      expected.volumeSum += reading.volume;
+      expected.noteRows += reading.note != nullptr;
+    }
+  }
+  if (device.mode == SENDS_BINARY) {
+    return;
+  }
+
+  timeline.clear(windowStart);
+  int events = reading.playing ? randomBelow(7) : 0;
+  for (int i = 0; i < events; i++) {
+    NoteEvent event;
+    event.timeMs = windowStart + (i + 1) * PUBLISH_INTERVAL_MS / (events + 1);
+    event.note = noteNames[randomBelow(12)];
+    event.octave = 2 + randomBelow(5);
+    event.frequency = 110 + randomBelow(1500);
+    event.volume = 50 + randomBelow(300);
+    timeline.push(event);
+    expected.volumeSum += event.volume;
+  }
+  char json[TELEMETRY_BATCH_JSON_MAX];
+  size_t length = writeReadingJson(json, sizeof(json), reading, timeline);
+  // Now and then a replay from the offline queue
+  if (randomBelow(20) == 0) {
+    char aged[TELEMETRY_BATCH_JSON_MAX + TELEMETRY_AGE_JSON_MAX];
+    length = writeAgedJson(aged, sizeof(aged), json, length, 1000 + randomBelow(60000));
+    memcpy(json, aged, length);
+  }
+  addLine(traffic, device.topic, json, length);
+  expected.messages[MESSAGE_READING]++;
+  expected.readingRows += 1 + events;
+  device.readingRows += 1 + events;
+  expected.volumeSum += reading.volume;
+  expected.noteRows += events > 0 ? events : reading.note != nullptr;
+  device.sawJson = true;
+}
+
+static void addSession(Traffic& traffic, Device& device, PracticeSession& session) {
+  uint32_t start = device.uptimeMs;
+  uint32_t end = start + 1000 * (30 + randomBelow(1800));
+  session.begin(SESSION_TIMEOUT_MS);
+  session.update(true, true, 200, start);
+  session.addNote(60);
+  session.update(true, false, 0, end);
+  session.update(false, false, 0, end + SESSION_TIMEOUT_MS);
+  device.uptimeMs = end + SESSION_TIMEOUT_MS;
+
+  char json[SESSION_JSON_MAX];
+  size_t length = writeSessionJson(json, sizeof(json), session, device.uptimeMs);
+  char topic[48];
+  snprintf(topic, sizeof(topic), "%s/session", device.topic);
+  addLine(traffic, topic, json, length);
+  traffic.expected.messages[MESSAGE_SESSION]++;
+  traffic.expected.sessionRows++;
+  traffic.expected.durationSum += (session.durationMs() + 500) / 1000;
+}
+
+static void buildTraffic(Traffic& traffic, int deviceCount, long messageCount) {
+  memset(&traffic.expected, 0, sizeof(traffic.expected));
+  std::vector<Device> devices(deviceCount);
+  for (int i = 0; i < deviceCount; i++) {
+    snprintf(devices[i].topic, sizeof(devices[i].topic), "fleet/piano-%03d", i);
+    devices[i].mode = i % 4 == 3 ? SENDS_BINARY : i % 4 == 2 ? SENDS_BOTH : SENDS_JSON;
+    devices[i].uptimeMs = randomBelow(100000);
+    devices[i].sawJson = false;
+    devices[i].readingRows = 0;
+  }
+  NoteTimeline timeline(PUBLISH_INTERVAL_MS);
+  PracticeSession session;
+  while ((long)traffic.lines.size() < messageCount) {
+    Device& device = devices[randomBelow(deviceCount)];
+    uint32_t pick = randomBelow(1000);
+    if (pick < 10) {
+      addSession(traffic, device, session);
+    } else if (pick < 30) {
+      const char diag[] = "{\"uptime\":1,\"heap\":2}";
+      char topic[48];
+      snprintf(topic, sizeof(topic), "%s/diag", device.topic);
+      addLine(traffic, topic, diag, sizeof(diag) - 1);
+      traffic.expected.messages[MESSAGE_IGNORED]++;
+    } else if (pick < 35) {
+      const char cut[] = "{\"distance\":120,\"volume\":";
+      addLine(traffic, device.topic, cut, sizeof(cut) - 1);
+      traffic.expected.messages[MESSAGE_READING]++;
+      traffic.expected.malformed++;
+    } else {
+      addReading(traffic, device, timeline);
+    }
+  }
+  for (int i = 0; i < deviceCount; i++) {
+    traffic.expected.readingDevices += devices[i].readingRows > 0;
+  }
+  traffic.expected.firstDeviceRows = devices[0].readingRows;
+}
+
+static void removeDatabase(const char* path) {
+  char name[512];
+  unlink(path);
+  snprintf(name, sizeof(name), "%s-wal", path);
+  unlink(name);
+  snprintf(name, sizeof(name), "%s-shm", path);
+  unlink(name);
+}
+
+// Lines [first, last) into the pipeline; the hex is decoded in place, so
+// every run submits from its own copy of the text like a read() would
+static void submitLines(Ingest& ingest, const Traffic& traffic, size_t first, size_t last) {
+  for (size_t i = first; i < last; i++) {
+    const Line& line = traffic.lines[i];
+    ingest.submit(&traffic.text[line.topicAt], line.topicLength,
+                  &traffic.text[line.payloadAt], line.payloadLength, true);
+  }
+}
+
+static void printRun(const char* name, long messages, double seconds, const LatencyPercentiles& latency) {
+  printf("%-12s %9ld %10.0f %9u %9u %9u\n", name, messages, messages / seconds,
+         latency.percentile(0.5), latency.percentile(0.99), latency.max());
+}
+
+static int failures = 0;
+
+static void check(const char* what, long long got, long long want) {
+  bool ok = got == want;
+  printf("check %-22s %s", what, ok ? "ok" : "FAIL");
+  if (!ok) {
+    printf(" (got %lld, want %lld)", got, want);
+    failures++;
+  }
+  printf("\n");
+}
+
+static long long queryNumber(sqlite3* db, const char* sql) {
+  sqlite3_stmt* statement;
+  long long value = -1;
+  if (sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) == SQLITE_OK &&
+      sqlite3_step(statement) == SQLITE_ROW) {
+    value = sqlite3_column_int64(statement, 0);
+  }
+  sqlite3_finalize(statement);
+  return value;
+}
+
+static void verify(const char* dbPath, const Expected& expected, const IngestStats& stats) {
+  static const char* KIND_NAMES[MESSAGE_KINDS] = {"json", "bin", "session", "ignored"};
+  for (int kind = 0; kind < MESSAGE_KINDS; kind++) {
+    char what[32];
+    snprintf(what, sizeof(what), "messages.%s", KIND_NAMES[kind]);
+    check(what, stats.messages[kind], expected.messages[kind]);
+  }
+  check("malformed", stats.malformed, expected.malformed);
+  check("duplicate_binary", stats.duplicateBinary, expected.duplicateBinary);
+  check("dropped_events", stats.droppedEvents, 0);
+  check("write_errors", stats.writeErrors, 0);
+
+  sqlite3* db;
+  if (sqlite3_open(dbPath, &db) != SQLITE_OK) {
+    printf("check open %s FAIL\n", dbPath);
+    failures++;
+    return;
+  }
+  check("readings.rows", queryNumber(db, "SELECT COUNT(*) FROM readings"), expected.readingRows);
+  check("readings.volume", queryNumber(db, "SELECT SUM(volume) FROM readings"), expected.volumeSum);
+  check("readings.notes", queryNumber(db, "SELECT COUNT(note) FROM readings"), expected.noteRows);
+  check("readings.devices", queryNumber(db, "SELECT COUNT(DISTINCT device) FROM readings"),
+        expected.readingDevices);
+  check("readings.piano-000",
+        queryNumber(db, "SELECT COUNT(*) FROM readings WHERE device = 'fleet/piano-000'"),
+        expected.firstDeviceRows);
+  check("readings.no_device", queryNumber(db, "SELECT COUNT(*) FROM readings WHERE device IS NULL"),
+        0);
+  check("sessions.rows", queryNumber(db, "SELECT COUNT(*) FROM player_sessions"), expected.sessionRows);
+  check("sessions.no_device",
+        queryNumber(db, "SELECT COUNT(*) FROM player_sessions WHERE device IS NULL"), 0);
+  check("sessions.duration",
+        queryNumber(db, "SELECT SUM(duration_seconds) FROM player_sessions"), expected.durationSum);
+  check("sessions.placed",
+        queryNumber(db, "SELECT COUNT(*) FROM player_sessions WHERE "
+                        "CAST(ROUND((julianday(end_time) - julianday(start_time)) * 86400) AS INTEGER)"
+                        " != duration_seconds"),
+        0);
+  sqlite3_close(db);
+}
+
+// server.js: parse, one INSERT per message, each committed on its own, on
+// a connection with SQLite's defaults
+static void runBaseline(const char* dbPath, const Traffic& traffic, long count) {
+  removeDatabase(dbPath);
+  IngestStore store;
+  if (!store.open(dbPath, false)) {
+    printf("baseline: can't open %s: %s\n", dbPath, store.error());
+    failures++;
+    return;
+  }
+  LatencyPercentiles latency;
+  std::vector<char> payload;
+  int64_t startNs = ingestSteadyNs();
+  for (long i = 0; i < count; i++) {
+    const Line& line = traffic.lines[i];
+    int64_t receivedNs = ingestSteadyNs();
+    Slice device;
+    MessageKind kind = classifyTopic(&traffic.text[line.topicAt], line.topicLength, device);
+    payload.assign(traffic.text.begin() + line.payloadAt,
+                   traffic.text.begin() + line.payloadAt + line.payloadLength);
+    long length = decodeHexInPlace(payload.data(), payload.size());
+    ReadingFields reading;
+    SessionFields session;
+    bool stored = false;
+    if (kind == MESSAGE_READING && parseReadingJson(payload.data(), length, reading)) {
+      ReadingRow row;
+      row.device.assign(device.data, device.size);
+      row.timeMs = ingestWallMs();
+      row.hasDistance = reading.hasDistance;
+      row.distance = reading.distance;
+      row.hasVolume = reading.hasVolume;
+      row.volume = reading.volume;
+      row.hasFrequency = reading.hasFrequency;
+      row.frequency = reading.frequency;
+      row.note[0] = '\0';
+      if (reading.note.size > 0 && reading.note.size <= INGEST_NOTE_MAX) {
+        memcpy(row.note, reading.note.data, reading.note.size);
+        row.note[reading.note.size] = '\0';
+      }
+      row.hasOctave = reading.hasOctave;
+      row.octave = reading.octave;
+      stored = store.insertReading(row);
+    } else if (kind == MESSAGE_SESSION && parseSessionJson(payload.data(), length, session)) {
+      SessionRow row;
+      row.device.assign(device.data, device.size);
+      row.endMs = ingestWallMs();
+      row.startMs = row.endMs - (int64_t)session.durationS * 1000;
+      row.durationS = session.durationS;
+      stored = store.insertSession(row);
+    }
+    if (stored) {
+      latency.record((uint32_t)((ingestSteadyNs() - receivedNs) / 1000));
+    }
+  }
+  double seconds = (ingestSteadyNs() - startNs) / 1e9;
+  store.close();
+  printRun("baseline", count, seconds, latency);
+}
+
+int main(int argc, char** argv) {
+  int deviceCount = 200;
+  long messageCount = 200000;
+  long rate = 0;
+  int seconds = 3;
+  long baselineCount = 20000;
+  const char* dbPath = "/tmp/ingest_bench.db";
+  IngestOptions options;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--devices") == 0 && hasValue) {
+      deviceCount = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--messages") == 0 && hasValue) {
+      messageCount = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--workers") == 0 && hasValue) {
+      options.workers = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--batch") == 0 && hasValue) {
+      options.batchRows = (size_t)atol(argv[++i]);
+    } else if (strcmp(argv[i], "--rate") == 0 && hasValue) {
+      rate = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+      seconds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+      baselineCount = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--db") == 0 && hasValue) {
+      dbPath = argv[++i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--devices N] [--messages N] [--workers N] [--batch ROWS] [--rate MSGS]\n"
+              "          [--seconds S] [--baseline N] [--db FILE]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (deviceCount < 1 || messageCount < 1 || options.workers < 1 || seconds < 1) {
+    fprintf(stderr, "counts must be positive\n");
+    return 2;
+  }
+
+  Traffic traffic;
+  buildTraffic(traffic, deviceCount, messageCount);
+  printf("# ingest-bench devices=%d messages=%ld bytes=%zu workers=%d batch=%zu flush_ms=%u cores=%u\n",
+         deviceCount, messageCount, traffic.text.size(), options.workers, options.batchRows,
+         options.flushMs, std::thread::hardware_concurrency());
+  printf("%-12s %9s %10s %9s %9s %9s\n", "run", "messages", "msgs/s", "p50_us", "p99_us", "max_us");
+
+  // Saturated: all of it as fast as submit() returns
+  double saturatedRate;
+  {
+    Traffic copy = traffic;
+    removeDatabase(dbPath);
+    Ingest ingest;
+    if (!ingest.begin(dbPath, options)) {
+      fprintf(stderr, "Can't open %s\n", ingest.error());
+      return 1;
+    }
+    int64_t startNs = ingestSteadyNs();
+    submitLines(ingest, copy, 0, copy.lines.size());
+    ingest.end();
+    double elapsed = (ingestSteadyNs() - startNs) / 1e9;
+    IngestStats stats = ingest.stats();
+    saturatedRate = messageCount / elapsed;
+    printRun("saturated", messageCount, elapsed, stats.latency);
+    verify(dbPath, traffic.expected, stats);
+  }
+
+  // Paced: 1 ms ticks, flushing after each like the daemon after a read()
+  {
+    if (rate <= 0) {
+      rate = (long)(saturatedRate / 2);
+    }
+    size_t total = (size_t)rate * seconds;
+    removeDatabase(dbPath);
+    Ingest ingest;
+    if (!ingest.begin(dbPath, options)) {
+      fprintf(stderr, "Can't open %s\n", ingest.error());
+      return 1;
+    }
+    Traffic copy = traffic;
+    size_t sent = 0;
+    size_t offset = 0;  // Wraps around the traffic when the run needs more
+    int64_t startNs = ingestSteadyNs();
+    for (long tick = 1; sent < total; tick++) {
+      size_t due = (size_t)((double)rate * tick / 1000);
+      if (due > total) {
+        due = total;
+      }
+      while (sent < due) {
+        if (offset == copy.lines.size()) {
+          copy = traffic;
+          offset = 0;
+        }
+        size_t take = due - sent;
+        if (take > copy.lines.size() - offset) {
+          take = copy.lines.size() - offset;
+        }
+        submitLines(ingest, copy, offset, offset + take);
+        offset += take;
+        sent += take;
+      }
+      ingest.flush();
+      int64_t waitNs = startNs + tick * 1000000 - ingestSteadyNs();
+      if (waitNs > 0) {
+        usleep((useconds_t)(waitNs / 1000));
+      }
+    }
+    ingest.end();
+    double elapsed = (ingestSteadyNs() - startNs) / 1e9;
+    char name[32];
+    snprintf(name, sizeof(name), "paced@%ld", rate);
+    printRun(name, (long)sent, elapsed, ingest.stats().latency);
+  }
+
+  if (baselineCount > 0) {
+    runBaseline(dbPath, traffic, baselineCount < messageCount ? baselineCount : messageCount);
+  }
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+// key_sweep - which of the 88 keys come out as the right note, with the
+// single-rate analysis and with the multi-rate one.
+//
+// Every key is rendered as a piano-like tone (8 decaying, slightly
+// stretched partials, no anti-alias filter - the board has none) through a
+// 10-bit ADC model, then analyzed both ways with the firmware's default
+// pitch engine (InterpolatedPitch):
+//
+//   before  one 128-sample block captured at 5 kHz
+//   after   10 kHz capture through the DecimationCascade, note decided by
+//           estimateMultiRate() once the longest band has filled
+//
+//   pio run -e key_sweep && .pio/build/key_sweep/program
+//
+// One CSV row per key, then the totals per register:
+//
+//   key,midi,hz,before,after,band
+//   A0,21,27.5,---,A0,4
+//   ...
+//   # A0-B2 before 4/27 after 26/27 (at least 26) PASS
+//
+// A note is right when mapFrequencyToNote() of the estimate is the key
+// played; "---" is no note at all. Each register has the least number of
+// keys the multi-rate analysis must get right (84 of 88 overall; F#2,
+// F#7, A#7 and B7 are the known misses) and the tool exits 1 if any
+// register comes in under it.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "DecimationCascade.h"
+#include "FixedSpectrum.h"
+#include "InterpolatedPitch.h"
+#include "MultiRatePitch.h"
+#include "NoteMapper.h"
+
+static const uint32_t SINGLE_RATE = 5000;
+static const uint32_t MULTI_RATE = 10000;
+static const int FIRST_BIN = 3;
+static const int16_t DC_OFFSET = 512;
+
+// Long enough for the slowest band to hold a whole window of the note
+static const double SETTLE_SECONDS = 0.25;
+
+struct Register {
+  const char* name;
+  int firstMidi;
+  int lastMidi;
+  int minAfter;  // Keys the multi-rate analysis must get right
+};
+
+static const Register REGISTERS[] = {
+  {"A0-B2", 21, 47, 26},
+  {"C3-B5", 48, 83, 36},
+  {"C6-C8", 84, 108, 22},
+  {"all", 21, 108, 84},
+};
+
+static double keyFrequency(int midi) {
+  return 440.0 * pow(2.0, (midi - 69) / 12.0);
+}
+
+static int16_t adcSample(double f0, double t) {
+  double value = 0;
+  for (int h = 1; h <= 8; h++) {
+    double partial = f0 * h * sqrt(1 + 0.0004 * h * h);
+    value += sin(2 * M_PI * partial * t + h) / h;
+  }
+  double noise = (rand() % 5) - 2;  // +-2 LSB of hiss
+  return (int16_t)lround(DC_OFFSET + 160 * value + noise);
+}
+
+static NoteInfo singleRate(FixedSpectrum& spectrum, InterpolatedPitch& engine, double f0) {
+  int16_t block[FixedSpectrum::SAMPLES];
+  for (int i = 0; i < FixedSpectrum::SAMPLES; i++) {
+    block[i] = adcSample(f0, SETTLE_SECONDS + (double)i / SINGLE_RATE);
+  }
+  spectrum.loadBlock(block, DC_OFFSET);
+  engine.load(block, DC_OFFSET);
+  spectrum.compute();
+  spectrum.complexToMagnitude();
+  PitchEstimate pitch = engine.estimate(spectrum, SINGLE_RATE, FIRST_BIN);
+  return pitch.valid() ? mapFrequencyToNote(pitch.frequencyQ4 / 16.0f) : NO_NOTE;
+}
+
+static NoteInfo multiRate(DecimationCascade& cascade, FixedSpectrum& spectrum,
+                          InterpolatedPitch& engine, double f0, int* band) {
+  cascade.begin(MULTI_RATE, DC_OFFSET);
+  const int total = (int)(SETTLE_SECONDS * MULTI_RATE) + FixedSpectrum::SAMPLES;
+  int16_t block[FixedSpectrum::SAMPLES];
+  for (int start = 0; start < total; start += FixedSpectrum::SAMPLES) {
+    for (int i = 0; i < FixedSpectrum::SAMPLES; i++) {
+      block[i] = adcSample(f0, (double)(start + i) / MULTI_RATE);
+    }
+    cascade.push(block, FixedSpectrum::SAMPLES);
+  }
+  MultiRateEstimate estimate = estimateMultiRate(cascade, spectrum, engine, DC_OFFSET, FIRST_BIN,
+                                                 cascade.freshBands());
+  *band = estimate.band;
+  return estimate.pitch.valid() ? mapFrequencyToNote(estimate.pitch.frequencyQ4 / 16.0f) : NO_NOTE;
+}
+
+int main() {
+  static FixedSpectrum spectrum;
+  static InterpolatedPitch engine;
+  static DecimationCascade cascade;
+  spectrum.begin();
+  srand(1);
+
+  bool beforeRight[128] = {false};
+  bool afterRight[128] = {false};
+
+  printf("# key_sweep samples=%d single=%luHz multi=%luHz bands=%d\n", FixedSpectrum::SAMPLES,
+         (unsigned long)SINGLE_RATE, (unsigned long)MULTI_RATE, DecimationCascade::BANDS);
+  printf("key,midi,hz,before,after,band\n");
+  for (int midi = 21; midi <= 108; midi++) {
+    double f0 = keyFrequency(midi);
+    NoteInfo before = singleRate(spectrum, engine, f0);
+    int band = -1;
+    NoteInfo after = multiRate(cascade, spectrum, engine, f0, &band);
+    beforeRight[midi] = before.midi == midi;
+    afterRight[midi] = after.midi == midi;
+
+    char beforeText[8];
+    char afterText[8];
+    snprintf(beforeText, sizeof(beforeText), "%s%d", before.name, before.octave);
+    snprintf(afterText, sizeof(afterText), "%s%d", after.name, after.octave);
+    printf("%s%d,%d,%.1f,%s,%s,%d\n", noteNames[midi % 12], midi / 12 - 1, midi, f0,
+           before.valid() ? beforeText : "---", after.valid() ? afterText : "---", band);
+  }
+
+  bool pass = true;
+  for (const Register& reg : REGISTERS) {
+    int keys = 0;
+    int beforeCount = 0;
+    int afterCount = 0;
+    for (int midi = reg.firstMidi; midi <= reg.lastMidi; midi++) {
+      keys++;
+      beforeCount += beforeRight[midi];
+      afterCount += afterRight[midi];
+    }
+    bool regPass = afterCount >= reg.minAfter;
+    pass = pass && regPass;
+    printf("# %s before %d/%d after %d/%d (at least %d) %s\n", reg.name, beforeCount, keys,
+           afterCount, keys, reg.minAfter, regPass ? "PASS" : "FAIL");
+  }
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+# memory_budget - static RAM, flash per subsystem and worst-case stack per
+# firmware stage after every link, and a failed build when any of them is
+# over the budget set in platformio.ini.
+#
+# Runs as a PlatformIO extra script ([env:nano_33_iot]), which adds
+# -fstack-usage and a link map to the build:
+#
+#   custom_ram_budget = 20480     ; .data + .bss, bytes
+#   custom_flash_budget = 196608  ; everything the board has to store, bytes
+#   custom_stack_budget = 4096    ; deepest stage, bytes
+#
+# The values there are provisional: they were picked from the SAMD21's
+# 32 KB of RAM and 256 KB of flash and tried against a host build only,
+# never against a real nano_33_iot link. Replace them with the first ARM
+# report's figures plus headroom.
+#
+# or on its own against any GCC build made with those flags:
+#
+#   python3 tools/memory_budget/memory_budget.py --elf firmware.elf \
+#       --map firmware.map --su-dir .pio/build/nano_33_iot [--objdump arm-none-eabi-objdump] \
+#       [--ram 20480] [--flash 196608] [--stack 4096]
+#
+# Output:
+#
+#   static RAM   11844 / 20480 bytes (.data 1204, .bss 10640)
+#   flash        97112 / 196608 bytes
+#   stack         1736 / 4096 bytes (loop)
+#
+#   subsystem            flash      ram
+#   src/main              8351     6868
+#   ...
+#
+#   stage                         stack
+#   loop                           1736  indirect
+#   ...
+#
+# Flash is .text + .rodata + .data (its initial values live in flash).
+# Subsystems are the project's lib/ folders, src/main, the board HAL, each
+# library dependency, the Arduino framework and the toolchain runtime.
+#
+# Stage depth is the .su frame of the function plus its deepest callee,
+# over the call graph objdump finds. Calls through pointers can't be
+# followed there; "indirect" marks a stage that makes some, so its figure is
+# a lower bound. The ones that matter - the scheduler calling the tasks and
+# the publish pipeline writing - are filled in from INDIRECT_TARGETS. "recursive" and "dynamic" mark call cycles
+# and frames that grow at run time (alloca, VLAs). The firmware's painted
+# stack high-water mark ("stack_max" on the diagnostics topic) is the
+# measured counterpart.
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Entry points reported as stages, in report order
+STAGES = [
+    "loop",
+    "setup",
+    "senseTask",
+    "calculateDominantFrequency",
+    "publishReading",
+    "publishSession",
+    "displayTask",
+    "mqttTask",
+    "connectionTask",
+    "backfillTask",
+    "diagTask",
+    "idleTask",
+    "spectrumTask",
+]
+
+# Tasks Scheduler::runOnce() calls through its function pointers
+SCHEDULER_TASKS = [
+    "senseTask",
+    "displayTask",
+    "mqttTask",
+    "connectionTask",
+    "backfillTask",
+    "diagTask",
+    "idleTask",
+    "spectrumTask",
+]
+# The publish pipeline's sender writes through the board's Publisher and
+# reports each message to main.cpp's send hook
+INDIRECT_TARGETS = {
+    "Scheduler::runOnce": SCHEDULER_TASKS,
+    "PublishPipeline::drain": ["MqttPublisher::publish", "pipelineSent"],
+}
+
+FLASH_SECTIONS = (".text", ".rodata", ".data", ".glue", ".vfp11", ".ARM.ex", ".init", ".fini",
+                  ".ramfunc")
+RAM_SECTIONS = (".data", ".bss", "COMMON", ".ramfunc")
+
+
+# --- Link map -----------------------------------------------------------
+
+def subsystem_of(path, project_libs):
+    """Which part of the firmware an input file of the link map belongs to."""
+    archive = re.search(r"lib([^/\\(]+)\.a\(", path)
+    if archive:
+        name = archive.group(1)
+        if name in project_libs:
+            return name
+        if name.startswith("FrameworkArduino"):
+            return "framework"
+        if name in ("gcc", "c", "c_nano", "m", "stdc++", "stdc++_nano", "nosys", "g", "g_nano"):
+            return "toolchain"
+        return "dep:" + name
+    normalized = path.replace("\\", "/")
+    if "/FrameworkArduino" in normalized or "/framework-" in normalized:
+        return "framework"
+    for lib in project_libs:
+        if "/" + lib + "/" in normalized:
+            return lib
+    if "/board/" in normalized:
+        return "board"
+    if "/src/" in normalized or normalized.startswith("src/"):
+        return "src/main"
+    base = os.path.basename(normalized)
+    if base.startswith("main."):
+        return "src/main"
+    if base.startswith("Board.") or base.startswith("Simulator."):
+        return "board"
+    for lib in project_libs:
+        if base.split(".")[0] in lib_sources(lib):
+            return lib
+    return "toolchain"
+
+
+_lib_sources = {}
+
+
+def lib_sources(lib):
+    return _lib_sources.get(lib, ())
+
+
+def parse_map(map_path, project_libs):
+    """Sum input section sizes per subsystem: {name: [flash, ram]}, .data, .bss."""
+    totals = {}
+    data = 0
+    bss = 0
+    in_map = False
+    pending = None
+    full = re.compile(r"^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+    cont = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+    name_only = re.compile(r"^ (\S+)\s*$")
+
+    with open(map_path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+            section = None
+            match = full.match(line)
+            if match:
+                section, address, size, path = match.groups()
+            elif pending:
+                match = cont.match(line)
+                if match:
+                    section = pending
+                    address, size, path = match.groups()
+            pending = None
+            if section is None:
+                match = name_only.match(line)
+                if match:
+                    pending = match.group(1)
+                continue
+            if section == "*fill*" or section.startswith("*("):
+                continue
+            size = int(size, 16)
+            if size == 0 or int(address, 16) == 0:
+                continue  # Garbage-collected or not loaded
+
+            in_flash = section.startswith(FLASH_SECTIONS)
+            in_ram = section.startswith(RAM_SECTIONS)
+            if not (in_flash or in_ram):
+                continue
+            if section.startswith(".bss") or section == "COMMON":
+                in_flash = False
+                bss += size
+            elif section.startswith(".data") or section.startswith(".ramfunc"):
+                in_flash = True
+                data += size
+            entry = totals.setdefault(subsystem_of(path.strip(), project_libs), [0, 0])
+            if in_flash:
+                entry[0] += size
+            if in_ram:
+                entry[1] += size
+    return totals, data, bss
+
+
+# --- Stack --------------------------------------------------------------
+
+def base_name(signature):
+    """'virtual void Foo::bar(int) const' -> 'Foo::bar', template arguments dropped."""
+    text = signature
+    while True:
+        stripped = re.sub(r"<[^<>]*>", "", text)
+        if stripped == text:
+            break
+        text = stripped
+    text = text.split("(")[0].strip()
+    return text.split()[-1] if text else text
+
+
+def parse_stack_usage(su_dir):
+    """Frame size per function from GCC's .su files: {name: (bytes, dynamic)}."""
+    frames = {}
+    for root, _, files in os.walk(su_dir):
+        for name in files:
+            if not name.endswith(".su"):
+                continue
+            with open(os.path.join(root, name)) as f:
+                for line in f:
+                    fields = line.rstrip("\n").split("\t")
+                    if len(fields) < 3:
+                        continue
+                    function = base_name(fields[0].split(":", 3)[-1])
+                    size = int(fields[1])
+                    dynamic = "dynamic" in fields[2] and "bounded" not in fields[2]
+                    old = frames.get(function, (0, False))
+                    frames[function] = (max(old[0], size), old[1] or dynamic)
+    return frames
+
+
+def parse_call_graph(elf_path, objdump):
+    """Direct callees and whether there are indirect calls, per function."""
+    output = subprocess.run([objdump, "-d", "-C", "--no-show-raw-insn", elf_path],
+                            stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    calls = {}
+    indirect = set()
+    current = None
+    header = re.compile(r"^[0-9a-fA-F]+ <(.+)>:$")
+    # bl/blx/b.w (ARM, tail calls included) and call/jmp (x86 hosts)
+    direct = re.compile(r"\s(?:bl|blx|b|b\.w|call|callq|jmp|jmpq)\s+[0-9a-fA-F]+ <([^>+]+)>")
+    through = re.compile(r"\s(?:blx\s+r\d+|bx\s+r(?:[0-9]|1[0-2])|callq?\s+\*|jmpq?\s+\*%)")
+    for line in output.splitlines():
+        match = header.match(line)
+        if match:
+            current = base_name(match.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        match = direct.search(line)
+        if match:
+            callee = base_name(match.group(1))
+            if callee != current:
+                calls[current].add(callee)
+            continue
+        if through.search(line):
+            indirect.add(current)
+    for caller, targets in INDIRECT_TARGETS.items():
+        if caller in calls:
+            calls[caller].update(targets)
+    return calls, indirect
+
+
+def stack_depth(function, frames, calls, indirect, memo, path):
+    """(bytes, flags) of the deepest chain starting at function."""
+    if function in memo:
+        return memo[function]
+    if function in path:
+        return 0, {"recursive"}
+    frame, dynamic = frames.get(function, (0, False))
+    flags = set()
+    if dynamic:
+        flags.add("dynamic")
+    if function in indirect and function not in INDIRECT_TARGETS:
+        flags.add("indirect")
+    deepest = 0
+    path.add(function)
+    for callee in calls.get(function, ()):
+        depth, callee_flags = stack_depth(callee, frames, calls, indirect, memo, path)
+        flags |= callee_flags
+        deepest = max(deepest, depth)
+    path.discard(function)
+    memo[function] = (frame + deepest, flags)
+    return memo[function]
+
+
+# --- Report -------------------------------------------------------------
+
+def check_budget(elf, map_path, su_dir, objdump, project_dir, ram_budget, flash_budget,
+                 stack_budget):
+    """Print the report; returns 0, or 1 if a budget is exceeded."""
+    lib_dir = os.path.join(project_dir, "lib")
+    project_libs = set()
+    if os.path.isdir(lib_dir):
+        for name in os.listdir(lib_dir):
+            path = os.path.join(lib_dir, name)
+            if os.path.isdir(path):
+                project_libs.add(name)
+                _lib_sources[name] = set(f.split(".")[0] for f in os.listdir(path))
+
+    totals, data, bss = parse_map(map_path, project_libs)
+    static_ram = data + bss
+    flash = sum(entry[0] for entry in totals.values())
+
+    frames = parse_stack_usage(su_dir)
+    calls, indirect = parse_call_graph(elf, objdump)
+    memo = {}
+    stages = []
+    for stage in STAGES:
+        if stage in calls or stage in frames:
+            depth, flags = stack_depth(stage, frames, calls, indirect, memo, set())
+            stages.append((stage, depth, flags))
+    deepest = max(stages, key=lambda s: s[1]) if stages else ("-", 0, set())
+
+    def budget_line(label, used, budget, detail):
+        limit = " / %d" % budget if budget else ""
+        over = "  OVER BUDGET" if budget and used > budget else ""
+        print("%-12s %6d%s bytes %s%s" % (label, used, limit, detail, over))
+        return 1 if budget and used > budget else 0
+
+    failed = 0
+    failed |= budget_line("static RAM", static_ram, ram_budget, "(.data %d, .bss %d)" % (data, bss))
+    failed |= budget_line("flash", flash, flash_budget, "")
+    failed |= budget_line("stack", deepest[1], stack_budget, "(%s)" % deepest[0])
+
+    print("")
+    print("%-20s %8s %8s" % ("subsystem", "flash", "ram"))
+    for name, (sub_flash, sub_ram) in sorted(totals.items(), key=lambda kv: -kv[1][0]):
+        print("%-20s %8d %8d" % (name, sub_flash, sub_ram))
+
+    print("")
+    print("%-28s %8s" % ("stage", "stack"))
+    for stage, depth, flags in stages:
+        print("%-28s %8d  %s" % (stage, depth, " ".join(sorted(flags))))
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Static RAM, flash and stack budget report")
+    parser.add_argument("--elf", required=True)
+    parser.add_argument("--map", required=True)
+    parser.add_argument("--su-dir", required=True)
+    parser.add_argument("--objdump", default="objdump")
+    parser.add_argument("--project-dir", default=os.path.join(os.path.dirname(__file__), "..", ".."))
+    parser.add_argument("--ram", type=int, default=0)
+    parser.add_argument("--flash", type=int, default=0)
+    parser.add_argument("--stack", type=int, default=0)
+    args = parser.parse_args()
+    return check_budget(args.elf, args.map, args.su_dir, args.objdump, args.project_dir, args.ram,
+                        args.flash, args.stack)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
+else:
+    # PlatformIO extra script
+    Import("env")  # noqa: F821 - provided by SCons
+
+    env.Append(CCFLAGS=["-fstack-usage"],  # noqa: F821
+               LINKFLAGS=["-Wl,-Map,${BUILD_DIR}/${PROGNAME}.map"])
+
+    def _option(name):
+        value = env.GetProjectOption(name, "0")  # noqa: F821
+        return int(str(value).strip() or "0", 0)
+
+    def _check(target, source, env):
+        build_dir = env.subst("$BUILD_DIR")
+        objdump = env.subst("$OBJCOPY").replace("objcopy", "objdump")
+        return check_budget(str(target[0]), env.subst("${BUILD_DIR}/${PROGNAME}.map"), build_dir,
+                            objdump, env.subst("$PROJECT_DIR"), _option("custom_ram_budget"),
+                            _option("custom_flash_budget"), _option("custom_stack_budget"))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf",  # noqa: F821
+                      env.VerboseAction(_check, "Checking memory budget"))  # noqa: F821
@@ -0,0 +1,359 @@
+// noise_check - how often room noise alone makes the firmware think the
+// piano is being played, with the fixed thresholds and with the adaptive
+// calibration.
+//
+// Each trace is 20 s of the empty room, then 60 s of the same room with
+// somebody sitting at the piano but not playing (except in the "notes"
+// traces). It goes through the firmware's chain at its default settings -
+// 10 kHz capture, the smoothed mic level every 10 ms sense tick, the
+// decimation cascade and InterpolatedPitch - twice:
+//
+//   before  MIC_MIN_THRESHOLD for level and pitch strength, the 39 Hz hum filter
+//   after   NoiseCalibration learning in the first 20 s (after the
+//           firmware's 3 s settle), its thresholds and tone notch after
+//
+//   pio run -e noise_check && .pio/build/noise_check/program [room.wav ...]
+//
+// Without arguments the traces are synthesized rooms; every WAV given
+// (16-bit PCM, looped if short) is run as a room recording as well. One CSV
+// row per trace and mode, then the totals:
+//
+//   trace,mode,level_threshold,tones,false_play_pct,false_notes_per_min,notes_found
+//   hvac,before,130,0,87.0,225.0,-
+//   hvac,after,240,0,0.6,4.0,-
+//   ...
+//   # false-trigger rate before 42.8% after 0.3%
+//   # notes after 41/45 (before 36/45, at least 0.80 per trace) PASS
+//
+// false_play_pct is the share of sense ticks with someone seated and no note
+// sounding where the level alone would put the firmware in STATE_PLAYING; false_notes_per_min
+// counts analyses (every ANALYSIS_REFRESH_MS while "playing") that came up
+// with a note nobody played. notes_found is, for traces with real notes on
+// top of the noise, how many of them were still detected. The calibration
+// must not cost notes: the check fails (exit status 1) if any such trace
+// finds fewer after than before, or under NOISE_MIN_RECALL of them.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "DecimationCascade.h"
+#include "FixedSpectrum.h"
+#include "InterpolatedPitch.h"
+#include "MultiRatePitch.h"
+#include "NoiseCalibration.h"
+#include "NoteMapper.h"
+#include "SimBoard.h"
+
+static const uint32_t RATE = 10000;
+static const int FIRST_BIN = 3;
+static const int16_t DC_OFFSET = 512;
+
+// The firmware's constants (src/main.cpp)
+static const int MIC_NOISE_FLOOR = 25;
+static const int MIC_MIN_THRESHOLD = 130;
+static const int MIC_MAX_AMPLITUDE = 350;
+static const int SMOOTHING = 10;               // Readings in the level average
+static const uint32_t SENSE_SAMPLES = RATE / 100;           // 10 ms tick
+static const uint32_t REFRESH_SAMPLES = RATE / 4;           // ANALYSIS_REFRESH_MS
+static const uint32_t CAL_SETTLE_SAMPLES = RATE * 3;        // CAL_SETTLE_MS
+static const uint32_t CAL_ANALYSIS_SAMPLES = RATE / 2;      // CAL_ANALYSIS_PERIOD
+static const double BACKGROUND_FREQ = 40.0;
+static const double BACKGROUND_TOLERANCE = 2.0;
+
+// Pass mark for notes_found after calibration, per trace (13/15 is the worst
+// measured)
+#ifndef NOISE_MIN_RECALL
+#define NOISE_MIN_RECALL 0.80
+#endif
+
+static const double EMPTY_SECONDS = 20;
+static const double SEATED_SECONDS = 60;
+
+// A note played on top of the noise in the "notes" traces
+struct PlayedNote {
+  double start;  // Seconds into the seated part
+  int midi;
+};
+static const double NOTE_SECONDS = 1.5;
+
+// --- Rooms --------------------------------------------------------------
+
+struct Room {
+  const char* name;
+  bool notes;        // Play a note every 2 s while seated
+  int kind;
+  std::vector<int16_t> recording;  // RECORDED: the whole file, mixed to mono
+  uint32_t recordingRate;
+};
+
+enum RoomKind { QUIET, MAINS_HUM, FAN, HVAC, TV, RECORDED };
+
+static double uniformNoise() {
+  return (double)rand() / RAND_MAX * 2 - 1;
+}
+
+// One-pole lowpass state for the coloured noises
+static double lowpassState = 0;
+
+static double roomSample(const Room& room, uint64_t index) {
+  double t = (double)index / RATE;
+  switch (room.kind) {
+    case QUIET:
+      return uniformNoise() * 2;
+    case MAINS_HUM:
+      // A ground loop: 60 Hz and its third harmonic, loud enough to count as playing
+      return 260 * sin(2 * M_PI * 60 * t) + 60 * sin(2 * M_PI * 180 * t) + uniformNoise() * 4;
+    case FAN:
+      // Blade-pass tone and its harmonic over broadband rush
+      return 160 * sin(2 * M_PI * 120 * t) + 60 * sin(2 * M_PI * 240 * t) + uniformNoise() * 120;
+    case HVAC:
+      // Loud broadband air noise
+      return uniformNoise() * 330;
+    case TV: {
+      // Speech-like: lowpassed noise in syllable bursts
+      lowpassState += 0.35 * (uniformNoise() * 900 - lowpassState);
+      double syllable = fabs(sin(2 * M_PI * 2.7 * t)) * (0.5 + 0.5 * sin(2 * M_PI * 0.31 * t));
+      return lowpassState * syllable;
+    }
+    case RECORDED: {
+      // Loop the file at its own rate, point-sampled like the ADC, with
+      // the simulator's scaling
+      uint64_t frame = (uint64_t)(t * room.recordingRate) % room.recording.size();
+      return room.recording[frame] / 64.0;
+    }
+  }
+  return 0;
+}
+
+static double pianoSample(int midi, double t) {
+  double f0 = 440.0 * pow(2.0, (midi - 69) / 12.0);
+  double value = 0;
+  for (int h = 1; h <= 8; h++) {
+    double partial = f0 * h * sqrt(1 + 0.0004 * h * h);
+    if (partial < RATE / 2) {
+      value += sin(2 * M_PI * partial * t + h) / h;
+    }
+  }
+  return 300 * value * exp(-t * 1.5);
+}
+
+// --- One run ------------------------------------------------------------
+
+struct Result {
+  int levelThreshold;
+  int tones;
+  double falsePlayPercent;
+  double falseNotesPerMinute;
+  int notesFound;
+  int notesPlayed;
+};
+
+static Result run(const Room& room, bool adaptive, const std::vector<PlayedNote>& notes) {
+  static DecimationCascade cascade;
+  static FixedSpectrum spectrum;
+  static InterpolatedPitch engine;
+  static NoiseCalibration calibration;
+  spectrum.begin();
+  cascade.begin(RATE, DC_OFFSET);
+  calibration.begin(DC_OFFSET, MIC_MIN_THRESHOLD, MIC_MAX_AMPLITUDE, MIC_NOISE_FLOOR,
+                    MIC_MIN_THRESHOLD);
+  srand(7);
+  lowpassState = 0;
+
+  int16_t dcOffset = DC_OFFSET;
+  int levelThreshold = MIC_MIN_THRESHOLD;
+  uint64_t pitchThreshold = MIC_MIN_THRESHOLD;
+
+  int readings[SMOOTHING] = {0};
+  int readingIndex = 0;
+  int readingTotal = 0;
+  int level = 0;
+
+  const uint64_t emptySamples = (uint64_t)(EMPTY_SECONDS * RATE);
+  const uint64_t totalSamples = emptySamples + (uint64_t)(SEATED_SECONDS * RATE);
+  int16_t block[FixedSpectrum::SAMPLES];
+  int blockFill = 0;
+  uint64_t lastAnalysis = 0;
+  uint64_t lastCalibration = 0;
+  bool playing = false;
+
+  uint32_t seatedTicks = 0;
+  uint32_t playingTicks = 0;
+  uint32_t falseNotes = 0;
+  std::vector<bool> found(notes.size(), false);
+
+  for (uint64_t i = 0; i < totalSamples; i++) {
+    double value = DC_OFFSET + roomSample(room, i);
+    double seatedTime = i >= emptySamples ? (double)(i - emptySamples) / RATE : -1;
+    int sounding = -1;  // Index of the note sounding, if any
+    for (size_t n = 0; n < notes.size(); n++) {
+      if (seatedTime >= notes[n].start && seatedTime < notes[n].start + NOTE_SECONDS) {
+        value += pianoSample(notes[n].midi, seatedTime - notes[n].start);
+        sounding = (int)n;
+      }
+    }
+    long adc = lround(value);
+    int16_t sample = (int16_t)(adc < 0 ? 0 : adc > 1023 ? 1023 : adc);
+    bool empty = i < emptySamples;
+
+    // Sense tick: the smoothed level from the newest sample
+    if (i % SENSE_SAMPLES == 0) {
+      int calibrated = abs(sample - dcOffset);
+      readingTotal += calibrated - readings[readingIndex];
+      readings[readingIndex] = calibrated;
+      readingIndex = (readingIndex + 1) % SMOOTHING;
+      level = readingTotal / SMOOTHING;
+
+      if (empty) {
+        if (adaptive && i >= CAL_SETTLE_SAMPLES) {
+          calibration.learnLevel(level);
+        }
+      } else {
+        playing = level > levelThreshold;
+        if (sounding < 0) {
+          seatedTicks++;
+          playingTicks += playing;
+        }
+      }
+    }
+
+    block[blockFill++] = sample;
+    if (blockFill < FixedSpectrum::SAMPLES) {
+      continue;
+    }
+    blockFill = 0;
+    cascade.push(block, FixedSpectrum::SAMPLES);
+
+    if (empty) {
+      if (adaptive && i >= CAL_SETTLE_SAMPLES) {
+        calibration.learnBlock(block, FixedSpectrum::SAMPLES);
+        if (i - lastCalibration >= CAL_ANALYSIS_SAMPLES) {
+          lastCalibration = i;
+          calibration.learnPitch(estimateMultiRate(cascade, spectrum, engine, dcOffset, FIRST_BIN,
+                                                   DecimationCascade::BANDS,
+                                                   ToneLevelLearner{calibration}).pitch);
+        }
+        dcOffset = calibration.dcOffset();
+        levelThreshold = calibration.levelThreshold();
+        pitchThreshold = calibration.strengthThreshold();
+      }
+      continue;
+    }
+
+    // Seated: while "playing", analyze as often as the onset gate's refresh would
+    if (!playing || i - lastAnalysis < REFRESH_SAMPLES) {
+      continue;
+    }
+    lastAnalysis = i;
+    // Before, calibration has learned no tones, so it notches nothing
+    PitchEstimate pitch = estimateMultiRate(cascade, spectrum, engine, dcOffset, FIRST_BIN,
+                                            DecimationCascade::BANDS, calibration).pitch;
+    if (adaptive && calibration.isBackground(pitch)) {
+      continue;
+    }
+    if (!pitch.valid() || pitch.strength <= pitchThreshold) {
+      continue;
+    }
+    double frequency = pitch.frequencyQ4 / 16.0;
+    if (frequency < 27.5 || frequency > 4186.0) {
+      continue;
+    }
+    if (!adaptive && fabs(frequency - BACKGROUND_FREQ) < BACKGROUND_TOLERANCE) {
+      continue;
+    }
+    NoteInfo note = mapFrequencyToNote((float)frequency);
+    if (sounding >= 0 && note.midi == notes[sounding].midi) {
+      found[sounding] = true;
+    } else if (sounding < 0) {
+      falseNotes++;
+    }
+  }
+
+  Result result;
+  result.levelThreshold = levelThreshold;
+  result.tones = adaptive ? calibration.learnedTones() : 0;
+  result.falsePlayPercent = seatedTicks ? 100.0 * playingTicks / seatedTicks : 0;
+  result.falseNotesPerMinute = falseNotes / (SEATED_SECONDS / 60);
+  result.notesPlayed = (int)notes.size();
+  result.notesFound = 0;
+  for (bool hit : found) {
+    result.notesFound += hit;
+  }
+  return result;
+}
+
+int main(int argc, char** argv) {
+  std::vector<Room> rooms = {
+    {"quiet", false, QUIET, {}, 0},
+    {"mains_hum", false, MAINS_HUM, {}, 0},
+    {"fan", false, FAN, {}, 0},
+    {"hvac", false, HVAC, {}, 0},
+    {"tv", false, TV, {}, 0},
+    {"quiet+notes", true, QUIET, {}, 0},
+    {"mains_hum+notes", true, MAINS_HUM, {}, 0},
+    {"hvac+notes", true, HVAC, {}, 0},
+  };
+  for (int i = 1; i < argc; i++) {
+    WavReader wav;
+    if (!wav.open(argv[i]) || wav.frames() == 0) {
+      fprintf(stderr, "Can't read %s (16-bit PCM WAV only)\n", argv[i]);
+      return 1;
+    }
+    Room room = {argv[i], false, RECORDED, {}, wav.rate()};
+    int16_t value;
+    for (uint64_t frame = 0; frame < wav.frames() && wav.sampleAt(frame, value); frame++) {
+      room.recording.push_back(value);
+    }
+    rooms.push_back(room);
+  }
+
+  // A spread of keys, one every 2 s of the seated minute
+  static const int NOTE_KEYS[] = {60, 64, 67, 72, 45, 52, 57, 69, 76, 84, 48, 55, 62, 65, 71};
+  std::vector<PlayedNote> played;
+  for (int n = 0; n < 15; n++) {
+    played.push_back({2.0 + n * 4.0, NOTE_KEYS[n]});
+  }
+  std::vector<PlayedNote> none;
+
+  printf("trace,mode,level_threshold,tones,false_play_pct,false_notes_per_min,notes_found\n");
+  double playBefore = 0;
+  double playAfter = 0;
+  int noiseOnly = 0;
+  int foundBefore = 0;
+  int foundAfter = 0;
+  int notesPlayed = 0;
+  bool pass = true;
+  for (const Room& room : rooms) {
+    int roomFoundBefore = 0;
+    for (int adaptive = 0; adaptive <= 1; adaptive++) {
+      Result result = run(room, adaptive, room.notes ? played : none);
+      char notesText[16] = "-";
+      if (room.notes) {
+        snprintf(notesText, sizeof(notesText), "%d/%d", result.notesFound, result.notesPlayed);
+      }
+      printf("%s,%s,%d,%d,%.1f,%.1f,%s\n", room.name, adaptive ? "after" : "before",
+             result.levelThreshold, result.tones, result.falsePlayPercent,
+             result.falseNotesPerMinute, notesText);
+      if (!room.notes) {
+        (adaptive ? playAfter : playBefore) += result.falsePlayPercent;
+      } else if (!adaptive) {
+        roomFoundBefore = result.notesFound;
+        foundBefore += result.notesFound;
+      } else {
+        foundAfter += result.notesFound;
+        notesPlayed += result.notesPlayed;
+        if (result.notesFound < roomFoundBefore ||
+            result.notesFound < NOISE_MIN_RECALL * result.notesPlayed) {
+          pass = false;
+        }
+      }
+    }
+    noiseOnly += !room.notes;
+  }
+  printf("# false-trigger rate before %.1f%% after %.1f%%\n", playBefore / noiseOnly,
+         playAfter / noiseOnly);
+  printf("# notes after %d/%d (before %d/%d, at least %.2f per trace) %s\n", foundAfter,
+         notesPlayed, foundBefore, notesPlayed, NOISE_MIN_RECALL, pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
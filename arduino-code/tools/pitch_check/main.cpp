@@ -0,0 +1,198 @@
+// pitch_check - accuracy in cents against cost for every pitch engine.
+//
+// Sweeps the piano from A0 to C7, each key at three detunings so none happens to
+// land on a bin centre, rendered as piano-like tones (decaying, slightly
+// stretched partials up to the anti-alias limit) sampled at the firmware's
+// 5 kHz through a 10-bit ADC model. Keys above C7 have no partial below
+// the 2.5 kHz Nyquist limit, so they are left out. Every frame goes through FixedSpectrum
+// once and then through each engine exactly as calculateDominantFrequency()
+// calls it.
+//
+//   pio run -e pitch_check && .pio/build/pitch_check/program
+//
+// One CSV row per engine and register:
+//
+//   engine,range,frames,voiced,right_note,median_cents,p90_cents,ns_per_call,check
+//
+// A frame is voiced when the engine finds a pitch above the firmware's
+// pitchThreshold (MIC_MIN_THRESHOLD scaled to the engine's strength).
+// right_note counts frames that map to the played key; the cents columns
+// are |estimate - true fundamental| over the voiced frames, so an octave
+// error shows up as 1200. ns_per_call is the engine alone on this host,
+// without the shared FFT - for cycles on the board see the pitch.* stages
+// of tools/bench.
+//
+// check is PASS or FAIL against the engine's limits for that register
+// (LIMITS below), or - where it has none: the bass below C3 is left to the
+// multi-rate analysis (tools/key_sweep), and HPS can't place a note finer
+// than a 39 Hz bin. Exits 1 if any row fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "FixedSpectrum.h"
+#include "HpsPitch.h"
+#include "InterpolatedPitch.h"
+#include "NoteMapper.h"
+#include "YinPitch.h"
+
+static const uint32_t SAMPLE_RATE = 5000;
+static const int FIRST_BIN = 3;
+static const int MIC_MIN_THRESHOLD = 130;  // src/main.cpp, for one spectrum bin
+static const int KEYS = 76;  // A0 (MIDI 21) to C7 (96)
+static const int DETUNINGS = 3;
+static const double DETUNE_CENTS[DETUNINGS] = {0, 17, -29};
+static const int FRAMES = KEYS * DETUNINGS;
+
+struct Range {
+  const char* name;
+  int firstMidi;
+  int lastMidi;
+};
+
+static const Range RANGES[] = {
+  {"A0-B2", 21, 47},
+  {"C3-B4", 48, 71},
+  {"C5-C7", 72, 96},
+  {"all", 21, 96},
+};
+
+// What each engine must keep delivering: the share of frames on the right
+// note, and the 90th percentile error in cents
+struct Limit {
+  const char* engine;
+  const char* range;
+  double minRightNote;
+  double maxP90Cents;
+};
+
+static const Limit LIMITS[] = {
+  {"hps", "C3-B4", 0.35, 1300},
+  {"hps", "C5-C7", 0.45, 60},
+  {"interpolated", "C3-B4", 0.95, 15},
+  {"interpolated", "C5-C7", 0.95, 15},
+  {"yin", "A0-B2", 0.30, 200},
+  {"yin", "C3-B4", 0.95, 20},
+  {"yin", "C5-C7", 0.90, 40},
+};
+
+static bool failed = false;
+
+// "PASS", "FAIL" or "-" for a row, noting failures
+static const char* check(const char* engine, const char* range, int frames, int rightNote,
+                         double p90) {
+  for (const Limit& limit : LIMITS) {
+    if (strcmp(limit.engine, engine) != 0 || strcmp(limit.range, range) != 0) {
+      continue;
+    }
+    if (rightNote < limit.minRightNote * frames || p90 > limit.maxP90Cents) {
+      failed = true;
+      return "FAIL";
+    }
+    return "PASS";
+  }
+  return "-";
+}
+
+static int16_t blocks[FRAMES][FixedSpectrum::SAMPLES];
+static double truth[FRAMES];
+static int truthMidi[FRAMES];
+
+// Per frame results of the engine under test
+static double estimates[FRAMES];
+
+static void render() {
+  srand(1);
+  for (int key = 0; key < KEYS; key++) {
+    for (int d = 0; d < DETUNINGS; d++) {
+      int frame = key * DETUNINGS + d;
+      int midi = 21 + key;
+      double f0 = 440.0 * pow(2.0, (midi - 69 + DETUNE_CENTS[d] / 100.0) / 12.0);
+      truth[frame] = f0;
+      truthMidi[frame] = midi;
+      for (int i = 0; i < FixedSpectrum::SAMPLES; i++) {
+        double t = 0.1 + (double)i / SAMPLE_RATE;
+        double value = 0;
+        for (int h = 1; h <= 8; h++) {
+          double partial = f0 * h * sqrt(1 + 0.0004 * h * h);
+          if (partial < 0.45 * SAMPLE_RATE) {
+            value += sin(2 * M_PI * partial * t + h) / h;
+          }
+        }
+        double noise = (rand() % 5) - 2;  // +-2 LSB of hiss
+        blocks[frame][i] = (int16_t)lround(512 + 160 * value + noise);
+      }
+    }
+  }
+}
+
+static int compareDouble(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+template <class Engine>
+static void runEngine(FixedSpectrum& spectrum, Engine& engine) {
+  double elapsedNs = 0;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    spectrum.loadBlock(blocks[frame], 512);
+    spectrum.compute();
+    spectrum.complexToMagnitude();
+
+    auto start = std::chrono::steady_clock::now();
+    engine.load(blocks[frame], 512);
+    PitchEstimate estimate = engine.estimate(spectrum, SAMPLE_RATE, FIRST_BIN);
+    elapsedNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    // The firmware's pitchThreshold, in the engine's units
+    bool voiced = estimate.valid() && estimate.strength > Engine::strengthThreshold(MIC_MIN_THRESHOLD);
+    estimates[frame] = voiced ? estimate.frequencyQ4 / 16.0 : 0;
+  }
+
+  for (const Range& range : RANGES) {
+    static double cents[FRAMES];
+    int frames = 0;
+    int voiced = 0;
+    int rightNote = 0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+      if (truthMidi[frame] < range.firstMidi || truthMidi[frame] > range.lastMidi) {
+        continue;
+      }
+      frames++;
+      if (estimates[frame] <= 0) {
+        continue;
+      }
+      cents[voiced++] = fabs(1200.0 * log2(estimates[frame] / truth[frame]));
+      if (mapFrequencyToNote((float)estimates[frame]).midi == truthMidi[frame]) {
+        rightNote++;
+      }
+    }
+    qsort(cents, voiced, sizeof(double), compareDouble);
+    double median = voiced > 0 ? cents[voiced / 2] : 0;
+    double p90 = voiced > 0 ? cents[voiced * 9 / 10] : 0;
+    printf("%s,%s,%d,%d,%d,%.1f,%.1f,%.0f,%s\n", Engine::name(), range.name, frames, voiced,
+           rightNote, median, p90, elapsedNs / FRAMES,
+           check(Engine::name(), range.name, frames, rightNote, p90));
+  }
+}
+
+int main() {
+  static FixedSpectrum spectrum;
+  static HpsPitch hps;
+  static InterpolatedPitch interpolated;
+  static YinPitch yin;
+  spectrum.begin();
+  render();
+
+  printf("# pitch_check samples=%d rate=%lu bin_hz=%.1f frames=%d\n", FixedSpectrum::SAMPLES,
+         (unsigned long)SAMPLE_RATE, (double)SAMPLE_RATE / FixedSpectrum::SAMPLES, FRAMES);
+  printf("engine,range,frames,voiced,right_note,median_cents,p90_cents,ns_per_call,check\n");
+  runEngine(spectrum, hps);
+  runEngine(spectrum, interpolated);
+  runEngine(spectrum, yin);
+  printf("# %s\n", failed ? "FAIL" : "PASS");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+// spectrum_decode - reference decoder for the live spectrum frames published
+// on conndev/piano/spectrum (SPECTRUM_STREAM builds).
+//
+// Reads one hex-encoded frame per line, which is what
+//   mosquitto_sub -t conndev/piano/spectrum -F %x
+// prints, and writes one CSV row per frame:
+//   sequence,key,bytes,<level in dB of bin 0>,<bin 1>,...
+// with a header naming each bin's centre frequency. Delta frames after a
+// lost frame are rejected until the next key frame. A summary of frame
+// sizes goes to stderr.
+//
+// Build and run with PlatformIO:
+//   pio run -e spectrum_decode
+//   mosquitto_sub ... -F %x | .pio/build/spectrum_decode/program > spectrum.csv
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "SpectrumFrame.h"
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  c = (char)tolower((unsigned char)c);
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Parses hex digits (whitespace ignored) into frame, returns the byte count
+// or -1 on a malformed line
+static int parseHexLine(const char* line, uint8_t* frame, size_t size) {
+  size_t count = 0;
+  int high = -1;
+  for (const char* p = line; *p; p++) {
+    if (isspace((unsigned char)*p)) {
+      continue;
+    }
+    int value = hexValue(*p);
+    if (value < 0) {
+      return -1;
+    }
+    if (high < 0) {
+      high = value;
+    } else {
+      if (count == size) {
+        return -1;
+      }
+      frame[count++] = (uint8_t)((high << 4) | value);
+      high = -1;
+    }
+  }
+  return high < 0 ? (int)count : -1;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    fprintf(stderr, "usage: %s < frames > spectrum.csv\n", argv[0]);
+    return 2;
+  }
+
+  SpectrumDecoder decoder;
+  SpectrumLevels levels;
+  unsigned long decoded = 0;
+  unsigned long keyFrames = 0;
+  unsigned long rejected = 0;
+  unsigned long totalBytes = 0;
+  unsigned long keyBytes = 0;
+  int largest = 0;
+  int headerBins = 0;
+  uint8_t frame[SPECTRUM_FRAME_MAX];
+  char line[512];
+
+  while (fgets(line, sizeof(line), stdin) != nullptr) {
+    int length = parseHexLine(line, frame, sizeof(frame));
+    if (length == 0) {
+      continue;  // Blank line
+    }
+    if (length < 0 || !decoder.decode(frame, (size_t)length, levels)) {
+      rejected++;
+      fprintf(stderr, "Bad or out-of-sequence frame: %s", line);
+      continue;
+    }
+
+    if (levels.bins != headerBins) {
+      printf("sequence,key,bytes");
+      for (int i = 0; i < levels.bins; i++) {
+        printf(",%.1fHz", i * levels.binWidthQ4 / 16.0);
+      }
+      printf("\n");
+      headerBins = levels.bins;
+    }
+    printf("%u,%d,%d", levels.sequence, levels.key ? 1 : 0, length);
+    for (int i = 0; i < levels.bins; i++) {
+      printf(",%.2f", spectrumLevelDb(levels.levels[i], levels.bits));
+    }
+    printf("\n");
+
+    decoded++;
+    totalBytes += length;
+    if (levels.key) {
+      keyFrames++;
+      keyBytes += length;
+    }
+    if (length > largest) {
+      largest = length;
+    }
+  }
+
+  fprintf(stderr, "%lu frames decoded (%lu key), %lu rejected\n", decoded, keyFrames, rejected);
+  if (decoded > 0) {
+    unsigned long deltaFrames = decoded - keyFrames;
+    fprintf(stderr, "bytes per frame: mean %.1f, key %.1f, delta %.1f, largest %d\n",
+            (double)totalBytes / decoded, keyFrames ? (double)keyBytes / keyFrames : 0.0,
+            deltaFrames ? (double)(totalBytes - keyBytes) / deltaFrames : 0.0, largest);
+  }
+  return rejected == 0 ? 0 : 1;
+}
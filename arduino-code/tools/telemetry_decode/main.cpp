@@ -0,0 +1,99 @@
+// telemetry_decode - turn binary piano telemetry frames back into the JSON
+// published on conndev/piano.
+//
+// By default reads one hex-encoded frame per line, which is what
+//   mosquitto_sub -t conndev/piano/bin -F %x
+// prints. With --raw, reads back-to-back binary frames instead.
+//
+// Build and run with PlatformIO:
+//   pio run -e telemetry_decode
+//   mosquitto_sub ... -F %x | .pio/build/telemetry_decode/program
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "TelemetryBinary.h"
+#include "TelemetryJson.h"
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  c = (char)tolower((unsigned char)c);
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Parses hex digits (whitespace ignored) into frame, returns the byte count
+// or -1 on a malformed line
+static int parseHexLine(const char* line, uint8_t* frame, size_t size) {
+  size_t count = 0;
+  int high = -1;
+  for (const char* p = line; *p; p++) {
+    if (isspace((unsigned char)*p)) {
+      continue;
+    }
+    int value = hexValue(*p);
+    if (value < 0) {
+      return -1;
+    }
+    if (high < 0) {
+      high = value;
+    } else {
+      if (count == size) {
+        return -1;
+      }
+      frame[count++] = (uint8_t)((high << 4) | value);
+      high = -1;
+    }
+  }
+  return high < 0 ? (int)count : -1;
+}
+
+static bool printFrame(const uint8_t* frame, size_t length) {
+  PianoReading reading;
+  if (!decodeReadingBinary(frame, length, reading)) {
+    return false;
+  }
+  char json[TELEMETRY_JSON_MAX];
+  writeReadingJson(json, sizeof(json), reading);
+  puts(json);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool raw = argc > 1 && strcmp(argv[1], "--raw") == 0;
+  if (argc > 1 && !raw) {
+    fprintf(stderr, "usage: %s [--raw] < frames\n", argv[0]);
+    return 2;
+  }
+
+  unsigned long decoded = 0;
+  unsigned long rejected = 0;
+  uint8_t frame[TELEMETRY_BINARY_SIZE];
+
+  if (raw) {
+    while (fread(frame, 1, sizeof(frame), stdin) == sizeof(frame)) {
+      if (printFrame(frame, sizeof(frame))) {
+        decoded++;
+      } else {
+        rejected++;
+      }
+    }
+  } else {
+    char line[256];
+    while (fgets(line, sizeof(line), stdin) != nullptr) {
+      int length = parseHexLine(line, frame, sizeof(frame));
+      if (length == 0) {
+        continue;  // Blank line
+      }
+      if (length > 0 && printFrame(frame, (size_t)length)) {
+        decoded++;
+      } else {
+        rejected++;
+        fprintf(stderr, "Bad frame: %s", line);
+      }
+    }
+  }
+
+  fprintf(stderr, "%lu frames decoded, %lu rejected\n", decoded, rejected);
+  return rejected == 0 ? 0 : 1;
+}
@@ -7,12 +7,17 @@ CREATE TABLE IF NOT EXISTS readings (
   volume INTEGER,
   frequency REAL,
   note TEXT,
-  octave INTEGER
+  octave INTEGER,
+  device TEXT
 );
 
 CREATE TABLE IF NOT EXISTS player_sessions (
   id INTEGER PRIMARY KEY AUTOINCREMENT, 
   start_time TEXT DEFAULT (datetime('now')),
   end_time TEXT,
-  duration_seconds INTEGER
-);
\ No newline at end of file
+  duration_seconds INTEGER,
+  device TEXT
+);
+
+CREATE INDEX IF NOT EXISTS readings_device ON readings (device, timestamp);
+CREATE INDEX IF NOT EXISTS player_sessions_device ON player_sessions (device, start_time);
\ No newline at end of file